@@ -0,0 +1,295 @@
+#include "CommandBuffer.h"
+#include "Renderer.h"
+#include "GPUProfiler.h"
+#include "Shader.h"
+
+Graphic::CommandBuffer::CommandBuffer()
+	:commands(), payload(), targets(), scopeNames(), program(0)
+{
+}
+
+Graphic::CommandBuffer::CommandBuffer(const CommandBuffer& commandBuffer)
+	:commands(commandBuffer.commands), payload(commandBuffer.payload), targets(commandBuffer.targets),
+	scopeNames(commandBuffer.scopeNames), program(commandBuffer.program)
+{
+}
+
+Graphic::CommandBuffer::~CommandBuffer()
+{
+}
+
+void Graphic::CommandBuffer::Reset()
+{
+	// keep capacity, buffers are recorded every frame
+	commands.clear();
+	payload.clear();
+	targets.clear();
+	scopeNames.clear();
+	program = 0;
+}
+
+void Graphic::CommandBuffer::Enable(GLenum capability)
+{
+	Push(COMMAND_ENABLE, capability, 0, 0, 0, 0, 0);
+}
+
+void Graphic::CommandBuffer::Disable(GLenum capability)
+{
+	Push(COMMAND_DISABLE, capability, 0, 0, 0, 0, 0);
+}
+
+void Graphic::CommandBuffer::BlendFunc(GLenum sourceFactor, GLenum destinationFactor)
+{
+	Push(COMMAND_BLEND_FUNC, sourceFactor, destinationFactor, 0, 0, 0, 0);
+}
+
+void Graphic::CommandBuffer::UseProgram(GLuint program)
+{
+	this->program = program;
+	Push(COMMAND_USE_PROGRAM, 0, program, 0, 0, 0, 0);
+}
+
+void Graphic::CommandBuffer::ActiveTexture(GLenum textureUnit)
+{
+	Push(COMMAND_ACTIVE_TEXTURE, textureUnit, 0, 0, 0, 0, 0);
+}
+
+void Graphic::CommandBuffer::BindTexture(GLenum target, GLuint texture)
+{
+	Push(COMMAND_BIND_TEXTURE, target, texture, 0, 0, 0, 0);
+}
+
+void Graphic::CommandBuffer::BindVertexArray(GLuint vertexArray)
+{
+	Push(COMMAND_BIND_VERTEX_ARRAY, 0, vertexArray, 0, 0, 0, 0);
+}
+
+void Graphic::CommandBuffer::BindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+	Push(COMMAND_BIND_BUFFER_BASE, target, buffer, static_cast<GLint>(index), 0, 0, 0);
+}
+
+void Graphic::CommandBuffer::Uniform1i(GLint location, GLint value)
+{
+	Push(COMMAND_UNIFORM_1I, 0, program, location, value, 0, 0);
+}
+
+void Graphic::CommandBuffer::Uniform1f(GLint location, GLfloat value)
+{
+	Push(COMMAND_UNIFORM_1F, 0, program, location, 0, 0, PushPayload(&value, 1));
+}
+
+void Graphic::CommandBuffer::Uniform2f(GLint location, const glm::vec2& value)
+{
+	Push(COMMAND_UNIFORM_2F, 0, program, location, 0, 0, PushPayload(glm::value_ptr(value), 2));
+}
+
+void Graphic::CommandBuffer::Uniform4f(GLint location, const glm::vec4& value)
+{
+	Push(COMMAND_UNIFORM_4F, 0, program, location, 0, 0, PushPayload(glm::value_ptr(value), 4));
+}
+
+void Graphic::CommandBuffer::UniformMatrix4(GLint location, const glm::mat4& value)
+{
+	Push(COMMAND_UNIFORM_MATRIX4, 0, program, location, 0, 0, PushPayload(glm::value_ptr(value), 16));
+}
+
+void Graphic::CommandBuffer::DrawArrays(GLint first, GLsizei count, GLsizei instanceCount)
+{
+	Push(COMMAND_DRAW_ARRAYS, 0, 0, first, count, instanceCount, 0);
+}
+
+void Graphic::CommandBuffer::DrawElements(GLsizei count, GLenum type, size_t offset, GLsizei instanceCount, GLuint baseInstance)
+{
+	Push(COMMAND_DRAW_ELEMENTS, type, 0, static_cast<GLint>(offset), count, instanceCount, baseInstance);
+}
+
+void Graphic::CommandBuffer::MultiDrawIndirect(GLuint indirectBuffer, GLsizei drawCount, GLenum type, size_t offset)
+{
+	Push(COMMAND_MULTI_DRAW_INDIRECT, type, indirectBuffer, static_cast<GLint>(offset), drawCount, 0, 0);
+}
+
+void Graphic::CommandBuffer::CallTarget(RenderTarget* target)
+{
+	if (target == nullptr) {
+		throw std::invalid_argument("Exception: Graphic::CommandBuffer::CallTarget(): Null render target!");
+	}
+	Push(COMMAND_CALL_TARGET, 0, 0, 0, 0, 0, static_cast<uint32_t>(targets.size()));
+	targets.push_back(target);
+}
+
+void Graphic::CommandBuffer::BeginScope(const char* name)
+{
+	Push(COMMAND_BEGIN_SCOPE, 0, 0, 0, 0, 0, static_cast<uint32_t>(scopeNames.size()));
+	scopeNames.push_back(name);
+}
+
+void Graphic::CommandBuffer::EndScope()
+{
+	Push(COMMAND_END_SCOPE, 0, 0, 0, 0, 0, 0);
+}
+
+void Graphic::CommandBuffer::Execute(float dt, GPUProfiler* profiler) const
+{
+	/**
+	*	must be called on the GL thread, the wrappers elide states which are already set
+	*/
+	GLuint shaderProgram = 0;
+	Shader* shader = nullptr;
+	for (const Command& command : commands) {
+		const GLfloat* values = payload.empty() ? nullptr : payload.data() + command.payload;
+
+		// uniforms go through the shader of their program, which skips unchanged values
+		if (command.type >= COMMAND_UNIFORM_1I && command.type <= COMMAND_UNIFORM_MATRIX4 && command.object != shaderProgram) {
+			shaderProgram = command.object;
+			shader = Shader::FindShader(shaderProgram);
+		}
+
+		switch (command.type)
+		{
+		case COMMAND_ENABLE:
+			GLEnable(command.target);
+			break;
+
+		case COMMAND_DISABLE:
+			GLDisable(command.target);
+			break;
+
+		case COMMAND_BLEND_FUNC:
+			GLBlendFunc(command.target, command.object);
+			break;
+
+		case COMMAND_USE_PROGRAM:
+			GLUseProgram(command.object);
+			break;
+
+		case COMMAND_ACTIVE_TEXTURE:
+			GLActiveTexture(command.target);
+			break;
+
+		case COMMAND_BIND_TEXTURE:
+			GLBindTexture(command.target, command.object);
+			break;
+
+		case COMMAND_BIND_VERTEX_ARRAY:
+			GLBindVertexArray(command.object);
+			break;
+
+		case COMMAND_BIND_BUFFER_BASE:
+			GLBindBufferBase(command.target, static_cast<GLuint>(command.argument), command.object);
+			break;
+
+		case COMMAND_UNIFORM_1I:
+			if (shader) {
+				shader->SetInt(command.argument, command.count);
+			}
+			else {
+				GLUniform1i(command.argument, command.count);
+			}
+			break;
+
+		case COMMAND_UNIFORM_1F:
+			if (shader) {
+				shader->SetFloat(command.argument, values[0]);
+			}
+			else {
+				GLUniform1f(command.argument, values[0]);
+			}
+			break;
+
+		case COMMAND_UNIFORM_2F:
+			if (shader) {
+				shader->SetVec2(command.argument, glm::make_vec2(values));
+			}
+			else {
+				GLUniform2fv(command.argument, 1, values);
+			}
+			break;
+
+		case COMMAND_UNIFORM_4F:
+			if (shader) {
+				shader->SetVec4(command.argument, glm::make_vec4(values));
+			}
+			else {
+				GLUniform4fv(command.argument, 1, values);
+			}
+			break;
+
+		case COMMAND_UNIFORM_MATRIX4:
+			if (shader) {
+				shader->SetMat4(command.argument, glm::make_mat4(values));
+			}
+			else {
+				GLUniformMatrix4fv(command.argument, 1, GL_FALSE, values);
+			}
+			break;
+
+		case COMMAND_DRAW_ARRAYS:
+			if (command.instanceCount > 0) {
+				GLDrawArraysInstanced(GL_TRIANGLES, command.argument, command.count, command.instanceCount);
+			}
+			else {
+				GLDrawArrays(GL_TRIANGLES, command.argument, command.count);
+			}
+			break;
+
+		case COMMAND_DRAW_ELEMENTS:
+			if (command.instanceCount > 0 && command.payload > 0) {
+				GLDrawElementsInstancedBaseInstance(GL_TRIANGLES, command.count, command.target, (void*)(size_t)command.argument,
+					command.instanceCount, command.payload);
+			}
+			else if (command.instanceCount > 0) {
+				GLDrawElementsInstanced(GL_TRIANGLES, command.count, command.target, (void*)(size_t)command.argument, command.instanceCount);
+			}
+			else {
+				GLDrawElements(GL_TRIANGLES, command.count, command.target, (void*)(size_t)command.argument);
+			}
+			break;
+
+		case COMMAND_MULTI_DRAW_INDIRECT:
+			GLBindBuffer(GL_DRAW_INDIRECT_BUFFER, command.object);
+			GLMultiDrawElementsIndirect(GL_TRIANGLES, command.target, (void*)(size_t)command.argument, command.count, 0);
+			break;
+
+		case COMMAND_CALL_TARGET:
+			targets[command.payload]->Render(dt);
+			break;
+
+		case COMMAND_BEGIN_SCOPE:
+			if (profiler) {
+				profiler->BeginScope(scopeNames[command.payload]);
+			}
+			GLTrace::BeginSection(scopeNames[command.payload]);
+			break;
+
+		case COMMAND_END_SCOPE:
+			if (profiler) {
+				profiler->EndScope();
+			}
+			GLTrace::EndSection();
+			break;
+
+		default:
+			throw std::runtime_error("Exception: Graphic::CommandBuffer::Execute(): Unknown command!");
+			break;
+		}
+	}
+}
+
+size_t Graphic::CommandBuffer::Count() const
+{
+	return commands.size();
+}
+
+void Graphic::CommandBuffer::Push(CommandType type, GLenum target, GLuint object, GLint argument, GLsizei count, GLsizei instanceCount, uint32_t payload)
+{
+	Command command = { type, target, object, argument, count, instanceCount, payload };
+	commands.push_back(command);
+}
+
+uint32_t Graphic::CommandBuffer::PushPayload(const GLfloat* values, size_t count)
+{
+	uint32_t offset = static_cast<uint32_t>(payload.size());
+	payload.insert(payload.end(), values, values + count);
+	return offset;
+}
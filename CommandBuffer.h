@@ -0,0 +1,120 @@
+#pragma once
+#include "Utility.h"
+
+namespace Graphic
+{
+	class RenderTarget;
+	class CommandBuffer;
+	class GPUProfiler;
+
+	enum CommandType : uint32_t
+	{
+		COMMAND_ENABLE,
+		COMMAND_DISABLE,
+		COMMAND_BLEND_FUNC,
+		COMMAND_USE_PROGRAM,
+		COMMAND_ACTIVE_TEXTURE,
+		COMMAND_BIND_TEXTURE,
+		COMMAND_BIND_VERTEX_ARRAY,
+		COMMAND_BIND_BUFFER_BASE,
+		COMMAND_UNIFORM_1I,
+		COMMAND_UNIFORM_1F,
+		COMMAND_UNIFORM_2F,
+		COMMAND_UNIFORM_4F,
+		COMMAND_UNIFORM_MATRIX4,
+		COMMAND_DRAW_ARRAYS,
+		COMMAND_DRAW_ELEMENTS,
+		COMMAND_MULTI_DRAW_INDIRECT,
+		COMMAND_CALL_TARGET,
+		COMMAND_BEGIN_SCOPE,
+		COMMAND_END_SCOPE
+	};
+
+	/**
+	*	one recorded GL call, the meaning of the fields depends on the type
+	*		ENABLE, DISABLE:		target = capability
+	*		BLEND_FUNC:				target = source factor, object = destination factor
+	*		USE_PROGRAM:			object = program
+	*		ACTIVE_TEXTURE:			target = texture unit
+	*		BIND_TEXTURE:			target = texture target, object = texture
+	*		BIND_VERTEX_ARRAY:		object = vertex array
+	*		BIND_BUFFER_BASE:		target = buffer target, object = buffer, argument = binding point
+	*		UNIFORM_*:				object = program, argument = location, count = value of UNIFORM_1I, payload = first float of the value
+	*		DRAW_ARRAYS:			argument = first vertex, count = vertex count
+	*		DRAW_ELEMENTS:			target = index type, argument = byte offset of first index, count = index count, payload = base instance
+	*		MULTI_DRAW_INDIRECT:	target = index type, object = indirect buffer, argument = byte offset of first command, count = draw count
+	*		CALL_TARGET:			payload = index of the render target, its Render() is called on replay
+	*		BEGIN_SCOPE:			payload = index of the scope name, timed by the profiler on replay
+	*	instanceCount of draws is 0 for non-instanced drawing.
+	*/
+	struct Command
+	{
+		CommandType type;
+		GLenum target;
+		GLuint object;
+		GLint argument;
+		GLsizei count;
+		GLsizei instanceCount;
+		uint32_t payload;
+	};
+}
+
+/**
+*	\description: class CommandBuffer: records GL calls as compact POD commands without touching GL, so that render
+*	targets can be recorded on worker threads. The GL thread replays the buffers in order through the state wrappers.
+*
+*	\detail: a buffer must only be filled by one thread at a time, and must not be reset while it is being executed.
+*/
+class Graphic::CommandBuffer
+{
+public:
+	CommandBuffer();
+	CommandBuffer(const CommandBuffer& commandBuffer);
+	~CommandBuffer();
+
+	void Reset();
+
+	// state
+	void Enable(GLenum capability);
+	void Disable(GLenum capability);
+	void BlendFunc(GLenum sourceFactor, GLenum destinationFactor);
+
+	// bindings
+	void UseProgram(GLuint program);
+	void ActiveTexture(GLenum textureUnit);
+	void BindTexture(GLenum target, GLuint texture);
+	void BindVertexArray(GLuint vertexArray);
+	void BindBufferBase(GLenum target, GLuint index, GLuint buffer);
+
+	// uniforms of the program of the last UseProgram, set through its Shader on replay
+	void Uniform1i(GLint location, GLint value);
+	void Uniform1f(GLint location, GLfloat value);
+	void Uniform2f(GLint location, const glm::vec2& value);
+	void Uniform4f(GLint location, const glm::vec4& value);
+	void UniformMatrix4(GLint location, const glm::mat4& value);
+
+	// draws of current vertex array
+	void DrawArrays(GLint first, GLsizei count, GLsizei instanceCount = 0);
+	void DrawElements(GLsizei count, GLenum type, size_t offset, GLsizei instanceCount = 0, GLuint baseInstance = 0);
+	void MultiDrawIndirect(GLuint indirectBuffer, GLsizei drawCount, GLenum type = GL_UNSIGNED_INT, size_t offset = 0); ///< offset in bytes
+
+	void CallTarget(RenderTarget* target); ///< fallback of targets which can not be recorded
+
+	// GPU profiler scopes, names must outlive the replay
+	void BeginScope(const char* name);
+	void EndScope();
+
+	void Execute(float dt, GPUProfiler* profiler = nullptr) const;
+	size_t Count() const;
+
+private:
+	std::vector<Command> commands;
+	std::vector<GLfloat> payload;			///< uniform values
+	std::vector<RenderTarget*> targets;		///< targets of CALL_TARGET
+	std::vector<const char*> scopeNames;	///< names of BEGIN_SCOPE
+	GLuint program;							///< program of recorded uniforms
+
+	void Push(CommandType type, GLenum target, GLuint object, GLint argument, GLsizei count, GLsizei instanceCount, uint32_t payload);
+	uint32_t PushPayload(const GLfloat* values, size_t count);
+
+};
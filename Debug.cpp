@@ -6,12 +6,18 @@ Debug debug;
 long long Debug::currentMemoryAllocate = 0L;
 long long Debug::peekMemmoryAllocate = 0L;
 
+#ifdef _MSC_VER
 Debug::Debug()
 	:memoryState()
 {
     _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 	_CrtSetReportMode(_CRT_WARN, _CRTDBG_MODE_DEBUG);
     _CrtSetAllocHook(reinterpret_cast<_CRT_ALLOC_HOOK>(AllocateHook));
+#else
+// the debug heap of the CRT is MSVC only, the heap statistic stays empty
+Debug::Debug()
+{
+#endif
 
 	std::set_new_handler(NewHandler);
 
@@ -49,7 +55,7 @@ void Debug::ShowMessage(const char* message)
 
 }
 
-void _stdcall Debug::GLDebugOutput(GLenum source, GLenum type, unsigned int id, GLenum severity, GLsizei length, const char* message, const void* userParam)
+void APIENTRY Debug::GLDebugOutput(GLenum source, GLenum type, unsigned int id, GLenum severity, GLsizei length, const char* message, const void* userParam)
 {
     // ignore non-significant error/warning codes
     if (id == 131169 || id == 131185 || id == 131218 || id == 131204) return;
@@ -92,6 +98,7 @@ void _stdcall Debug::GLDebugOutput(GLenum source, GLenum type, unsigned int id,
 
 int _cdecl Debug::AllocateHook(int nAllocType, void* pvData, size_t nSize, int nBlockUse, long lRequest, const unsigned char* szFileName, int nLine)
 {
+#ifdef _MSC_VER
 	// ignore crt allocs because we might be calling into the crt from this function
 	if (nBlockUse == _CRT_BLOCK)
 	{
@@ -117,6 +124,7 @@ int _cdecl Debug::AllocateHook(int nAllocType, void* pvData, size_t nSize, int n
 		currentMemoryAllocate -= _msize_dbg(pvData, nBlockUse);
 		break;
 	}
+#endif // _MSC_VER
 
 
 	return 1;
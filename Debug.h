@@ -3,7 +3,18 @@
 
 #define _CRTDBG_MAP_ALLOC
 
-#define ASSERT(x) if(!(x)) __debugbreak();
+#ifdef _MSC_VER
+#define DEBUG_BREAK() __debugbreak()
+#else
+#include <csignal>
+#define DEBUG_BREAK() std::raise(SIGTRAP)
+#endif
+
+#ifndef _WIN32
+#define _cdecl
+#endif
+
+#define ASSERT(x) if(!(x)) DEBUG_BREAK();
 
 #ifdef _DEBUG
 #define GLCall(x) \
@@ -35,7 +46,7 @@ public:
 
 	static void ShowMessage(const char* message);
 
-	static void _stdcall GLDebugOutput(GLenum source, GLenum type, unsigned int id, GLenum severity,
+	static void APIENTRY GLDebugOutput(GLenum source, GLenum type, unsigned int id, GLenum severity,
 		GLsizei length, const char* message, const void* userParam);
 
 	static int _cdecl AllocateHook(int nAllocType, void* pvData, size_t nSize, int nBlockUse, long lRequest, 
@@ -52,7 +63,9 @@ private:
 	static long long currentMemoryAllocate;
 	static long long peekMemmoryAllocate;
 
+#ifdef _MSC_VER
 	// crt memory check
 	_CrtMemState memoryState;
+#endif
 
 };
\ No newline at end of file
@@ -15,16 +15,19 @@ Engine::~Engine()
 	SafeDelete(window);
 }
 
-Window* Engine::CreateWindowX(double width, double height, const wchar_t* title, bool fullscreen)
+Window* Engine::CreateWindowX(double width, double height, const wchar_t* title, bool fullscreen, bool headless)
 {
-	window = new Window(width, height, title, fullscreen);
+	window = new Window(width, height, title, fullscreen, headless);
 	try
 	{
 		window->Init();
+		Resources::CompileTechniques();
 		return window;
 	}
-	catch (const std::exception&)
+	catch (const std::exception& exception)
 	{
+		// also reported in release builds, e.g. a headless run on a node without the null platform of GLFW
+		std::cerr << exception.what() << std::endl;
 		return nullptr;
 	}
 
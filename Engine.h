@@ -9,7 +9,7 @@ public:
 	Engine();
 	~Engine();
 
-	Window* CreateWindowX(double width, double height, const wchar_t* title = L"Window", bool fullscreen = false);
+	Window* CreateWindowX(double width, double height, const wchar_t* title = L"Window", bool fullscreen = false, bool headless = false);
 
 	int Running();
 
@@ -13,21 +13,20 @@ FontTech::~FontTech()
 {
 }
 
-bool FontTech::Init()
+void FontTech::Compile()
 {
 	const char* fontVSCode = R"(
 	#version 440 
 	#define FONT_VERTEX_SHADER
+	)" FRAME_CONSTANTS_GLSL R"(
 	
 	layout (location = 0) in vec4 vertex;
 	
 	out vec2 textureCoords;
 	
-	uniform mat4 projection;
-	
 	void main()
 	{
-	    gl_Position = projection * vec4(vertex.xy, 0.0, 1.0);
+	    gl_Position = vec4(vertex.xy * frame.content.xy * frame.viewport.zw * 2.0 - 1.0, 0.0, 1.0);
 	    textureCoords = vertex.zw;
 	}
 	
@@ -52,21 +51,17 @@ bool FontTech::Init()
 	)";
 
 	shader = Resources::CreateShader(fontVSCode, fontFSCode);
+}
+
+bool FontTech::Init()
+{
+	Compile();
 	shader->Use();
-	projectionLocation = shader->GetLocation("projection");
 	colorLocation = shader->GetLocation("textColor");
 
-	glm::mat4 projection = glm::ortho(0.0f, static_cast<float>(Window::GetWindowWidth()), 0.0f, static_cast<float>(Window::GetWindowHeight()));
-	shader->SetMat4(projectionLocation, projection);
-
 	return false;
 }
 
-void FontTech::SetProjection(glm::mat4& projection)
-{
-	shader->SetMat4(projectionLocation, projection);
-}
-
 void FontTech::SetColor(glm::vec4& color)
 {
 	shader->SetVec4(colorLocation, color);
@@ -74,5 +69,15 @@ void FontTech::SetColor(glm::vec4& color)
 
 void FontTech::BindTexture(GLuint textureID)
 {
-	GLCall(glBindTexture(GL_TEXTURE_2D, textureID));
+	Graphic::GLBindTexture(GL_TEXTURE_2D, textureID);
+}
+
+void FontTech::SetColor(const glm::vec4& color, Graphic::CommandBuffer* commandBuffer)
+{
+	commandBuffer->Uniform4f(colorLocation, color);
+}
+
+void FontTech::BindTexture(GLuint textureID, Graphic::CommandBuffer* commandBuffer)
+{
+	commandBuffer->BindTexture(GL_TEXTURE_2D, textureID);
 }
@@ -8,14 +8,17 @@ public:
 	FontTech();
 	virtual ~FontTech();
 
+	void Compile();
 	bool Init();
 
-	void SetProjection(glm::mat4& projection);
 	void SetColor(glm::vec4& color);
 	void BindTexture(GLuint textureID);
 
+	// record into a command buffer instead of calling GL
+	void SetColor(const glm::vec4& color, Graphic::CommandBuffer* commandBuffer);
+	void BindTexture(GLuint textureID, Graphic::CommandBuffer* commandBuffer);
+
 private:
-	GLuint projectionLocation;
 	GLuint colorLocation;
 
 };
@@ -0,0 +1,442 @@
+#include "FrameGraph.h"
+#include "Renderer.h"
+#include "GPUProfiler.h"
+
+bool Graphic::TextureDescription::operator==(const TextureDescription& description) const
+{
+	return width == description.width && height == description.height && internalFormat == description.internalFormat;
+}
+
+Graphic::FrameGraph::PassBuilder::PassBuilder(FrameGraph* graph, size_t pass)
+	:graph(graph), pass(pass)
+{
+}
+
+Graphic::FrameGraphResource Graphic::FrameGraph::PassBuilder::Create(const char* name, const TextureDescription& description)
+{
+	Texture texture = { name, description, false, 0, -1, -1, -1 };
+	graph->textures.push_back(texture);
+
+	FrameGraphResource resource = graph->AddNode(static_cast<uint32_t>(graph->textures.size() - 1), static_cast<GLint>(pass));
+	graph->passes[pass].writes.push_back(resource);
+
+	return resource;
+}
+
+Graphic::FrameGraphResource Graphic::FrameGraph::PassBuilder::Read(FrameGraphResource resource)
+{
+	if (resource >= graph->nodes.size()) {
+		throw std::invalid_argument("Exception: Graphic::FrameGraph::PassBuilder::Read(): Invalid resource!");
+	}
+	graph->passes[pass].reads.push_back(resource);
+
+	return resource;
+}
+
+Graphic::FrameGraphResource Graphic::FrameGraph::PassBuilder::Write(FrameGraphResource resource)
+{
+	if (resource >= graph->nodes.size()) {
+		throw std::invalid_argument("Exception: Graphic::FrameGraph::PassBuilder::Write(): Invalid resource!");
+	}
+
+	/**
+	*	a write depends on the former version, so it is ordered after the former writer and keeps it alive
+	*/
+	uint32_t texture = graph->nodes[resource].texture;
+	graph->passes[pass].reads.push_back(resource);
+	if (graph->textures[texture].imported) {
+		graph->passes[pass].sideEffect = true;
+	}
+
+	FrameGraphResource newVersion = graph->AddNode(texture, static_cast<GLint>(pass));
+	graph->passes[pass].writes.push_back(newVersion);
+
+	return newVersion;
+}
+
+void Graphic::FrameGraph::PassBuilder::SetSideEffect()
+{
+	graph->passes[pass].sideEffect = true;
+}
+
+Graphic::FrameGraph::FrameGraph()
+	:textures(), nodes(), passes(), executionOrder(), physicalTextures(), framebuffers(), statistics(), compiled(false), frame(0)
+{
+}
+
+Graphic::FrameGraph::~FrameGraph()
+{
+	for (PhysicalTexture& physicalTexture : physicalTextures) {
+		GLDeleteTextures(1, &physicalTexture.texture);
+	}
+	for (Framebuffer& framebuffer : framebuffers) {
+		GLDeleteFramebuffers(1, &framebuffer.framebuffer);
+	}
+}
+
+void Graphic::FrameGraph::Reset()
+{
+	// keep the pools, the same graph is built again next frame
+	textures.clear();
+	nodes.clear();
+	passes.clear();
+	executionOrder.clear();
+	statistics = {};
+	compiled = false;
+
+	frame++;
+	ReleaseUnusedTextures();
+}
+
+Graphic::FrameGraphResource Graphic::FrameGraph::Import(const char* name, const TextureDescription& description, GLuint framebuffer)
+{
+	Texture texture = { name, description, true, framebuffer, -1, -1, -1 };
+	textures.push_back(texture);
+
+	return AddNode(static_cast<uint32_t>(textures.size() - 1), -1);
+}
+
+void Graphic::FrameGraph::AddPass(const char* name, const SetupFunc& setup, const ExecuteFunc& execute)
+{
+	Pass pass = { name, execute, {}, {}, false, 0, false };
+	passes.push_back(pass);
+	compiled = false;
+
+	PassBuilder builder(this, passes.size() - 1);
+	setup(builder);
+}
+
+void Graphic::FrameGraph::Compile()
+{
+	statistics.passes = static_cast<uint32_t>(passes.size());
+
+	/**
+	*	cull: start from versions nobody reads, and walk back to the writers whose results all turn out unused
+	*/
+	for (ResourceNode& node : nodes) {
+		node.refCount = 0;
+	}
+	for (Pass& pass : passes) {
+		pass.refCount = static_cast<uint32_t>(pass.writes.size());
+		pass.culled = false;
+		for (FrameGraphResource read : pass.reads) {
+			nodes[read].refCount++;
+		}
+	}
+
+	std::vector<FrameGraphResource> unused;
+	for (FrameGraphResource resource = 0; resource < nodes.size(); ++resource) {
+		if (nodes[resource].refCount == 0) {
+			unused.push_back(resource);
+		}
+	}
+	while (!unused.empty()) {
+		FrameGraphResource resource = unused.back();
+		unused.pop_back();
+
+		GLint producer = nodes[resource].producer;
+		if (producer < 0 || passes[producer].sideEffect || passes[producer].culled) {
+			continue;
+		}
+
+		Pass& pass = passes[producer];
+		if (pass.refCount > 0 && --pass.refCount == 0) {
+			pass.culled = true;
+			statistics.culledPasses++;
+			for (FrameGraphResource read : pass.reads) {
+				if (--nodes[read].refCount == 0) {
+					unused.push_back(read);
+				}
+			}
+		}
+	}
+
+	/**
+	*	order: topological sort of the remaining passes, ties keep declaration order
+	*/
+	std::vector<uint32_t> dependencies(passes.size(), 0);
+	for (size_t i = 0; i < passes.size(); ++i) {
+		for (FrameGraphResource read : passes[i].reads) {
+			GLint producer = nodes[read].producer;
+			if (producer >= 0 && static_cast<size_t>(producer) != i && !passes[producer].culled) {
+				dependencies[i]++;
+			}
+		}
+	}
+
+	std::vector<bool> scheduled(passes.size(), false);
+	size_t livePasses = passes.size() - statistics.culledPasses;
+	executionOrder.clear();
+	while (executionOrder.size() < livePasses) {
+		size_t next = passes.size();
+		for (size_t i = 0; i < passes.size(); ++i) {
+			if (!passes[i].culled && !scheduled[i] && dependencies[i] == 0) {
+				next = i;
+				break;
+			}
+		}
+		if (next == passes.size()) {
+			throw std::runtime_error("Exception: Graphic::FrameGraph::Compile(): Passes depend on each other!");
+		}
+
+		scheduled[next] = true;
+		executionOrder.push_back(next);
+		for (size_t i = 0; i < passes.size(); ++i) {
+			for (FrameGraphResource read : passes[i].reads) {
+				if (nodes[read].producer == static_cast<GLint>(next) && i != next) {
+					dependencies[i]--;
+				}
+			}
+		}
+	}
+
+	/**
+	*	lifetimes: first and last execution index touching each texture
+	*/
+	for (Texture& texture : textures) {
+		texture.physical = -1;
+		texture.firstPass = -1;
+		texture.lastPass = -1;
+	}
+	for (size_t slot = 0; slot < executionOrder.size(); ++slot) {
+		const Pass& pass = passes[executionOrder[slot]];
+		for (const std::vector<FrameGraphResource>* resources : { &pass.reads, &pass.writes }) {
+			for (FrameGraphResource resource : *resources) {
+				Texture& texture = textures[nodes[resource].texture];
+				if (texture.firstPass < 0) {
+					texture.firstPass = static_cast<GLint>(slot);
+				}
+				texture.lastPass = static_cast<GLint>(slot);
+			}
+		}
+	}
+	for (const Texture& texture : textures) {
+		if (!texture.imported && texture.firstPass >= 0) {
+			statistics.transientTextures++;
+		}
+	}
+
+	compiled = true;
+}
+
+void Graphic::FrameGraph::Execute(float dt, GPUProfiler* profiler)
+{
+	if (!compiled) {
+		Compile();
+	}
+
+	/**
+	*	a transient texture takes a free physical texture of the same description at its first use,
+	*	and gives it back after its last use
+	*/
+	std::vector<bool> usedThisFrame(physicalTextures.size(), false);
+	for (size_t slot = 0; slot < executionOrder.size(); ++slot) {
+		const Pass& pass = passes[executionOrder[slot]];
+
+		for (Texture& texture : textures) {
+			if (!texture.imported && texture.firstPass == static_cast<GLint>(slot)) {
+				texture.physical = AcquireTexture(texture.description);
+				usedThisFrame.resize(physicalTextures.size(), false);
+				usedThisFrame[texture.physical] = true;
+			}
+		}
+
+		if (profiler) {
+			profiler->BeginScope(pass.name.c_str());
+		}
+		GLTrace::BeginSection(pass.name.c_str());
+		BindTargets(pass, slot);
+		if (pass.execute) {
+			pass.execute(*this, dt);
+		}
+		GLTrace::EndSection();
+		if (profiler) {
+			profiler->EndScope();
+		}
+
+		for (Texture& texture : textures) {
+			if (!texture.imported && texture.lastPass == static_cast<GLint>(slot)) {
+				physicalTextures[texture.physical].inUse = false;
+			}
+		}
+	}
+
+	for (bool used : usedThisFrame) {
+		statistics.physicalTextures += used ? 1 : 0;
+	}
+	GLBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+GLuint Graphic::FrameGraph::GetTexture(FrameGraphResource resource) const
+{
+	const Texture& texture = textures.at(nodes.at(resource).texture);
+	if (texture.imported || texture.physical < 0) {
+		return 0;
+	}
+
+	return physicalTextures[texture.physical].texture;
+}
+
+const Graphic::TextureDescription& Graphic::FrameGraph::GetDescription(FrameGraphResource resource) const
+{
+	return textures.at(nodes.at(resource).texture).description;
+}
+
+const Graphic::FrameGraph::Statistics& Graphic::FrameGraph::GetStatistics() const
+{
+	return statistics;
+}
+
+Graphic::FrameGraphResource Graphic::FrameGraph::AddNode(uint32_t texture, GLint producer)
+{
+	ResourceNode node = { texture, producer, 0 };
+	nodes.push_back(node);
+
+	return static_cast<FrameGraphResource>(nodes.size() - 1);
+}
+
+GLint Graphic::FrameGraph::AcquireTexture(const TextureDescription& description)
+{
+	for (size_t i = 0; i < physicalTextures.size(); ++i) {
+		if (!physicalTextures[i].inUse && physicalTextures[i].description == description) {
+			physicalTextures[i].inUse = true;
+			physicalTextures[i].lastUsedFrame = frame;
+			return static_cast<GLint>(i);
+		}
+	}
+
+	PhysicalTexture physicalTexture = { 0, description, true, frame };
+	GLGenTextures(1, &physicalTexture.texture);
+	GLBindTexture(GL_TEXTURE_2D, physicalTexture.texture);
+	GLTexStorage2D(GL_TEXTURE_2D, 1, description.internalFormat, description.width, description.height);
+	GLTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	GLTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	GLTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	GLTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	GLBindTexture(GL_TEXTURE_2D, 0);
+
+	physicalTextures.push_back(physicalTexture);
+	return static_cast<GLint>(physicalTextures.size() - 1);
+}
+
+void Graphic::FrameGraph::ReleaseUnusedTextures()
+{
+	/**
+	*	a framebuffer keeps its attachments alive, so it is deleted with them and generated again by its next pass
+	*/
+	for (size_t i = 0; i < physicalTextures.size();) {
+		if (physicalTextures[i].inUse || frame - physicalTextures[i].lastUsedFrame <= MAX_UNUSED_FRAMES) {
+			++i;
+			continue;
+		}
+
+		GLuint texture = physicalTextures[i].texture;
+		for (Framebuffer& framebuffer : framebuffers) {
+			if (std::find(framebuffer.textures.begin(), framebuffer.textures.end(), texture) != framebuffer.textures.end()) {
+				GLDeleteFramebuffers(1, &framebuffer.framebuffer);
+				framebuffer = Framebuffer{ 0, 0, false, {} };
+			}
+		}
+		GLDeleteTextures(1, &texture);
+		physicalTextures.erase(physicalTextures.begin() + i);
+	}
+}
+
+void Graphic::FrameGraph::BindTargets(const Pass& pass, size_t slot)
+{
+	if (pass.writes.empty()) {
+		return;
+	}
+
+	/**
+	*	imported textures are written through their own framebuffer, transient ones are attached to a pooled one
+	*/
+	const Texture& first = textures[nodes[pass.writes[0]].texture];
+	if (first.imported) {
+		if (pass.writes.size() > 1) {
+			throw std::invalid_argument("Exception: Graphic::FrameGraph::BindTargets(): An imported texture must be the only target of a pass!");
+		}
+		GLBindFramebuffer(GL_FRAMEBUFFER, first.importedFramebuffer);
+		GLViewport(0, 0, first.description.width, first.description.height);
+		return;
+	}
+
+	if (framebuffers.size() <= slot) {
+		framebuffers.resize(slot + 1, Framebuffer{ 0, 0, false, {} });
+	}
+	Framebuffer& framebuffer = framebuffers[slot];
+	if (framebuffer.framebuffer == 0) {
+		GLGenFramebuffers(1, &framebuffer.framebuffer);
+	}
+	GLBindFramebuffer(GL_FRAMEBUFFER, framebuffer.framebuffer);
+
+	GLuint colorAttachments = 0;
+	bool depthAttachment = false;
+	std::vector<GLenum> drawBuffers;
+	framebuffer.textures.clear();
+	for (FrameGraphResource resource : pass.writes) {
+		const Texture& texture = textures[nodes[resource].texture];
+		if (texture.imported) {
+			throw std::invalid_argument("Exception: Graphic::FrameGraph::BindTargets(): An imported texture must be the only target of a pass!");
+		}
+		GLuint textureID = physicalTextures[texture.physical].texture;
+		framebuffer.textures.push_back(textureID);
+
+		if (IsDepthFormat(texture.description.internalFormat)) {
+			GLenum attachment = HasStencil(texture.description.internalFormat) ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+			GLFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, textureID, 0);
+			depthAttachment = true;
+		}
+		else {
+			GLFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + colorAttachments, GL_TEXTURE_2D, textureID, 0);
+			drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + colorAttachments);
+			colorAttachments++;
+		}
+	}
+
+	// detach what the former frame attached to this slot
+	for (GLuint i = colorAttachments; i < framebuffer.colorAttachments; ++i) {
+		GLFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, 0, 0);
+	}
+	if (framebuffer.depthAttachment && !depthAttachment) {
+		GLFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
+	}
+	framebuffer.colorAttachments = colorAttachments;
+	framebuffer.depthAttachment = depthAttachment;
+
+	if (drawBuffers.empty()) {
+		GLDrawBuffer(GL_NONE);
+	}
+	else {
+		GLDrawBuffers(static_cast<GLsizei>(drawBuffers.size()), drawBuffers.data());
+	}
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::string throwMessage = "Exception: Graphic::FrameGraph::BindTargets(): Framebuffer of pass " + pass.name + " is incomplete!";
+		throw std::runtime_error(throwMessage.c_str());
+	}
+
+	const TextureDescription& description = first.description;
+	GLViewport(0, 0, description.width, description.height);
+}
+
+bool Graphic::FrameGraph::IsDepthFormat(GLenum internalFormat)
+{
+	switch (internalFormat)
+	{
+	case GL_DEPTH_COMPONENT16:
+	case GL_DEPTH_COMPONENT24:
+	case GL_DEPTH_COMPONENT32:
+	case GL_DEPTH_COMPONENT32F:
+	case GL_DEPTH24_STENCIL8:
+	case GL_DEPTH32F_STENCIL8:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool Graphic::FrameGraph::HasStencil(GLenum internalFormat)
+{
+	return internalFormat == GL_DEPTH24_STENCIL8 || internalFormat == GL_DEPTH32F_STENCIL8;
+}
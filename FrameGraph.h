@@ -0,0 +1,143 @@
+#pragma once
+#include "Utility.h"
+
+namespace Graphic
+{
+	class FrameGraph;
+	class GPUProfiler;
+
+	typedef uint32_t FrameGraphResource;	///< handle of one version of a texture in the graph
+	constexpr FrameGraphResource INVALID_RESOURCE = 0xffffffff;
+
+	struct TextureDescription
+	{
+		GLsizei width;
+		GLsizei height;
+		GLenum internalFormat;	///< sized format, e.g. GL_RGBA8 or GL_DEPTH24_STENCIL8
+
+		bool operator==(const TextureDescription& description) const;
+	};
+}
+
+/**
+*	\description: class FrameGraph: passes of a frame declare the textures they create, read and write. The graph culls
+*	passes whose results are never used, orders the rest by their dependencies, and allocates transient textures only
+*	for the passes between their first and last use, so textures whose lifetimes do not overlap share memory.
+*
+*	\detail: the graph is rebuilt every frame by Reset(), AddPass() ..., Compile() and Execute(). Physical textures and
+*	framebuffers are pooled across frames, a physical texture unused for MAX_UNUSED_FRAMES frames, e.g. one of the size
+*	before a resize, is released with the framebuffers it is attached to. Writing a texture returns a new handle (version) of it, later passes must
+*	use that handle to see the write. A pass which writes an imported texture, e.g. the backbuffer, is never culled.
+*/
+class Graphic::FrameGraph
+{
+public:
+	class PassBuilder
+	{
+	public:
+		FrameGraphResource Create(const char* name, const TextureDescription& description);
+		FrameGraphResource Read(FrameGraphResource resource);
+		FrameGraphResource Write(FrameGraphResource resource);
+		void SetSideEffect(); ///< keep the pass even if nothing reads its results
+
+	private:
+		PassBuilder(FrameGraph* graph, size_t pass);
+
+		FrameGraph* graph;
+		size_t pass;
+
+		friend class FrameGraph;
+	};
+
+	typedef std::function<void(PassBuilder& builder)> SetupFunc;
+	typedef std::function<void(const FrameGraph& graph, float dt)> ExecuteFunc;
+
+	struct Statistics
+	{
+		uint32_t passes;			///< passes declared
+		uint32_t culledPasses;		///< passes removed by culling
+		uint32_t transientTextures;	///< transient textures used by the executed passes
+		uint32_t physicalTextures;	///< textures allocated for them, less than above when memory is aliased
+	};
+
+	FrameGraph();
+	FrameGraph(const FrameGraph& frameGraph) = delete;
+	~FrameGraph();
+
+	void Reset();
+	FrameGraphResource Import(const char* name, const TextureDescription& description, GLuint framebuffer);
+	void AddPass(const char* name, const SetupFunc& setup, const ExecuteFunc& execute);
+	void Compile();
+	void Execute(float dt, GPUProfiler* profiler = nullptr); ///< every pass is a profiler scope
+
+	GLuint GetTexture(FrameGraphResource resource) const;	///< valid while the passes using it execute
+	const TextureDescription& GetDescription(FrameGraphResource resource) const;
+	const Statistics& GetStatistics() const;
+
+private:
+	/**
+	*	virtual texture, physical is an index of the pool, or -1
+	*/
+	struct Texture
+	{
+		std::string name;
+		TextureDescription description;
+		bool imported;
+		GLuint importedFramebuffer;
+		GLint physical;
+		GLint firstPass;	///< execution index of first use, -1 if unused
+		GLint lastPass;
+	};
+	struct ResourceNode
+	{
+		uint32_t texture;
+		GLint producer;		///< pass which writes this version, -1 for imported or created outside
+		uint32_t refCount;	///< readers which are not culled
+	};
+	struct Pass
+	{
+		std::string name;
+		ExecuteFunc execute;
+		std::vector<FrameGraphResource> reads;
+		std::vector<FrameGraphResource> writes;
+		bool sideEffect;
+		uint32_t refCount;
+		bool culled;
+	};
+	struct PhysicalTexture
+	{
+		GLuint texture;
+		TextureDescription description;
+		bool inUse;
+		uint32_t lastUsedFrame;
+	};
+	struct Framebuffer
+	{
+		GLuint framebuffer;
+		GLuint colorAttachments;
+		bool depthAttachment;
+		std::vector<GLuint> textures;	///< attached physical textures
+	};
+
+	static constexpr uint32_t MAX_UNUSED_FRAMES = 3;
+
+	std::vector<Texture> textures;
+	std::vector<ResourceNode> nodes;
+	std::vector<Pass> passes;
+	std::vector<size_t> executionOrder;
+
+	std::vector<PhysicalTexture> physicalTextures;	///< pool, kept across frames
+	std::vector<Framebuffer> framebuffers;			///< one per execution slot, kept across frames
+
+	Statistics statistics;
+	bool compiled;
+	uint32_t frame;		///< counts Reset()
+
+	FrameGraphResource AddNode(uint32_t texture, GLint producer);
+	GLint AcquireTexture(const TextureDescription& description);
+	void ReleaseUnusedTextures();
+	void BindTargets(const Pass& pass, size_t slot);
+
+	static bool IsDepthFormat(GLenum internalFormat);
+	static bool HasStencil(GLenum internalFormat);
+};
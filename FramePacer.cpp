@@ -0,0 +1,187 @@
+#include "FramePacer.h"
+#include "Renderer.h"
+#include "Debug.h"
+
+#ifdef _WIN32
+// Windows 10 1803 and later, older SDKs lack the flag
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#else
+#define YieldProcessor() std::this_thread::yield()
+#endif
+
+Graphic::FramePacer::FramePacer(GLuint framesInFlight)
+	:framesInFlight(2), frameRateLimit(0.f), vsync(VSync::ON), vsyncDirty(true), fences(), frameBegin(), deadline(),
+	started(false), waitTimer(nullptr), statistics()
+{
+	SetFramesInFlight(framesInFlight);
+#ifdef _WIN32
+	waitTimer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+#endif
+}
+
+Graphic::FramePacer::~FramePacer()
+{
+	for (GLsync fence : fences) {
+		GLDeleteSync(fence);
+	}
+#ifdef _WIN32
+	if (waitTimer) {
+		CloseHandle(waitTimer);
+	}
+#endif
+}
+
+void Graphic::FramePacer::SetFramesInFlight(GLuint count)
+{
+	framesInFlight = (std::min)((std::max)(count, MIN_FRAMES_IN_FLIGHT), MAX_FRAMES_IN_FLIGHT);
+	statistics.framesInFlight = framesInFlight;
+}
+
+void Graphic::FramePacer::SetFrameRateLimit(float framesPerSecond)
+{
+	frameRateLimit = (std::max)(framesPerSecond, 0.f);
+	started = false;
+}
+
+void Graphic::FramePacer::SetVSync(VSync mode)
+{
+	vsync = mode;
+	vsyncDirty = true;
+}
+
+void Graphic::FramePacer::BeginFrame()
+{
+	ApplyVSync();
+
+	/**
+	*	the limiter keeps a fixed cadence of deadlines, it restarts after a frame missed its deadline by a whole period
+	*/
+	Clock::time_point waitBegin = Clock::now();
+	if (frameRateLimit > 0.f) {
+		const Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / frameRateLimit));
+		if (!started || waitBegin > deadline + period) {
+			deadline = waitBegin;
+		}
+		WaitUntil(deadline);
+		deadline += period;
+	}
+	Clock::time_point waitEnd = Clock::now();
+	statistics.limiterWaitMilliseconds = Milliseconds(waitEnd - waitBegin);
+
+	// the frame about to be recorded is in flight as well
+	waitBegin = waitEnd;
+	while (!fences.empty() && fences.size() >= framesInFlight) {
+		WaitForFence(fences.front());
+		GLDeleteSync(fences.front());
+		fences.pop_front();
+	}
+	waitEnd = Clock::now();
+	statistics.fenceWaitMilliseconds = Milliseconds(waitEnd - waitBegin);
+
+	statistics.frameMilliseconds = started ? Milliseconds(waitEnd - frameBegin) : 0.f;
+	frameBegin = waitEnd;
+	started = true;
+}
+
+void Graphic::FramePacer::Present(GLFWwindow* window)
+{
+	const Clock::time_point swapBegin = Clock::now();
+	if (window) {
+		glfwSwapBuffers(window);
+	}
+	statistics.swapMilliseconds = Milliseconds(Clock::now() - swapBegin);
+
+	fences.push_back(GLFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+}
+
+GLuint Graphic::FramePacer::GetFramesInFlight() const
+{
+	return framesInFlight;
+}
+
+float Graphic::FramePacer::GetFrameRateLimit() const
+{
+	return frameRateLimit;
+}
+
+Graphic::FramePacer::VSync Graphic::FramePacer::GetVSync() const
+{
+	return vsync;
+}
+
+const Graphic::FramePacer::Statistics& Graphic::FramePacer::GetStatistics() const
+{
+	return statistics;
+}
+
+void Graphic::FramePacer::ApplyVSync()
+{
+	if (!vsyncDirty || glfwGetCurrentContext() == nullptr) {
+		return;
+	}
+	vsyncDirty = false;
+
+	int interval = vsync == VSync::OFF ? 0 : 1;
+	if (vsync == VSync::ADAPTIVE) {
+		if (glfwExtensionSupported("WGL_EXT_swap_control_tear") || glfwExtensionSupported("GLX_EXT_swap_control_tear")) {
+			interval = -1;
+		}
+		else {
+			Debug::ShowMessage("Graphic::FramePacer: adaptive vsync is not supported, vsync is on instead.");
+		}
+	}
+	glfwSwapInterval(interval);
+}
+
+void Graphic::FramePacer::WaitForFence(GLsync fence)
+{
+	GLbitfield waitFlags = 0;
+	GLuint64 timeout = 0;
+	while (true) {
+		GLenum result = GLClientWaitSync(fence, waitFlags, timeout);
+		if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED) {
+			break;
+		}
+		// flush once, then block
+		waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		timeout = 1000000000ull;
+	}
+}
+
+void Graphic::FramePacer::WaitUntil(Clock::time_point time)
+{
+	/**
+	*	sleep most of the time away, the scheduler wakes up late by up to a timer period, so the rest is spun
+	*/
+	const Clock::duration spin = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(SPIN_MILLISECONDS));
+	Clock::duration remaining = time - Clock::now();
+	if (remaining > spin) {
+		const Clock::duration sleep = remaining - spin;
+#ifdef _WIN32
+		if (waitTimer) {
+			// relative due time in 100 nanosecond units
+			LARGE_INTEGER dueTime;
+			dueTime.QuadPart = -static_cast<LONGLONG>(std::chrono::duration_cast<std::chrono::nanoseconds>(sleep).count() / 100);
+			if (SetWaitableTimer(waitTimer, &dueTime, 0, nullptr, nullptr, FALSE)) {
+				WaitForSingleObject(waitTimer, INFINITE);
+			}
+		}
+		else {
+			std::this_thread::sleep_for(sleep);
+		}
+#else
+		std::this_thread::sleep_for(sleep);
+#endif
+	}
+
+	while (Clock::now() < time) {
+		YieldProcessor();
+	}
+}
+
+float Graphic::FramePacer::Milliseconds(Clock::duration duration)
+{
+	return std::chrono::duration<float, std::milli>(duration).count();
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include "Utility.h"
+
+#include <chrono>
+#include <deque>
+
+namespace Graphic
+{
+	class FramePacer;
+}
+
+/**
+*	\description: class FramePacer: paces the frames of the window loop. At most N frames are in flight, a fence is
+*	inserted after each swap and the CPU waits for the oldest one before it starts a new frame, so it neither runs
+*	ahead of the GPU by a queue of frames nor stalls inside the driver at random points.
+*
+*	\detail: the optional frame rate limiter sleeps on a high resolution waitable timer until SPIN_MILLISECONDS before
+*	the deadline and spins for the rest. Swap interval changes are applied at the beginning of the next frame, on the
+*	thread owning the context.
+*/
+class Graphic::FramePacer
+{
+public:
+	static constexpr GLuint MIN_FRAMES_IN_FLIGHT = 1;
+	static constexpr GLuint MAX_FRAMES_IN_FLIGHT = 3;	///< stream buffers keep this many regions
+	static constexpr double SPIN_MILLISECONDS = 1.5;	///< timer wake up jitter covered by spinning
+
+	enum class VSync
+	{
+		OFF,		///< swap interval 0, tearing
+		ON,			///< swap interval 1
+		ADAPTIVE	///< swap interval -1, tears only when a frame misses the vblank, ON without the extension
+	};
+
+	/**
+	*	CPU time spent waiting in a frame, in milliseconds
+	*/
+	struct Statistics
+	{
+		float fenceWaitMilliseconds;	///< blocked on the frame which left the flight window
+		float limiterWaitMilliseconds;	///< idle in the frame rate limiter
+		float swapMilliseconds;			///< inside the swap, includes vsync blocking
+		float frameMilliseconds;		///< from the beginning of the previous frame
+		GLuint framesInFlight;
+	};
+
+	FramePacer(GLuint framesInFlight = 2);
+	FramePacer(const FramePacer& framePacer) = delete;
+	~FramePacer();
+
+	void SetFramesInFlight(GLuint count);
+	void SetFrameRateLimit(float framesPerSecond); ///< 0 disables the limiter
+	void SetVSync(VSync mode);
+
+	void BeginFrame();					///< before the CPU work of a frame
+	void Present(GLFWwindow* window);	///< swaps and fences the frame, window is null when there is nothing to swap
+
+	GLuint GetFramesInFlight() const;
+	float GetFrameRateLimit() const;
+	VSync GetVSync() const;
+	const Statistics& GetStatistics() const;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	GLuint framesInFlight;
+	float frameRateLimit;
+	VSync vsync;
+	bool vsyncDirty;
+
+	std::deque<GLsync> fences;	///< of the frames the GPU may still work on, oldest first
+	Clock::time_point frameBegin;
+	Clock::time_point deadline;	///< of the next frame when limited
+	bool started;
+
+#ifdef _WIN32
+	HANDLE waitTimer;	///< null if high resolution waitable timers are unsupported
+#else
+	void* waitTimer;	///< always null, std::this_thread::sleep_for() is precise enough
+#endif
+	Statistics statistics;
+
+	void ApplyVSync();
+	void WaitForFence(GLsync fence);
+	void WaitUntil(Clock::time_point time);
+
+	static float Milliseconds(Clock::duration duration);
+};
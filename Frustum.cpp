@@ -0,0 +1,105 @@
+#include "Frustum.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define FRUSTUM_SSE
+#include <emmintrin.h>
+#endif
+
+Graphic::Frustum::Frustum()
+{
+	// clip space cube, what is drawn with an identity view projection
+	Extract(glm::mat4(1.f));
+}
+
+Graphic::Frustum::Frustum(const glm::mat4& viewProjection)
+{
+	Extract(viewProjection);
+}
+
+void Graphic::Frustum::Extract(const glm::mat4& viewProjection)
+{
+	/**
+	*	Gribb-Hartmann, planes are sums of the rows, glm matrices are column major
+	*/
+	auto row = [&viewProjection](int index) {
+		return glm::vec4(viewProjection[0][index], viewProjection[1][index], viewProjection[2][index], viewProjection[3][index]);
+	};
+
+	planes[PLANE_LEFT] = row(3) + row(0);
+	planes[PLANE_RIGHT] = row(3) - row(0);
+	planes[PLANE_BOTTOM] = row(3) + row(1);
+	planes[PLANE_TOP] = row(3) - row(1);
+	planes[PLANE_NEAR] = row(3) + row(2);
+	planes[PLANE_FAR] = row(3) - row(2);
+
+	for (glm::vec4& plane : planes) {
+		float length = glm::length(glm::vec3(plane));
+		if (length > 0.f) {
+			plane /= length;
+		}
+	}
+}
+
+const glm::vec4& Graphic::Frustum::GetPlane(PlaneIndex index) const
+{
+	return planes[index];
+}
+
+bool Graphic::Frustum::IntersectsSphere(const glm::vec3& center, float radius) const
+{
+	for (const glm::vec4& plane : planes) {
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+			return false;
+		}
+	}
+	return true;
+}
+
+size_t Graphic::Frustum::CullSpheres(const float* x, const float* y, const float* z, const float* radius, size_t count,
+	uint8_t* visible) const
+{
+	size_t visibleCount = 0;
+	size_t i = 0;
+
+#if defined(FRUSTUM_SSE)
+	__m128 planeX[PLANE_COUNT];
+	__m128 planeY[PLANE_COUNT];
+	__m128 planeZ[PLANE_COUNT];
+	__m128 planeW[PLANE_COUNT];
+	for (int p = 0; p < PLANE_COUNT; ++p) {
+		planeX[p] = _mm_set1_ps(planes[p].x);
+		planeY[p] = _mm_set1_ps(planes[p].y);
+		planeZ[p] = _mm_set1_ps(planes[p].z);
+		planeW[p] = _mm_set1_ps(planes[p].w);
+	}
+
+	for (; i + 4 <= count; i += 4) {
+		const __m128 centerX = _mm_loadu_ps(x + i);
+		const __m128 centerY = _mm_loadu_ps(y + i);
+		const __m128 centerZ = _mm_loadu_ps(z + i);
+		const __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+
+		// a sphere is outside if it is behind any plane by more than its radius
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < PLANE_COUNT; ++p) {
+			__m128 distance = _mm_add_ps(_mm_mul_ps(planeX[p], centerX), planeW[p]);
+			distance = _mm_add_ps(distance, _mm_mul_ps(planeY[p], centerY));
+			distance = _mm_add_ps(distance, _mm_mul_ps(planeZ[p], centerZ));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+		}
+
+		const int mask = _mm_movemask_ps(inside);
+		for (int k = 0; k < 4; ++k) {
+			visible[i + k] = static_cast<uint8_t>((mask >> k) & 1);
+			visibleCount += visible[i + k];
+		}
+	}
+#endif
+
+	for (; i < count; ++i) {
+		visible[i] = IntersectsSphere(glm::vec3(x[i], y[i], z[i]), radius[i]) ? 1 : 0;
+		visibleCount += visible[i];
+	}
+
+	return visibleCount;
+}
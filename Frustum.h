@@ -0,0 +1,41 @@
+#pragma once
+#include "Utility.h"
+
+namespace Graphic
+{
+	class Frustum;
+}
+
+/**
+*	\description: class Frustum: six planes extracted from a view projection matrix, the normals point inside.
+*	CullSpheres() tests bounding spheres in structure-of-arrays layout, four at a time with SSE.
+*/
+class Graphic::Frustum
+{
+public:
+	enum PlaneIndex
+	{
+		PLANE_LEFT,
+		PLANE_RIGHT,
+		PLANE_BOTTOM,
+		PLANE_TOP,
+		PLANE_NEAR,
+		PLANE_FAR,
+
+		PLANE_COUNT
+	};
+
+	Frustum();
+	explicit Frustum(const glm::mat4& viewProjection);
+
+	void Extract(const glm::mat4& viewProjection);
+	const glm::vec4& GetPlane(PlaneIndex index) const;
+
+	bool IntersectsSphere(const glm::vec3& center, float radius) const;
+	size_t CullSpheres(const float* x, const float* y, const float* z, const float* radius, size_t count,
+		uint8_t* visible) const; ///< visible[i] is 1 if sphere i intersects the frustum, returns the visible count
+
+private:
+	glm::vec4 planes[PLANE_COUNT];	///< xyz normal, w distance
+
+};
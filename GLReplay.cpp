@@ -0,0 +1,869 @@
+#include "GLReplay.h"
+#include "Debug.h"
+
+#include <iomanip>
+
+Graphic::GLReplay::GLReplay()
+	:trace(), finishEachCall(false), buffers(), textures(), vertexArrays(), framebuffers(), renderbuffers(), shaders(),
+	programs(), locations(), handles(), currentProgram(0), defaultFramebuffer(0), defaultColor(0), defaultDepth(0),
+	arguments(nullptr), payload(nullptr), payloadSize(0), alignedPayload(), patchedPayload(), queries(), usedQueries(0),
+	sectionStack(), closedSections(), frameSection(), inFrame(false), setupMilliseconds(0.0),
+	callStatistics(static_cast<size_t>(GLTrace::Call::COUNT), CallStatistics{ 0, 0.0, 0.0 }), frames(), sections(),
+	slowestCalls()
+{
+}
+
+Graphic::GLReplay::~GLReplay()
+{
+	if (glfwGetCurrentContext() == nullptr) {
+		return;
+	}
+	if (!queries.empty()) {
+		glDeleteQueries(static_cast<GLsizei>(queries.size()), queries.data());
+	}
+	if (defaultFramebuffer != 0) {
+		glDeleteFramebuffers(1, &defaultFramebuffer);
+		glDeleteRenderbuffers(1, &defaultColor);
+		glDeleteRenderbuffers(1, &defaultDepth);
+	}
+}
+
+bool Graphic::GLReplay::Load(const char* path)
+{
+	if (!GLTrace::Load(path, trace)) {
+		return false;
+	}
+	// a record with fewer arguments than its call reads zeros instead of the next record
+	trace.arguments.resize(trace.arguments.size() + GLTrace::MAX_ARGUMENTS, 0);
+	return true;
+}
+
+void Graphic::GLReplay::GetFramebufferSize(GLsizei& width, GLsizei& height) const
+{
+	width = 1;
+	height = 1;
+	for (const GLTrace::CallRecord& record : trace.records) {
+		if (record.call == GLTrace::Call::BEGIN_FRAME && record.argumentCount >= 2) {
+			width = (std::max)(static_cast<GLsizei>(trace.arguments[record.firstArgument]), 1);
+			height = (std::max)(static_cast<GLsizei>(trace.arguments[record.firstArgument + 1]), 1);
+			return;
+		}
+	}
+}
+
+void Graphic::GLReplay::SetFinishEachCall(bool finish)
+{
+	finishEachCall = finish;
+}
+
+void Graphic::GLReplay::Run()
+{
+	if (glfwGetCurrentContext() == nullptr) {
+		throw std::runtime_error("Exception: Graphic::GLReplay::Run(): No current context!");
+	}
+
+	GLsizei width = 1;
+	GLsizei height = 1;
+	GetFramebufferSize(width, height);
+	glGenRenderbuffers(1, &defaultColor);
+	glBindRenderbuffer(GL_RENDERBUFFER, defaultColor);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glGenRenderbuffers(1, &defaultDepth);
+	glBindRenderbuffer(GL_RENDERBUFFER, defaultDepth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glGenFramebuffers(1, &defaultFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, defaultColor);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, defaultDepth);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		throw std::runtime_error("Exception: Graphic::GLReplay::Run(): Default framebuffer is incomplete!");
+	}
+	glViewport(0, 0, width, height);
+	while (glGetError() != GL_NO_ERROR);
+
+	const Clock::time_point setupBegin = Clock::now();
+	bool setup = true;
+	for (size_t index = 0; index < trace.records.size(); ++index) {
+		const GLTrace::CallRecord& record = trace.records[index];
+		arguments = trace.arguments.data() + record.firstArgument;
+		payload = trace.data.data() + record.payload;
+		payloadSize = record.payloadSize;
+
+		switch (record.call)
+		{
+		case GLTrace::Call::BEGIN_FRAME:
+			if (setup) {
+				glFinish();
+				setupMilliseconds = Elapsed(setupBegin, Clock::now());
+				setup = false;
+			}
+			BeginFrame();
+			break;
+
+		case GLTrace::Call::END_FRAME:
+			EndFrame();
+			break;
+
+		case GLTrace::Call::BEGIN_SECTION:
+			BeginSection();
+			break;
+
+		case GLTrace::Call::END_SECTION:
+			EndSection();
+			break;
+
+		default:
+			if (!inFrame) {
+				Issue(record.call);
+				break;
+			}
+			else {
+				const Clock::time_point begin = Clock::now();
+				Issue(record.call);
+				if (finishEachCall) {
+					glFinish();
+				}
+				AddCallTime(index, record.call, Elapsed(begin, Clock::now()));
+			}
+			break;
+		}
+	}
+	if (setup) {
+		glFinish();
+		setupMilliseconds = Elapsed(setupBegin, Clock::now());
+	}
+}
+
+void Graphic::GLReplay::Report(std::ostream& stream) const
+{
+	stream << std::fixed << std::setprecision(3);
+	stream << "GLReplay: " << trace.records.size() << " records, " << frames.size() << " frames, setup "
+		<< setupMilliseconds << " ms" << (finishEachCall ? ", finished after each call" : "") << "\n\n";
+
+	stream << "frame\tcalls\tcpu ms\tgpu ms\terrors\n";
+	for (size_t frame = 0; frame < frames.size(); ++frame) {
+		const FrameResult& result = frames[frame];
+		stream << frame << "\t" << result.calls << "\t" << result.cpuMilliseconds << "\t" << result.gpuMilliseconds << "\t"
+			<< result.errors << "\n";
+	}
+
+	/**
+	*	sections of the same name and depth are averaged over the frames, in order of first appearance
+	*/
+	struct SectionSummary
+	{
+		std::string name;
+		uint32_t depth;
+		uint32_t count;
+		double cpuMilliseconds;
+		double gpuMilliseconds;
+		double maxGpuMilliseconds;
+	};
+	std::vector<SectionSummary> summaries;
+	for (const SectionResult& section : sections) {
+		auto summary = std::find_if(summaries.begin(), summaries.end(), [&section](const SectionSummary& candidate) {
+			return candidate.depth == section.depth && candidate.name == section.name;
+		});
+		if (summary == summaries.end()) {
+			summaries.push_back(SectionSummary{ section.name, section.depth, 0, 0.0, 0.0, 0.0 });
+			summary = summaries.end() - 1;
+		}
+		summary->count++;
+		summary->cpuMilliseconds += section.cpuMilliseconds;
+		summary->gpuMilliseconds += section.gpuMilliseconds;
+		summary->maxGpuMilliseconds = (std::max)(summary->maxGpuMilliseconds, section.gpuMilliseconds);
+	}
+	stream << "\nsection\tcount\tcpu ms\tgpu ms\tmax gpu ms\n";
+	for (const SectionSummary& summary : summaries) {
+		stream << std::string(summary.depth * 2, ' ') << summary.name << "\t" << summary.count << "\t"
+			<< summary.cpuMilliseconds / summary.count << "\t" << summary.gpuMilliseconds / summary.count << "\t"
+			<< summary.maxGpuMilliseconds << "\n";
+	}
+
+	stream << "\ncall\tcount\ttotal ms\taverage us\tmax us\n";
+	for (size_t call = 0; call < callStatistics.size(); ++call) {
+		const CallStatistics& statistics = callStatistics[call];
+		if (statistics.count == 0) {
+			continue;
+		}
+		stream << GLTrace::GetName(static_cast<GLTrace::Call>(call)) << "\t" << statistics.count << "\t"
+			<< statistics.milliseconds << "\t" << statistics.milliseconds * 1000.0 / statistics.count << "\t"
+			<< statistics.maxMilliseconds * 1000.0 << "\n";
+	}
+
+	stream << "\nslowest calls\nrecord\tframe\tcall\tus\n";
+	for (const SlowCall& slowCall : slowestCalls) {
+		stream << slowCall.record << "\t" << slowCall.frame << "\t" << GLTrace::GetName(slowCall.call) << "\t"
+			<< slowCall.milliseconds * 1000.0 << "\n";
+	}
+	stream.flush();
+}
+
+bool Graphic::GLReplay::Dump(const char* path) const
+{
+	std::ofstream file(path);
+	if (!file.is_open()) {
+		std::string message = "Graphic::GLReplay::Dump(): open " + std::string(path) + " failed.";
+		Debug::ShowMessage(message.c_str());
+		return false;
+	}
+
+	file << "frame,depth,section,cpu ms,gpu ms\n";
+	for (const SectionResult& section : sections) {
+		file << section.frame << "," << section.depth << "," << section.name << "," << section.cpuMilliseconds << ","
+			<< section.gpuMilliseconds << "\n";
+	}
+
+	return file.good();
+}
+
+const std::vector<Graphic::GLReplay::FrameResult>& Graphic::GLReplay::GetFrames() const
+{
+	return frames;
+}
+
+const std::vector<Graphic::GLReplay::SectionResult>& Graphic::GLReplay::GetSections() const
+{
+	return sections;
+}
+
+void Graphic::GLReplay::Issue(GLTrace::Call call)
+{
+	typedef GLTrace::Call Call;
+
+	switch (call)
+	{
+	// state
+	case Call::ENABLE:
+		glEnable(Uint(0));
+		break;
+
+	case Call::DISABLE:
+		glDisable(Uint(0));
+		break;
+
+	case Call::DEPTH_FUNC:
+		glDepthFunc(Uint(0));
+		break;
+
+	case Call::DEPTH_MASK:
+		glDepthMask(static_cast<GLboolean>(Uint(0)));
+		break;
+
+	case Call::COLOR_MASK:
+		glColorMask(static_cast<GLboolean>(Uint(0)), static_cast<GLboolean>(Uint(1)), static_cast<GLboolean>(Uint(2)),
+			static_cast<GLboolean>(Uint(3)));
+		break;
+
+	case Call::BLEND_FUNC:
+		glBlendFunc(Uint(0), Uint(1));
+		break;
+
+	case Call::VIEWPORT:
+		glViewport(Int(0), Int(1), Int(2), Int(3));
+		break;
+
+	case Call::CLEAR_COLOR:
+		glClearColor(Float(0), Float(1), Float(2), Float(3));
+		break;
+
+	case Call::CLEAR:
+		glClear(Uint(0));
+		break;
+
+	case Call::PIXEL_STORE:
+		glPixelStorei(Uint(0), Int(1));
+		break;
+
+	// texture
+	case Call::GEN_TEXTURES:
+		Generate(textures, glGenTextures);
+		break;
+
+	case Call::DELETE_TEXTURES:
+		Delete(textures, glDeleteTextures);
+		break;
+
+	case Call::ACTIVE_TEXTURE:
+		glActiveTexture(Uint(0));
+		break;
+
+	case Call::BIND_TEXTURE:
+		glBindTexture(Uint(0), Name(textures, Uint(1)));
+		break;
+
+	case Call::TEX_IMAGE_2D:
+		glTexImage2D(Uint(0), Int(1), Int(2), Int(3), Int(4), Int(5), Uint(6), Uint(7), Data());
+		break;
+
+	case Call::TEX_STORAGE_2D:
+		glTexStorage2D(Uint(0), Int(1), Uint(2), Int(3), Int(4));
+		break;
+
+	case Call::TEX_STORAGE_3D:
+		glTexStorage3D(Uint(0), Int(1), Uint(2), Int(3), Int(4), Int(5));
+		break;
+
+	case Call::TEX_SUB_IMAGE_2D:
+		glTexSubImage2D(Uint(0), Int(1), Int(2), Int(3), Int(4), Int(5), Uint(6), Uint(7), Data());
+		break;
+
+	case Call::TEX_SUB_IMAGE_3D:
+		glTexSubImage3D(Uint(0), Int(1), Int(2), Int(3), Int(4), Int(5), Int(6), Int(7), Uint(8), Uint(9), Data());
+		break;
+
+	case Call::TEX_PARAMETER_I:
+		glTexParameteri(Uint(0), Uint(1), Int(2));
+		break;
+
+	case Call::GENERATE_MIPMAP:
+		glGenerateMipmap(Uint(0));
+		break;
+
+	case Call::GET_TEXTURE_HANDLE:
+		if (GLEW_ARB_bindless_texture) {
+			handles[Wide(1)] = glGetTextureHandleARB(Name(textures, Uint(0)));
+		}
+		break;
+
+	case Call::MAKE_TEXTURE_HANDLE_RESIDENT:
+		if (GLEW_ARB_bindless_texture) {
+			glMakeTextureHandleResidentARB(Handle(Wide(0)));
+		}
+		break;
+
+	case Call::MAKE_TEXTURE_HANDLE_NON_RESIDENT:
+		if (GLEW_ARB_bindless_texture) {
+			glMakeTextureHandleNonResidentARB(Handle(Wide(0)));
+		}
+		break;
+
+	// buffer and vertex array
+	case Call::GEN_BUFFERS:
+		Generate(buffers, glGenBuffers);
+		break;
+
+	case Call::DELETE_BUFFERS:
+		Delete(buffers, glDeleteBuffers);
+		break;
+
+	case Call::BIND_BUFFER:
+		glBindBuffer(Uint(0), Name(buffers, Uint(1)));
+		break;
+
+	case Call::BIND_BUFFER_BASE:
+		glBindBufferBase(Uint(0), Uint(1), Name(buffers, Uint(2)));
+		break;
+
+	case Call::BUFFER_DATA:
+		glBufferData(Uint(0), static_cast<GLsizeiptr>(Wide(1)), Data(), Uint(2));
+		break;
+
+	case Call::BUFFER_SUB_DATA:
+		glBufferSubData(Uint(0), static_cast<GLintptr>(Wide(1)), static_cast<GLsizeiptr>(Wide(2)), Data());
+		break;
+
+	case Call::BUFFER_STORAGE:
+		// mapped writes of the capture arrive as buffer contents
+		glBufferStorage(Uint(0), static_cast<GLsizeiptr>(Wide(1)), Data(), Uint(2) | GL_DYNAMIC_STORAGE_BIT);
+		break;
+
+	case Call::BUFFER_CONTENTS:
+		glBindBuffer(GL_COPY_WRITE_BUFFER, Name(buffers, Uint(0)));
+		glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(Wide(1)), static_cast<GLsizeiptr>(Wide(2)), Data());
+		break;
+
+	case Call::GEN_VERTEX_ARRAYS:
+		Generate(vertexArrays, glGenVertexArrays);
+		break;
+
+	case Call::DELETE_VERTEX_ARRAYS:
+		Delete(vertexArrays, glDeleteVertexArrays);
+		break;
+
+	case Call::BIND_VERTEX_ARRAY:
+		glBindVertexArray(Name(vertexArrays, Uint(0)));
+		break;
+
+	case Call::ENABLE_VERTEX_ATTRIB_ARRAY:
+		glEnableVertexAttribArray(Uint(0));
+		break;
+
+	case Call::VERTEX_ATTRIB_POINTER:
+		glVertexAttribPointer(Uint(0), Int(1), Uint(2), static_cast<GLboolean>(Uint(3)), Int(4), Offset(5));
+		break;
+
+	case Call::VERTEX_ATTRIB_DIVISOR:
+		glVertexAttribDivisor(Uint(0), Uint(1));
+		break;
+
+	// framebuffer
+	case Call::GEN_FRAMEBUFFERS:
+		Generate(framebuffers, glGenFramebuffers);
+		break;
+
+	case Call::DELETE_FRAMEBUFFERS:
+		Delete(framebuffers, glDeleteFramebuffers);
+		break;
+
+	case Call::BIND_FRAMEBUFFER:
+		glBindFramebuffer(Uint(0), Framebuffer(Uint(1)));
+		break;
+
+	case Call::FRAMEBUFFER_TEXTURE_2D:
+		glFramebufferTexture2D(Uint(0), Uint(1), Uint(2), Name(textures, Uint(3)), Int(4));
+		break;
+
+	case Call::FRAMEBUFFER_RENDERBUFFER:
+		glFramebufferRenderbuffer(Uint(0), Uint(1), Uint(2), Name(renderbuffers, Uint(3)));
+		break;
+
+	case Call::DRAW_BUFFER:
+		// the back buffer of the capture is the color attachment of the offscreen default
+		glDrawBuffer(Uint(0) == GL_BACK ? GL_COLOR_ATTACHMENT0 : Uint(0));
+		break;
+
+	case Call::DRAW_BUFFERS:
+		glDrawBuffers(Int(0), reinterpret_cast<const GLenum*>(Floats()));
+		break;
+
+	case Call::GEN_RENDERBUFFERS:
+		Generate(renderbuffers, glGenRenderbuffers);
+		break;
+
+	case Call::DELETE_RENDERBUFFERS:
+		Delete(renderbuffers, glDeleteRenderbuffers);
+		break;
+
+	case Call::BIND_RENDERBUFFER:
+		glBindRenderbuffer(Uint(0), Name(renderbuffers, Uint(1)));
+		break;
+
+	case Call::RENDERBUFFER_STORAGE:
+		glRenderbufferStorage(Uint(0), Uint(1), Int(2), Int(3));
+		break;
+
+	// shader
+	case Call::CREATE_SHADER:
+		shaders[Uint(1)] = glCreateShader(Uint(0));
+		break;
+
+	case Call::SHADER_SOURCE:
+	{
+		const GLchar* source = reinterpret_cast<const GLchar*>(payload);
+		const GLint length = static_cast<GLint>(payloadSize);
+		glShaderSource(Name(shaders, Uint(0)), 1, &source, &length);
+		break;
+	}
+
+	case Call::COMPILE_SHADER:
+		glCompileShader(Name(shaders, Uint(0)));
+		break;
+
+	case Call::CREATE_PROGRAM:
+		programs[Uint(0)] = glCreateProgram();
+		break;
+
+	case Call::ATTACH_SHADER:
+		glAttachShader(Name(programs, Uint(0)), Name(shaders, Uint(1)));
+		break;
+
+	case Call::LINK_PROGRAM:
+		glLinkProgram(Name(programs, Uint(0)));
+		break;
+
+	case Call::PROGRAM_UNIFORMS:
+		MapUniforms(Name(programs, Uint(0)));
+		break;
+
+	case Call::DELETE_SHADER:
+		glDeleteShader(Name(shaders, Uint(0)));
+		shaders.erase(Uint(0));
+		break;
+
+	case Call::DELETE_PROGRAM:
+		glDeleteProgram(Name(programs, Uint(0)));
+		programs.erase(Uint(0));
+		break;
+
+	case Call::USE_PROGRAM:
+		currentProgram = Name(programs, Uint(0));
+		glUseProgram(currentProgram);
+		break;
+
+	// uniform
+	case Call::UNIFORM_1I:
+		glUniform1i(Location(currentProgram, Int(0)), Int(1));
+		break;
+
+	case Call::UNIFORM_1F:
+		glUniform1f(Location(currentProgram, Int(0)), Float(1));
+		break;
+
+	case Call::UNIFORM_2F:
+		glUniform2f(Location(currentProgram, Int(0)), Float(1), Float(2));
+		break;
+
+	case Call::UNIFORM_3F:
+		glUniform3f(Location(currentProgram, Int(0)), Float(1), Float(2), Float(3));
+		break;
+
+	case Call::UNIFORM_4F:
+		glUniform4f(Location(currentProgram, Int(0)), Float(1), Float(2), Float(3), Float(4));
+		break;
+
+	case Call::UNIFORM_2FV:
+		glUniform2fv(Location(currentProgram, Int(0)), Int(1), Floats());
+		break;
+
+	case Call::UNIFORM_3FV:
+		glUniform3fv(Location(currentProgram, Int(0)), Int(1), Floats());
+		break;
+
+	case Call::UNIFORM_4FV:
+		glUniform4fv(Location(currentProgram, Int(0)), Int(1), Floats());
+		break;
+
+	case Call::UNIFORM_MATRIX_3FV:
+		glUniformMatrix3fv(Location(currentProgram, Int(0)), Int(1), static_cast<GLboolean>(Uint(2)), Floats());
+		break;
+
+	case Call::UNIFORM_MATRIX_4FV:
+		glUniformMatrix4fv(Location(currentProgram, Int(0)), Int(1), static_cast<GLboolean>(Uint(2)), Floats());
+		break;
+
+	case Call::PROGRAM_UNIFORM_1I:
+	{
+		const GLuint program = Name(programs, Uint(0));
+		glProgramUniform1i(program, Location(program, Int(1)), Int(2));
+		break;
+	}
+
+	case Call::PROGRAM_UNIFORM_1F:
+	{
+		const GLuint program = Name(programs, Uint(0));
+		glProgramUniform1f(program, Location(program, Int(1)), Float(2));
+		break;
+	}
+
+	case Call::PROGRAM_UNIFORM_2FV:
+	{
+		const GLuint program = Name(programs, Uint(0));
+		glProgramUniform2fv(program, Location(program, Int(1)), Int(2), Floats());
+		break;
+	}
+
+	case Call::PROGRAM_UNIFORM_3FV:
+	{
+		const GLuint program = Name(programs, Uint(0));
+		glProgramUniform3fv(program, Location(program, Int(1)), Int(2), Floats());
+		break;
+	}
+
+	case Call::PROGRAM_UNIFORM_4FV:
+	{
+		const GLuint program = Name(programs, Uint(0));
+		glProgramUniform4fv(program, Location(program, Int(1)), Int(2), Floats());
+		break;
+	}
+
+	case Call::PROGRAM_UNIFORM_MATRIX_3FV:
+	{
+		const GLuint program = Name(programs, Uint(0));
+		glProgramUniformMatrix3fv(program, Location(program, Int(1)), Int(2), static_cast<GLboolean>(Uint(3)), Floats());
+		break;
+	}
+
+	case Call::PROGRAM_UNIFORM_MATRIX_4FV:
+	{
+		const GLuint program = Name(programs, Uint(0));
+		glProgramUniformMatrix4fv(program, Location(program, Int(1)), Int(2), static_cast<GLboolean>(Uint(3)), Floats());
+		break;
+	}
+
+	// draw
+	case Call::DRAW_ARRAYS:
+		glDrawArrays(Uint(0), Int(1), Int(2));
+		break;
+
+	case Call::DRAW_ARRAYS_INSTANCED:
+		glDrawArraysInstanced(Uint(0), Int(1), Int(2), Int(3));
+		break;
+
+	case Call::DRAW_ELEMENTS:
+		glDrawElements(Uint(0), Int(1), Uint(2), Offset(3));
+		break;
+
+	case Call::DRAW_ELEMENTS_INSTANCED:
+		glDrawElementsInstanced(Uint(0), Int(1), Uint(2), Offset(3), Int(4));
+		break;
+
+	case Call::DRAW_ELEMENTS_INSTANCED_BASE_INSTANCE:
+		glDrawElementsInstancedBaseInstance(Uint(0), Int(1), Uint(2), Offset(3), Int(4), Uint(5));
+		break;
+
+	case Call::MULTI_DRAW_ELEMENTS_INDIRECT:
+		glMultiDrawElementsIndirect(Uint(0), Uint(1), Offset(2), Int(3), Int(4));
+		break;
+
+	default:
+		throw std::runtime_error("Exception: Graphic::GLReplay::Issue(): Unknown call!");
+		break;
+	}
+}
+
+void Graphic::GLReplay::BeginFrame()
+{
+	if (inFrame) {
+		EndFrame();
+	}
+	frames.push_back(FrameResult{ 0, 0.0, 0.0, 0 });
+	usedQueries = 0;
+	frameSection = PendingSection{ frames.size() - 1, Query(), 0, Clock::now() };
+	glQueryCounter(frameSection.beginQuery, GL_TIMESTAMP);
+	inFrame = true;
+}
+
+void Graphic::GLReplay::EndFrame()
+{
+	if (!inFrame) {
+		return;
+	}
+	while (!sectionStack.empty()) {
+		EndSection();
+	}
+	frameSection.endQuery = Query();
+	glQueryCounter(frameSection.endQuery, GL_TIMESTAMP);
+
+	/**
+	*	the frame is finished before the next one starts, so the timestamps are available
+	*/
+	glFinish();
+	FrameResult& frame = frames[frameSection.result];
+	frame.cpuMilliseconds = Elapsed(frameSection.begin, Clock::now());
+
+	auto gpuMilliseconds = [](GLuint beginQuery, GLuint endQuery) {
+		GLuint64 begin = 0;
+		GLuint64 end = 0;
+		glGetQueryObjectui64v(beginQuery, GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(endQuery, GL_QUERY_RESULT, &end);
+		return end > begin ? static_cast<double>(end - begin) / 1000000.0 : 0.0;
+	};
+	frame.gpuMilliseconds = gpuMilliseconds(frameSection.beginQuery, frameSection.endQuery);
+	for (const PendingSection& section : closedSections) {
+		sections[section.result].gpuMilliseconds = gpuMilliseconds(section.beginQuery, section.endQuery);
+	}
+	closedSections.clear();
+
+	while (glGetError() != GL_NO_ERROR) {
+		frame.errors++;
+	}
+	inFrame = false;
+}
+
+void Graphic::GLReplay::BeginSection()
+{
+	if (!inFrame) {
+		return;
+	}
+	const std::string name(reinterpret_cast<const char*>(payload), payloadSize);
+	sections.push_back(SectionResult{ name, static_cast<uint32_t>(frames.size() - 1), static_cast<uint32_t>(sectionStack.size()), 0.0, 0.0 });
+
+	PendingSection section = { sections.size() - 1, Query(), 0, Clock::now() };
+	glQueryCounter(section.beginQuery, GL_TIMESTAMP);
+	sectionStack.push_back(section);
+}
+
+void Graphic::GLReplay::EndSection()
+{
+	if (!inFrame || sectionStack.empty()) {
+		return;
+	}
+	PendingSection section = sectionStack.back();
+	sectionStack.pop_back();
+
+	section.endQuery = Query();
+	glQueryCounter(section.endQuery, GL_TIMESTAMP);
+	sections[section.result].cpuMilliseconds = Elapsed(section.begin, Clock::now());
+	closedSections.push_back(section);
+}
+
+void Graphic::GLReplay::AddCallTime(size_t record, GLTrace::Call call, double milliseconds)
+{
+	CallStatistics& statistics = callStatistics[static_cast<size_t>(call)];
+	statistics.count++;
+	statistics.milliseconds += milliseconds;
+	statistics.maxMilliseconds = (std::max)(statistics.maxMilliseconds, milliseconds);
+	frames.back().calls++;
+
+	// sorted insert into a short list
+	if (slowestCalls.size() == SLOWEST_CALLS && slowestCalls.back().milliseconds >= milliseconds) {
+		return;
+	}
+	SlowCall slowCall = { record, static_cast<uint32_t>(frames.size() - 1), call, milliseconds };
+	auto position = std::upper_bound(slowestCalls.begin(), slowestCalls.end(), slowCall, [](const SlowCall& a, const SlowCall& b) {
+		return a.milliseconds > b.milliseconds;
+	});
+	slowestCalls.insert(position, slowCall);
+	if (slowestCalls.size() > SLOWEST_CALLS) {
+		slowestCalls.pop_back();
+	}
+}
+
+GLuint Graphic::GLReplay::Query()
+{
+	if (usedQueries == queries.size()) {
+		// grow in chunks, queries are reused by every frame
+		const size_t chunk = (std::max)(queries.size(), static_cast<size_t>(64));
+		queries.resize(queries.size() + chunk, 0);
+		glGenQueries(static_cast<GLsizei>(chunk), queries.data() + usedQueries);
+	}
+	return queries[usedQueries++];
+}
+
+double Graphic::GLReplay::Elapsed(Clock::time_point begin, Clock::time_point end)
+{
+	return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+GLuint Graphic::GLReplay::Uint(size_t index) const
+{
+	return static_cast<GLuint>(arguments[index]);
+}
+
+GLint Graphic::GLReplay::Int(size_t index) const
+{
+	return static_cast<GLint>(static_cast<uint32_t>(arguments[index]));
+}
+
+GLfloat Graphic::GLReplay::Float(size_t index) const
+{
+	return GLTrace::UnpackFloat(arguments[index]);
+}
+
+uint64_t Graphic::GLReplay::Wide(size_t index) const
+{
+	return arguments[index];
+}
+
+const void* Graphic::GLReplay::Offset(size_t index) const
+{
+	return reinterpret_cast<const void*>(static_cast<uintptr_t>(arguments[index]));
+}
+
+const void* Graphic::GLReplay::Data()
+{
+	if (payloadSize == 0) {
+		return nullptr;
+	}
+	if (handles.empty() || payloadSize < sizeof(GLuint64)) {
+		return payload;
+	}
+
+	/**
+	*	bindless handles of the capture may sit in any buffer, e.g. the material texture table, 64 bit aligned
+	*/
+	patchedPayload.assign(payload, payload + payloadSize);
+	for (size_t offset = 0; offset + sizeof(GLuint64) <= payloadSize; offset += sizeof(GLuint64)) {
+		GLuint64 value = 0;
+		memcpy(&value, patchedPayload.data() + offset, sizeof(value));
+		auto handle = handles.find(value);
+		if (handle != handles.end()) {
+			memcpy(patchedPayload.data() + offset, &handle->second, sizeof(GLuint64));
+		}
+	}
+	return patchedPayload.data();
+}
+
+const GLfloat* Graphic::GLReplay::Floats()
+{
+	alignedPayload.resize((payloadSize + sizeof(uint64_t) - 1) / sizeof(uint64_t) + 1);
+	if (payloadSize > 0) {
+		memcpy(alignedPayload.data(), payload, payloadSize);
+	}
+	return reinterpret_cast<const GLfloat*>(alignedPayload.data());
+}
+
+void Graphic::GLReplay::Generate(NameMap& names, GenerateNames generate)
+{
+	const GLsizei n = Int(0);
+	if (n <= 0 || payloadSize < n * sizeof(GLuint)) {
+		return;
+	}
+	std::vector<GLuint> captured(n);
+	std::vector<GLuint> replayed(n);
+	memcpy(captured.data(), payload, n * sizeof(GLuint));
+	generate(n, replayed.data());
+	for (GLsizei i = 0; i < n; ++i) {
+		names[captured[i]] = replayed[i];
+	}
+}
+
+void Graphic::GLReplay::Delete(NameMap& names, DeleteNames release)
+{
+	const GLsizei n = Int(0);
+	if (n <= 0 || payloadSize < n * sizeof(GLuint)) {
+		return;
+	}
+	std::vector<GLuint> captured(n);
+	std::vector<GLuint> replayed(n);
+	memcpy(captured.data(), payload, n * sizeof(GLuint));
+	for (GLsizei i = 0; i < n; ++i) {
+		replayed[i] = Name(names, captured[i]);
+		names.erase(captured[i]);
+	}
+	release(n, replayed.data());
+}
+
+void Graphic::GLReplay::MapUniforms(GLuint program)
+{
+	/**
+	*	entries of location, array size and name length followed by the name, see GLTrace::RecordProgramUniforms()
+	*/
+	size_t position = 0;
+	while (position + sizeof(int32_t) * 3 <= payloadSize) {
+		int32_t entry[3] = { 0, 0, 0 };
+		memcpy(entry, payload + position, sizeof(entry));
+		position += sizeof(entry);
+		if (entry[2] < 0 || position + static_cast<size_t>(entry[2]) > payloadSize) {
+			break;
+		}
+		const std::string name(reinterpret_cast<const char*>(payload + position), static_cast<size_t>(entry[2]));
+		position += static_cast<size_t>(entry[2]);
+
+		const GLint location = glGetUniformLocation(program, name.c_str());
+		for (int32_t element = 0; element < (std::max)(entry[1], 1); ++element) {
+			locations[std::make_pair(program, entry[0] + element)] = location < 0 ? -1 : location + element;
+		}
+	}
+}
+
+GLuint Graphic::GLReplay::Name(const NameMap& names, GLuint name) const
+{
+	if (name == 0) {
+		return 0;
+	}
+	auto replayed = names.find(name);
+	return replayed == names.end() ? name : replayed->second;
+}
+
+GLuint Graphic::GLReplay::Framebuffer(GLuint framebuffer) const
+{
+	return framebuffer == 0 ? defaultFramebuffer : Name(framebuffers, framebuffer);
+}
+
+GLint Graphic::GLReplay::Location(GLuint program, GLint location) const
+{
+	if (location < 0) {
+		return location;
+	}
+	auto replayed = locations.find(std::make_pair(program, location));
+	return replayed == locations.end() ? location : replayed->second;
+}
+
+GLuint64 Graphic::GLReplay::Handle(GLuint64 handle) const
+{
+	auto replayed = handles.find(handle);
+	return replayed == handles.end() ? handle : replayed->second;
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include "GLTrace.h"
+
+#include <chrono>
+#include <unordered_map>
+
+namespace Graphic
+{
+	class GLReplay;
+}
+
+/**
+*	\description: class GLReplay: re-issues a trace of Graphic::GLTrace into the current context and times it. Each
+*	call of the captured frames is timed on the CPU, each frame and each section, i.e. the frame graph passes and the
+*	render targets inside them, is timed on the CPU and on the GPU with timestamp queries.
+*
+*	\detail: the calls before the first frame create the resources and are timed as a whole. Object names, uniform
+*	locations and texture handles of the capturing context are mapped to the ones of the replay, the default
+*	framebuffer of the capture is an offscreen framebuffer of the captured size, so no window is presented.
+*	Each frame ends with glFinish(), frames never overlap and the times of two replays compare.
+*/
+class Graphic::GLReplay
+{
+public:
+	static constexpr size_t SLOWEST_CALLS = 16; ///< kept for the report
+
+	struct CallStatistics
+	{
+		uint32_t count;
+		double milliseconds;
+		double maxMilliseconds;
+	};
+
+	struct SectionResult
+	{
+		std::string name;
+		uint32_t frame;
+		uint32_t depth;
+		double cpuMilliseconds;
+		double gpuMilliseconds;
+	};
+
+	struct FrameResult
+	{
+		uint32_t calls;
+		double cpuMilliseconds;
+		double gpuMilliseconds;
+		uint32_t errors; ///< GL errors raised by the frame
+	};
+
+	struct SlowCall
+	{
+		size_t record;
+		uint32_t frame;
+		GLTrace::Call call;
+		double milliseconds;
+	};
+
+	GLReplay();
+	GLReplay(const GLReplay& replay) = delete;
+	~GLReplay();
+
+	bool Load(const char* path);
+	void GetFramebufferSize(GLsizei& width, GLsizei& height) const; ///< of the first captured frame
+
+	void SetFinishEachCall(bool finish); ///< call times include the GPU work of the call, slow but exact
+	void Run(); ///< needs a current context
+
+	void Report(std::ostream& stream) const;
+	bool Dump(const char* path) const; ///< sections of all frames as CSV
+
+	const std::vector<FrameResult>& GetFrames() const;
+	const std::vector<SectionResult>& GetSections() const;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+	typedef std::unordered_map<GLuint, GLuint> NameMap;
+	typedef void (APIENTRY* GenerateNames)(GLsizei n, GLuint* names);
+	typedef void (APIENTRY* DeleteNames)(GLsizei n, const GLuint* names);
+
+	/**
+	*	section waiting for its timestamps
+	*/
+	struct PendingSection
+	{
+		size_t result;
+		GLuint beginQuery;
+		GLuint endQuery;
+		Clock::time_point begin;
+	};
+
+	GLTrace::Trace trace;
+	bool finishEachCall;
+
+	// capturing context to replay
+	NameMap buffers;
+	NameMap textures;
+	NameMap vertexArrays;
+	NameMap framebuffers;
+	NameMap renderbuffers;
+	NameMap shaders;
+	NameMap programs;
+	std::map<std::pair<GLuint, GLint>, GLint> locations; ///< replay program and captured location to replay location
+	std::unordered_map<GLuint64, GLuint64> handles;
+	GLuint currentProgram; ///< of the replay
+
+	// stands in for the window of the capture
+	GLuint defaultFramebuffer;
+	GLuint defaultColor;
+	GLuint defaultDepth;
+
+	// record being issued
+	const uint64_t* arguments;
+	const unsigned char* payload;
+	size_t payloadSize;
+	std::vector<uint64_t> alignedPayload;
+	std::vector<unsigned char> patchedPayload;
+
+	// timing
+	std::vector<GLuint> queries;
+	size_t usedQueries;
+	std::vector<PendingSection> sectionStack;
+	std::vector<PendingSection> closedSections;
+	PendingSection frameSection; ///< result is the frame
+	bool inFrame;
+	double setupMilliseconds;
+	std::vector<CallStatistics> callStatistics; ///< per GLTrace::Call, calls of the frames only
+	std::vector<FrameResult> frames;
+	std::vector<SectionResult> sections;
+	std::vector<SlowCall> slowestCalls; ///< slowest first
+
+	void Issue(GLTrace::Call call);
+	void BeginFrame();
+	void EndFrame();
+	void BeginSection();
+	void EndSection();
+	void AddCallTime(size_t record, GLTrace::Call call, double milliseconds);
+
+	GLuint Query();
+	static double Elapsed(Clock::time_point begin, Clock::time_point end);
+
+	// arguments of the record being issued
+	GLuint Uint(size_t index) const;
+	GLint Int(size_t index) const;
+	GLfloat Float(size_t index) const;
+	uint64_t Wide(size_t index) const;
+	const void* Offset(size_t index) const;
+	const void* Data(); ///< payload, texture handles inside are patched
+	const GLfloat* Floats(); ///< payload, aligned
+
+	void Generate(NameMap& names, GenerateNames generate);
+	void Delete(NameMap& names, DeleteNames release);
+	void MapUniforms(GLuint program);
+	GLuint Name(const NameMap& names, GLuint name) const;
+	GLuint Framebuffer(GLuint framebuffer) const;
+	GLint Location(GLuint program, GLint location) const;
+	GLuint64 Handle(GLuint64 handle) const;
+};
@@ -0,0 +1,86 @@
+#include "GLReplay.h"
+#include "Debug.h"
+
+/**
+*	GLReplay trace.gltrace [--finish] [--csv file.csv]: replays a trace captured with --trace in a hidden window and
+*	prints the times of its frames, sections and calls, --finish times each call with its GPU work
+*/
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		std::cout << "usage: GLReplay trace.gltrace [--finish] [--csv file.csv]" << std::endl;
+		return -1;
+	}
+
+	const char* tracePath = argv[1];
+	bool finishEachCall = false;
+	const char* csvPath = nullptr;
+	for (int i = 2; i < argc; ++i) {
+		std::string argument(argv[i]);
+		if (argument == "--finish") {
+			finishEachCall = true;
+		}
+		else if (argument == "--csv" && i + 1 < argc) {
+			csvPath = argv[++i];
+		}
+	}
+
+	std::unique_ptr<Graphic::GLReplay> replay(new Graphic::GLReplay());
+	try {
+		if (!replay->Load(tracePath)) {
+			std::cout << "GLReplay: open " << tracePath << " failed." << std::endl;
+			return -1;
+		}
+	}
+	catch (const std::exception& e) {
+		std::cout << e.what() << std::endl;
+		return -1;
+	}
+
+	GLsizei width = 1;
+	GLsizei height = 1;
+	replay->GetFramebufferSize(width, height);
+
+	// same context as Window::Init(), the window is never shown
+	if (!glfwInit()) {
+		return -1;
+	}
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, GLFW_VERSION_MAJOR);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, GLFW_VERSION_MINOR);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow* window = glfwCreateWindow(width, height, "GLReplay", nullptr, nullptr);
+	if (window == nullptr) {
+		glfwTerminate();
+		return -1;
+	}
+	glfwMakeContextCurrent(window);
+	glfwSwapInterval(0);
+
+	glewExperimental = true;
+	if (glewInit() != GLEW_OK) {
+		glfwDestroyWindow(window);
+		glfwTerminate();
+		return -1;
+	}
+
+	int result = 0;
+	try {
+		replay->SetFinishEachCall(finishEachCall);
+		replay->Run();
+		replay->Report(std::cout);
+		if (csvPath && !replay->Dump(csvPath)) {
+			result = -1;
+		}
+	}
+	catch (const std::exception& e) {
+		std::cout << e.what() << std::endl;
+		result = -1;
+	}
+
+	// GL objects of the replay go before the context
+	replay.reset();
+	glfwDestroyWindow(window);
+	glfwTerminate();
+
+	return result;
+}
@@ -0,0 +1,365 @@
+#include "GLTrace.h"
+#include "Debug.h"
+
+namespace
+{
+	const char* const CALL_NAMES[] = {
+		"glEnable", "glDisable", "glDepthFunc", "glDepthMask", "glColorMask", "glBlendFunc", "glViewport", "glClearColor",
+		"glClear", "glPixelStorei",
+
+		"glGenTextures", "glDeleteTextures", "glActiveTexture", "glBindTexture", "glTexImage2D", "glTexStorage2D",
+		"glTexStorage3D", "glTexSubImage2D", "glTexSubImage3D", "glTexParameteri", "glGenerateMipmap",
+		"glGetTextureHandleARB", "glMakeTextureHandleResidentARB", "glMakeTextureHandleNonResidentARB",
+
+		"glGenBuffers", "glDeleteBuffers", "glBindBuffer", "glBindBufferBase", "glBufferData", "glBufferSubData",
+		"glBufferStorage", "BufferContents", "glGenVertexArrays", "glDeleteVertexArrays", "glBindVertexArray",
+		"glEnableVertexAttribArray", "glVertexAttribPointer", "glVertexAttribDivisor",
+
+		"glGenFramebuffers", "glDeleteFramebuffers", "glBindFramebuffer", "glFramebufferTexture2D",
+		"glFramebufferRenderbuffer", "glDrawBuffer", "glDrawBuffers", "glGenRenderbuffers", "glDeleteRenderbuffers",
+		"glBindRenderbuffer", "glRenderbufferStorage",
+
+		"glCreateShader", "glShaderSource", "glCompileShader", "glCreateProgram", "glAttachShader", "glLinkProgram",
+		"ProgramUniforms", "glDeleteShader", "glDeleteProgram", "glUseProgram",
+
+		"glUniform1i", "glUniform1f", "glUniform2f", "glUniform3f", "glUniform4f", "glUniform2fv", "glUniform3fv",
+		"glUniform4fv", "glUniformMatrix3fv", "glUniformMatrix4fv", "glProgramUniform1i", "glProgramUniform1f",
+		"glProgramUniform2fv", "glProgramUniform3fv", "glProgramUniform4fv", "glProgramUniformMatrix3fv",
+		"glProgramUniformMatrix4fv",
+
+		"glDrawArrays", "glDrawArraysInstanced", "glDrawElements", "glDrawElementsInstanced",
+		"glDrawElementsInstancedBaseInstance", "glMultiDrawElementsIndirect",
+
+		"BeginFrame", "EndFrame", "BeginSection", "EndSection"
+	};
+	static_assert(sizeof(CALL_NAMES) / sizeof(CALL_NAMES[0]) == static_cast<size_t>(Graphic::GLTrace::Call::COUNT),
+		"Every GL trace call needs a name!");
+
+	struct CaptureState
+	{
+		std::ofstream file;
+		std::string path;
+		std::vector<unsigned char> buffer;	///< records not written yet
+		bool capturing = false;
+		GLuint frames = 0;					///< to capture, 0 is unlimited
+		GLuint frameIndex = 0;
+		uint64_t records = 0;
+		uint64_t bytes = 0;
+		GLint unpackAlignment = 4;
+	};
+
+	CaptureState g_capture;
+
+	void WriteVarint(std::vector<unsigned char>& buffer, uint64_t value)
+	{
+		while (value >= 0x80) {
+			buffer.push_back(static_cast<unsigned char>(value | 0x80));
+			value >>= 7;
+		}
+		buffer.push_back(static_cast<unsigned char>(value));
+	}
+
+	bool ReadVarint(const std::vector<unsigned char>& data, size_t& position, uint64_t& value)
+	{
+		value = 0;
+		for (uint32_t shift = 0; shift < 64; shift += 7) {
+			if (position >= data.size()) {
+				return false;
+			}
+			const unsigned char byte = data[position++];
+			value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+			if ((byte & 0x80) == 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+bool Graphic::GLTrace::Begin(const char* path, GLuint frames)
+{
+	End();
+
+	g_capture.file.open(path, std::ios::binary | std::ios::trunc);
+	if (!g_capture.file.is_open()) {
+		std::string message = "Graphic::GLTrace::Begin(): open " + std::string(path) + " failed.";
+		Debug::ShowMessage(message.c_str());
+		return false;
+	}
+	const uint32_t header[] = { MAGIC, VERSION };
+	g_capture.file.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+	g_capture.path = path;
+	g_capture.buffer.clear();
+	g_capture.buffer.reserve(FLUSH_SIZE + (FLUSH_SIZE >> 2));
+	g_capture.frames = frames;
+	g_capture.frameIndex = 0;
+	g_capture.records = 0;
+	g_capture.bytes = sizeof(header);
+	g_capture.unpackAlignment = 4;
+	g_capture.capturing = true;
+
+	return true;
+}
+
+void Graphic::GLTrace::End()
+{
+	if (!g_capture.capturing) {
+		return;
+	}
+	Flush();
+	g_capture.file.close();
+	g_capture.capturing = false;
+	std::vector<unsigned char>().swap(g_capture.buffer);
+
+	std::string message = "Graphic::GLTrace::End(): " + std::to_string(g_capture.records) + " calls of " +
+		std::to_string(g_capture.frameIndex) + " frames, " + std::to_string(g_capture.bytes >> 10) + " KB written to " + g_capture.path;
+	Debug::ShowMessage(message.c_str());
+}
+
+bool Graphic::GLTrace::IsCapturing()
+{
+	return g_capture.capturing;
+}
+
+void Graphic::GLTrace::BeginFrame(GLsizei width, GLsizei height)
+{
+	Record(Call::BEGIN_FRAME, width, height);
+}
+
+void Graphic::GLTrace::EndFrame()
+{
+	if (!g_capture.capturing) {
+		return;
+	}
+	Record(Call::END_FRAME);
+	g_capture.frameIndex++;
+	if (g_capture.frames != 0 && g_capture.frameIndex >= g_capture.frames) {
+		End();
+	}
+}
+
+void Graphic::GLTrace::BeginSection(const char* name)
+{
+	RecordData(Call::BEGIN_SECTION, name, name ? strlen(name) : 0);
+}
+
+void Graphic::GLTrace::EndSection()
+{
+	Record(Call::END_SECTION);
+}
+
+void Graphic::GLTrace::RecordProgramUniforms(GLuint program)
+{
+	/**
+	*	location, array size and name of each uniform in the default block, the replayer looks the names up in its
+	*	own program, since locations may differ between drivers
+	*/
+	if (!g_capture.capturing) {
+		return;
+	}
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked != GL_TRUE) {
+		return;
+	}
+
+	GLint count = 0;
+	GLint maxNameLength = 0;
+	glGetProgramInterfaceiv(program, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+	glGetProgramInterfaceiv(program, GL_UNIFORM, GL_MAX_NAME_LENGTH, &maxNameLength);
+
+	std::vector<unsigned char> table;
+	std::vector<GLchar> name(static_cast<size_t>((std::max)(maxNameLength, 1)));
+	for (GLint index = 0; index < count; ++index) {
+		const GLenum properties[] = { GL_LOCATION, GL_ARRAY_SIZE };
+		GLint values[2] = { -1, 1 };
+		glGetProgramResourceiv(program, GL_UNIFORM, index, 2, properties, 2, nullptr, values);
+		if (values[0] < 0) {
+			// member of a block
+			continue;
+		}
+		GLsizei length = 0;
+		glGetProgramResourceName(program, GL_UNIFORM, index, static_cast<GLsizei>(name.size()), &length, name.data());
+
+		const int32_t entry[] = { values[0], values[1], length };
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(entry);
+		table.insert(table.end(), bytes, bytes + sizeof(entry));
+		table.insert(table.end(), name.data(), name.data() + length);
+	}
+
+	RecordData(Call::PROGRAM_UNIFORMS, table.data(), table.size(), program);
+}
+
+void Graphic::GLTrace::SetUnpackAlignment(GLint alignment)
+{
+	g_capture.unpackAlignment = (std::max)(alignment, 1);
+}
+
+size_t Graphic::GLTrace::ImageSize(GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type)
+{
+	size_t components = 4;
+	switch (format)
+	{
+	case GL_RED:
+	case GL_RED_INTEGER:
+	case GL_DEPTH_COMPONENT:
+	case GL_STENCIL_INDEX:
+		components = 1;
+		break;
+
+	case GL_RG:
+	case GL_RG_INTEGER:
+	case GL_DEPTH_STENCIL:
+		components = 2;
+		break;
+
+	case GL_RGB:
+	case GL_BGR:
+	case GL_RGB_INTEGER:
+		components = 3;
+		break;
+
+	default:
+		break;
+	}
+
+	size_t pixelSize = components;
+	switch (type)
+	{
+	case GL_UNSIGNED_BYTE:
+	case GL_BYTE:
+		break;
+
+	case GL_UNSIGNED_SHORT:
+	case GL_SHORT:
+	case GL_HALF_FLOAT:
+		pixelSize = components * 2;
+		break;
+
+	case GL_UNSIGNED_INT:
+	case GL_INT:
+	case GL_FLOAT:
+		pixelSize = components * 4;
+		break;
+
+	default:
+		// packed types, e.g. GL_UNSIGNED_INT_24_8, hold a whole pixel
+		pixelSize = type == GL_UNSIGNED_SHORT_5_6_5 || type == GL_UNSIGNED_SHORT_4_4_4_4 || type == GL_UNSIGNED_SHORT_5_5_5_1 ? 2 : 4;
+		break;
+	}
+
+	if (width <= 0 || height <= 0 || depth <= 0) {
+		return 0;
+	}
+	const size_t alignment = static_cast<size_t>(g_capture.unpackAlignment);
+	const size_t rowSize = static_cast<size_t>(width) * pixelSize;
+	const size_t rowStride = (rowSize + alignment - 1) / alignment * alignment;
+	const size_t rows = static_cast<size_t>(height) * static_cast<size_t>(depth);
+
+	// the last row is not padded
+	return rowStride * (rows - 1) + rowSize;
+}
+
+bool Graphic::GLTrace::Load(const char* path, Trace& trace)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		std::string message = "Graphic::GLTrace::Load(): open " + std::string(path) + " failed.";
+		Debug::ShowMessage(message.c_str());
+		return false;
+	}
+	const std::streamoff size = file.tellg();
+	file.seekg(0);
+	trace.data.resize(static_cast<size_t>(size));
+	file.read(reinterpret_cast<char*>(trace.data.data()), size);
+	trace.arguments.clear();
+	trace.records.clear();
+
+	uint32_t header[2] = { 0, 0 };
+	if (!file.good() || trace.data.size() < sizeof(header)) {
+		throw std::runtime_error("Exception: Graphic::GLTrace::Load(): Truncated trace!");
+	}
+	memcpy(header, trace.data.data(), sizeof(header));
+	if (header[0] != MAGIC || header[1] != VERSION) {
+		throw std::runtime_error("Exception: Graphic::GLTrace::Load(): Not a GL trace of this version!");
+	}
+
+	size_t position = sizeof(header);
+	while (position < trace.data.size()) {
+		CallRecord record = {};
+		uint64_t value = 0;
+		if (!ReadVarint(trace.data, position, value) || value >= static_cast<uint64_t>(Call::COUNT) || position >= trace.data.size()) {
+			throw std::runtime_error("Exception: Graphic::GLTrace::Load(): Corrupted record!");
+		}
+		record.call = static_cast<Call>(value);
+		record.argumentCount = trace.data[position++];
+		record.firstArgument = trace.arguments.size();
+		for (uint32_t argument = 0; argument < record.argumentCount; ++argument) {
+			if (!ReadVarint(trace.data, position, value)) {
+				throw std::runtime_error("Exception: Graphic::GLTrace::Load(): Corrupted record!");
+			}
+			trace.arguments.push_back(value);
+		}
+		if (!ReadVarint(trace.data, position, value) || value > trace.data.size() - position) {
+			throw std::runtime_error("Exception: Graphic::GLTrace::Load(): Corrupted record!");
+		}
+		record.payload = position;
+		record.payloadSize = static_cast<size_t>(value);
+		position += record.payloadSize;
+
+		trace.records.push_back(record);
+	}
+
+	return true;
+}
+
+const char* Graphic::GLTrace::GetName(Call call)
+{
+	return call < Call::COUNT ? CALL_NAMES[static_cast<size_t>(call)] : "Unknown";
+}
+
+GLfloat Graphic::GLTrace::UnpackFloat(uint64_t argument)
+{
+	const uint32_t bits = static_cast<uint32_t>(argument);
+	GLfloat value = 0.f;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+uint64_t Graphic::GLTrace::Pack(GLfloat value)
+{
+	uint32_t bits = 0;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+void Graphic::GLTrace::Write(Call call, const uint64_t* arguments, size_t argumentCount, const void* payload, size_t payloadSize)
+{
+	std::vector<unsigned char>& buffer = g_capture.buffer;
+	WriteVarint(buffer, static_cast<uint64_t>(call));
+	buffer.push_back(static_cast<unsigned char>(argumentCount));
+	for (size_t argument = 0; argument < argumentCount; ++argument) {
+		WriteVarint(buffer, arguments[argument]);
+	}
+	WriteVarint(buffer, payloadSize);
+	if (payloadSize > 0) {
+		const unsigned char* bytes = static_cast<const unsigned char*>(payload);
+		buffer.insert(buffer.end(), bytes, bytes + payloadSize);
+	}
+	g_capture.records++;
+
+	if (buffer.size() >= FLUSH_SIZE) {
+		Flush();
+	}
+}
+
+void Graphic::GLTrace::Flush()
+{
+	if (g_capture.buffer.empty()) {
+		return;
+	}
+	g_capture.file.write(reinterpret_cast<const char*>(g_capture.buffer.data()), g_capture.buffer.size());
+	g_capture.bytes += g_capture.buffer.size();
+	g_capture.buffer.clear();
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include "Utility.h"
+
+#include <type_traits>
+
+namespace Graphic
+{
+	class GLTrace;
+}
+
+/**
+*	\description: class GLTrace: captures the GL calls issued through the Graphic::GL* wrappers into a compact binary
+*	trace, from the creation of the context to the end of the last captured frame, so the trace replays on its own.
+*	Buffer and texture payloads are stored with their calls, data written through mapped pointers of the stream buffer
+*	is stored as buffer contents right before the draws which read it. Frames and the scopes of passes and render
+*	targets are marked as sections, see Graphic::GLReplay.
+*
+*	\detail: a record is the call as a varint, the argument count as a byte, the arguments as varints and the payload
+*	size as a varint followed by the payload. Object names, uniform locations and texture handles are the ones of the
+*	capturing context, the replayer maps them to its own. Queries, read backs, maps and sync objects are not captured.
+*	Capture is GL thread only.
+*/
+class Graphic::GLTrace
+{
+public:
+	static constexpr uint32_t MAGIC = 0x52544c47;	///< "GLTR"
+	static constexpr uint32_t VERSION = 2;
+	static constexpr size_t FLUSH_SIZE = 4 << 20;	///< records are buffered and written in chunks of this size
+	static constexpr size_t MAX_ARGUMENTS = 10;
+
+	enum class Call : uint16_t
+	{
+		// state
+		ENABLE, DISABLE, DEPTH_FUNC, DEPTH_MASK, COLOR_MASK, BLEND_FUNC, VIEWPORT, CLEAR_COLOR, CLEAR, PIXEL_STORE,
+
+		// texture
+		GEN_TEXTURES, DELETE_TEXTURES, ACTIVE_TEXTURE, BIND_TEXTURE, TEX_IMAGE_2D, TEX_STORAGE_2D, TEX_STORAGE_3D,
+		TEX_SUB_IMAGE_2D, TEX_SUB_IMAGE_3D, TEX_PARAMETER_I, GENERATE_MIPMAP, GET_TEXTURE_HANDLE,
+		MAKE_TEXTURE_HANDLE_RESIDENT, MAKE_TEXTURE_HANDLE_NON_RESIDENT,
+
+		// buffer and vertex array
+		GEN_BUFFERS, DELETE_BUFFERS, BIND_BUFFER, BIND_BUFFER_BASE, BUFFER_DATA, BUFFER_SUB_DATA, BUFFER_STORAGE,
+		BUFFER_CONTENTS, GEN_VERTEX_ARRAYS, DELETE_VERTEX_ARRAYS, BIND_VERTEX_ARRAY, ENABLE_VERTEX_ATTRIB_ARRAY,
+		VERTEX_ATTRIB_POINTER, VERTEX_ATTRIB_DIVISOR,
+
+		// framebuffer
+		GEN_FRAMEBUFFERS, DELETE_FRAMEBUFFERS, BIND_FRAMEBUFFER, FRAMEBUFFER_TEXTURE_2D, FRAMEBUFFER_RENDERBUFFER,
+		DRAW_BUFFER, DRAW_BUFFERS, GEN_RENDERBUFFERS, DELETE_RENDERBUFFERS, BIND_RENDERBUFFER, RENDERBUFFER_STORAGE,
+
+		// shader
+		CREATE_SHADER, SHADER_SOURCE, COMPILE_SHADER, CREATE_PROGRAM, ATTACH_SHADER, LINK_PROGRAM, PROGRAM_UNIFORMS,
+		DELETE_SHADER, DELETE_PROGRAM, USE_PROGRAM,
+
+		// uniform
+		UNIFORM_1I, UNIFORM_1F, UNIFORM_2F, UNIFORM_3F, UNIFORM_4F, UNIFORM_2FV, UNIFORM_3FV, UNIFORM_4FV,
+		UNIFORM_MATRIX_3FV, UNIFORM_MATRIX_4FV, PROGRAM_UNIFORM_1I, PROGRAM_UNIFORM_1F, PROGRAM_UNIFORM_2FV,
+		PROGRAM_UNIFORM_3FV, PROGRAM_UNIFORM_4FV, PROGRAM_UNIFORM_MATRIX_3FV, PROGRAM_UNIFORM_MATRIX_4FV,
+
+		// draw
+		DRAW_ARRAYS, DRAW_ARRAYS_INSTANCED, DRAW_ELEMENTS, DRAW_ELEMENTS_INSTANCED,
+		DRAW_ELEMENTS_INSTANCED_BASE_INSTANCE, MULTI_DRAW_ELEMENTS_INDIRECT,
+
+		// markers
+		BEGIN_FRAME, END_FRAME, BEGIN_SECTION, END_SECTION,
+
+		COUNT
+	};
+
+	/**
+	*	call of a loaded trace, arguments and payload point into the trace
+	*/
+	struct CallRecord
+	{
+		Call call;
+		uint32_t argumentCount;
+		size_t firstArgument;	///< into Trace::arguments
+		size_t payload;			///< into Trace::data
+		size_t payloadSize;
+	};
+
+	struct Trace
+	{
+		std::vector<unsigned char> data;	///< whole file
+		std::vector<uint64_t> arguments;
+		std::vector<CallRecord> records;
+	};
+
+	static bool Begin(const char* path, GLuint frames); ///< frames is 0 to capture until End()
+	static void End();
+	static bool IsCapturing();
+
+	static void BeginFrame(GLsizei width, GLsizei height); ///< framebuffer size of the frame
+	static void EndFrame(); ///< ends the capture after the last frame
+	static void BeginSection(const char* name);
+	static void EndSection();
+
+	template<typename... Arguments>
+	static void Record(Call call, Arguments... arguments)
+	{
+		RecordData(call, nullptr, 0, arguments...);
+	}
+
+	template<typename... Arguments>
+	static void RecordData(Call call, const void* payload, size_t payloadSize, Arguments... arguments)
+	{
+		static_assert(sizeof...(Arguments) <= MAX_ARGUMENTS, "Too many arguments of a GL call!");
+		if (!IsCapturing()) {
+			return;
+		}
+		const uint64_t packed[] = { Pack(arguments)..., 0 };
+		Write(call, packed, sizeof...(Arguments), payload, payload ? payloadSize : 0);
+	}
+
+	static void RecordProgramUniforms(GLuint program); ///< locations of the active uniforms of a linked program
+	static void SetUnpackAlignment(GLint alignment);
+	static size_t ImageSize(GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type); ///< bytes read by an upload
+
+	static bool Load(const char* path, Trace& trace);
+	static const char* GetName(Call call);
+
+	static GLfloat UnpackFloat(uint64_t argument);
+
+private:
+	static uint64_t Pack(GLfloat value);
+
+	template<typename Integer>
+	static uint64_t Pack(Integer value)
+	{
+		// signed values keep their own width, -1 of a GLint is 0xffffffff
+		static_assert(std::is_integral<Integer>::value, "GL call arguments are integers or floats!");
+		return static_cast<uint64_t>(static_cast<typename std::make_unsigned<Integer>::type>(value));
+	}
+
+	static void Write(Call call, const uint64_t* arguments, size_t argumentCount, const void* payload, size_t payloadSize);
+	static void Flush();
+};
@@ -0,0 +1,187 @@
+#include "GPUProfiler.h"
+#include "Renderer.h"
+
+Graphic::GPUProfiler::GPUProfiler()
+	:frames(), scopeStack(), frameCount(0), inFrame(false), targetScopes(true), supported(false), results(),
+	frameMilliseconds(0.0), resultFrame(0), droppedFrames(0)
+{
+	// core since GL 3.3
+	supported = GLEW_ARB_timer_query != GL_FALSE || GLEW_VERSION_3_3 != GL_FALSE;
+	if (!supported) {
+		Debug::ShowMessage("Graphic::GPUProfiler: timer queries are not supported, GPU profiling is disabled.");
+	}
+	for (FrameQueries& frame : frames) {
+		frame.usedQueries = 0;
+		frame.frameBegin = 0;
+		frame.frameEnd = 0;
+		frame.frame = 0;
+		frame.pending = false;
+	}
+}
+
+Graphic::GPUProfiler::~GPUProfiler()
+{
+	for (FrameQueries& frame : frames) {
+		if (!frame.queries.empty()) {
+			GLCall(glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data()));
+		}
+	}
+}
+
+void Graphic::GPUProfiler::BeginFrame()
+{
+	if (!supported) {
+		return;
+	}
+
+	/**
+	*	the slot was last used FRAMES_IN_FLIGHT frames ago, collect its results before reusing the queries
+	*/
+	FrameQueries& frame = frames[frameCount % FRAMES_IN_FLIGHT];
+	if (frame.pending) {
+		Resolve(frame);
+	}
+
+	frame.usedQueries = 0;
+	frame.scopes.clear();
+	frame.frame = frameCount;
+	scopeStack.clear();
+	inFrame = true;
+
+	frame.frameBegin = Timestamp(frame);
+}
+
+void Graphic::GPUProfiler::EndFrame()
+{
+	if (!supported || !inFrame) {
+		return;
+	}
+
+	FrameQueries& frame = frames[frameCount % FRAMES_IN_FLIGHT];
+	while (!scopeStack.empty()) {
+		EndScope();
+	}
+	frame.frameEnd = Timestamp(frame);
+	frame.pending = true;
+
+	inFrame = false;
+	frameCount++;
+}
+
+void Graphic::GPUProfiler::BeginScope(const char* name)
+{
+	if (!inFrame) {
+		return;
+	}
+
+	FrameQueries& frame = frames[frameCount % FRAMES_IN_FLIGHT];
+	Scope scope = { name, static_cast<uint32_t>(scopeStack.size()), Timestamp(frame), 0 };
+	frame.scopes.push_back(scope);
+	scopeStack.push_back(frame.scopes.size() - 1);
+}
+
+void Graphic::GPUProfiler::EndScope()
+{
+	if (!inFrame || scopeStack.empty()) {
+		return;
+	}
+
+	FrameQueries& frame = frames[frameCount % FRAMES_IN_FLIGHT];
+	frame.scopes[scopeStack.back()].endQuery = Timestamp(frame);
+	scopeStack.pop_back();
+}
+
+void Graphic::GPUProfiler::SetTargetScopes(bool enable)
+{
+	targetScopes = enable;
+}
+
+bool Graphic::GPUProfiler::IsTargetScopesEnabled() const
+{
+	return supported && targetScopes;
+}
+
+const std::vector<Graphic::GPUProfiler::ScopeResult>& Graphic::GPUProfiler::GetResults() const
+{
+	return results;
+}
+
+double Graphic::GPUProfiler::GetFrameMilliseconds() const
+{
+	return frameMilliseconds;
+}
+
+uint64_t Graphic::GPUProfiler::GetResultFrame() const
+{
+	return resultFrame;
+}
+
+uint32_t Graphic::GPUProfiler::GetDroppedFrames() const
+{
+	return droppedFrames;
+}
+
+bool Graphic::GPUProfiler::Dump(const char* path) const
+{
+	std::ofstream file(path, std::ios::app);
+	if (!file.is_open()) {
+		std::string message = "Graphic::GPUProfiler::Dump(): open " + std::string(path) + " failed.";
+		Debug::ShowMessage(message.c_str());
+		return false;
+	}
+
+	// frame, scope, depth, milliseconds
+	file << resultFrame << ",Frame,0," << frameMilliseconds << "\n";
+	for (const ScopeResult& result : results) {
+		file << resultFrame << "," << result.name << "," << result.depth + 1 << "," << result.milliseconds << "\n";
+	}
+
+	return file.good();
+}
+
+GLuint Graphic::GPUProfiler::Timestamp(FrameQueries& frame)
+{
+	if (frame.usedQueries == frame.queries.size()) {
+		// grow the pool in chunks, queries are kept for the next frames
+		const size_t chunk = frame.queries.empty() ? 64 : frame.queries.size();
+		frame.queries.resize(frame.queries.size() + chunk);
+		GLCall(glGenQueries(static_cast<GLsizei>(chunk), frame.queries.data() + frame.usedQueries));
+	}
+
+	GLuint query = frame.queries[frame.usedQueries++];
+	GLCall(glQueryCounter(query, GL_TIMESTAMP));
+
+	return query;
+}
+
+void Graphic::GPUProfiler::Resolve(FrameQueries& frame)
+{
+	frame.pending = false;
+
+	// queries finish in order, the last one tells whether the whole frame is available
+	GLint available = GL_FALSE;
+	GLCall(glGetQueryObjectiv(frame.frameEnd, GL_QUERY_RESULT_AVAILABLE, &available));
+	if (available == GL_FALSE) {
+		droppedFrames++;
+		return;
+	}
+
+	auto elapsed = [](GLuint beginQuery, GLuint endQuery) {
+		GLuint64 begin = 0;
+		GLuint64 end = 0;
+		GLCall(glGetQueryObjectui64v(beginQuery, GL_QUERY_RESULT, &begin));
+		GLCall(glGetQueryObjectui64v(endQuery, GL_QUERY_RESULT, &end));
+		return end > begin ? static_cast<double>(end - begin) / 1000000.0 : 0.0;
+	};
+
+	results.clear();
+	for (const Scope& scope : frame.scopes) {
+		if (scope.endQuery == 0) {
+			continue;
+		}
+		ScopeResult result = { scope.name, scope.depth, elapsed(scope.beginQuery, scope.endQuery) };
+		results.push_back(result);
+	}
+	frameMilliseconds = elapsed(frame.frameBegin, frame.frameEnd);
+	resultFrame = frame.frame;
+}
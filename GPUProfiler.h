@@ -0,0 +1,80 @@
+#pragma once
+#include "Utility.h"
+
+namespace Graphic
+{
+	class GPUProfiler;
+}
+
+/**
+*	\description: class GPUProfiler: measures GPU time of named scopes with GL_TIMESTAMP queries. The queries of a frame
+*	are read back FRAMES_IN_FLIGHT - 1 frames later, when the GPU has finished them, so profiling never stalls the
+*	pipeline. A frame whose queries are still pending at that time is dropped instead of waited for.
+*
+*	\detail: scopes nest, timestamps are used instead of GL_TIME_ELAPSED because elapsed queries can not overlap.
+*/
+class Graphic::GPUProfiler
+{
+public:
+	static constexpr size_t FRAMES_IN_FLIGHT = 3;
+
+	struct ScopeResult
+	{
+		std::string name;
+		uint32_t depth;			///< 0 for outermost scopes
+		double milliseconds;
+	};
+
+	GPUProfiler();
+	GPUProfiler(const GPUProfiler& profiler) = delete;
+	~GPUProfiler();
+
+	void BeginFrame();
+	void EndFrame();
+	void BeginScope(const char* name);
+	void EndScope();
+
+	void SetTargetScopes(bool enable);	///< scope every render target, not only passes
+	bool IsTargetScopesEnabled() const;
+
+	const std::vector<ScopeResult>& GetResults() const;	///< scopes of the latest finished frame
+	double GetFrameMilliseconds() const;
+	uint64_t GetResultFrame() const;
+	uint32_t GetDroppedFrames() const;
+
+	bool Dump(const char* path) const;	///< append latest results to a CSV file
+
+private:
+	struct Scope
+	{
+		std::string name;
+		uint32_t depth;
+		GLuint beginQuery;
+		GLuint endQuery;
+	};
+	struct FrameQueries
+	{
+		std::vector<GLuint> queries;	///< pool of the frame, reused
+		size_t usedQueries;
+		std::vector<Scope> scopes;
+		GLuint frameBegin;
+		GLuint frameEnd;
+		uint64_t frame;
+		bool pending;
+	};
+
+	FrameQueries frames[FRAMES_IN_FLIGHT];
+	std::vector<size_t> scopeStack;
+	uint64_t frameCount;
+	bool inFrame;
+	bool targetScopes;
+	bool supported;
+
+	std::vector<ScopeResult> results;
+	double frameMilliseconds;
+	uint64_t resultFrame;
+	uint32_t droppedFrames;
+
+	GLuint Timestamp(FrameQueries& frame);
+	void Resolve(FrameQueries& frame);
+};
@@ -0,0 +1,348 @@
+#include "MaterialTextures.h"
+#include "Renderer.h"
+#include <cmath>
+
+namespace
+{
+	constexpr GLuint INVALID_ARRAY = 0xffffffff;
+
+	// the table and the sampler array must match MaterialTextures::TABLE_BINDING and MAX_ARRAYS, a bindless handle is
+	// an opaque sampler so it must be dynamically uniform unless NONUNIFORM_SHADER_CODE is inserted first
+	const char* NONUNIFORM_SHADER_CODE = R"(
+	#extension GL_NV_gpu_shader5 : require
+	#define MATERIAL_NONUNIFORM_INDEX
+	)";
+
+	const char* BINDLESS_SHADER_CODE = R"(
+	#extension GL_ARB_bindless_texture : require
+	#define MATERIAL_BINDLESS_TEXTURES
+
+	layout (std430, binding = 2) readonly buffer MaterialTextureTable
+	{
+		uvec2 materialTextures[];
+	};
+
+	vec4 SampleMaterial(int index, vec2 coord)
+	{
+		if (index < 0) {
+			return vec4(0.0);
+		}
+		return texture(sampler2D(materialTextures[index]), coord);
+	}
+	)";
+
+	const char* ARRAY_SHADER_CODE = R"(
+	#define MATERIAL_TEXTURE_ARRAYS
+	#define MAX_MATERIAL_ARRAYS 8
+
+	layout (std430, binding = 2) readonly buffer MaterialTextureTable
+	{
+		uvec2 materialTextures[];
+	};
+
+	uniform sampler2DArray materialArrays[MAX_MATERIAL_ARRAYS];
+
+	// samplers are selected by constant indices only, the array may vary between fragments and the layer is a coordinate
+	vec4 SampleMaterialArray(uint array, vec3 coord, vec2 dx, vec2 dy)
+	{
+		switch (array) {
+		case 0u: return textureGrad(materialArrays[0], coord, dx, dy);
+		case 1u: return textureGrad(materialArrays[1], coord, dx, dy);
+		case 2u: return textureGrad(materialArrays[2], coord, dx, dy);
+		case 3u: return textureGrad(materialArrays[3], coord, dx, dy);
+		case 4u: return textureGrad(materialArrays[4], coord, dx, dy);
+		case 5u: return textureGrad(materialArrays[5], coord, dx, dy);
+		case 6u: return textureGrad(materialArrays[6], coord, dx, dy);
+		case 7u: return textureGrad(materialArrays[7], coord, dx, dy);
+		}
+		return vec4(0.0);
+	}
+
+	// derivatives are taken before any branch, they are undefined in non-uniform control flow
+	vec4 SampleMaterial(int index, vec2 coord)
+	{
+		vec2 dx = dFdx(coord);
+		vec2 dy = dFdy(coord);
+		if (index < 0) {
+			return vec4(0.0);
+		}
+		uvec2 entry = materialTextures[index];
+		return SampleMaterialArray(entry.x, vec3(coord, float(entry.y)), dx, dy);
+	}
+	)";
+}
+
+Graphic::MaterialTextures::MaterialTextures(bool varyingIndex)
+	:images(), table(), textures(), handles(), tableBuffer(0), bindless(IsBindlessSupported(varyingIndex))
+{
+}
+
+Graphic::MaterialTextures::~MaterialTextures()
+{
+	for (GLuint64 handle : handles) {
+		GLMakeTextureHandleNonResident(handle);
+	}
+	if (!textures.empty()) {
+		GLDeleteTextures(static_cast<GLsizei>(textures.size()), textures.data());
+	}
+	if (tableBuffer != 0) {
+		GLDeleteBuffers(1, &tableBuffer);
+	}
+}
+
+GLint Graphic::MaterialTextures::Add(GLsizei width, GLsizei height, const unsigned char* pixels)
+{
+	if (pixels == nullptr || width <= 0 || height <= 0) {
+		throw std::invalid_argument("Exception: Graphic::MaterialTextures::Add(): Empty texture!");
+	}
+	if (tableBuffer != 0) {
+		throw std::runtime_error("Exception: Graphic::MaterialTextures::Add(): Textures have been finalized!");
+	}
+
+	Image image = { width, height, std::vector<unsigned char>(pixels, pixels + static_cast<size_t>(width) * height * 4) };
+	images.push_back(std::move(image));
+
+	return static_cast<GLint>(images.size() - 1);
+}
+
+void Graphic::MaterialTextures::Finalize()
+{
+	if (tableBuffer != 0 || images.empty()) {
+		return;
+	}
+
+	table.resize(images.size(), TableEntry{ INVALID_ARRAY, 0 });
+	if (bindless) {
+		CreateHandles();
+	}
+	else {
+		CreateArrays();
+	}
+
+	GLGenBuffers(1, &tableBuffer);
+	GLBindBuffer(GL_SHADER_STORAGE_BUFFER, tableBuffer);
+	GLBufferData(GL_SHADER_STORAGE_BUFFER, table.size() * sizeof(TableEntry), &table[0], GL_STATIC_DRAW);
+	GLBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// pixels live in GPU memory now
+	std::vector<Image>().swap(images);
+}
+
+void Graphic::MaterialTextures::Bind() const
+{
+	if (!bindless) {
+		for (size_t unit = 0; unit < textures.size(); ++unit) {
+			GLActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(unit));
+			GLBindTexture(GL_TEXTURE_2D_ARRAY, textures[unit]);
+		}
+		GLActiveTexture(GL_TEXTURE0);
+	}
+	GLBindBufferBase(GL_SHADER_STORAGE_BUFFER, TABLE_BINDING, tableBuffer);
+}
+
+void Graphic::MaterialTextures::Bind(CommandBuffer* commandBuffer) const
+{
+	if (!bindless) {
+		for (size_t unit = 0; unit < textures.size(); ++unit) {
+			commandBuffer->ActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(unit));
+			commandBuffer->BindTexture(GL_TEXTURE_2D_ARRAY, textures[unit]);
+		}
+		commandBuffer->ActiveTexture(GL_TEXTURE0);
+	}
+	commandBuffer->BindBufferBase(GL_SHADER_STORAGE_BUFFER, TABLE_BINDING, tableBuffer);
+}
+
+size_t Graphic::MaterialTextures::Count() const
+{
+	return table.empty() ? images.size() : table.size();
+}
+
+bool Graphic::MaterialTextures::IsBindless() const
+{
+	return bindless;
+}
+
+bool Graphic::MaterialTextures::IsBindlessSupported(bool varyingIndex)
+{
+	return GLEW_ARB_bindless_texture != GL_FALSE && (!varyingIndex || IsNonUniformIndexSupported());
+}
+
+bool Graphic::MaterialTextures::IsNonUniformIndexSupported()
+{
+	return GLEW_NV_gpu_shader5 != GL_FALSE;
+}
+
+std::string Graphic::MaterialTextures::GetShaderCode(bool varyingIndex)
+{
+	// must match the path chosen by the constructor of the same varyingIndex
+	if (!IsBindlessSupported(varyingIndex)) {
+		return ARRAY_SHADER_CODE;
+	}
+	return std::string(varyingIndex ? NONUNIFORM_SHADER_CODE : "") + BINDLESS_SHADER_CODE;
+}
+
+void Graphic::MaterialTextures::CreateArrays()
+{
+	/**
+	*	one array per size, arrays larger than the layer limit are split
+	*/
+	std::map<std::pair<GLsizei, GLsizei>, std::vector<size_t>> sizeClasses;
+	for (size_t index = 0; index < images.size(); ++index) {
+		sizeClasses[std::make_pair(images[index].width, images[index].height)].push_back(index);
+	}
+
+	GLint maxLayers = 0;
+	GLCall(glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers));
+	maxLayers = (std::max)(maxLayers, 1);
+	auto arrayCount = [maxLayers](size_t members) {
+		return (members + static_cast<size_t>(maxLayers) - 1) / static_cast<size_t>(maxLayers);
+	};
+
+	size_t arrays = 0;
+	for (auto& sizeClass : sizeClasses) {
+		arrays += arrayCount(sizeClass.second.size());
+	}
+
+	/**
+	*	sizes beyond MAX_ARRAYS arrays are not dropped, the smallest size class is resampled to the nearest size by
+	*	area until the arrays fit the texture units
+	*/
+	size_t resampled = 0;
+	while (arrays > MAX_ARRAYS && sizeClasses.size() > 1) {
+		auto source = sizeClasses.begin();
+		for (auto sizeClass = sizeClasses.begin(); sizeClass != sizeClasses.end(); ++sizeClass) {
+			if (sizeClass->second.size() < source->second.size()) {
+				source = sizeClass;
+			}
+		}
+		const double sourceArea = static_cast<double>(source->first.first) * source->first.second;
+		auto target = sizeClasses.end();
+		double nearest = 0.0;
+		for (auto sizeClass = sizeClasses.begin(); sizeClass != sizeClasses.end(); ++sizeClass) {
+			const double distance = std::abs(std::log(static_cast<double>(sizeClass->first.first) * sizeClass->first.second / sourceArea));
+			if (sizeClass != source && (target == sizeClasses.end() || distance < nearest)) {
+				target = sizeClass;
+				nearest = distance;
+			}
+		}
+
+		arrays -= arrayCount(source->second.size()) + arrayCount(target->second.size());
+		for (size_t index : source->second) {
+			Resample(images[index], target->first.first, target->first.second);
+			target->second.push_back(index);
+		}
+		arrays += arrayCount(target->second.size());
+		resampled += source->second.size();
+		sizeClasses.erase(source);
+	}
+	if (arrays > MAX_ARRAYS) {
+		throw std::runtime_error("Exception: Graphic::MaterialTextures::CreateArrays(): Too many textures for the texture units!");
+	}
+
+	for (auto& sizeClass : sizeClasses) {
+		const std::vector<size_t>& members = sizeClass.second;
+		for (size_t first = 0; first < members.size(); first += static_cast<size_t>(maxLayers)) {
+			const GLsizei width = sizeClass.first.first;
+			const GLsizei height = sizeClass.first.second;
+			const GLsizei layers = static_cast<GLsizei>((std::min)(members.size() - first, static_cast<size_t>(maxLayers)));
+
+			GLuint array = 0;
+			GLGenTextures(1, &array);
+			GLBindTexture(GL_TEXTURE_2D_ARRAY, array);
+			GLTexStorage3D(GL_TEXTURE_2D_ARRAY, MipLevels(width, height), GL_RGBA8, width, height, layers);
+			for (GLsizei layer = 0; layer < layers; ++layer) {
+				const size_t index = members[first + layer];
+				GLTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, images[index].pixels.data());
+				table[index] = { static_cast<GLuint>(textures.size()), static_cast<GLuint>(layer) };
+			}
+			GLTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			GLTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+			GLTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			GLTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			GLGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+			textures.push_back(array);
+		}
+	}
+	GLBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	// every index returned by Add() resolves to a layer
+	for (const TableEntry& entry : table) {
+		if (entry.x >= textures.size()) {
+			throw std::runtime_error("Exception: Graphic::MaterialTextures::CreateArrays(): Texture has no layer!");
+		}
+	}
+
+	if (resampled > 0) {
+		Debug::ShowMessage((std::string("Graphic::MaterialTextures::CreateArrays(): too many texture sizes, ") + std::to_string(resampled) +
+			" textures are resampled.").c_str());
+	}
+}
+
+void Graphic::MaterialTextures::CreateHandles()
+{
+	textures.resize(images.size(), 0);
+	GLGenTextures(static_cast<GLsizei>(textures.size()), textures.data());
+
+	for (size_t index = 0; index < images.size(); ++index) {
+		const Image& image = images[index];
+		GLBindTexture(GL_TEXTURE_2D, textures[index]);
+		GLTexStorage2D(GL_TEXTURE_2D, MipLevels(image.width, image.height), GL_RGBA8, image.width, image.height);
+		GLTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
+		GLTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		GLTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		GLTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		GLTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		GLGenerateMipmap(GL_TEXTURE_2D);
+
+		// parameters are frozen once a handle is created
+		GLuint64 handle = GLGetTextureHandle(textures[index]);
+		GLMakeTextureHandleResident(handle);
+		handles.push_back(handle);
+
+		table[index] = { static_cast<GLuint>(handle & 0xffffffff), static_cast<GLuint>(handle >> 32) };
+	}
+	GLBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Graphic::MaterialTextures::Resample(Image& image, GLsizei width, GLsizei height)
+{
+	/**
+	*	bilinear with clamped edges, mipmaps are generated from the resampled level
+	*/
+	std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * 4);
+	const float scaleX = static_cast<float>(image.width) / width;
+	const float scaleY = static_cast<float>(image.height) / height;
+	for (GLsizei y = 0; y < height; ++y) {
+		const float sourceY = (std::max)((y + 0.5f) * scaleY - 0.5f, 0.f);
+		const GLsizei y0 = (std::min)(static_cast<GLsizei>(sourceY), image.height - 1);
+		const GLsizei y1 = (std::min)(y0 + 1, image.height - 1);
+		const float fy = sourceY - y0;
+		for (GLsizei x = 0; x < width; ++x) {
+			const float sourceX = (std::max)((x + 0.5f) * scaleX - 0.5f, 0.f);
+			const GLsizei x0 = (std::min)(static_cast<GLsizei>(sourceX), image.width - 1);
+			const GLsizei x1 = (std::min)(x0 + 1, image.width - 1);
+			const float fx = sourceX - x0;
+			for (size_t channel = 0; channel < 4; ++channel) {
+				auto texel = [&image, channel](GLsizei tx, GLsizei ty) {
+					return static_cast<float>(image.pixels[(static_cast<size_t>(ty) * image.width + tx) * 4 + channel]);
+				};
+				const float top = texel(x0, y0) + (texel(x1, y0) - texel(x0, y0)) * fx;
+				const float bottom = texel(x0, y1) + (texel(x1, y1) - texel(x0, y1)) * fx;
+				pixels[(static_cast<size_t>(y) * width + x) * 4 + channel] = static_cast<unsigned char>(top + (bottom - top) * fy + 0.5f);
+			}
+		}
+	}
+	image.width = width;
+	image.height = height;
+	image.pixels.swap(pixels);
+}
+
+GLsizei Graphic::MaterialTextures::MipLevels(GLsizei width, GLsizei height)
+{
+	GLsizei levels = 1;
+	for (GLsizei size = (std::max)(width, height); size > 1; size >>= 1) {
+		levels++;
+	}
+	return levels;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "Utility.h"
+
+namespace Graphic
+{
+	class MaterialTextures;
+	class CommandBuffer;
+}
+
+/**
+*	\description: class MaterialTextures: all material textures of a model, addressed by index from shaders, so draws
+*	of different materials need no binding changes. With ARB_bindless_texture every texture is a resident handle,
+*	otherwise textures of the same size are layers of one GL_TEXTURE_2D_ARRAY, sizes beyond MAX_ARRAYS are resampled. A table in a storage buffer maps the
+*	index to the handle, or to the array and layer.
+*
+*	\detail: textures are added as RGBA8 pixels, they are kept in memory until Finalize() creates the GL textures.
+*	Shaders declare SampleMaterial(index, coord) by inserting GetShaderCode() after their #version line. The array path
+*	takes the layer as a coordinate and selects the array by constant indices, so any index is valid. A bindless handle
+*	is an opaque sampler, so a varying index, e.g. one derived from gl_DrawIDARB, keeps the bindless path only with
+*	GL_NV_gpu_shader5 and falls back to arrays otherwise, see MaterialTextures(true) and GetShaderCode(true).
+*/
+class Graphic::MaterialTextures
+{
+public:
+	static constexpr GLuint MAX_ARRAYS = 8;		///< texture units 0 ~ MAX_ARRAYS - 1 without bindless textures
+	static constexpr GLuint TABLE_BINDING = 2;	///< storage buffer binding of the table
+
+	explicit MaterialTextures(bool varyingIndex = false); ///< varyingIndex: the index may differ between fragments of a draw
+	MaterialTextures(const MaterialTextures& materialTextures) = delete;
+	~MaterialTextures();
+
+	GLint Add(GLsizei width, GLsizei height, const unsigned char* pixels); ///< index of the texture
+	void Finalize();
+
+	void Bind() const;
+	void Bind(CommandBuffer* commandBuffer) const;
+
+	size_t Count() const;
+	bool IsBindless() const;
+
+	static bool IsBindlessSupported(bool varyingIndex = false);
+	static bool IsNonUniformIndexSupported(); ///< GL_NV_gpu_shader5, samplers may be selected by any value
+	static std::string GetShaderCode(bool varyingIndex = false); ///< same varyingIndex as the constructor
+
+private:
+	struct Image
+	{
+		GLsizei width;
+		GLsizei height;
+		std::vector<unsigned char> pixels;
+	};
+	/**
+	*	entry of the table, handle of bindless texture, or array and layer
+	*/
+	struct TableEntry
+	{
+		GLuint x;
+		GLuint y;
+	};
+
+	std::vector<Image> images;			///< staging pixels, released by Finalize()
+	std::vector<TableEntry> table;
+	std::vector<GLuint> textures;		///< arrays, or textures of the handles
+	std::vector<GLuint64> handles;
+	GLuint tableBuffer;
+	bool bindless;
+
+	void CreateArrays();
+	void CreateHandles();
+
+	static void Resample(Image& image, GLsizei width, GLsizei height); ///< into another size class of the arrays
+	static GLsizei MipLevels(GLsizei width, GLsizei height);
+};
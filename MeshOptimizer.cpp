@@ -0,0 +1,352 @@
+#include "MeshOptimizer.h"
+
+#include <cstring>
+
+namespace
+{
+	/**
+	*	vertex score constants of Forsyth's algorithm
+	*/
+	constexpr float CACHE_DECAY_POWER = 1.5f;
+	constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+	constexpr float VALENCE_BOOST_SCALE = 2.f;
+	constexpr float VALENCE_BOOST_POWER = 0.5f;
+}
+
+size_t Graphic::MeshOptimizer::GenerateRemap(const void* vertices, size_t vertexCount, size_t vertexSize, std::vector<GLuint>& remap)
+{
+	remap.assign(vertexCount, INVALID_INDEX);
+	if (vertices == nullptr || vertexCount == 0) {
+		return 0;
+	}
+
+	auto bytes = [vertices, vertexSize](GLuint vertex) {
+		return static_cast<const uint8_t*>(vertices) + static_cast<size_t>(vertex) * vertexSize;
+	};
+
+	/**
+	*	equal vertices are adjacent after sorting by their bytes, the first of each run represents it
+	*/
+	std::vector<GLuint> order(vertexCount);
+	for (size_t vertex = 0; vertex < vertexCount; ++vertex) {
+		order[vertex] = static_cast<GLuint>(vertex);
+	}
+	std::stable_sort(order.begin(), order.end(), [&](GLuint left, GLuint right) {
+		return std::memcmp(bytes(left), bytes(right), vertexSize) < 0;
+	});
+
+	std::vector<GLuint> representative(vertexCount);
+	for (size_t i = 0; i < vertexCount; ++i) {
+		const bool duplicate = i > 0 && std::memcmp(bytes(order[i - 1]), bytes(order[i]), vertexSize) == 0;
+		representative[order[i]] = duplicate ? representative[order[i - 1]] : order[i];
+	}
+
+	// unique vertices keep their relative order
+	size_t uniqueCount = 0;
+	for (size_t vertex = 0; vertex < vertexCount; ++vertex) {
+		if (representative[vertex] == vertex) {
+			remap[vertex] = static_cast<GLuint>(uniqueCount++);
+		}
+		else {
+			remap[vertex] = remap[representative[vertex]];
+		}
+	}
+
+	return uniqueCount;
+}
+
+void Graphic::MeshOptimizer::OptimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount < 2 || vertexCount == 0) {
+		return;
+	}
+
+	/**
+	*	live triangles of each vertex, emitted triangles are swapped behind the live ones
+	*/
+	std::vector<uint32_t> remaining(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; ++i) {
+		remaining[indices[i]]++;
+	}
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (size_t vertex = 0; vertex < vertexCount; ++vertex) {
+		offsets[vertex + 1] = offsets[vertex] + remaining[vertex];
+	}
+	std::vector<uint32_t> adjacency(triangleCount * 3);
+	{
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; ++i) {
+			adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+
+	std::vector<int> cachePositions(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	for (size_t vertex = 0; vertex < vertexCount; ++vertex) {
+		vertexScores[vertex] = VertexScore(-1, remaining[vertex]);
+	}
+	std::vector<float> triangleScores(triangleCount);
+	for (size_t triangle = 0; triangle < triangleCount; ++triangle) {
+		triangleScores[triangle] = vertexScores[indices[triangle * 3]] + vertexScores[indices[triangle * 3 + 1]] +
+			vertexScores[indices[triangle * 3 + 2]];
+	}
+	std::vector<uint8_t> emitted(triangleCount, 0);
+
+	std::vector<GLuint> ordered;
+	ordered.reserve(indices.size());
+	std::vector<GLuint> cache;
+	std::vector<GLuint> nextCache;
+	cache.reserve(CACHE_SIZE + 3);
+	nextCache.reserve(CACHE_SIZE + 3);
+
+	size_t best = 0;
+	for (size_t triangle = 1; triangle < triangleCount; ++triangle) {
+		if (triangleScores[triangle] > triangleScores[best]) {
+			best = triangle;
+		}
+	}
+
+	size_t cursor = 0;
+	while (best < triangleCount) {
+		emitted[best] = 1;
+		const GLuint* corners = &indices[best * 3];
+		ordered.insert(ordered.end(), corners, corners + 3);
+
+		nextCache.clear();
+		for (size_t corner = 0; corner < 3; ++corner) {
+			const GLuint vertex = corners[corner];
+			uint32_t* triangles = &adjacency[offsets[vertex]];
+			uint32_t* last = triangles + remaining[vertex] - 1;
+			std::iter_swap(std::find(triangles, last + 1, static_cast<uint32_t>(best)), last);
+			remaining[vertex]--;
+
+			// degenerate triangles repeat a vertex
+			if (std::find(nextCache.begin(), nextCache.end(), vertex) == nextCache.end()) {
+				nextCache.push_back(vertex);
+			}
+		}
+		for (GLuint vertex : cache) {
+			if (vertex != corners[0] && vertex != corners[1] && vertex != corners[2]) {
+				nextCache.push_back(vertex);
+			}
+		}
+
+		// vertices pushed out of the cache are rescored as well
+		for (size_t position = 0; position < nextCache.size(); ++position) {
+			const GLuint vertex = nextCache[position];
+			cachePositions[vertex] = position < CACHE_SIZE ? static_cast<int>(position) : -1;
+			const float score = VertexScore(cachePositions[vertex], remaining[vertex]);
+			const float delta = score - vertexScores[vertex];
+			vertexScores[vertex] = score;
+			for (uint32_t i = 0; i < remaining[vertex]; ++i) {
+				triangleScores[adjacency[offsets[vertex] + i]] += delta;
+			}
+		}
+		if (nextCache.size() > CACHE_SIZE) {
+			nextCache.resize(CACHE_SIZE);
+		}
+		cache.swap(nextCache);
+
+		// the next triangle is the best one around the cache, or any left one when the cache has none
+		best = triangleCount;
+		float bestScore = -FLT_MAX;
+		for (GLuint vertex : cache) {
+			for (uint32_t i = 0; i < remaining[vertex]; ++i) {
+				const uint32_t triangle = adjacency[offsets[vertex] + i];
+				if (triangleScores[triangle] > bestScore) {
+					bestScore = triangleScores[triangle];
+					best = triangle;
+				}
+			}
+		}
+		if (best == triangleCount) {
+			while (cursor < triangleCount && emitted[cursor]) {
+				cursor++;
+			}
+			best = cursor;
+		}
+	}
+
+	// a trailing partial triangle is kept as it was
+	ordered.insert(ordered.end(), indices.begin() + triangleCount * 3, indices.end());
+	indices.swap(ordered);
+}
+
+void Graphic::MeshOptimizer::OptimizeOverdraw(std::vector<GLuint>& indices, const void* positions, size_t vertexCount, size_t stride,
+	float threshold)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount < 2 || positions == nullptr || vertexCount == 0) {
+		return;
+	}
+
+	auto position = [positions, stride](GLuint vertex) {
+		const float* p = reinterpret_cast<const float*>(static_cast<const uint8_t*>(positions) + vertex * stride);
+		return glm::vec3(p[0], p[1], p[2]);
+	};
+
+	/**
+	*	clusters of the cache order, a cluster ends where the cache restarts, or where its misses per triangle have
+	*	reached the ones of the whole order, the next cluster then starts with a cold cache since it may move
+	*/
+	const float targetMissRatio = AnalyzeVertexCache(indices.data(), triangleCount * 3, vertexCount) * threshold;
+	std::vector<uint32_t> clusterStarts(1, 0);
+	{
+		std::vector<uint32_t> stamps(vertexCount, 0);
+		uint32_t time = ANALYZE_CACHE_SIZE + 1;
+		uint32_t clusterTriangles = 0;
+		uint32_t clusterMisses = 0;
+		for (size_t triangle = 0; triangle < triangleCount; ++triangle) {
+			uint32_t misses = 0;
+			for (size_t corner = 0; corner < 3; ++corner) {
+				const GLuint vertex = indices[triangle * 3 + corner];
+				if (time - stamps[vertex] > ANALYZE_CACHE_SIZE) {
+					stamps[vertex] = time++;
+					misses++;
+				}
+			}
+
+			if (misses == 3 && clusterTriangles > 0) {
+				clusterStarts.push_back(static_cast<uint32_t>(triangle));
+				clusterTriangles = 0;
+				clusterMisses = 0;
+			}
+			clusterTriangles++;
+			clusterMisses += misses;
+
+			if (triangle + 1 < triangleCount && clusterMisses <= targetMissRatio * clusterTriangles) {
+				clusterStarts.push_back(static_cast<uint32_t>(triangle + 1));
+				clusterTriangles = 0;
+				clusterMisses = 0;
+				time += ANALYZE_CACHE_SIZE + 1;
+			}
+		}
+	}
+	const size_t clusterCount = clusterStarts.size();
+	clusterStarts.push_back(static_cast<uint32_t>(triangleCount));
+
+	/**
+	*	clusters are sorted by how far they face away from the mesh center, outer surfaces are drawn first
+	*/
+	std::vector<glm::vec3> clusterCentroids(clusterCount, glm::vec3(0.f));
+	std::vector<glm::vec3> clusterNormals(clusterCount, glm::vec3(0.f));
+	std::vector<float> clusterAreas(clusterCount, 0.f);
+	glm::vec3 meshCentroid(0.f);
+	float meshArea = 0.f;
+	for (size_t cluster = 0; cluster < clusterCount; ++cluster) {
+		for (uint32_t triangle = clusterStarts[cluster]; triangle < clusterStarts[cluster + 1]; ++triangle) {
+			const glm::vec3 p0 = position(indices[triangle * 3]);
+			const glm::vec3 p1 = position(indices[triangle * 3 + 1]);
+			const glm::vec3 p2 = position(indices[triangle * 3 + 2]);
+			const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			const float area = glm::length(normal);
+			const glm::vec3 centroid = (p0 + p1 + p2) * (1.f / 3.f);
+
+			clusterCentroids[cluster] = clusterCentroids[cluster] + centroid * area;
+			clusterNormals[cluster] = clusterNormals[cluster] + normal;
+			clusterAreas[cluster] += area;
+		}
+		meshCentroid = meshCentroid + clusterCentroids[cluster];
+		meshArea += clusterAreas[cluster];
+	}
+	if (meshArea <= 0.f) {
+		return;
+	}
+	meshCentroid = meshCentroid * (1.f / meshArea);
+
+	std::vector<float> sortKeys(clusterCount, 0.f);
+	for (size_t cluster = 0; cluster < clusterCount; ++cluster) {
+		const float normalLength = glm::length(clusterNormals[cluster]);
+		if (clusterAreas[cluster] <= 0.f || normalLength <= 0.f) {
+			continue;
+		}
+		const glm::vec3 centroid = clusterCentroids[cluster] * (1.f / clusterAreas[cluster]);
+		sortKeys[cluster] = glm::dot(centroid - meshCentroid, clusterNormals[cluster] * (1.f / normalLength));
+	}
+
+	std::vector<uint32_t> clusterOrder(clusterCount);
+	for (size_t cluster = 0; cluster < clusterCount; ++cluster) {
+		clusterOrder[cluster] = static_cast<uint32_t>(cluster);
+	}
+	std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&](uint32_t left, uint32_t right) {
+		return sortKeys[left] > sortKeys[right];
+	});
+
+	std::vector<GLuint> ordered;
+	ordered.reserve(indices.size());
+	for (uint32_t cluster : clusterOrder) {
+		ordered.insert(ordered.end(), indices.begin() + clusterStarts[cluster] * 3, indices.begin() + clusterStarts[cluster + 1] * 3);
+	}
+	ordered.insert(ordered.end(), indices.begin() + triangleCount * 3, indices.end());
+	indices.swap(ordered);
+}
+
+size_t Graphic::MeshOptimizer::OptimizeVertexFetch(std::vector<GLuint>& indices, size_t vertexCount, std::vector<GLuint>& remap)
+{
+	remap.assign(vertexCount, INVALID_INDEX);
+
+	size_t referencedCount = 0;
+	for (GLuint& index : indices) {
+		if (remap[index] == INVALID_INDEX) {
+			remap[index] = static_cast<GLuint>(referencedCount++);
+		}
+		index = remap[index];
+	}
+
+	return referencedCount;
+}
+
+float Graphic::MeshOptimizer::AnalyzeVertexCache(const GLuint* indices, size_t indexCount, size_t vertexCount, size_t cacheSize)
+{
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0 || vertexCount == 0 || cacheSize == 0) {
+		return 0.f;
+	}
+
+	/**
+	*	FIFO cache, a vertex is cached while fewer than cacheSize misses happened since it was loaded
+	*/
+	std::vector<size_t> stamps(vertexCount, 0);
+	size_t time = cacheSize + 1;
+	size_t misses = 0;
+	for (size_t i = 0; i < triangleCount * 3; ++i) {
+		if (time - stamps[indices[i]] > cacheSize) {
+			stamps[indices[i]] = time++;
+			misses++;
+		}
+	}
+
+	return static_cast<float>(misses) / static_cast<float>(triangleCount);
+}
+
+void Graphic::MeshOptimizer::RemapIndices(std::vector<GLuint>& indices, const std::vector<GLuint>& remap)
+{
+	for (GLuint& index : indices) {
+		index = remap[index];
+	}
+}
+
+float Graphic::MeshOptimizer::VertexScore(int cachePosition, uint32_t remainingTriangles)
+{
+	// vertices without triangles left are never picked
+	if (remainingTriangles == 0) {
+		return -1.f;
+	}
+
+	float score = 0.f;
+	if (cachePosition >= 0) {
+		if (cachePosition < 3) {
+			// the triangle just drawn, fixed score so the strip does not turn back on itself
+			score = LAST_TRIANGLE_SCORE;
+		}
+		else {
+			const float scale = 1.f / static_cast<float>(CACHE_SIZE - 3);
+			score = std::pow(1.f - static_cast<float>(cachePosition - 3) * scale, CACHE_DECAY_POWER);
+		}
+	}
+
+	// few triangles left boost a vertex, so it is finished before it leaves the cache
+	score += VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remainingTriangles), -VALENCE_BOOST_POWER);
+	return score;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "Utility.h"
+
+namespace Graphic
+{
+	class MeshOptimizer;
+}
+
+/**
+*	\description: class MeshOptimizer: import time optimizations of indexed triangle lists. Duplicate vertices are
+*	welded, triangles are ordered for the post-transform vertex cache and then for overdraw, and vertices are ordered
+*	by their first use, so vertex fetch walks the vertex buffer forward.
+*
+*	\detail: the vertex cache order is Forsyth's linear speed algorithm. The overdraw order splits that order into
+*	clusters where the cache restarts or where its efficiency is already good, and draws the clusters facing away from
+*	the mesh center first, since they tend to occlude the rest.
+*/
+class Graphic::MeshOptimizer
+{
+public:
+	static constexpr GLuint INVALID_INDEX = ~0u;
+	static constexpr size_t CACHE_SIZE = 32;			///< cache modeled by the vertex scores
+	static constexpr size_t ANALYZE_CACHE_SIZE = 16;	///< FIFO cache of AnalyzeVertexCache()
+	static constexpr float OVERDRAW_THRESHOLD = 1.05f;	///< clusters may cost this much more cache misses than the cache order
+
+	/**
+	*	remap[old] = new, vertices equal in all bytes share one new vertex, returns the count of unique vertices
+	*/
+	static size_t GenerateRemap(const void* vertices, size_t vertexCount, size_t vertexSize, std::vector<GLuint>& remap);
+
+	static void OptimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount);
+	static void OptimizeOverdraw(std::vector<GLuint>& indices, const void* positions, size_t vertexCount, size_t stride,
+		float threshold = OVERDRAW_THRESHOLD);
+
+	/**
+	*	rewrites the indices in the order of first use, remap[old] = new and unreferenced vertices are INVALID_INDEX,
+	*	returns the count of referenced vertices
+	*/
+	static size_t OptimizeVertexFetch(std::vector<GLuint>& indices, size_t vertexCount, std::vector<GLuint>& remap);
+
+	static float AnalyzeVertexCache(const GLuint* indices, size_t indexCount, size_t vertexCount,
+		size_t cacheSize = ANALYZE_CACHE_SIZE); ///< average cache miss ratio, transformed vertices per triangle
+
+	static void RemapIndices(std::vector<GLuint>& indices, const std::vector<GLuint>& remap);
+
+	template<typename Vertex>
+	static void RemapVertices(std::vector<Vertex>& vertices, const std::vector<GLuint>& remap, size_t count)
+	{
+		std::vector<Vertex> remapped(count);
+		for (size_t vertex = 0; vertex < vertices.size(); ++vertex) {
+			if (remap[vertex] != INVALID_INDEX) {
+				remapped[remap[vertex]] = vertices[vertex];
+			}
+		}
+		vertices.swap(remapped);
+	}
+
+private:
+	static float VertexScore(int cachePosition, uint32_t remainingTriangles);
+};
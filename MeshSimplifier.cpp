@@ -0,0 +1,273 @@
+#include "MeshSimplifier.h"
+
+std::vector<GLuint> Graphic::MeshSimplifier::Simplify(const void* positions, size_t vertexCount, size_t stride,
+	const std::vector<GLuint>& indices, size_t targetIndexCount, float maxError, float* error)
+{
+	if (error) {
+		*error = 0.f;
+	}
+	if (positions == nullptr || vertexCount == 0 || indices.size() <= targetIndexCount) {
+		return indices;
+	}
+
+	auto position = [positions, stride](GLuint vertex) {
+		const float* p = reinterpret_cast<const float*>(static_cast<const uint8_t*>(positions) + vertex * stride);
+		return glm::dvec3(p[0], p[1], p[2]);
+	};
+
+	std::vector<GLuint> triangles(indices.begin(), indices.begin() + indices.size() / 3 * 3);
+	const size_t triangleCount = triangles.size() / 3;
+	std::vector<uint8_t> triangleAlive(triangleCount, 1);
+	std::vector<std::vector<uint32_t>> vertexTriangles(vertexCount);
+	for (size_t triangle = 0; triangle < triangleCount; ++triangle) {
+		for (size_t corner = 0; corner < 3; ++corner) {
+			vertexTriangles[triangles[triangle * 3 + corner]].push_back(static_cast<uint32_t>(triangle));
+		}
+	}
+
+	/**
+	*	vertices sharing a position split an attribute seam, moving one of them would tear the surface
+	*/
+	std::vector<uint8_t> locked(vertexCount, 0);
+	{
+		std::vector<GLuint> order(vertexCount);
+		for (size_t vertex = 0; vertex < vertexCount; ++vertex) {
+			order[vertex] = static_cast<GLuint>(vertex);
+		}
+		auto less = [&](GLuint left, GLuint right) {
+			const glm::dvec3 a = position(left);
+			const glm::dvec3 b = position(right);
+			return a.x != b.x ? a.x < b.x : (a.y != b.y ? a.y < b.y : a.z < b.z);
+		};
+		std::sort(order.begin(), order.end(), less);
+		for (size_t i = 1; i < order.size(); ++i) {
+			if (position(order[i - 1]) == position(order[i])) {
+				locked[order[i - 1]] = 1;
+				locked[order[i]] = 1;
+			}
+		}
+	}
+
+	/**
+	*	quadrics of the planes of adjacent triangles
+	*/
+	std::vector<Quadric> quadrics(vertexCount, Quadric{});
+	for (size_t triangle = 0; triangle < triangleCount; ++triangle) {
+		const GLuint* corners = &triangles[triangle * 3];
+		const glm::dvec3 p0 = position(corners[0]);
+		glm::dvec3 normal = glm::cross(position(corners[1]) - p0, position(corners[2]) - p0);
+		const double length = glm::length(normal);
+		if (length <= 0.0) {
+			continue;
+		}
+		normal /= length;
+		const glm::dvec4 plane(normal, -glm::dot(normal, p0));
+		for (size_t corner = 0; corner < 3; ++corner) {
+			quadrics[corners[corner]].AddPlane(plane, 1.0);
+		}
+	}
+
+	/**
+	*	edges keyed by their sorted vertices, edges of one triangle are open borders
+	*/
+	struct Edge
+	{
+		uint64_t key;
+		uint32_t triangle;
+
+		bool operator<(const Edge& edge) const { return key < edge.key; }
+	};
+	std::vector<Edge> edges;
+	edges.reserve(triangles.size());
+	for (size_t triangle = 0; triangle < triangleCount; ++triangle) {
+		for (size_t corner = 0; corner < 3; ++corner) {
+			const GLuint a = triangles[triangle * 3 + corner];
+			const GLuint b = triangles[triangle * 3 + (corner + 1) % 3];
+			const uint64_t key = (static_cast<uint64_t>((std::min)(a, b)) << 32) | (std::max)(a, b);
+			edges.push_back({ key, static_cast<uint32_t>(triangle) });
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+
+	for (size_t i = 0; i < edges.size(); ++i) {
+		const bool shared = (i > 0 && edges[i - 1].key == edges[i].key) || (i + 1 < edges.size() && edges[i + 1].key == edges[i].key);
+		if (shared) {
+			continue;
+		}
+
+		const GLuint a = static_cast<GLuint>(edges[i].key >> 32);
+		const GLuint b = static_cast<GLuint>(edges[i].key & 0xffffffff);
+		const GLuint* corners = &triangles[edges[i].triangle * 3];
+		const glm::dvec3 p0 = position(corners[0]);
+		const glm::dvec3 faceNormal = glm::cross(position(corners[1]) - p0, position(corners[2]) - p0);
+		glm::dvec3 borderNormal = glm::cross(position(b) - position(a), faceNormal);
+		const double length = glm::length(borderNormal);
+		if (length <= 0.0) {
+			continue;
+		}
+		borderNormal /= length;
+		const glm::dvec4 plane(borderNormal, -glm::dot(borderNormal, position(a)));
+		quadrics[a].AddPlane(plane, BORDER_WEIGHT);
+		quadrics[b].AddPlane(plane, BORDER_WEIGHT);
+	}
+
+	/**
+	*	cheapest collapses first, candidates are invalidated by bumping the versions of their vertices
+	*/
+	std::vector<uint32_t> versions(vertexCount, 0);
+	std::vector<uint8_t> removed(vertexCount, 0);
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> candidates;
+	auto pushEdge = [&](GLuint a, GLuint b) {
+		Quadric quadric = quadrics[a];
+		quadric.Add(quadrics[b]);
+		if (!locked[a]) {
+			candidates.push({ quadric.Evaluate(position(b)), a, b, versions[a], versions[b] });
+		}
+		if (!locked[b]) {
+			candidates.push({ quadric.Evaluate(position(a)), b, a, versions[b], versions[a] });
+		}
+	};
+	for (size_t i = 0; i < edges.size(); ++i) {
+		if (i == 0 || edges[i - 1].key != edges[i].key) {
+			pushEdge(static_cast<GLuint>(edges[i].key >> 32), static_cast<GLuint>(edges[i].key & 0xffffffff));
+		}
+	}
+	std::vector<Edge>().swap(edges);
+
+	const double maxCost = static_cast<double>(maxError) * maxError;
+	double reachedCost = 0.0;
+	size_t indexCount = triangles.size();
+	std::vector<GLuint> neighbors;
+	while (indexCount > targetIndexCount && !candidates.empty()) {
+		const Collapse collapse = candidates.top();
+		candidates.pop();
+		if (collapse.cost > maxCost) {
+			break;
+		}
+		if (removed[collapse.from] || removed[collapse.to] || versions[collapse.from] != collapse.fromVersion ||
+			versions[collapse.to] != collapse.toVersion) {
+			continue;
+		}
+
+		// triangles which keep existing must not turn over
+		const glm::dvec3 target = position(collapse.to);
+		bool flipped = false;
+		for (uint32_t triangle : vertexTriangles[collapse.from]) {
+			const GLuint* corners = &triangles[triangle * 3];
+			if (!triangleAlive[triangle] || corners[0] == collapse.to || corners[1] == collapse.to || corners[2] == collapse.to) {
+				continue;
+			}
+			glm::dvec3 p[3] = { position(corners[0]), position(corners[1]), position(corners[2]) };
+			const glm::dvec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+			for (size_t corner = 0; corner < 3; ++corner) {
+				if (corners[corner] == collapse.from) {
+					p[corner] = target;
+				}
+			}
+			const glm::dvec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+			if (glm::dot(before, after) <= 0.0 && glm::dot(before, before) > 0.0) {
+				flipped = true;
+				break;
+			}
+		}
+		if (flipped) {
+			continue;
+		}
+
+		for (uint32_t triangle : vertexTriangles[collapse.from]) {
+			if (!triangleAlive[triangle]) {
+				continue;
+			}
+			GLuint* corners = &triangles[triangle * 3];
+			if (corners[0] == collapse.to || corners[1] == collapse.to || corners[2] == collapse.to) {
+				triangleAlive[triangle] = 0;
+				indexCount -= 3;
+				continue;
+			}
+			for (size_t corner = 0; corner < 3; ++corner) {
+				if (corners[corner] == collapse.from) {
+					corners[corner] = collapse.to;
+				}
+			}
+			vertexTriangles[collapse.to].push_back(triangle);
+		}
+		std::vector<uint32_t>().swap(vertexTriangles[collapse.from]);
+
+		quadrics[collapse.to].Add(quadrics[collapse.from]);
+		removed[collapse.from] = 1;
+		versions[collapse.to]++;
+		reachedCost = (std::max)(reachedCost, collapse.cost);
+
+		// drop the dead triangles of the surviving vertex and requeue its edges
+		std::vector<uint32_t>& around = vertexTriangles[collapse.to];
+		around.erase(std::remove_if(around.begin(), around.end(), [&](uint32_t triangle) { return !triangleAlive[triangle]; }),
+			around.end());
+		neighbors.clear();
+		for (uint32_t triangle : around) {
+			for (size_t corner = 0; corner < 3; ++corner) {
+				if (triangles[triangle * 3 + corner] != collapse.to) {
+					neighbors.push_back(triangles[triangle * 3 + corner]);
+				}
+			}
+		}
+		std::sort(neighbors.begin(), neighbors.end());
+		neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+		for (GLuint neighbor : neighbors) {
+			pushEdge(collapse.to, neighbor);
+		}
+	}
+
+	std::vector<GLuint> simplified;
+	simplified.reserve(indexCount);
+	for (size_t triangle = 0; triangle < triangleCount; ++triangle) {
+		if (triangleAlive[triangle]) {
+			simplified.insert(simplified.end(), triangles.begin() + triangle * 3, triangles.begin() + triangle * 3 + 3);
+		}
+	}
+
+	if (error) {
+		*error = static_cast<float>(std::sqrt(reachedCost));
+	}
+	return simplified;
+}
+
+void Graphic::MeshSimplifier::Quadric::AddPlane(const glm::dvec4& plane, double weight)
+{
+	a00 += weight * plane.x * plane.x;
+	a01 += weight * plane.x * plane.y;
+	a02 += weight * plane.x * plane.z;
+	a03 += weight * plane.x * plane.w;
+	a11 += weight * plane.y * plane.y;
+	a12 += weight * plane.y * plane.z;
+	a13 += weight * plane.y * plane.w;
+	a22 += weight * plane.z * plane.z;
+	a23 += weight * plane.z * plane.w;
+	a33 += weight * plane.w * plane.w;
+}
+
+void Graphic::MeshSimplifier::Quadric::Add(const Quadric& quadric)
+{
+	a00 += quadric.a00;
+	a01 += quadric.a01;
+	a02 += quadric.a02;
+	a03 += quadric.a03;
+	a11 += quadric.a11;
+	a12 += quadric.a12;
+	a13 += quadric.a13;
+	a22 += quadric.a22;
+	a23 += quadric.a23;
+	a33 += quadric.a33;
+}
+
+double Graphic::MeshSimplifier::Quadric::Evaluate(const glm::dvec3& point) const
+{
+	const double x = point.x;
+	const double y = point.y;
+	const double z = point.z;
+	const double cost = a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z + 2.0 * a03 * x +
+		a11 * y * y + 2.0 * a12 * y * z + 2.0 * a13 * y +
+		a22 * z * z + 2.0 * a23 * z + a33;
+
+	// rounding may push a zero cost below zero
+	return (std::max)(cost, 0.0);
+}
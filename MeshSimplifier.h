@@ -0,0 +1,53 @@
+#pragma once
+#include "Utility.h"
+
+namespace Graphic
+{
+	class MeshSimplifier;
+}
+
+/**
+*	\description: class MeshSimplifier: reduces the triangles of an indexed mesh by quadric error metric edge collapses.
+*	Vertices only collapse onto other existing vertices, so simplified index buffers share the vertex buffer of the source.
+*
+*	\detail: vertices sharing a position with other vertices, e.g. texture seams, are never moved, and open borders are
+*	kept by perpendicular border quadrics. Collapses which flip a triangle are rejected.
+*/
+class Graphic::MeshSimplifier
+{
+public:
+	static constexpr float BORDER_WEIGHT = 16.f; ///< weight of the quadrics holding open borders
+
+	/**
+	*	positions are read with a stride in bytes, returns the simplified indices with at most targetIndexCount indices
+	*	unless no further collapse is possible below maxError, error receives the geometric error in model units
+	*/
+	static std::vector<GLuint> Simplify(const void* positions, size_t vertexCount, size_t stride,
+		const std::vector<GLuint>& indices, size_t targetIndexCount, float maxError, float* error = nullptr);
+
+private:
+	/**
+	*	symmetric 4x4 matrix, sum of the squared distances to planes
+	*/
+	struct Quadric
+	{
+		double a00, a01, a02, a03;
+		double a11, a12, a13;
+		double a22, a23;
+		double a33;
+
+		void AddPlane(const glm::dvec4& plane, double weight);
+		void Add(const Quadric& quadric);
+		double Evaluate(const glm::dvec3& point) const;
+	};
+	struct Collapse
+	{
+		double cost;
+		GLuint from;
+		GLuint to;
+		uint32_t fromVersion;
+		uint32_t toVersion;
+
+		bool operator>(const Collapse& collapse) const { return cost > collapse.cost; }
+	};
+};
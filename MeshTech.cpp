@@ -2,9 +2,12 @@
 #include "Resources.h"
 #include "Debug.h"
 #include "Shader.h"
+#include "Renderer.h"
+#include "MaterialTextures.h"
+#include "VertexFormat.h"
 
 MeshTech::MeshTech()
-	:Technique()
+	:Technique(), model(1.f)
 {
 }
 
@@ -12,138 +15,359 @@ MeshTech::~MeshTech()
 {
 }
 
-bool MeshTech::Init()
+void MeshTech::Compile()
+{
+	shader = CompileVariant(DIFFUSE_TEXTURE | SPECULAR_TEXTURE | AMBIENT_TEXTURE);
+}
+
+Graphic::Shader* MeshTech::CompileVariant(Features features)
 {
 	const char* modelVSCode = R"(
 	#version 440
 	#define MODEL_VERTEX_SHADER
-	layout (location = 0) in vec3 aPosition;
-	layout (location = 1) in vec3 aNormal;
+	)" FRAME_CONSTANTS_GLSL PACKED_VERTEX_GLSL R"(
+	layout (location = 0) in vec3 aPosition;		// unorm in the position range of the mesh
+	layout (location = 1) in vec2 aNormal;			// octahedral
 	layout (location = 2) in vec2 aTextureCoord;
-	layout (location = 3) in vec3 aTangent;
-	layout (location = 4) in vec3 aBitangent;
+	layout (location = 3) in vec4 aTangentFrame;	// quaternion, see DecodeTangentFrame()
+	layout (location = 5) in mat4 aInstanceModel;
 
 	out vec3 normal;
 	out vec2 textureCoord;	
 
-	uniform mat4 projectionView;
-	uniform mat4 model;
+	layout (location = 0) uniform mat4 model;
+	layout (location = 1) uniform vec4 positionOffset;
+	layout (location = 2) uniform vec4 positionScale;
+
+	// the depth pre-pass must produce the same depth, see MeshDepthTech
+	invariant gl_Position;
 
 	void main()
 	{
-		gl_Position = projectionView * model * vec4(aPosition, 1.0);
-		normal = aNormal;
+		vec3 position = positionOffset.xyz + aPosition * positionScale.xyz;
+		gl_Position = frame.viewProjection * model * aInstanceModel * vec4(position, 1.0);
+		normal = DecodeOctahedral(aNormal);
 		textureCoord = aTextureCoord;
 	}
 	
 	)";
 
-	const char* modelFSCode = R"(
+	// materials select their textures by index, see Graphic::MaterialTextures
+	std::string modelFSCode = std::string(R"(
 	#version 440
 	#define MODEL_FRAGMENT_SHADER
-
+	)") + Graphic::MaterialTextures::GetShaderCode() + R"(
 	in vec3 normal;
 	in vec2 textureCoord;
 
 	out vec4 FragColor;	
 	
-	struct Texture
+	struct Material
 	{
-		sampler2D textureDiffuse;
-		sampler2D textureSpecular;
-		sampler2D textureAmbient;
+		int diffuse;
+		int specular;
+		int ambient;
 	};
 	
-	uniform Texture tx0;
-	uniform Texture tx1;
+	// members have the locations 3 to 5
+	layout (location = 3) uniform Material material;
 	
+	// a variant samples only the textures its materials have
 	void main()
 	{
-		vec4 diffuse = texture(tx0.textureDiffuse, textureCoord) + texture(tx1.textureDiffuse, textureCoord);
-		vec4 specular = texture(tx0.textureSpecular, textureCoord) + texture(tx1.textureSpecular, textureCoord);
-		vec4 ambient = texture(tx0.textureAmbient, textureCoord) + texture(tx1.textureAmbient, textureCoord);
-		
-		FragColor = diffuse + specular + ambient;
+		FragColor = vec4(0.0);
+	#ifdef DIFFUSE_TEXTURE
+		FragColor += SampleMaterial(material.diffuse, textureCoord);
+	#endif
+	#ifdef SPECULAR_TEXTURE
+		FragColor += SampleMaterial(material.specular, textureCoord);
+	#endif
+	#ifdef AMBIENT_TEXTURE
+		FragColor += SampleMaterial(material.ambient, textureCoord);
+	#endif
 	}
 	)";
 
-	shader = Resources::CreateShader(modelVSCode, modelFSCode);
-	shader->Use();
+	static const Feature FEATURES[] = {
+		{ DIFFUSE_TEXTURE, "DIFFUSE_TEXTURE" }, { SPECULAR_TEXTURE, "SPECULAR_TEXTURE" }, { AMBIENT_TEXTURE, "AMBIENT_TEXTURE" }
+	};
+	modelFSCode = Specialize(modelFSCode.c_str(), features, FEATURES, 3);
 
-	projectionLocation = shader->GetLocation("projectionView");
-	modelLocation = shader->GetLocation("model");
+	return Resources::CreateShader(modelVSCode, modelFSCode.c_str());
+}
 
-	/** location 0 */
-	txLocation0.textureDiffuseLocation = shader->GetLocation("tx0.textureDiffuse");
-	txLocation0.textureSpecularLocation = shader->GetLocation("tx0.textureSpecular");
-	txLocation0.textureAmbientLocation = shader->GetLocation("tx0.textureAmbient");
-	/** location 1 */
-	txLocation1.textureDiffuseLocation = shader->GetLocation("tx1.textureDiffuse");
-	txLocation1.textureSpecularLocation = shader->GetLocation("tx1.textureSpecular");
-	txLocation1.textureAmbientLocation = shader->GetLocation("tx1.textureAmbient");
-	
-	glm::mat4 mat(1.f);
-	shader->SetMat4(projectionLocation, mat);
-	shader->SetMat4(modelLocation, mat);
+bool MeshTech::Init()
+{
+	// explicit locations of the shaders, the same in every variant
+	modelLocation = 0;
+	positionLocation.offsetLocation = 1;
+	positionLocation.scaleLocation = 2;
+	materialLocation.diffuseLocation = 3;
+	materialLocation.specularLocation = 4;
+	materialLocation.ambientLocation = 5;
 
+	// variants are created for the materials of the meshes, see Model::Load()
 	return true;
 }
 
-void MeshTech::SetProjectionView(glm::mat4& projection)
+void MeshTech::InitVariant(Graphic::Shader* variant)
 {
-	shader->SetMat4(projectionLocation, projection);
+	SetMaterialArrays(variant);
+	variant->SetInt(materialLocation.diffuseLocation, -1);
+	variant->SetInt(materialLocation.specularLocation, -1);
+	variant->SetInt(materialLocation.ambientLocation, -1);
+	variant->SetVec4(positionLocation.offsetLocation, glm::vec4(0.f));
+	variant->SetVec4(positionLocation.scaleLocation, glm::vec4(1.f));
+	variant->SetMat4(modelLocation, model);
+}
+
+MeshTech::Features MeshTech::GetMaterialFeatures(GLint diffuse, GLint specular, GLint ambient)
+{
+	return (diffuse >= 0 ? DIFFUSE_TEXTURE : 0) | (specular >= 0 ? SPECULAR_TEXTURE : 0) | (ambient >= 0 ? AMBIENT_TEXTURE : 0);
 }
 
 void MeshTech::SetModel(glm::mat4& model)
 {
-	shader->SetMat4(modelLocation, model);
+	// every variant keeps its own uniforms
+	this->model = model;
+	for (auto& variant : variants) {
+		variant.second->SetMat4(modelLocation, model);
+	}
 }
 
-void MeshTech::SetDiffuseMap(GLuint textureUnit)
+void MeshTech::SetMaterial(GLint diffuse, GLint specular, GLint ambient)
 {
-	switch (textureUnit)
-	{
-	case 0:
-		shader->SetInt(txLocation0.textureDiffuseLocation, textureUnit);
-		break;
-	case 1:
-		shader->SetInt(txLocation1.textureDiffuseLocation, textureUnit);
-		break;
+	shader->SetInt(materialLocation.diffuseLocation, diffuse);
+	shader->SetInt(materialLocation.specularLocation, specular);
+	shader->SetInt(materialLocation.ambientLocation, ambient);
+}
+
+void MeshTech::SetMaterial(GLint diffuse, GLint specular, GLint ambient, Graphic::CommandBuffer* commandBuffer)
+{
+	commandBuffer->Uniform1i(materialLocation.diffuseLocation, diffuse);
+	commandBuffer->Uniform1i(materialLocation.specularLocation, specular);
+	commandBuffer->Uniform1i(materialLocation.ambientLocation, ambient);
+}
+
+void MeshTech::SetPositionRange(const glm::vec4& offset, const glm::vec4& scale)
+{
+	shader->SetVec4(positionLocation.offsetLocation, offset);
+	shader->SetVec4(positionLocation.scaleLocation, scale);
+}
+
+void MeshTech::SetPositionRange(const glm::vec4& offset, const glm::vec4& scale, Graphic::CommandBuffer* commandBuffer)
+{
+	commandBuffer->Uniform4f(positionLocation.offsetLocation, offset);
+	commandBuffer->Uniform4f(positionLocation.scaleLocation, scale);
+}
+
+void MeshTech::SetMaterialArrays(Graphic::Shader* shader)
+{
+	/** array i is bound to texture unit i, the samplers do not exist with bindless textures */
+	for (GLint unit = 0; unit < static_cast<GLint>(Graphic::MaterialTextures::MAX_ARRAYS); ++unit) {
+		std::string name = "materialArrays[" + std::to_string(unit) + "]";
+		shader->SetInt(shader->GetLocation(name.c_str()), unit);
 	}
 }
 
-void MeshTech::SetSpeculatMap(GLuint textureUnit)
+MeshDepthTech::MeshDepthTech()
+	:Technique()
+{
+}
+
+MeshDepthTech::~MeshDepthTech()
 {
-	switch (textureUnit)
+}
+
+void MeshDepthTech::Compile()
+{
+	const char* depthVSCode = R"(
+	#version 440
+	#define MODEL_DEPTH_VERTEX_SHADER
+	)" FRAME_CONSTANTS_GLSL R"(
+	layout (location = 0) in vec3 aPosition;
+	layout (location = 5) in mat4 aInstanceModel;
+
+	uniform mat4 model;
+	uniform vec4 positionOffset;
+	uniform vec4 positionScale;
+
+	invariant gl_Position;
+
+	void main()
 	{
-	case 0:
-		shader->SetInt(txLocation0.textureSpecularLocation, textureUnit);
-		break;
-	case 1:
-		shader->SetInt(txLocation1.textureSpecularLocation, textureUnit);
-		break;
+		vec3 position = positionOffset.xyz + aPosition * positionScale.xyz;
+		gl_Position = frame.viewProjection * model * aInstanceModel * vec4(position, 1.0);
 	}
+	
+	)";
+
+	const char* depthFSCode = R"(
+	#version 440
+	#define MODEL_DEPTH_FRAGMENT_SHADER
+
+	void main()
+	{
+	}
+	)";
+
+	shader = Resources::CreateShader(depthVSCode, depthFSCode);
 }
 
-void MeshTech::SetAmbientMap(GLuint textureUnit)
+bool MeshDepthTech::Init()
 {
-	switch (textureUnit)
+	Compile();
+	shader->Use();
+
+	modelLocation = shader->GetLocation("model");
+	positionLocation.offsetLocation = shader->GetLocation("positionOffset");
+	positionLocation.scaleLocation = shader->GetLocation("positionScale");
+	SetPositionRange(glm::vec4(0.f), glm::vec4(1.f));
+
+	glm::mat4 mat(1.f);
+	shader->SetMat4(modelLocation, mat);
+
+	return true;
+}
+
+void MeshDepthTech::SetModel(glm::mat4& model)
+{
+	shader->SetMat4(modelLocation, model);
+}
+
+void MeshDepthTech::SetPositionRange(const glm::vec4& offset, const glm::vec4& scale)
+{
+	shader->SetVec4(positionLocation.offsetLocation, offset);
+	shader->SetVec4(positionLocation.scaleLocation, scale);
+}
+
+void MeshDepthTech::SetPositionRange(const glm::vec4& offset, const glm::vec4& scale, Graphic::CommandBuffer* commandBuffer)
+{
+	commandBuffer->Uniform4f(positionLocation.offsetLocation, offset);
+	commandBuffer->Uniform4f(positionLocation.scaleLocation, scale);
+}
+
+MeshBatchTech::MeshBatchTech()
+	:Technique(), modelLocation(0)
+{
+}
+
+MeshBatchTech::~MeshBatchTech()
+{
+}
+
+void MeshBatchTech::Compile()
+{
+	const char* batchVSCode = R"(
+	#version 440
+	#extension GL_ARB_shader_draw_parameters : require
+	#define MODEL_BATCH_VERTEX_SHADER
+	)" FRAME_CONSTANTS_GLSL PACKED_VERTEX_GLSL R"(
+	layout (location = 0) in vec3 aPosition;		// unorm in the position range of the mesh
+	layout (location = 1) in vec2 aNormal;			// octahedral
+	layout (location = 2) in vec2 aTextureCoord;
+	layout (location = 3) in vec4 aTangentFrame;	// quaternion, see DecodeTangentFrame()
+	layout (location = 5) in mat4 aInstanceModel;
+
+	out vec3 normal;
+	out vec2 textureCoord;
+	flat out int drawID;
+
+	uniform mat4 model;
+	uniform vec4 positionOffset;
+	uniform vec4 positionScale;
+
+	// the depth pre-pass must produce the same depth, see MeshDepthTech
+	invariant gl_Position;
+
+	void main()
 	{
-	case 0:
-		shader->SetInt(txLocation1.textureAmbientLocation, textureUnit);
-		break;
-	case 1:
-		shader->SetInt(txLocation1.textureAmbientLocation, textureUnit);
-		break;
+		vec3 position = positionOffset.xyz + aPosition * positionScale.xyz;
+		gl_Position = frame.viewProjection * model * aInstanceModel * vec4(position, 1.0);
+		normal = DecodeOctahedral(aNormal);
+		textureCoord = aTextureCoord;
+		drawID = gl_DrawIDARB;
 	}
+	
+	)";
+
+	// drawID is a varying, not dynamically uniform, the material textures are sampled for a varying index
+	std::string batchFSCode = std::string(R"(
+	#version 440
+	#define MODEL_BATCH_FRAGMENT_SHADER
+	)") + Graphic::MaterialTextures::GetShaderCode(true) + R"(
+	in vec3 normal;
+	in vec2 textureCoord;
+	flat in int drawID;
+
+	out vec4 FragColor;	
+	
+	struct Material
+	{
+		int diffuse;
+		int specular;
+		int ambient;
+		int padding;
+	};
+
+	layout (std430, binding = 1) readonly buffer Materials
+	{
+		Material materials[];
+	};
+
+	// all draws of the batch are one multi-draw-indirect call, the material is selected by the draw ID
+	void main()
+	{
+		Material material = materials[drawID];
+		FragColor = SampleMaterial(material.diffuse, textureCoord) + SampleMaterial(material.specular, textureCoord) +
+			SampleMaterial(material.ambient, textureCoord);
+	}
+	)";
+
+	shader = Resources::CreateShader(batchVSCode, batchFSCode.c_str());
+}
+
+bool MeshBatchTech::Init()
+{
+	Compile();
+	shader->Use();
+
+	modelLocation = shader->GetLocation("model");
+	positionLocation.offsetLocation = shader->GetLocation("positionOffset");
+	positionLocation.scaleLocation = shader->GetLocation("positionScale");
+	MeshTech::SetMaterialArrays(shader);
+	SetPositionRange(glm::vec4(0.f), glm::vec4(1.f));
+
+	glm::mat4 mat(1.f);
+	shader->SetMat4(modelLocation, mat);
+
+	return true;
+}
+
+void MeshBatchTech::SetModel(glm::mat4& model)
+{
+	shader->Use();
+	shader->SetMat4(modelLocation, model);
+}
+
+void MeshBatchTech::SetPositionRange(const glm::vec4& offset, const glm::vec4& scale)
+{
+	shader->SetVec4(positionLocation.offsetLocation, offset);
+	shader->SetVec4(positionLocation.scaleLocation, scale);
+}
+
+void MeshBatchTech::SetPositionRange(const glm::vec4& offset, const glm::vec4& scale, Graphic::CommandBuffer* commandBuffer)
+{
+	commandBuffer->Uniform4f(positionLocation.offsetLocation, offset);
+	commandBuffer->Uniform4f(positionLocation.scaleLocation, scale);
 }
 
-void MeshTech::BindTexture(GLuint textureID)
+void MeshBatchTech::BindMaterials(GLuint materialBuffer)
 {
-	GLCall(glBindTexture(GL_TEXTURE_2D, textureID));
+	Graphic::GLBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_BINDING, materialBuffer);
 }
 
-void MeshTech::ActiveTexture(GLenum texture)
+void MeshBatchTech::BindMaterials(GLuint materialBuffer, Graphic::CommandBuffer* commandBuffer)
 {
-	GLCall(glActiveTexture(texture));
+	commandBuffer->BindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_BINDING, materialBuffer);
 }
@@ -5,36 +5,111 @@
 class MeshTech : public Technique
 {
 public:
+	static constexpr Features DIFFUSE_TEXTURE = 1 << 0;
+	static constexpr Features SPECULAR_TEXTURE = 1 << 1;
+	static constexpr Features AMBIENT_TEXTURE = 1 << 2;
+
 	MeshTech();
 	~MeshTech();
 
+	void Compile();
 	bool Init();
 
-	void SetProjectionView(glm::mat4& projection);
 	void SetModel(glm::mat4& model);
-	void SetDiffuseMap(GLuint textureUnit);
-	void SetSpeculatMap(GLuint textureUnit);
-	void SetAmbientMap(GLuint textureUnit);
+	void SetMaterial(GLint diffuse, GLint specular, GLint ambient); ///< indices of the model's material textures, -1 for none
+	void SetPositionRange(const glm::vec4& offset, const glm::vec4& scale); ///< dequantization of packed positions
+
+	// record into a command buffer instead of calling GL
+	void SetMaterial(GLint diffuse, GLint specular, GLint ambient, Graphic::CommandBuffer* commandBuffer);
+	void SetPositionRange(const glm::vec4& offset, const glm::vec4& scale, Graphic::CommandBuffer* commandBuffer);
 
+	static void SetMaterialArrays(Graphic::Shader* shader); ///< samplers of material texture arrays read their units
+	static Features GetMaterialFeatures(GLint diffuse, GLint specular, GLint ambient); ///< minimal variant of a material
 
-	void BindTexture(GLuint textureID);
-	void ActiveTexture(GLenum texture);
+protected:
+	Graphic::Shader* CompileVariant(Features features);
+	void InitVariant(Graphic::Shader* variant);
 
 private:
-	GLuint projectionLocation;
 	GLuint viewLocation;
 	GLuint modelLocation;
+	glm::mat4 model;	///< set on the variants created later
+
+	struct MaterialLocation
+	{
+		GLuint diffuseLocation;
+		GLuint specularLocation;
+		GLuint ambientLocation;
+	};
+
+	MaterialLocation materialLocation;
 
-	struct TextureLocation
+	/**
+	*	locations of the position range, shared by all mesh techniques
+	*/
+	struct PositionLocation
 	{
-		GLuint textureDiffuseLocation;
-		GLuint textureSpecularLocation;
-		GLuint textureAmbientLocation;
+		GLuint offsetLocation;
+		GLuint scaleLocation;
 	};
 
+	PositionLocation positionLocation;
 
-	TextureLocation txLocation0;
-	TextureLocation txLocation1;
+	friend class MeshDepthTech;
+	friend class MeshBatchTech;
+};
+
+/**
+*	\description: class MeshDepthTech: depth-only technique of the depth pre-pass, it reads positions and instance
+*	transforms only. gl_Position is invariant and computed like MeshTech, so the shading pass can test with GL_EQUAL.
+*/
+class MeshDepthTech : public Technique
+{
+public:
+	MeshDepthTech();
+	~MeshDepthTech();
+
+	void Compile();
+	bool Init();
+
+	void SetModel(glm::mat4& model);
+	void SetPositionRange(const glm::vec4& offset, const glm::vec4& scale);
+	void SetPositionRange(const glm::vec4& offset, const glm::vec4& scale, Graphic::CommandBuffer* commandBuffer);
+
+private:
+	GLuint modelLocation;
+	MeshTech::PositionLocation positionLocation;
+
+};
+
+/**
+*	\description: class MeshBatchTech: technique of MeshBatch, the material of every draw of a multi-draw-indirect call
+*	is read from a storage buffer by gl_DrawIDARB, and its textures are selected from the model's material textures.
+*
+*	\detail: the draw ID is not dynamically uniform, the material textures of the model must be created for a varying
+*	index, see Graphic::MaterialTextures(true).
+*/
+class MeshBatchTech : public Technique
+{
+public:
+	static constexpr GLuint MATERIAL_BINDING = 1;
+
+	MeshBatchTech();
+	~MeshBatchTech();
+
+	void Compile();
+	bool Init();
+
+	void SetModel(glm::mat4& model);
+	void BindMaterials(GLuint materialBuffer);
+	void SetPositionRange(const glm::vec4& offset, const glm::vec4& scale);
+
+	// record into a command buffer instead of calling GL
+	void BindMaterials(GLuint materialBuffer, Graphic::CommandBuffer* commandBuffer);
+	void SetPositionRange(const glm::vec4& offset, const glm::vec4& scale, Graphic::CommandBuffer* commandBuffer);
+
+private:
+	GLuint modelLocation;
+	MeshTech::PositionLocation positionLocation;
 
-};	
-	
+};
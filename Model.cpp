@@ -1,21 +1,68 @@
 #include "Model.h"
 #include "MeshTech.h"
 #include "Light.h"
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+#include <cfloat>
+#include <assimp/DefaultIOSystem.h>
+
+namespace
+{
+	constexpr unsigned int INVALID_SLOT = 0xffffffff;
+	constexpr GLuint INSTANCE_ATTRIBUTE_LAYOUT = 5;
+	constexpr float FULL_DETAIL_COVERAGE = 0.5f;	///< projected radius over half the viewport height drawn at full detail
+	constexpr float OCCLUDER_COVERAGE = 0.25f;		///< meshes projected larger than this are picked as occluders
+
+	/**
+	*	keeps the path of every file the importer opens, e.g. the .mtl libraries of an .obj, for the model cache
+	*/
+	class RecordingIOSystem : public Assimp::DefaultIOSystem
+	{
+	public:
+		explicit RecordingIOSystem(std::vector<std::string>& files)
+			:files(files)
+		{
+		}
+
+		Assimp::IOStream* Open(const char* file, const char* mode = "rb") override
+		{
+			files.push_back(file);
+			return DefaultIOSystem::Open(file, mode);
+		}
+
+	private:
+		std::vector<std::string>& files;
+	};
+}
+
 Model::Model(Graphic::Renderer* renderer)
-	:renderer(renderer), meshes(), meshTech(new MeshTech()), light(new Light())
+	:renderer(renderer), meshes(), meshTech(new MeshTech()), depthTech(new MeshDepthTech()), light(new Light()), instanceBuffer(0), instanceTransforms(),
+	handleToSlot(), slotToHandle(), freeHandles(), instancesDirty(false), batch(nullptr),
+	materialTextures(new Graphic::MaterialTextures()), loadedTextures(), meshBounds(), modelBounds(), instanceItems(),
+	inScene(false), sphereX(), sphereY(), sphereZ(), sphereRadius(), sphereVisibility(), meshVisibility(), meshLevels(), meshCoverages(), meshDepths(), occluders(), occlusionBoxes(),
+	occlusionSpheres(), occlusionVisibility(), occluder(false), occluderFrame(UINT64_MAX), occlusionFrame(UINT64_MAX), modelMatrix(1.f),
+	boundsDirty(true), cullFrame(UINT64_MAX), visibleTransforms(), instanceRanges(), uploadedVisibility(), instanceFrame(UINT64_MAX),
+	modelCache(nullptr)
 {
 }
 
 Model::~Model()
 {
+	RemoveFromScene();
 	delete meshTech;
+	delete depthTech;
+	SafeDelete(materialTextures);
+
+	if (instanceBuffer != 0) {
+		Graphic::GLDeleteBuffers(1, &instanceBuffer);
+	}
 }
 
-bool Model::Load(const wchar_t* filePath)
+bool Model::Load(const wchar_t* filePath, unsigned int flags)
 {
 	std::string path = Unicode::UnicodeToMultibytes(filePath).c_str();
 	directory = path.substr(0, path.find_last_of('/'));
@@ -23,39 +70,501 @@ bool Model::Load(const wchar_t* filePath)
 	if(!meshTech->Init()) {
 		return false;
 	}
-
-	Assimp::Importer importer;
-	const aiScene* scene = importer.ReadFile(path.c_str(), aiProcess_Triangulate | aiProcess_FlipUVs);
-	if (scene == nullptr || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || scene->mRootNode == nullptr) {
-		std::string excepMessage = "Exception::Model::Load(): Load model" + path + " failed!";
-		throw std::invalid_argument(excepMessage.c_str());
+	if (!depthTech->Init()) {
 		return false;
 	}
 
 	/**
-	*	process node
+	*	all meshes share the instance buffer of this model
 	*/
-	ProcessNode(scene->mRootNode, scene);
+	Graphic::GLGenBuffers(1, &instanceBuffer);
+	AddInstance(glm::mat4(1.f));
 
-	importer.FreeScene();
+	/**
+	*	batched drawing needs multi-draw-indirect, draw parameters and storage buffers
+	*/
+	if (flags & LOAD_BATCHED) {
+		if (GLEW_ARB_multi_draw_indirect && GLEW_ARB_shader_draw_parameters && GLEW_ARB_shader_storage_buffer_object) {
+			batch = new MeshBatch();
+			batch->model = this;
+			// the batch selects textures by the draw ID, which is not dynamically uniform
+			SafeDelete(materialTextures);
+			materialTextures = new Graphic::MaterialTextures(true);
+		}
+		else {
+			Debug::ShowMessage("Model::Load(): multi-draw-indirect is unsupported, meshes are drawn one by one.");
+		}
+	}
+
+	/**
+	*	meshes drawn one by one are uploaded from the cache of an earlier import, a batch packs all meshes with one
+	*	position range so it is always imported
+	*/
+	Graphic::ModelCache cache;
+	const bool cached = batch == nullptr && cache.Open(filePath) && LoadCache(cache);
+	cache.Close();
+	if (!cached) {
+		Assimp::Importer importer;
+		std::vector<std::string> importedFiles;
+		importer.SetIOHandler(new RecordingIOSystem(importedFiles)); // owned by the importer
+		const aiScene* scene = importer.ReadFile(path.c_str(), aiProcess_Triangulate | aiProcess_FlipUVs);
+		if (scene == nullptr || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || scene->mRootNode == nullptr) {
+			std::string excepMessage = "Exception::Model::Load(): Load model" + path + " failed!";
+			throw std::invalid_argument(excepMessage.c_str());
+			return false;
+		}
+
+		/**
+		*	process node
+		*/
+		modelCache = batch ? nullptr : &cache;
+		ProcessMeshes(scene);
+		if (modelCache) {
+			for (const std::string& file : importedFiles) {
+				if (file != path) {
+					modelCache->AddDependency(file.c_str());
+				}
+			}
+			modelCache->Write(filePath);
+			modelCache = nullptr;
+		}
+		importer.FreeScene();
+	}
+	materialTextures->Finalize();
+	if (batch == nullptr) {
+		// the variants of all materials compile at once, the first frame waits for them
+		for (Mesh* mesh : meshes) {
+			meshTech->Precompile(MeshTech::GetMaterialFeatures(mesh->material.diffuse, mesh->material.specular, mesh->material.ambient));
+		}
+	}
+	AddToScene();
+
+	if (batch) {
+		batch->Finalize(instanceBuffer);
+		renderer->AddObeject(batch);
+	}
 
 	return true;
 }
 
-void Model::SetProjectionView(glm::mat4& projection)
+void Model::SetOccluder(bool occluder)
 {
-	meshTech->SetProjectionView(projection);
+	this->occluder = occluder;
 }
 
 void Model::SetModel(glm::mat4& model)
 {
+	if (model != modelMatrix) {
+		modelMatrix = model;
+		boundsDirty = true;
+
+		Graphic::SceneBVH* sceneBVH = Graphic::Renderer::GetSceneBVH();
+		if (inScene && sceneBVH) {
+			for (size_t slot = 0; slot < instanceItems.size(); ++slot) {
+				sceneBVH->Update(instanceItems[slot], GetInstanceBox(instanceTransforms[slot]));
+			}
+		}
+	}
 	meshTech->SetModel(model);
+	depthTech->SetModel(model);
+	if (batch) {
+		batch->batchTech->SetModel(model);
+	}
+}
+
+Model::InstanceHandle Model::AddInstance(const glm::mat4& transform)
+{
+	InstanceHandle handle = 0;
+	if (!freeHandles.empty()) {
+		handle = freeHandles.back();
+		freeHandles.pop_back();
+	}
+	else {
+		handle = static_cast<InstanceHandle>(handleToSlot.size());
+		handleToSlot.push_back(INVALID_SLOT);
+	}
+
+	handleToSlot[handle] = static_cast<unsigned int>(instanceTransforms.size());
+	instanceTransforms.push_back(transform);
+	slotToHandle.push_back(handle);
+
+	Graphic::SceneBVH* sceneBVH = Graphic::Renderer::GetSceneBVH();
+	instanceItems.push_back(inScene && sceneBVH ? sceneBVH->Insert(GetInstanceBox(transform)) : Graphic::SceneBVH::INVALID_ITEM);
+	instancesDirty = true;
+	boundsDirty = true;
+
+	return handle;
+}
+
+void Model::SetInstanceTransform(InstanceHandle handle, const glm::mat4& transform)
+{
+	if (handle >= handleToSlot.size() || handleToSlot[handle] == INVALID_SLOT) {
+		throw std::invalid_argument("Exception::Model::SetInstanceTransform(): Invalid instance handle!");
+	}
+	instanceTransforms[handleToSlot[handle]] = transform;
+
+	// moving instances only refit the hierarchy
+	Graphic::SceneBVH* sceneBVH = Graphic::Renderer::GetSceneBVH();
+	if (inScene && sceneBVH) {
+		sceneBVH->Update(instanceItems[handleToSlot[handle]], GetInstanceBox(transform));
+	}
+	instancesDirty = true;
+	boundsDirty = true;
+}
+
+void Model::RemoveInstance(InstanceHandle handle)
+{
+	if (handle >= handleToSlot.size() || handleToSlot[handle] == INVALID_SLOT) {
+		throw std::invalid_argument("Exception::Model::RemoveInstance(): Invalid instance handle!");
+	}
+
+	/**
+	*	move the last slot into the removed one to keep transforms packed
+	*/
+	unsigned int slot = handleToSlot[handle];
+	unsigned int lastSlot = static_cast<unsigned int>(instanceTransforms.size() - 1);
+	InstanceHandle lastHandle = slotToHandle[lastSlot];
+
+	Graphic::SceneBVH* sceneBVH = Graphic::Renderer::GetSceneBVH();
+	if (inScene && sceneBVH) {
+		sceneBVH->Remove(instanceItems[slot]);
+	}
+
+	instanceTransforms[slot] = instanceTransforms[lastSlot];
+	instanceItems[slot] = instanceItems[lastSlot];
+	slotToHandle[slot] = lastHandle;
+	handleToSlot[lastHandle] = slot;
+
+	instanceTransforms.pop_back();
+	instanceItems.pop_back();
+	slotToHandle.pop_back();
+	handleToSlot[handle] = INVALID_SLOT;
+	freeHandles.push_back(handle);
+	instancesDirty = true;
+	boundsDirty = true;
+}
+
+size_t Model::GetInstanceCount() const
+{
+	return instanceTransforms.size();
+}
+
+void Model::UploadInstances()
+{
+	const uint64_t frame = Graphic::Renderer::GetFrameIndex();
+	if (instanceFrame == frame || instanceBuffer == 0) {
+		return;
+	}
+	instanceFrame = frame;
+
+	// the ranges only change with the transforms or the visibility of the instances
+	CullOccluded();
+	if (!instancesDirty && sphereVisibility == uploadedVisibility) {
+		return;
+	}
+
+	/**
+	*	visible instances of each mesh are packed into one range, mesh major, so a mesh draws only its visible instances
+	*/
+	const size_t meshCount = meshBounds.size();
+	const size_t instanceCount = instanceTransforms.size();
+	visibleTransforms.clear();
+	instanceRanges.assign(meshCount, Mesh::InstanceRange{ 0, 0 });
+	for (size_t mesh = 0; mesh < meshCount; ++mesh) {
+		instanceRanges[mesh].first = static_cast<GLuint>(visibleTransforms.size());
+		for (size_t instance = 0; instance < instanceCount; ++instance) {
+			if (sphereVisibility[instance * meshCount + mesh]) {
+				visibleTransforms.push_back(instanceTransforms[instance]);
+			}
+		}
+		instanceRanges[mesh].count = static_cast<GLuint>(visibleTransforms.size()) - instanceRanges[mesh].first;
+	}
+
+	// glBufferData orphans the storage in use by former frames
+	Graphic::GLBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	Graphic::GLBufferData(GL_ARRAY_BUFFER, visibleTransforms.size() * sizeof(glm::mat4),
+		visibleTransforms.empty() ? nullptr : &visibleTransforms[0], GL_DYNAMIC_DRAW);
+	Graphic::GLBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	for (Mesh* mesh : meshes) {
+		const Mesh::InstanceRange& range = instanceRanges[mesh->boundsIndex];
+		mesh->primitive->SetInstanceRange(range.first, range.count);
+		mesh->depthPrimitive->SetInstanceRange(range.first, range.count);
+	}
+	if (batch) {
+		batch->SetInstanceRanges(instanceRanges);
+	}
+	uploadedVisibility = sphereVisibility;
+	instancesDirty = false;
 }
 
-Model* Model::LoadModel(const wchar_t* filePath, Graphic::Renderer* renderer)
+void Model::UpdateBounds()
+{
+	if (!boundsDirty) {
+		return;
+	}
+
+	const size_t instanceCount = instanceTransforms.size();
+	const size_t count = meshBounds.size() * instanceCount;
+	sphereX.resize(count);
+	sphereY.resize(count);
+	sphereZ.resize(count);
+	sphereRadius.resize(count);
+
+	const size_t meshCount = meshBounds.size();
+	for (size_t instance = 0; instance < instanceCount; ++instance) {
+		const glm::mat4 world = modelMatrix * instanceTransforms[instance];
+		// spheres are scaled by the largest axis
+		const float scale = std::sqrt((std::max)({ glm::dot(glm::vec3(world[0]), glm::vec3(world[0])),
+			glm::dot(glm::vec3(world[1]), glm::vec3(world[1])), glm::dot(glm::vec3(world[2]), glm::vec3(world[2])) }));
+
+		for (size_t mesh = 0; mesh < meshCount; ++mesh) {
+			const size_t index = instance * meshCount + mesh;
+			const glm::vec4 center = world * glm::vec4(meshBounds[mesh].center, 1.f);
+			sphereX[index] = center.x;
+			sphereY[index] = center.y;
+			sphereZ[index] = center.z;
+			sphereRadius[index] = meshBounds[mesh].radius * scale;
+		}
+	}
+
+	boundsDirty = false;
+}
+
+void Model::Cull()
+{
+	const uint64_t frame = Graphic::Renderer::GetFrameIndex();
+	if (cullFrame == frame) {
+		return;
+	}
+	cullFrame = frame;
+
+	UpdateBounds();
+
+	const size_t instanceCount = instanceTransforms.size();
+	const size_t meshCount = meshBounds.size();
+	sphereVisibility.assign(sphereX.size(), 0);
+	meshVisibility.assign(meshCount, 0);
+
+	/**
+	*	meshes of instances rejected by the scene hierarchy stay invisible,
+	*	consecutive visible instances are tested by one call of the kernel
+	*/
+	const Graphic::Frustum& frustum = Graphic::Renderer::GetFrustum();
+	const Graphic::SceneBVH* sceneBVH = Graphic::Renderer::GetSceneBVH();
+	size_t instance = 0;
+	while (instance < instanceCount) {
+		auto instanceVisible = [&](size_t slot) {
+			return !inScene || sceneBVH == nullptr || instanceItems[slot] == Graphic::SceneBVH::INVALID_ITEM ||
+				sceneBVH->IsVisible(instanceItems[slot]);
+		};
+		if (!instanceVisible(instance)) {
+			instance++;
+			continue;
+		}
+
+		size_t last = instance + 1;
+		while (last < instanceCount && instanceVisible(last)) {
+			last++;
+		}
+		const size_t first = instance * meshCount;
+		frustum.CullSpheres(&sphereX[first], &sphereY[first], &sphereZ[first], &sphereRadius[first],
+			(last - instance) * meshCount, &sphereVisibility[first]);
+		instance = last;
+	}
+
+	/**
+	*	level of detail from the projected size of the largest visible instance of each mesh, every level halves the
+	*	triangles, so one level is dropped each time the projected radius halves
+	*/
+	const Graphic::FrameConstants& frameConstants = Graphic::Renderer::GetFrameConstants();
+	std::vector<float>& coverages = meshCoverages;
+	coverages.assign(meshCount, 0.f);
+	meshDepths.assign(meshCount, 1.f);
+
+	// far plane of the perspective projection, P[3][2] / (P[2][2] + 1) = far
+	const float depthScale = frameConstants.projection[2][2] + 1.f != 0.f ?
+		(frameConstants.projection[2][2] + 1.f) / frameConstants.projection[3][2] : 0.f;
+	for (size_t index = 0; index < sphereVisibility.size(); ++index) {
+		if (!sphereVisibility[index]) {
+			continue;
+		}
+		const size_t mesh = index % meshCount;
+		meshVisibility[mesh] = 1;
+
+		const glm::vec4 center = frameConstants.view * glm::vec4(sphereX[index], sphereY[index], sphereZ[index], 1.f);
+		const float distance = glm::length(glm::vec3(center));
+		const float coverage = distance > sphereRadius[index] ? frameConstants.projection[1][1] * sphereRadius[index] / distance : FLT_MAX;
+		coverages[mesh] = (std::max)(coverages[mesh], coverage);
+		meshDepths[mesh] = (std::min)(meshDepths[mesh], (std::max)(distance - sphereRadius[index], 0.f) * depthScale);
+	}
+
+	const float bias = Graphic::Renderer::GetLODBias();
+	meshLevels.assign(meshCount, 0);
+	for (size_t mesh = 0; mesh < meshCount; ++mesh) {
+		if (!meshVisibility[mesh] || coverages[mesh] <= 0.f) {
+			continue;
+		}
+		const float level = std::floor(std::log2(FULL_DETAIL_COVERAGE / coverages[mesh]) + bias);
+		meshLevels[mesh] = static_cast<uint8_t>((std::min)((std::max)(level, 0.f), 255.f));
+	}
+
+	uint32_t visible = 0;
+	for (uint8_t meshVisible : meshVisibility) {
+		visible += meshVisible;
+	}
+	Graphic::Renderer::AddCullingStatistics(visible, static_cast<uint32_t>(meshCount) - visible);
+}
+
+void Model::AddToScene()
+{
+	Graphic::SceneBVH* sceneBVH = Graphic::Renderer::GetSceneBVH();
+	if (inScene || sceneBVH == nullptr) {
+		return;
+	}
+
+	modelBounds = { glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX), glm::vec3(0.f), 0.f };
+	for (const Mesh::Bounds& bounds : meshBounds) {
+		modelBounds.minimum = glm::min(modelBounds.minimum, bounds.minimum);
+		modelBounds.maximum = glm::max(modelBounds.maximum, bounds.maximum);
+	}
+	if (meshBounds.empty()) {
+		modelBounds.minimum = glm::vec3(0.f);
+		modelBounds.maximum = glm::vec3(0.f);
+	}
+	modelBounds.center = (modelBounds.minimum + modelBounds.maximum) * 0.5f;
+	modelBounds.radius = glm::length(modelBounds.maximum - modelBounds.center);
+
+	inScene = true;
+	for (size_t slot = 0; slot < instanceTransforms.size(); ++slot) {
+		instanceItems[slot] = sceneBVH->Insert(GetInstanceBox(instanceTransforms[slot]));
+	}
+}
+
+void Model::RemoveFromScene()
+{
+	Graphic::SceneBVH* sceneBVH = Graphic::Renderer::GetSceneBVH();
+	if (inScene && sceneBVH) {
+		for (uint32_t item : instanceItems) {
+			if (item != Graphic::SceneBVH::INVALID_ITEM) {
+				sceneBVH->Remove(item);
+			}
+		}
+	}
+	instanceItems.assign(instanceItems.size(), Graphic::SceneBVH::INVALID_ITEM);
+	inScene = false;
+}
+
+Graphic::SceneBVH::Box Model::GetInstanceBox(const glm::mat4& transform) const
+{
+	return Graphic::SceneBVH::Transform({ modelBounds.minimum, modelBounds.maximum }, modelMatrix * transform);
+}
+
+void Model::SubmitOccluders(Graphic::OcclusionCuller* occlusionCuller)
+{
+	const uint64_t frame = Graphic::Renderer::GetFrameIndex();
+	if (occluderFrame == frame) {
+		return;
+	}
+	occluderFrame = frame;
+
+	Cull();
+
+	/**
+	*	every visible instance of an occluding mesh is drawn with its coarsest level
+	*/
+	const size_t meshCount = meshBounds.size();
+	for (size_t index = 0; index < sphereVisibility.size(); ++index) {
+		const size_t mesh = index % meshCount;
+		if (!sphereVisibility[index] || occluders[mesh].indices.empty() || (!occluder && meshCoverages[mesh] < OCCLUDER_COVERAGE)) {
+			continue;
+		}
+		const Mesh::Occluder& geometry = occluders[mesh];
+		occlusionCuller->AddOccluder(geometry.positions.data(), geometry.positions.size(), geometry.indices.data(),
+			geometry.indices.size(), modelMatrix * instanceTransforms[index / meshCount]);
+	}
+}
+
+void Model::CullOccluded()
+{
+	Cull();
+
+	const uint64_t frame = Graphic::Renderer::GetFrameIndex();
+	if (occlusionFrame == frame) {
+		return;
+	}
+	occlusionFrame = frame;
+
+	Graphic::OcclusionCuller* occlusionCuller = Graphic::Renderer::GetOcclusionCuller();
+	if (occlusionCuller == nullptr || !occlusionCuller->HasOccluders()) {
+		return;
+	}
+
+	/**
+	*	world boxes of the spheres which passed the frustum are tested in one batch
+	*/
+	const size_t meshCount = meshBounds.size();
+	occlusionBoxes.clear();
+	occlusionSpheres.clear();
+	for (size_t index = 0; index < sphereVisibility.size(); ++index) {
+		if (!sphereVisibility[index]) {
+			continue;
+		}
+		const Mesh::Bounds& bounds = meshBounds[index % meshCount];
+		occlusionBoxes.push_back(Graphic::SceneBVH::Transform({ bounds.minimum, bounds.maximum },
+			modelMatrix * instanceTransforms[index / meshCount]));
+		occlusionSpheres.push_back(static_cast<uint32_t>(index));
+	}
+
+	occlusionVisibility.resize(occlusionBoxes.size());
+	if (occlusionCuller->TestBoxes(occlusionBoxes.data(), occlusionBoxes.size(), occlusionVisibility.data()) == occlusionBoxes.size()) {
+		return;
+	}
+
+	for (size_t i = 0; i < occlusionSpheres.size(); ++i) {
+		sphereVisibility[occlusionSpheres[i]] = occlusionVisibility[i];
+	}
+
+	// Cull() has counted the meshes inside the frustum as visible
+	uint32_t visibleBefore = 0;
+	for (uint8_t meshVisible : meshVisibility) {
+		visibleBefore += meshVisible;
+	}
+	meshVisibility.assign(meshCount, 0);
+	for (size_t index = 0; index < sphereVisibility.size(); ++index) {
+		if (sphereVisibility[index]) {
+			meshVisibility[index % meshCount] = 1;
+		}
+	}
+	uint32_t visible = 0;
+	for (uint8_t meshVisible : meshVisibility) {
+		visible += meshVisible;
+	}
+	Graphic::Renderer::AddOcclusionStatistics(visibleBefore - visible);
+}
+
+bool Model::IsVisible(GLuint boundsIndex) const
+{
+	return boundsIndex < meshVisibility.size() && meshVisibility[boundsIndex] != 0;
+}
+
+size_t Model::GetLevel(GLuint boundsIndex, size_t levelCount) const
+{
+	if (boundsIndex >= meshLevels.size() || levelCount == 0) {
+		return 0;
+	}
+	return (std::min)(static_cast<size_t>(meshLevels[boundsIndex]), levelCount - 1);
+}
+
+float Model::GetDepth(GLuint boundsIndex) const
+{
+	return boundsIndex < meshDepths.size() ? meshDepths[boundsIndex] : 1.f;
+}
+
+Model* Model::LoadModel(const wchar_t* filePath, Graphic::Renderer* renderer, unsigned int flags)
 {
 	Model* model = new Model(renderer);
-	if (!model->Load(filePath)) {
+	if (!model->Load(filePath, flags)) {
 		SafeDelete(model);
 		return nullptr;
 	}
@@ -63,29 +572,69 @@ Model* Model::LoadModel(const wchar_t* filePath, Graphic::Renderer* renderer)
 	return model;
 }
 
-void Model::ProcessNode(aiNode* node, const aiScene* scene)
+void Model::ProcessNode(aiNode* node, const aiScene* scene, std::vector<aiMesh*>& sceneMeshes) const
 {
 	for (unsigned int i : Range<unsigned int>(0, node->mNumMeshes)) {
-		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-		meshes.push_back(ProcessMesh(mesh, scene));
+		sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
 	}
 	/** process children node */
 	for (unsigned int i : Range<unsigned int>(0, node->mNumChildren)) {
-		ProcessNode(node->mChildren[i], scene);
+		ProcessNode(node->mChildren[i], scene, sceneMeshes);
 	}
 }
 
-Mesh* Model::ProcessMesh(aiMesh* mesh, const aiScene* scene)
+void Model::ProcessMeshes(const aiScene* scene)
 {
-	Mesh* newMesh = new Mesh();
-	newMesh->meshTech = meshTech;
+	/**
+	*	meshes are collected in node order and converted by the workers of the thread pool, then their GL objects are
+	*	created on this thread in the same order, so texture indices and the cache do not depend on the scheduling
+	*/
+	std::vector<aiMesh*> sceneMeshes;
+	ProcessNode(scene->mRootNode, scene, sceneMeshes);
 
+	std::vector<ImportedMesh> importedMeshes(sceneMeshes.size());
+	ThreadPool::GetInstance().ParallelFor(sceneMeshes.size(), [&](size_t index) {
+		ProcessMesh(sceneMeshes[index], scene, importedMeshes[index]);
+	});
+
+	// the index type is the one chosen by Mesh::PackIndices(), a batch packs the indices of all meshes at once
+	for (const ImportedMesh& imported : importedMeshes) {
+		const Mesh::OptimizeStatistics& optimization = imported.optimization;
+		const char* indexText = batch ? ", indices packed by the batch" :
+			(imported.indexType == GL_UNSIGNED_SHORT ? ", 16-bit indices" : ", 32-bit indices");
+		std::string message = "Mesh::Optimize(): " + imported.name + " ACMR " + std::to_string(optimization.acmrBefore) +
+			" -> " + std::to_string(optimization.acmrAfter) + ", vertices " + std::to_string(optimization.verticesBefore) + " -> " +
+			std::to_string(optimization.verticesAfter) + indexText;
+		Debug::ShowMessage(message.c_str());
+	}
+
+	std::vector<std::string> texturePaths;
+	for (const ImportedMesh& imported : importedMeshes) {
+		for (auto& texture : imported.textures) {
+			texturePaths.push_back(texture.first);
+		}
+	}
+	LoadTextures(texturePaths);
+
+	for (ImportedMesh& imported : importedMeshes) {
+		Mesh* newMesh = CreateMesh(imported);
+		if (newMesh) {
+			meshes.push_back(newMesh);
+		}
+		// staging data of the mesh live in GPU memory now
+		imported = ImportedMesh();
+	}
+}
+
+void Model::ProcessMesh(aiMesh* mesh, const aiScene* scene, ImportedMesh& imported) const
+{
 	/** 
-	*	process vertices and indices
+	*	process vertices and indices, runs on a worker so it only reads the scene and writes the imported mesh
 	*/
-	std::vector<Mesh::Vertex> vertices;
+	std::vector<Mesh::Vertex>& vertices = imported.vertices;
+	vertices.resize(mesh->mNumVertices);
 	for (unsigned int i : Range<unsigned int>(0, mesh->mNumVertices)) {
-		Mesh::Vertex vertex = {};
+		Mesh::Vertex& vertex = vertices[i];
 		/** position */
 		vertex.position.x = mesh->mVertices[i].x;
 		vertex.position.y = mesh->mVertices[i].y;
@@ -118,12 +667,11 @@ Mesh* Model::ProcessMesh(aiMesh* mesh, const aiScene* scene)
 		else {
 			vertex.textureCoord = glm::vec2(0.f);
 		}
-
-		vertices.push_back(vertex);
 	}
 
 	/** process indices */
-	std::vector<GLuint> indices;
+	std::vector<GLuint>& indices = imported.indices;
+	indices.reserve(static_cast<size_t>(mesh->mNumFaces) * 3);
 	for (unsigned int i : Range<unsigned int>(0, mesh->mNumFaces)) {
 		aiFace& face = mesh->mFaces[i];
 		for (int k : Range<int>(0, face.mNumIndices)) {
@@ -131,115 +679,275 @@ Mesh* Model::ProcessMesh(aiMesh* mesh, const aiScene* scene)
 		}
 	}
 
-	/** set vertices and indices to mesh */
-	newMesh->SetVerticesAndIndices(vertices, indices);
-
-
 	/**
-	*	process textures
+	*	process textures, only their paths here, files are decoded once for all meshes
 	*/
-	auto checkTexturesRedundancy = [&](unsigned int hash)->bool {
-		try
-		{
-			newMesh->textures.at(hash);
-			return true;
-		}
-		catch (const std::exception&)
-		{
-			return false;
-		}
-	};
-
 	if (mesh->mMaterialIndex >= 0) {
 		aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
 
-		/** load diffuse textures */
-		std::map<unsigned int, Mesh::Texture> diffuseMaps;
-		for (unsigned int i : Range<unsigned int>(0, material->GetTextureCount(aiTextureType_DIFFUSE))) {
-			aiString path;
-			material->GetTexture(aiTextureType_DIFFUSE, i, &path);
-
-			unsigned int hash = 0;
-			if (path.length == 0 || checkTexturesRedundancy(hash = HashString::FNV_1A_Multibyte(path.C_Str(), path.length))) {
-				continue;
-			}
-			else {
-				Mesh::Texture texture = {};
-				texture.textureID = LoadTexture(path.C_Str());
-				texture.type = Mesh::TextureType::TEXTURE_DIFFUSE;
-				newMesh->textures.insert(std::pair<unsigned int, Mesh::Texture>(hash, texture));
+		/** diffuse and specular textures, ambient textures are not loaded */
+		const std::pair<aiTextureType, Mesh::TextureType> types[] = {
+			{ aiTextureType_DIFFUSE, Mesh::TextureType::TEXTURE_DIFFUSE },
+			{ aiTextureType_SPECULAR, Mesh::TextureType::TEXTURE_SPECULAR }
+		};
+		std::set<unsigned int> hashes;
+		for (auto& type : types) {
+			for (unsigned int i : Range<unsigned int>(0, material->GetTextureCount(type.first))) {
+				aiString path;
+				material->GetTexture(type.first, i, &path);
+				if (path.length == 0 || !hashes.insert(HashString::FNV_1A_Multibyte(path.C_Str(), path.length)).second) {
+					continue;
+				}
+				imported.textures.push_back(std::make_pair(std::string(path.C_Str()), type.second));
 			}
 		}
+	}
 
-		/** load specular textures */
-		std::map<unsigned int, Mesh::Texture> specularMaps;
-		for (unsigned int i : Range<unsigned int>(0, material->GetTextureCount(aiTextureType_SPECULAR))) {
-			aiString path;
-			material->GetTexture(aiTextureType_SPECULAR, i, &path);
+	imported.name = mesh->mName.C_Str();
+	imported.optimization = Mesh::Optimize(vertices, indices);
 
-			unsigned int hash = 0;
-			if (path.length == 0 || checkTexturesRedundancy(hash = HashString::FNV_1A_Multibyte(path.C_Str(), path.length))) {
-				continue;
-			}
-			else {
-				Mesh::Texture texture = {};
-				texture.textureID = LoadTexture(path.C_Str());
-				texture.type = Mesh::TextureType::TEXTURE_SPECULAR;
-				newMesh->textures.insert(std::pair<unsigned int, Mesh::Texture>(hash, texture));
-			}
+	imported.bounds = Mesh::ComputeBounds(vertices);
+	imported.levels = Mesh::BuildLevels(vertices, indices);
+	imported.occluder = Mesh::MakeOccluder(vertices, indices, imported.levels.empty() ? Mesh::Level{ 0, 0 } : imported.levels.back());
+
+	/**
+	*	a batch packs all meshes with one position range when it is finalized
+	*/
+	if (batch == nullptr) {
+		imported.positionRange = Mesh::MakePositionRange(imported.bounds);
+		imported.packedVertices = Mesh::PackVertices(vertices, imported.positionRange);
+		imported.depthVertices = Mesh::PackDepthVertices(vertices, imported.positionRange);
+		imported.indexType = Mesh::PackIndices(indices, imported.shortIndices);
+	}
+}
+
+Mesh* Model::CreateMesh(ImportedMesh& imported)
+{
+	std::map<unsigned int, Mesh::Texture> textures;
+	for (auto& texture : imported.textures) {
+		const unsigned int hash = HashString::FNV_1A_Multibyte(texture.first.c_str(), texture.first.size());
+		auto loaded = loadedTextures.find(hash);
+		if (loaded != loadedTextures.end()) {
+			textures.insert(std::make_pair(hash, Mesh::Texture{ loaded->second, texture.second }));
 		}
+	}
 
-		/** load ambient textures... */
-		
+	/**
+	*	a batched model only appends the mesh into its batch
+	*/
+	boundsDirty = true;
+	if (batch) {
+		if (batch->AddMesh(imported.vertices, imported.indices, imported.levels, textures)) {
+			meshBounds.push_back(imported.bounds);
+			occluders.push_back(std::move(imported.occluder));
+		}
+		return nullptr;
+	}
+
+	const Mesh::Bounds& bounds = imported.bounds;
+	const std::vector<Mesh::Level>& levels = imported.levels;
+	Mesh* newMesh = CreateMesh(bounds, imported.positionRange, levels, std::move(imported.occluder));
+
+	/** set vertices and indices to mesh, the packed data is what the cache keeps */
+	const bool shortIndices = imported.indexType == GL_UNSIGNED_SHORT;
+	const void* indexData = shortIndices ? static_cast<const void*>(imported.shortIndices.data()) : imported.indices.data();
+	const size_t indexSize = shortIndices ? sizeof(GLushort) : sizeof(GLuint);
+	newMesh->Upload(imported.packedVertices.data(), imported.depthVertices.data(), imported.vertices.size(), indexData,
+		imported.indices.size(), imported.indexType, instanceBuffer);
+	newMesh->SetTextures(textures);
+
+	if (modelCache) {
+		// material indices are the texture records, LoadTextures() adds both in the same order
+		const Mesh::Occluder& occluder = occluders.back();
+		Graphic::ModelCache::MeshRecord record = {};
+		record.boundsMinimum = bounds.minimum;
+		record.boundsMaximum = bounds.maximum;
+		record.boundsCenter = bounds.center;
+		record.boundsRadius = bounds.radius;
+		record.positionOffset = imported.positionRange.offset;
+		record.positionScale = imported.positionRange.scale;
+		record.material[0] = newMesh->material.diffuse;
+		record.material[1] = newMesh->material.specular;
+		record.material[2] = newMesh->material.ambient;
+		record.indexType = imported.indexType;
+		record.vertexCount = static_cast<uint32_t>(imported.vertices.size());
+		record.levelCount = static_cast<uint32_t>(levels.size());
+		for (size_t level = 0; level < levels.size(); ++level) {
+			record.levels[level][0] = levels[level].firstIndex;
+			record.levels[level][1] = levels[level].indexCount;
+		}
+		record.blobs[Graphic::ModelCache::BLOB_VERTICES].size = imported.packedVertices.size() * sizeof(Mesh::PackedVertex);
+		record.blobs[Graphic::ModelCache::BLOB_DEPTH_VERTICES].size = imported.depthVertices.size() * sizeof(Mesh::DepthVertex);
+		record.blobs[Graphic::ModelCache::BLOB_INDICES].size = imported.indices.size() * indexSize;
+		record.blobs[Graphic::ModelCache::BLOB_OCCLUDER_POSITIONS].size = occluder.positions.size() * sizeof(glm::vec3);
+		record.blobs[Graphic::ModelCache::BLOB_OCCLUDER_INDICES].size = occluder.indices.size() * sizeof(GLuint);
+		const void* const data[Graphic::ModelCache::BLOB_COUNT] = {
+			imported.packedVertices.data(), imported.depthVertices.data(), indexData, occluder.positions.data(), occluder.indices.data()
+		};
+		modelCache->AddMesh(record, data);
 	}
 
 	renderer->AddObeject(newMesh);
 	return newMesh;
 }
 
-unsigned int Model::LoadTexture(const char* path)
+Mesh* Model::CreateMesh(const Mesh::Bounds& bounds, const Mesh::PositionRange& positionRange, const std::vector<Mesh::Level>& levels,
+	Mesh::Occluder&& occluder)
 {
-	int width, height, channels;
-	stbi_set_flip_vertically_on_load(true);
+	Mesh* newMesh = new Mesh();
+	newMesh->meshTech = meshTech;
+	newMesh->depthTech = depthTech;
+	newMesh->model = this;
+	newMesh->boundsIndex = static_cast<GLuint>(meshBounds.size());
+	newMesh->levels = levels;
+	newMesh->positionRange = positionRange;
+	meshBounds.push_back(bounds);
+	occluders.push_back(std::move(occluder));
+	boundsDirty = true;
 
-	std::string dir = directory + '/' + path;
+	return newMesh;
+}
 
-	unsigned char* data = stbi_load(dir.c_str(), &width, &height, &channels, 0);
-	if (data) {
-		GLenum format;
-		switch (channels)
-		{
-		case 1:
-			format = GL_RED;
-			break;
-		case 3:
-			format = GL_RGB;
-			break;
-		case 4:
-			format = GL_RGBA;
-			break;
+bool Model::LoadCache(const Graphic::ModelCache& cache)
+{
+	static_assert(Mesh::MAX_LEVELS <= Graphic::ModelCache::MAX_LEVELS, "levels of a mesh must fit its cache record");
+	typedef Graphic::ModelCache Cache;
+
+	/**
+	*	records are checked against the sizes of this build before anything is created
+	*/
+	for (uint32_t index : Range<uint32_t>(0, cache.GetMeshCount())) {
+		const Cache::MeshRecord& record = cache.GetMesh(index);
+		const uint64_t indexSize = record.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+		const uint64_t indexCount = record.blobs[Cache::BLOB_INDICES].size / indexSize;
+		bool valid = (record.indexType == GL_UNSIGNED_SHORT || record.indexType == GL_UNSIGNED_INT) &&
+			record.blobs[Cache::BLOB_VERTICES].size == record.vertexCount * sizeof(Mesh::PackedVertex) &&
+			record.blobs[Cache::BLOB_DEPTH_VERTICES].size == record.vertexCount * sizeof(Mesh::DepthVertex) &&
+			record.blobs[Cache::BLOB_INDICES].size % indexSize == 0 &&
+			record.blobs[Cache::BLOB_OCCLUDER_POSITIONS].size % sizeof(glm::vec3) == 0 &&
+			record.blobs[Cache::BLOB_OCCLUDER_INDICES].size % sizeof(GLuint) == 0 &&
+			record.levelCount <= Mesh::MAX_LEVELS;
+		for (uint32_t level = 0; valid && level < record.levelCount; ++level) {
+			valid = static_cast<uint64_t>(record.levels[level][0]) + record.levels[level][1] <= indexCount;
+		}
+		if (!valid) {
+			Debug::ShowMessage("Model::LoadCache(): model cache does not match the mesh layout, the model is imported again.");
+			return false;
+		}
+	}
+
+	/**
+	*	textures are decoded again by the workers, and added in the order of the import
+	*/
+	std::vector<std::string> texturePaths(cache.GetTextureCount());
+	for (uint32_t index : Range<uint32_t>(0, cache.GetTextureCount())) {
+		texturePaths[index] = cache.GetTexturePath(index);
+	}
+	LoadTextures(texturePaths);
+	std::vector<GLint> textureIndices(texturePaths.size());
+	for (size_t index = 0; index < texturePaths.size(); ++index) {
+		auto loaded = loadedTextures.find(HashString::FNV_1A_Multibyte(texturePaths[index].c_str(), texturePaths[index].size()));
+		textureIndices[index] = loaded != loadedTextures.end() ? loaded->second : -1;
+	}
+	auto getTexture = [&](GLint texture)->GLint {
+		return texture >= 0 && static_cast<size_t>(texture) < textureIndices.size() ? textureIndices[texture] : -1;
+	};
+
+	for (uint32_t index : Range<uint32_t>(0, cache.GetMeshCount())) {
+		const Cache::MeshRecord& record = cache.GetMesh(index);
+		const Mesh::Bounds bounds = { record.boundsMinimum, record.boundsMaximum, record.boundsCenter, record.boundsRadius };
+		std::vector<Mesh::Level> levels(record.levelCount);
+		for (uint32_t level = 0; level < record.levelCount; ++level) {
+			levels[level] = { record.levels[level][0], record.levels[level][1] };
 		}
 
-		GLuint textureID = 0;
-		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		// the occlusion culler reads occluders every frame, they are small and copied out of the mapping
+		Mesh::Occluder occluder;
+		const glm::vec3* positions = static_cast<const glm::vec3*>(cache.GetBlob(record, Cache::BLOB_OCCLUDER_POSITIONS));
+		const GLuint* indices = static_cast<const GLuint*>(cache.GetBlob(record, Cache::BLOB_OCCLUDER_INDICES));
+		if (positions && indices) {
+			occluder.positions.assign(positions, positions + record.blobs[Cache::BLOB_OCCLUDER_POSITIONS].size / sizeof(glm::vec3));
+			occluder.indices.assign(indices, indices + record.blobs[Cache::BLOB_OCCLUDER_INDICES].size / sizeof(GLuint));
+		}
 
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		Mesh* newMesh = CreateMesh(bounds, { record.positionOffset, record.positionScale }, levels, std::move(occluder));
+		const size_t indexSize = record.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+		newMesh->Upload(static_cast<const Mesh::PackedVertex*>(cache.GetBlob(record, Cache::BLOB_VERTICES)),
+			static_cast<const Mesh::DepthVertex*>(cache.GetBlob(record, Cache::BLOB_DEPTH_VERTICES)), record.vertexCount,
+			cache.GetBlob(record, Cache::BLOB_INDICES), static_cast<size_t>(record.blobs[Cache::BLOB_INDICES].size / indexSize),
+			record.indexType, instanceBuffer);
+		newMesh->material = { getTexture(record.material[0]), getTexture(record.material[1]), getTexture(record.material[2]), 0 };
 
-		return textureID;
+		renderer->AddObeject(newMesh);
+		meshes.push_back(newMesh);
 	}
-	else {
-		return 0;
+
+	return true;
+}
+
+GLint Model::LoadTexture(const char* path)
+{
+	/**
+	*	meshes of a model often share texture files, load each file once
+	*/
+	unsigned int hash = HashString::FNV_1A_Multibyte(path, strlen(path));
+	auto loaded = loadedTextures.find(hash);
+	if (loaded != loadedTextures.end()) {
+		return loaded->second;
 	}
 
-	stbi_image_free(data);
+	LoadTextures({ path });
+	loaded = loadedTextures.find(hash);
+	return loaded != loadedTextures.end() ? loaded->second : -1;
+}
 
+void Model::LoadTextures(const std::vector<std::string>& paths)
+{
+	/**
+	*	files not loaded yet are decoded by the workers, then added in the order of the paths so that texture indices
+	*	do not depend on the scheduling
+	*/
+	std::vector<std::string> files;
+	std::set<unsigned int> queued;
+	for (const std::string& path : paths) {
+		const unsigned int hash = HashString::FNV_1A_Multibyte(path.c_str(), path.size());
+		if (loadedTextures.find(hash) == loadedTextures.end() && queued.insert(hash).second) {
+			files.push_back(path);
+		}
+	}
 
+	struct Image
+	{
+		int width;
+		int height;
+		unsigned char* pixels;
+	};
+	std::vector<Image> images(files.size(), Image{ 0, 0, nullptr });
+	stbi_set_flip_vertically_on_load(true);
+	ThreadPool::GetInstance().ParallelFor(files.size(), [&](size_t index) {
+		const std::string file = directory + '/' + files[index];
+		int channels = 0;
+		// expanded to RGBA, all material textures share one format
+		images[index].pixels = stbi_load(file.c_str(), &images[index].width, &images[index].height, &channels, 4);
+	});
+
+	for (size_t index = 0; index < files.size(); ++index) {
+		Image& image = images[index];
+		if (modelCache) {
+			// also the ones that failed, the cache is stale once they appear
+			modelCache->AddDependency((directory + '/' + files[index]).c_str());
+		}
+		if (image.pixels == nullptr) {
+			continue;
+		}
+		GLint textureIndex = materialTextures->Add(image.width, image.height, image.pixels);
+
+		stbi_image_free(image.pixels);
+		loadedTextures.insert(std::make_pair(HashString::FNV_1A_Multibyte(files[index].c_str(), files[index].size()), textureIndex));
+		if (modelCache) {
+			modelCache->AddTexture(files[index].c_str());
+		}
+	}
 }
 
 std::map<unsigned int, Mesh::Texture> Model::LoadMaterialTexture(aiMaterial* material, aiTextureType aiType, Mesh::TextureType type)
@@ -249,8 +957,11 @@ std::map<unsigned int, Mesh::Texture> Model::LoadMaterialTexture(aiMaterial* mat
 		aiString path;
 		material->GetTexture(aiType, i, &path);
 		Mesh::Texture texture = {};
-		texture.textureID = LoadTexture(path.C_Str());
+		texture.index = LoadTexture(path.C_Str());
 		texture.type = type;
+		if (texture.index < 0) {
+			continue;
+		}
 
 		textures.insert(std::pair<unsigned int, Mesh::Texture>(HashString::FNV_1A_Multibyte(path.C_Str(), path.length), texture));
 	}
@@ -259,72 +970,516 @@ std::map<unsigned int, Mesh::Texture> Model::LoadMaterialTexture(aiMaterial* mat
 }
 
 Mesh::Mesh()
-	:textures(), meshTech(nullptr)
+	:material{ -1, -1, -1, 0 }, positionRange{ glm::vec4(0.f), glm::vec4(1.f) }, boundsIndex(0), levels(), meshTech(nullptr), depthTech(nullptr), light(nullptr), model(nullptr),
+	depthPrimitive(new Graphic::Primitive())
 {
 }
 
 Mesh::~Mesh()
 {
+	SafeDelete(depthPrimitive);
 }
 
-void Mesh::SetVerticesAndIndices(std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+void Mesh::Upload(const PackedVertex* vertices, const DepthVertex* depthVertices, size_t vertexCount, const void* indices,
+	size_t indexCount, GLenum indexType, GLuint instanceBuffer)
 {
+	UploadVerticesAndIndices(primitive, vertices, vertexCount, indices, indexCount, indexType);
+	if (!levels.empty()) {
+		primitive->SetIndexRange(levels[0].firstIndex, levels[0].indexCount);
+	}
+	primitive->AttachInstanceBuffer(instanceBuffer, INSTANCE_ATTRIBUTE_LAYOUT);
+	primitive->SetInstanceCount(static_cast<GLuint>(model->GetInstanceCount()));
+	CreateDepthStream(depthVertices, vertexCount, instanceBuffer);
+}
+
+void Mesh::UploadVerticesAndIndices(Graphic::Primitive* primitive, std::vector<Vertex>& vertices, std::vector<GLuint>& indices,
+	const PositionRange& positionRange)
+{
+	std::vector<PackedVertex> packedVertices = PackVertices(vertices, positionRange);
+	std::vector<GLushort> shortIndices;
+	const GLenum indexType = PackIndices(indices, shortIndices);
+	const void* indexData = indexType == GL_UNSIGNED_SHORT ? static_cast<const void*>(shortIndices.data()) : indices.data();
+	UploadVerticesAndIndices(primitive, packedVertices.data(), packedVertices.size(), indexData, indices.size(), indexType);
+}
+
+void Mesh::UploadVerticesAndIndices(Graphic::Primitive* primitive, const PackedVertex* vertices, size_t vertexCount,
+	const void* indices, size_t indexCount, GLenum indexType)
+{
+	if (vertexCount == 0) {
+		return;
+	}
+
 	primitive->CreateBuffer(GL_ARRAY_BUFFER);
-	primitive->AttachBuffer(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-	primitive->AttribPointer(0, 3, 14, (void*)0);
-	primitive->AttribPointer(1, 3, 14, (void*)offsetof(Vertex, normal));
-	primitive->AttribPointer(2, 2, 14, (void*)offsetof(Vertex, textureCoord));
-	primitive->AttribPointer(3, 3, 14, (void*)offsetof(Vertex, tangent));
-	primitive->AttribPointer(4, 3, 14, (void*)offsetof(Vertex, bitangent));
+	primitive->AttachBuffer(GL_ARRAY_BUFFER, vertexCount * sizeof(PackedVertex), vertices, GL_STATIC_DRAW);
+	PackedFormat::Apply(primitive);
 	primitive->DetachBuffer();
 
-	if (!indices.empty()) {
+	if (indexCount > 0) {
+		const size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
 		primitive->CreateBuffer(GL_ELEMENT_ARRAY_BUFFER);
-		primitive->AttachBuffer(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+		primitive->SetIndexType(indexType);
+		primitive->AttachBuffer(GL_ELEMENT_ARRAY_BUFFER, indexCount * indexSize, indices, GL_STATIC_DRAW);
 		primitive->DetachBuffer();
+	}
+}
+
+void Mesh::CreateDepthStream(const DepthVertex* depthVertices, size_t vertexCount, GLuint instanceBuffer)
+{
+	/**
+	*	the pre-pass fetches 8 bytes per vertex instead of the whole vertex, indices are shared with the shading draw
+	*/
+	if (vertexCount == 0) {
+		return;
+	}
 
+	depthPrimitive->CreateBuffer(GL_ARRAY_BUFFER);
+	depthPrimitive->AttachBuffer(GL_ARRAY_BUFFER, vertexCount * sizeof(DepthVertex), depthVertices, GL_STATIC_DRAW);
+	DepthFormat::Apply(depthPrimitive);
+	if (primitive->GetIndexBuffer() != 0) {
+		depthPrimitive->SetIndexType(primitive->GetIndexType());
+		depthPrimitive->ShareBuffer(GL_ELEMENT_ARRAY_BUFFER, primitive->GetIndexBuffer());
 	}
+	depthPrimitive->DetachBuffer();
+	depthPrimitive->AttachInstanceBuffer(instanceBuffer, INSTANCE_ATTRIBUTE_LAYOUT);
+	depthPrimitive->SetInstanceCount(static_cast<GLuint>(model->GetInstanceCount()));
 }
 
 void Mesh::SetTextures(std::map<unsigned int, Texture>& textures)
 {
-	this->textures = textures;
+	material = MakeMaterial(textures);
 }
 
-bool Mesh::Update(float dt)
+Mesh::PositionRange Mesh::MakePositionRange(const Bounds& bounds)
 {
-	return true;
+	return { glm::vec4(bounds.minimum, 0.f), glm::vec4(bounds.maximum - bounds.minimum, 0.f) };
 }
 
-bool Mesh::Render(float dt)
+void Mesh::QuantizePosition(const glm::vec3& position, const PositionRange& positionRange, uint16_t* quantized)
 {
-	meshTech->Use();
-	int i = 0;
-	for (auto& texture : textures) {
-		meshTech->ActiveTexture(GL_TEXTURE0 + i);
+	for (int axis = 0; axis < 3; ++axis) {
+		const float extent = positionRange.scale[axis];
+		const float unorm = extent > 0.f ? (position[axis] - positionRange.offset[axis]) / extent : 0.f;
+		quantized[axis] = Graphic::VertexPacking::PackUnorm16(unorm);
+	}
+	quantized[3] = 0;
+}
+
+std::vector<Mesh::PackedVertex> Mesh::PackVertices(const std::vector<Vertex>& vertices, const PositionRange& positionRange)
+{
+	std::vector<PackedVertex> packedVertices(vertices.size());
+	for (size_t index = 0; index < vertices.size(); ++index) {
+		const Vertex& vertex = vertices[index];
+		PackedVertex& packed = packedVertices[index];
 
+		QuantizePosition(vertex.position, positionRange, packed.position);
+
+		const glm::vec2 normal = Graphic::VertexPacking::EncodeOctahedral(vertex.normal);
+		packed.normal[0] = Graphic::VertexPacking::PackSnorm16(normal.x);
+		packed.normal[1] = Graphic::VertexPacking::PackSnorm16(normal.y);
+
+		packed.textureCoord[0] = Graphic::VertexPacking::PackHalf(vertex.textureCoord.x);
+		packed.textureCoord[1] = Graphic::VertexPacking::PackHalf(vertex.textureCoord.y);
+
+		const glm::vec4 frame = Graphic::VertexPacking::EncodeTangentFrame(vertex.normal, vertex.tangent, vertex.bitangent);
+		packed.tangentFrame[0] = Graphic::VertexPacking::PackSnorm8(frame.x);
+		packed.tangentFrame[1] = Graphic::VertexPacking::PackSnorm8(frame.y);
+		packed.tangentFrame[2] = Graphic::VertexPacking::PackSnorm8(frame.z);
+		packed.tangentFrame[3] = Graphic::VertexPacking::PackSnorm8(frame.w);
+	}
+	return packedVertices;
+}
+
+std::vector<Mesh::DepthVertex> Mesh::PackDepthVertices(const std::vector<Vertex>& vertices, const PositionRange& positionRange)
+{
+	std::vector<DepthVertex> depthVertices(vertices.size());
+	for (size_t vertex = 0; vertex < vertices.size(); ++vertex) {
+		QuantizePosition(vertices[vertex].position, positionRange, depthVertices[vertex].position);
+	}
+	return depthVertices;
+}
+
+GLenum Mesh::PackIndices(const std::vector<GLuint>& indices, std::vector<GLushort>& shortIndices)
+{
+	// indices are relative to the mesh even in a batch, 0xffff stays free as a restart index
+	if (indices.empty() || *std::max_element(indices.begin(), indices.end()) >= 0xffff) {
+		return GL_UNSIGNED_INT;
+	}
+	shortIndices.assign(indices.begin(), indices.end());
+	return GL_UNSIGNED_SHORT;
+}
+
+Mesh::Material Mesh::MakeMaterial(const std::map<unsigned int, Texture>& textures)
+{
+	/**
+	*	only the first texture of each type is used
+	*/
+	Material material = { -1, -1, -1, 0 };
+	for (auto& texture : textures) {
 		switch (texture.second.type)
 		{
 		case Mesh::TextureType::TEXTURE_DIFFUSE:
-			meshTech->SetDiffuseMap(i);
+			if (material.diffuse < 0) {
+				material.diffuse = texture.second.index;
+			}
 			break;
 
 		case Mesh::TextureType::TEXTURE_SPECULAR:
-			meshTech->SetSpeculatMap(i);
+			if (material.specular < 0) {
+				material.specular = texture.second.index;
+			}
 			break;
 
 		case Mesh::TextureType::TEXTURE_AMBIENT:
-			meshTech->SetAmbientMap(i);
+			if (material.ambient < 0) {
+				material.ambient = texture.second.index;
+			}
+			break;
+		}
+	}
+
+	return material;
+}
+
+Mesh::Bounds Mesh::ComputeBounds(const std::vector<Vertex>& vertices)
+{
+	Bounds bounds = { glm::vec3(0.f), glm::vec3(0.f), glm::vec3(0.f), 0.f };
+	if (vertices.empty()) {
+		return bounds;
+	}
+
+	bounds.minimum = vertices[0].position;
+	bounds.maximum = vertices[0].position;
+	for (const Vertex& vertex : vertices) {
+		bounds.minimum = glm::min(bounds.minimum, vertex.position);
+		bounds.maximum = glm::max(bounds.maximum, vertex.position);
+	}
+
+	// sphere around the box center, tighter than the half diagonal
+	bounds.center = (bounds.minimum + bounds.maximum) * 0.5f;
+	float radiusSquared = 0.f;
+	for (const Vertex& vertex : vertices) {
+		glm::vec3 offset = vertex.position - bounds.center;
+		radiusSquared = (std::max)(radiusSquared, glm::dot(offset, offset));
+	}
+	bounds.radius = std::sqrt(radiusSquared);
+
+	return bounds;
+}
+
+Mesh::OptimizeStatistics Mesh::Optimize(std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+{
+	if (vertices.empty() || indices.size() < 3) {
+		return { 0.f, 0.f, vertices.size(), vertices.size() };
+	}
+	const float acmrBefore = Graphic::MeshOptimizer::AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+	const size_t verticesBefore = vertices.size();
+
+	/**
+	*	files often store one vertex per triangle corner, identical corners are welded first
+	*/
+	std::vector<GLuint> remap;
+	size_t vertexCount = Graphic::MeshOptimizer::GenerateRemap(&vertices[0], vertices.size(), sizeof(Vertex), remap);
+	Graphic::MeshOptimizer::RemapIndices(indices, remap);
+	Graphic::MeshOptimizer::RemapVertices(vertices, remap, vertexCount);
+
+	Graphic::MeshOptimizer::OptimizeVertexCache(indices, vertices.size());
+	Graphic::MeshOptimizer::OptimizeOverdraw(indices, &vertices[0].position, vertices.size(), sizeof(Vertex));
+
+	vertexCount = Graphic::MeshOptimizer::OptimizeVertexFetch(indices, vertices.size(), remap);
+	Graphic::MeshOptimizer::RemapVertices(vertices, remap, vertexCount);
+
+	const float acmrAfter = Graphic::MeshOptimizer::AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+	return { acmrBefore, acmrAfter, verticesBefore, vertices.size() };
+}
+
+std::vector<Mesh::Level> Mesh::BuildLevels(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+{
+	/**
+	*	each level simplifies the previous one, all levels are appended to one index buffer
+	*/
+	std::vector<Level> levels;
+	if (indices.empty()) {
+		return levels;
+	}
+	levels.push_back({ 0, static_cast<GLuint>(indices.size()) });
+
+	std::vector<GLuint> previous = indices;
+	while (levels.size() < MAX_LEVELS) {
+		const size_t target = static_cast<size_t>(previous.size() * LEVEL_REDUCTION) / 3 * 3;
+		std::vector<GLuint> simplified = Graphic::MeshSimplifier::Simplify(&vertices[0].position, vertices.size(),
+			sizeof(Vertex), previous, target, FLT_MAX);
+		if (simplified.empty() || simplified.size() > previous.size() * MIN_LEVEL_REDUCTION) {
 			break;
 		}
-		
-		meshTech->BindTexture(texture.second.textureID);
-		i++;
+		Graphic::MeshOptimizer::OptimizeVertexCache(simplified, vertices.size());
+
+		levels.push_back({ static_cast<GLuint>(indices.size()), static_cast<GLuint>(simplified.size()) });
+		indices.insert(indices.end(), simplified.begin(), simplified.end());
+		previous.swap(simplified);
 	}
 
+	return levels;
+}
+
+Mesh::Occluder Mesh::MakeOccluder(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, const Level& level)
+{
+	/**
+	*	only the vertices referenced by the level are kept
+	*/
+	Occluder occluder;
+	std::vector<GLuint> remap(vertices.size(), 0xffffffff);
+	occluder.indices.reserve(level.indexCount);
+	for (GLuint i = level.firstIndex; i < level.firstIndex + level.indexCount; ++i) {
+		GLuint& vertex = remap[indices[i]];
+		if (vertex == 0xffffffff) {
+			vertex = static_cast<GLuint>(occluder.positions.size());
+			occluder.positions.push_back(vertices[indices[i]].position);
+		}
+		occluder.indices.push_back(vertex);
+	}
+
+	return occluder;
+}
+
+bool Mesh::Update(float dt)
+{
+	return true;
+}
+
+bool Mesh::Render(float dt)
+{
+	/**
+	*	program has been bound by the render queue, instances have been uploaded by Submit()
+	*/
+	// the textures of all meshes of the model stay bound, the wrappers elide the rebinding
+	model->materialTextures->Bind();
+	meshTech->SelectVariant(MeshTech::GetMaterialFeatures(material.diffuse, material.specular, material.ambient));
+	meshTech->SetMaterial(material.diffuse, material.specular, material.ambient);
+	meshTech->SetPositionRange(positionRange.offset, positionRange.scale);
+
 	primitive->Render(dt);
-	meshTech->ActiveTexture(GL_TEXTURE0);
-	meshTech->BindTexture(0);
 
 	return true;
 }
+
+void Mesh::Submit(Graphic::RenderQueue* queue)
+{
+	// upload on the GL thread once the occluders are tested, recording may run on a worker
+	model->UploadInstances();
+	if (!model->IsVisible(boundsIndex)) {
+		return;
+	}
+	if (!levels.empty()) {
+		const Level& level = levels[model->GetLevel(boundsIndex, levels.size())];
+		primitive->SetIndexRange(level.firstIndex, level.indexCount);
+		depthPrimitive->SetIndexRange(level.firstIndex, level.indexCount);
+	}
+
+	// textures are selected by index, meshes of a model never switch them, the variant samples the ones of the material
+	const GLuint program = meshTech->GetProgram(MeshTech::GetMaterialFeatures(material.diffuse, material.specular, material.ambient));
+	queue->Push(this, Graphic::LAYER_OPAQUE, program, 0, primitive->GetVertexArray(), model->GetDepth(boundsIndex));
+}
+
+void Mesh::SubmitOccluders(Graphic::OcclusionCuller* occlusionCuller)
+{
+	model->SubmitOccluders(occlusionCuller);
+}
+
+bool Mesh::Record(Graphic::CommandBuffer* commandBuffer, float dt) const
+{
+	/**
+	*	same as Render(), instances have been uploaded by Submit()
+	*/
+	model->materialTextures->Bind(commandBuffer);
+	meshTech->SetMaterial(material.diffuse, material.specular, material.ambient, commandBuffer);
+	meshTech->SetPositionRange(positionRange.offset, positionRange.scale, commandBuffer);
+
+	primitive->Record(commandBuffer);
+
+	return true;
+}
+
+bool Mesh::RecordDepth(Graphic::CommandBuffer* commandBuffer, float dt) const
+{
+	if (depthPrimitive->GetVertexArray() == 0) {
+		return false;
+	}
+
+	depthTech->Use(commandBuffer);
+	depthTech->SetPositionRange(positionRange.offset, positionRange.scale, commandBuffer);
+	depthPrimitive->Record(commandBuffer);
+
+	return true;
+}
+
+const char* Mesh::GetName() const
+{
+	return "Mesh";
+}
+
+MeshBatch::MeshBatch()
+	:vertices(), indices(), commands(), materials(), positionRange{ glm::vec4(0.f), glm::vec4(1.f) }, drawVisibility(), drawLevels(), drawLevel(), instanceRanges(), materialBuffer(0),
+	batchTech(new MeshBatchTech()),
+	model(nullptr)
+{
+	batchTech->Init();
+}
+
+MeshBatch::~MeshBatch()
+{
+	if (materialBuffer != 0) {
+		Graphic::GLDeleteBuffers(1, &materialBuffer);
+	}
+	SafeDelete(batchTech);
+}
+
+bool MeshBatch::AddMesh(std::vector<Mesh::Vertex>& vertices, std::vector<GLuint>& indices, const std::vector<Mesh::Level>& levels,
+	std::map<unsigned int, Mesh::Texture>& textures)
+{
+	if (indices.empty() || levels.empty()) {
+		return false;
+	}
+
+	// levels are relative to the indices of the mesh
+	std::vector<Mesh::Level> batchLevels = levels;
+	for (Mesh::Level& level : batchLevels) {
+		level.firstIndex += static_cast<GLuint>(this->indices.size());
+	}
+
+	DrawElementsIndirectCommand command = {};
+	command.count = batchLevels[0].indexCount;
+	command.instanceCount = 0;
+	command.firstIndex = batchLevels[0].firstIndex;
+	command.baseVertex = static_cast<GLint>(this->vertices.size());
+	command.baseInstance = 0;
+	commands.push_back(command);
+	drawLevels.push_back(batchLevels);
+	drawLevel.push_back(0);
+	instanceRanges.push_back(Mesh::InstanceRange{ 0, 0 });
+
+	this->vertices.insert(this->vertices.end(), vertices.begin(), vertices.end());
+	this->indices.insert(this->indices.end(), indices.begin(), indices.end());
+
+	Mesh::Material material = Mesh::MakeMaterial(textures);
+	materials.push_back(material);
+	drawVisibility.push_back(1);
+
+	return true;
+}
+
+void MeshBatch::Finalize(GLuint instanceBuffer)
+{
+	if (commands.empty()) {
+		return;
+	}
+
+	positionRange = Mesh::MakePositionRange(Mesh::ComputeBounds(vertices));
+	Mesh::UploadVerticesAndIndices(primitive, vertices, indices, positionRange);
+	primitive->AttachInstanceBuffer(instanceBuffer, INSTANCE_ATTRIBUTE_LAYOUT);
+	UploadCommands();
+
+	/** materials are indexed by draw ID */
+	Graphic::GLGenBuffers(1, &materialBuffer);
+	Graphic::GLBindBuffer(GL_SHADER_STORAGE_BUFFER, materialBuffer);
+	Graphic::GLBufferData(GL_SHADER_STORAGE_BUFFER, materials.size() * sizeof(Mesh::Material), &materials[0], GL_STATIC_DRAW);
+	Graphic::GLBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// staging data live in GPU memory now
+	std::vector<Mesh::Vertex>().swap(vertices);
+	std::vector<GLuint>().swap(indices);
+}
+
+void MeshBatch::SetInstanceRanges(const std::vector<Mesh::InstanceRange>& ranges)
+{
+	if (commands.empty() || ranges.size() != commands.size()) {
+		return;
+	}
+	// uploaded by Submit() with the visibility of the same frame
+	instanceRanges = ranges;
+}
+
+void MeshBatch::UploadCommands()
+{
+	for (size_t draw = 0; draw < commands.size(); ++draw) {
+		const Mesh::Level& level = drawLevels[draw][drawLevel[draw]];
+		commands[draw].firstIndex = level.firstIndex;
+		commands[draw].count = level.indexCount;
+		commands[draw].instanceCount = drawVisibility[draw] ? instanceRanges[draw].count : 0;
+		commands[draw].baseInstance = instanceRanges[draw].first;
+	}
+	primitive->AttachIndirectBuffer(commands.size() * sizeof(DrawElementsIndirectCommand), &commands[0], static_cast<GLsizei>(commands.size()));
+}
+
+bool MeshBatch::Render(float dt)
+{
+	/**
+	*	program has been bound by the render queue, instances have been uploaded by Submit()
+	*/
+	model->materialTextures->Bind();
+	batchTech->BindMaterials(materialBuffer);
+	batchTech->SetPositionRange(positionRange.offset, positionRange.scale);
+	primitive->Render(dt);
+
+	return true;
+}
+
+void MeshBatch::Submit(Graphic::RenderQueue* queue)
+{
+	model->UploadInstances();
+	if (commands.empty() || model->GetInstanceCount() == 0) {
+		return;
+	}
+
+	/**
+	*	culled draws keep their slot with no instances, commands are rewritten only when the visibility, the level
+	*	of detail or the instance range changes
+	*/
+	bool changed = false;
+	bool anyVisible = false;
+	for (size_t draw = 0; draw < commands.size(); ++draw) {
+		uint8_t visible = model->IsVisible(static_cast<GLuint>(draw)) ? 1 : 0;
+		uint8_t level = static_cast<uint8_t>(model->GetLevel(static_cast<GLuint>(draw), drawLevels[draw].size()));
+		changed = changed || visible != drawVisibility[draw] || (visible && level != drawLevel[draw]) ||
+			(visible && (commands[draw].instanceCount != instanceRanges[draw].count || commands[draw].baseInstance != instanceRanges[draw].first));
+		anyVisible = anyVisible || visible != 0;
+		drawVisibility[draw] = visible;
+		if (visible) {
+			drawLevel[draw] = level;
+		}
+	}
+	if (changed) {
+		UploadCommands();
+	}
+	if (!anyVisible) {
+		return;
+	}
+
+	// the batch is one draw, it is sorted by its nearest visible mesh
+	float depth = 1.f;
+	for (size_t draw = 0; draw < commands.size(); ++draw) {
+		if (drawVisibility[draw]) {
+			depth = (std::min)(depth, model->GetDepth(static_cast<GLuint>(draw)));
+		}
+	}
+	queue->Push(this, Graphic::LAYER_OPAQUE, batchTech->GetProgram(), 0, primitive->GetVertexArray(), depth);
+}
+
+void MeshBatch::SubmitOccluders(Graphic::OcclusionCuller* occlusionCuller)
+{
+	model->SubmitOccluders(occlusionCuller);
+}
+
+bool MeshBatch::Record(Graphic::CommandBuffer* commandBuffer, float dt) const
+{
+	model->materialTextures->Bind(commandBuffer);
+	batchTech->BindMaterials(materialBuffer, commandBuffer);
+	batchTech->SetPositionRange(positionRange.offset, positionRange.scale, commandBuffer);
+	primitive->Record(commandBuffer);
+
+	return true;
+}
+
+const char* MeshBatch::GetName() const
+{
+	return "MeshBatch";
+}
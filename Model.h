@@ -1,12 +1,17 @@
 #pragma once
 #include "Utility.h"
 #include "Renderer.h"
+#include "MaterialTextures.h"
+#include "VertexFormat.h"
+#include "ModelCache.h"
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#ifdef _MSC_VER
 #pragma comment(lib, "assimp-vc142-mt.lib")
+#endif
 
 class Mesh : public Graphic::RenderTarget
 {
@@ -16,6 +21,9 @@ public:
 
 
 private:
+	/**
+	*	full precision vertex of loading and simplification, meshes upload PackedVertex
+	*/
 	struct Vertex
 	{
 		glm::vec3 position;
@@ -24,6 +32,32 @@ private:
 		glm::vec3 tangent;
 		glm::vec3 bitangent;
 	};
+	/**
+	*	20 bytes instead of 56, the bitangent is the cross product of the frame flipped by the sign of its w
+	*/
+	struct PackedVertex
+	{
+		uint16_t position[4];		///< unorm16 in the position range of the mesh, w unused
+		int16_t normal[2];			///< octahedral, snorm16
+		uint16_t textureCoord[2];	///< half floats, tiling coordinates stay exact
+		int8_t tangentFrame[4];		///< quaternion, snorm8
+	};
+	/**
+	*	positions of the depth pre-pass, quantized like PackedVertex so both passes compute the same depth
+	*/
+	struct DepthVertex
+	{
+		uint16_t position[4];
+	};
+	typedef Graphic::VertexFormat<PackedVertex,
+		Graphic::VertexAttribute<0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PackedVertex, position)>,
+		Graphic::VertexAttribute<1, 2, GL_SHORT, GL_TRUE, offsetof(PackedVertex, normal)>,
+		Graphic::VertexAttribute<2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, textureCoord)>,
+		Graphic::VertexAttribute<3, 4, GL_BYTE, GL_TRUE, offsetof(PackedVertex, tangentFrame)>> PackedFormat;
+	typedef Graphic::VertexFormat<DepthVertex,
+		Graphic::VertexAttribute<0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(DepthVertex, position)>> DepthFormat;
+	static_assert(sizeof(PackedVertex) == 20, "PackedVertex must stay tightly packed");
+
 	enum class TextureType
 	{
 		TEXTURE_DIFFUSE,
@@ -33,47 +67,303 @@ private:
 	};
 	struct Texture
 	{
-		GLuint textureID;
+		GLint index;	///< texture of the model's material textures
 		TextureType type;
 	};
+	/**
+	*	std430 layout, indices of the model's material textures, -1 means no texture
+	*/
+	struct Material
+	{
+		GLint diffuse;
+		GLint specular;
+		GLint ambient;
+		GLint padding;
+	};
 
-	std::map<unsigned int, Texture> textures;
+	/**
+	*	model space bounds
+	*/
+	struct Bounds
+	{
+		glm::vec3 minimum;
+		glm::vec3 maximum;
+		glm::vec3 center;	///< of the bounding sphere
+		float radius;
+	};
+
+	/**
+	*	dequantization of packed positions, position = offset + unorm * scale
+	*/
+	struct PositionRange
+	{
+		glm::vec4 offset;
+		glm::vec4 scale;
+	};
+
+	/**
+	*	range of the index buffer drawn at one level of detail, all levels share the vertices
+	*/
+	struct Level
+	{
+		GLuint firstIndex;
+		GLuint indexCount;
+	};
+
+	/**
+	*	range of the instance buffer holding the visible instances of one mesh
+	*/
+	struct InstanceRange
+	{
+		GLuint first;
+		GLuint count;
+	};
+
+	/**
+	*	vertex cache efficiency before and after Optimize(), average cache misses per triangle
+	*/
+	struct OptimizeStatistics
+	{
+		float acmrBefore;
+		float acmrAfter;
+		size_t verticesBefore;
+		size_t verticesAfter;
+	};
+
+	/**
+	*	coarsest level with its own compact vertices, rasterized by the software occlusion culler
+	*/
+	struct Occluder
+	{
+		std::vector<glm::vec3> positions;
+		std::vector<GLuint> indices;
+	};
+
+	static constexpr size_t MAX_LEVELS = 4;				///< full resolution and three simplified levels
+	static constexpr float LEVEL_REDUCTION = 0.5f;		///< indices of a level relative to the previous one
+	static constexpr float MIN_LEVEL_REDUCTION = 0.8f;	///< levels which keep more than this are not worth drawing
+
+	Material material;
+	PositionRange positionRange;
+	GLuint boundsIndex;	///< index of the bounds in the model
+	std::vector<Level> levels;
 
 	class MeshTech* meshTech;
+	class MeshDepthTech* depthTech;
 	class Light* light;
+	class Model* model;
+	Graphic::Primitive* depthPrimitive;	///< packed positions sharing the index buffer, drawn by the depth pre-pass
 
-	void SetVerticesAndIndices(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+	void Upload(const PackedVertex* vertices, const DepthVertex* depthVertices, size_t vertexCount, const void* indices,
+		size_t indexCount, GLenum indexType, GLuint instanceBuffer); ///< from memory of the import or from the mapped cache
 	void SetTextures(std::map<unsigned int, Texture>& textures);
+	void CreateDepthStream(const DepthVertex* depthVertices, size_t vertexCount, GLuint instanceBuffer);
 
 	bool Update(float dt);
 	bool Render(float dt);
+	void Submit(Graphic::RenderQueue* queue);
+	void SubmitOccluders(Graphic::OcclusionCuller* occlusionCuller);
+	bool Record(Graphic::CommandBuffer* commandBuffer, float dt) const;
+	bool RecordDepth(Graphic::CommandBuffer* commandBuffer, float dt) const;
+	const char* GetName() const;
+
+	static void UploadVerticesAndIndices(Graphic::Primitive* primitive, std::vector<Vertex>& vertices, std::vector<GLuint>& indices,
+		const PositionRange& positionRange);
+	static void UploadVerticesAndIndices(Graphic::Primitive* primitive, const PackedVertex* vertices, size_t vertexCount,
+		const void* indices, size_t indexCount, GLenum indexType);
+	static PositionRange MakePositionRange(const Bounds& bounds);
+	static std::vector<PackedVertex> PackVertices(const std::vector<Vertex>& vertices, const PositionRange& positionRange);
+	static std::vector<DepthVertex> PackDepthVertices(const std::vector<Vertex>& vertices, const PositionRange& positionRange);
+	static GLenum PackIndices(const std::vector<GLuint>& indices, std::vector<GLushort>& shortIndices); ///< type of the indices uploaded
+	static void QuantizePosition(const glm::vec3& position, const PositionRange& positionRange, uint16_t* quantized);
+	static Material MakeMaterial(const std::map<unsigned int, Texture>& textures);
+	static Bounds ComputeBounds(const std::vector<Vertex>& vertices);
+	static OptimizeStatistics Optimize(std::vector<Vertex>& vertices, std::vector<GLuint>& indices); ///< weld and reorder at import, thread safe
+	static std::vector<Level> BuildLevels(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices); ///< appends simplified indices
+	static Occluder MakeOccluder(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, const Level& level);
 	
 	friend class Model;
+	friend class MeshBatch;
 };
 
+/**
+*	\description: class MeshBatch: packs all meshes of a model into one vertex and index buffer pair, and draws them with
+*	a single glMultiDrawElementsIndirect. The material of each draw is fetched by gl_DrawIDARB, see MeshBatchTech.
+*/
+class MeshBatch : public Graphic::RenderTarget
+{
+public:
+	MeshBatch();
+	~MeshBatch();
+
+private:
+	struct DrawElementsIndirectCommand
+	{
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+	std::vector<Mesh::Vertex> vertices;	///< staging data, released after finalized
+	std::vector<GLuint> indices;
+	std::vector<DrawElementsIndirectCommand> commands;
+	std::vector<Mesh::Material> materials;
+	Mesh::PositionRange positionRange;	///< of all draws, draws share the vertex buffer
+	std::vector<uint8_t> drawVisibility;	///< culled draws are uploaded with no instances
+	std::vector<std::vector<Mesh::Level>> drawLevels;
+	std::vector<uint8_t> drawLevel;		///< level of detail uploaded for each draw
+	std::vector<Mesh::InstanceRange> instanceRanges;	///< visible instances of each draw
+	GLuint materialBuffer;
+
+	class MeshBatchTech* batchTech;
+	class Model* model;
+
+	bool AddMesh(std::vector<Mesh::Vertex>& vertices, std::vector<GLuint>& indices, const std::vector<Mesh::Level>& levels,
+		std::map<unsigned int, Mesh::Texture>& textures);
+	void Finalize(GLuint instanceBuffer);
+	void SetInstanceRanges(const std::vector<Mesh::InstanceRange>& ranges);
+	void UploadCommands();
+
+	bool Render(float dt);
+	void Submit(Graphic::RenderQueue* queue);
+	void SubmitOccluders(Graphic::OcclusionCuller* occlusionCuller);
+	bool Record(Graphic::CommandBuffer* commandBuffer, float dt) const;
+	const char* GetName() const;
+
+	friend class Model;
+};
+
+/**
+*	\description: class Model: load a model file into meshes, every mesh draws its visible instances of the model in one call.
+*	A loaded model owns one identity instance whose handle is 0, remove it or move it when it is not needed.
+*/
 class Model 
 {
 public:
+	typedef unsigned int InstanceHandle;
+
+	enum LoadFlags
+	{
+		LOAD_DEFAULT = 0,
+		LOAD_BATCHED = 1 << 0	///< pack all meshes and draw them with one multi-draw-indirect call
+	};
+
 	Model(Graphic::Renderer* renderer);
 	~Model();
 
-	bool Load(const wchar_t* filePath);
-	void SetProjectionView(glm::mat4& projection);
+	bool Load(const wchar_t* filePath, unsigned int flags = LOAD_DEFAULT);
 	void SetModel(glm::mat4& model);
+	void SetOccluder(bool occluder); ///< all meshes occlude, otherwise only meshes covering much of the screen do
+
+	// instances
+	InstanceHandle AddInstance(const glm::mat4& transform);
+	void SetInstanceTransform(InstanceHandle handle, const glm::mat4& transform);
+	void RemoveInstance(InstanceHandle handle);
+	size_t GetInstanceCount() const;
 
-	static Model* LoadModel(const wchar_t* filePath, Graphic::Renderer* renderer);
+	static Model* LoadModel(const wchar_t* filePath, Graphic::Renderer* renderer, unsigned int flags = LOAD_DEFAULT);
 
 private:
 	Graphic::Renderer* renderer;
 	std::vector<Mesh*> meshes;
 
+	/**
+	*	instance transforms are packed, handles are mapped to slots so that they stay valid after removal. The instance
+	*	buffer holds the visible instances only, one range per mesh, rebuilt when the transforms or the visibility change.
+	*/
+	GLuint instanceBuffer;
+	std::vector<glm::mat4> instanceTransforms;
+	std::vector<unsigned int> handleToSlot;
+	std::vector<InstanceHandle> slotToHandle;
+	std::vector<InstanceHandle> freeHandles;
+	bool instancesDirty;
+	std::vector<glm::mat4> visibleTransforms;				///< staging data of the instance buffer
+	std::vector<Mesh::InstanceRange> instanceRanges;		///< of each mesh, or of each draw of the batch
+	std::vector<uint8_t> uploadedVisibility;				///< sphere visibility the instance buffer was built for
+	uint64_t instanceFrame;
+
+	MeshBatch* batch; ///< not null when the model is loaded with LOAD_BATCHED
+	Graphic::MaterialTextures* materialTextures; ///< textures of all meshes, selected by index
+	std::map<unsigned int, GLint> loadedTextures; ///< indices of textures shared by meshes, keyed by path hash
+
+	/**
+	*	frustum culling, instances are culled by the scene hierarchy of the renderer first, then the meshes of visible
+	*	instances are tested. World space spheres are kept in SoA layout for the SIMD kernel, instance major.
+	*/
+	std::vector<Mesh::Bounds> meshBounds;	///< of each mesh, or of each draw of the batch
+	Mesh::Bounds modelBounds;				///< union of the mesh bounds
+	std::vector<uint32_t> instanceItems;	///< scene hierarchy item of each slot
+	bool inScene;							///< instances are in the scene hierarchy once the model is loaded
+	std::vector<float> sphereX;
+	std::vector<float> sphereY;
+	std::vector<float> sphereZ;
+	std::vector<float> sphereRadius;
+	std::vector<uint8_t> sphereVisibility;
+	std::vector<uint8_t> meshVisibility;	///< a mesh is visible if any of its instances is
+	std::vector<uint8_t> meshLevels;		///< level of detail of each mesh, chosen by its largest visible instance
+	std::vector<float> meshCoverages;		///< projected radius of the largest visible instance over half the viewport height
+	std::vector<float> meshDepths;			///< nearest visible instance over the far plane, sorts opaque meshes front to back
+	std::vector<Mesh::Occluder> occluders;	///< of each mesh, or of each draw of the batch
+	std::vector<Graphic::SceneBVH::Box> occlusionBoxes;	///< world boxes of visible spheres tested against the occluders
+	std::vector<uint32_t> occlusionSpheres;
+	std::vector<uint8_t> occlusionVisibility;
+	bool occluder;
+	uint64_t occluderFrame;
+	uint64_t occlusionFrame;
+	glm::mat4 modelMatrix;
+	bool boundsDirty;
+	uint64_t cullFrame;
+
+	/**
+	*	CPU side of an imported mesh, converted by a worker and released once its GL objects are created
+	*/
+	struct ImportedMesh
+	{
+		std::vector<Mesh::Vertex> vertices;
+		std::vector<GLuint> indices;
+		std::vector<Mesh::Level> levels;
+		Mesh::Bounds bounds;
+		Mesh::Occluder occluder;
+		std::vector<std::pair<std::string, Mesh::TextureType>> textures; ///< paths relative to the directory of the model
+		Mesh::PositionRange positionRange;	///< packed data are left empty for a batch, it packs all meshes at once
+		std::vector<Mesh::PackedVertex> packedVertices;
+		std::vector<Mesh::DepthVertex> depthVertices;
+		std::vector<GLushort> shortIndices;
+		GLenum indexType;	///< of shortIndices or indices, 0 for a batch
+		std::string name;
+		Mesh::OptimizeStatistics optimization;	///< logged by the loading thread, workers do not write to the console
+	};
+
 	std::string directory;
+	Graphic::ModelCache* modelCache; ///< records the meshes while importing, written next to the model file
 	class MeshTech* meshTech;
+	class MeshDepthTech* depthTech;
 	class Light* light;
 
-	void ProcessNode(aiNode* node, const aiScene* scene);
-	Mesh* ProcessMesh(aiMesh* mesh, const aiScene* scene);
-	unsigned int LoadTexture(const char* path);
+	void ProcessNode(aiNode* node, const aiScene* scene, std::vector<aiMesh*>& sceneMeshes) const; ///< collects meshes in node order
+	void ProcessMeshes(const aiScene* scene);
+	void ProcessMesh(aiMesh* mesh, const aiScene* scene, ImportedMesh& imported) const; ///< thread safe, no GL calls
+	Mesh* CreateMesh(ImportedMesh& imported); ///< on the GL thread, null when the mesh is appended into the batch
+	Mesh* CreateMesh(const Mesh::Bounds& bounds, const Mesh::PositionRange& positionRange, const std::vector<Mesh::Level>& levels,
+		Mesh::Occluder&& occluder);
+	bool LoadCache(const Graphic::ModelCache& cache); ///< false when the records do not match the mesh layout
+	GLint LoadTexture(const char* path);
+	void LoadTextures(const std::vector<std::string>& paths); ///< decodes files in parallel
 	std::map<unsigned int, Mesh::Texture> LoadMaterialTexture(aiMaterial* material, aiTextureType aiType, Mesh::TextureType type);
+	void UploadInstances(); ///< once per frame, culls first and compacts the visible instances
+	void UpdateBounds();
+	void AddToScene();
+	void RemoveFromScene();
+	Graphic::SceneBVH::Box GetInstanceBox(const glm::mat4& transform) const; ///< world box of an instance
+	void Cull(); ///< once per frame, by the first submitting mesh
+	void SubmitOccluders(Graphic::OcclusionCuller* occlusionCuller);
+	void CullOccluded(); ///< after Cull(), once the occluders are rasterized
+	bool IsVisible(GLuint boundsIndex) const;
+	size_t GetLevel(GLuint boundsIndex, size_t levelCount) const;
+	float GetDepth(GLuint boundsIndex) const;
+
+	friend class Mesh;
+	friend class MeshBatch;
 };
 
@@ -0,0 +1,393 @@
+#include "ModelCache.h"
+#include "Debug.h"
+#include <cstring>
+#ifndef _WIN32
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	uint64_t AlignUp(uint64_t offset, uint64_t alignment)
+	{
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	void RemoveFile(const std::wstring& path)
+	{
+#ifdef _WIN32
+		DeleteFileW(path.c_str());
+#else
+		remove(Unicode::UnicodeToMultibytes(path.c_str()).c_str());
+#endif
+	}
+
+#ifndef _WIN32
+	/**
+	*	nanoseconds of the last write, the field is named differently on macOS
+	*/
+	uint64_t LastWriteTime(const struct stat& status)
+	{
+#ifdef __APPLE__
+		const timespec& time = status.st_mtimespec;
+#else
+		const timespec& time = status.st_mtim;
+#endif
+		return static_cast<uint64_t>(time.tv_sec) * 1000000000ull + static_cast<uint64_t>(time.tv_nsec);
+	}
+#endif
+
+	bool ReplaceFile(const std::wstring& source, const std::wstring& destination)
+	{
+#ifdef _WIN32
+		return MoveFileExW(source.c_str(), destination.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+#else
+		return rename(Unicode::UnicodeToMultibytes(source.c_str()).c_str(), Unicode::UnicodeToMultibytes(destination.c_str()).c_str()) == 0;
+#endif
+	}
+}
+
+#ifdef _WIN32
+Graphic::ModelCache::ModelCache()
+	:file(INVALID_HANDLE_VALUE), mapping(nullptr), view(nullptr), viewSize(0), meshes(), texturePaths(), dependencyPaths(), blobs()
+{
+}
+#else
+Graphic::ModelCache::ModelCache()
+	:file(-1), view(nullptr), viewSize(0), meshes(), texturePaths(), dependencyPaths(), blobs()
+{
+}
+#endif
+
+Graphic::ModelCache::~ModelCache()
+{
+	Close();
+}
+
+bool Graphic::ModelCache::Open(const wchar_t* sourcePath)
+{
+	Close();
+
+	uint64_t sourceSize = 0;
+	uint64_t sourceTime = 0;
+	if (!GetSourceStamp(sourcePath, sourceSize, sourceTime)) {
+		return false;
+	}
+
+	const std::wstring cachePath = GetCachePath(sourcePath);
+#ifdef _WIN32
+	file = CreateFileW(cachePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER fileSize = {};
+	if (!GetFileSizeEx(file, &fileSize) || static_cast<uint64_t>(fileSize.QuadPart) < sizeof(Header)) {
+		Close();
+		return false;
+	}
+
+	// blobs are read in place, pages are loaded on first touch by the upload
+	mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping != nullptr) {
+		view = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	}
+	if (view == nullptr) {
+		Debug::ShowMessage("Graphic::ModelCache::Open(): map model cache failed.");
+		Close();
+		return false;
+	}
+	viewSize = static_cast<uint64_t>(fileSize.QuadPart);
+#else
+	file = open(Unicode::UnicodeToMultibytes(cachePath.c_str()).c_str(), O_RDONLY);
+	if (file < 0) {
+		return false;
+	}
+
+	struct stat status = {};
+	if (fstat(file, &status) != 0 || static_cast<uint64_t>(status.st_size) < sizeof(Header)) {
+		Close();
+		return false;
+	}
+
+	// blobs are read in place, pages are loaded on first touch by the upload
+	void* address = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+	if (address == MAP_FAILED) {
+		Debug::ShowMessage("Graphic::ModelCache::Open(): map model cache failed.");
+		Close();
+		return false;
+	}
+	view = static_cast<const unsigned char*>(address);
+	viewSize = static_cast<uint64_t>(status.st_size);
+#endif
+
+	/**
+	*	every record and blob is checked once here, getters trust the file afterwards
+	*/
+	const Header& header = GetHeader();
+	bool valid = header.magic == MAGIC && header.version == VERSION && header.meshRecordSize == sizeof(MeshRecord) &&
+		header.sourceSize == sourceSize && header.sourceTime == sourceTime &&
+		Validate({ header.meshOffset, static_cast<uint64_t>(header.meshCount) * sizeof(MeshRecord) }) &&
+		Validate({ header.textureOffset, static_cast<uint64_t>(header.textureCount) * sizeof(TextureRecord) }) &&
+		Validate({ header.dependencyOffset, static_cast<uint64_t>(header.dependencyCount) * sizeof(DependencyRecord) }) &&
+		header.meshOffset % alignof(MeshRecord) == 0 && header.textureOffset % alignof(TextureRecord) == 0 &&
+		header.dependencyOffset % alignof(DependencyRecord) == 0;
+	for (uint32_t index = 0; valid && index < header.meshCount; ++index) {
+		const MeshRecord& mesh = GetMesh(index);
+		valid = mesh.levelCount <= MAX_LEVELS;
+		for (int type = 0; valid && type < BLOB_COUNT; ++type) {
+			valid = Validate(mesh.blobs[type]) && mesh.blobs[type].offset % BLOB_ALIGNMENT == 0;
+		}
+	}
+	const TextureRecord* textures = reinterpret_cast<const TextureRecord*>(view + (valid ? header.textureOffset : 0));
+	for (uint32_t index = 0; valid && index < header.textureCount; ++index) {
+		valid = Validate({ textures[index].offset, textures[index].length });
+	}
+	// e.g. an edited .mtl or texture leaves the model file as it is
+	const DependencyRecord* dependencies = reinterpret_cast<const DependencyRecord*>(view + (valid ? header.dependencyOffset : 0));
+	for (uint32_t index = 0; valid && index < header.dependencyCount; ++index) {
+		const DependencyRecord& dependency = dependencies[index];
+		valid = Validate({ dependency.offset, dependency.length });
+		if (valid) {
+			const std::string path(reinterpret_cast<const char*>(view + dependency.offset), static_cast<size_t>(dependency.length));
+			uint64_t size = 0;
+			uint64_t time = 0;
+			GetDependencyStamp(path.c_str(), size, time);
+			valid = size == dependency.size && time == dependency.time;
+		}
+	}
+
+	if (!valid) {
+		Debug::ShowMessage("Graphic::ModelCache::Open(): model cache is stale, the model is imported again.");
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void Graphic::ModelCache::Close()
+{
+#ifdef _WIN32
+	if (view != nullptr) {
+		UnmapViewOfFile(view);
+		view = nullptr;
+	}
+	if (mapping != nullptr) {
+		CloseHandle(mapping);
+		mapping = nullptr;
+	}
+	if (file != INVALID_HANDLE_VALUE) {
+		CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (view != nullptr) {
+		munmap(const_cast<unsigned char*>(view), static_cast<size_t>(viewSize));
+		view = nullptr;
+	}
+	if (file >= 0) {
+		close(file);
+		file = -1;
+	}
+#endif
+	viewSize = 0;
+}
+
+uint32_t Graphic::ModelCache::GetMeshCount() const
+{
+	return view ? GetHeader().meshCount : 0;
+}
+
+const Graphic::ModelCache::MeshRecord& Graphic::ModelCache::GetMesh(uint32_t index) const
+{
+	if (index >= GetMeshCount()) {
+		throw std::out_of_range("Exception: Graphic::ModelCache::GetMesh(): Index out of range!");
+	}
+	return reinterpret_cast<const MeshRecord*>(view + GetHeader().meshOffset)[index];
+}
+
+uint32_t Graphic::ModelCache::GetTextureCount() const
+{
+	return view ? GetHeader().textureCount : 0;
+}
+
+std::string Graphic::ModelCache::GetTexturePath(uint32_t index) const
+{
+	if (index >= GetTextureCount()) {
+		throw std::out_of_range("Exception: Graphic::ModelCache::GetTexturePath(): Index out of range!");
+	}
+	const TextureRecord& texture = reinterpret_cast<const TextureRecord*>(view + GetHeader().textureOffset)[index];
+	return std::string(reinterpret_cast<const char*>(view + texture.offset), static_cast<size_t>(texture.length));
+}
+
+const void* Graphic::ModelCache::GetBlob(const MeshRecord& mesh, BlobType type) const
+{
+	return mesh.blobs[type].size > 0 ? view + mesh.blobs[type].offset : nullptr;
+}
+
+uint32_t Graphic::ModelCache::AddTexture(const char* path)
+{
+	texturePaths.push_back(path);
+	return static_cast<uint32_t>(texturePaths.size() - 1);
+}
+
+void Graphic::ModelCache::AddDependency(const char* path)
+{
+	if (std::find(dependencyPaths.begin(), dependencyPaths.end(), path) == dependencyPaths.end()) {
+		dependencyPaths.push_back(path);
+	}
+}
+
+void Graphic::ModelCache::AddMesh(const MeshRecord& record, const void* const data[BLOB_COUNT])
+{
+	MeshRecord mesh = record;
+	for (int type = 0; type < BLOB_COUNT; ++type) {
+		Blob& blob = mesh.blobs[type];
+		blob.offset = AlignUp(blobs.size(), BLOB_ALIGNMENT);
+		blobs.resize(static_cast<size_t>(blob.offset + blob.size));
+		if (blob.size > 0) {
+			memcpy(&blobs[static_cast<size_t>(blob.offset)], data[type], static_cast<size_t>(blob.size));
+		}
+	}
+	meshes.push_back(mesh);
+}
+
+bool Graphic::ModelCache::Write(const wchar_t* sourcePath)
+{
+	Header header = {};
+	if (!GetSourceStamp(sourcePath, header.sourceSize, header.sourceTime)) {
+		return false;
+	}
+	header.magic = MAGIC;
+	header.version = VERSION;
+	header.meshRecordSize = sizeof(MeshRecord);
+	header.meshCount = static_cast<uint32_t>(meshes.size());
+	header.textureCount = static_cast<uint32_t>(texturePaths.size());
+	header.dependencyCount = static_cast<uint32_t>(dependencyPaths.size());
+	header.meshOffset = sizeof(Header);
+	header.textureOffset = header.meshOffset + meshes.size() * sizeof(MeshRecord);
+	header.dependencyOffset = header.textureOffset + texturePaths.size() * sizeof(TextureRecord);
+
+	/**
+	*	paths follow the dependency records, blobs start at the next aligned offset
+	*/
+	std::vector<TextureRecord> textures(texturePaths.size());
+	std::vector<DependencyRecord> dependencies(dependencyPaths.size());
+	uint64_t offset = header.dependencyOffset + dependencies.size() * sizeof(DependencyRecord);
+	for (size_t index = 0; index < textures.size(); ++index) {
+		textures[index] = { offset, texturePaths[index].size() };
+		offset += texturePaths[index].size();
+	}
+	for (size_t index = 0; index < dependencies.size(); ++index) {
+		dependencies[index] = { offset, dependencyPaths[index].size(), 0, 0 };
+		GetDependencyStamp(dependencyPaths[index].c_str(), dependencies[index].size, dependencies[index].time);
+		offset += dependencyPaths[index].size();
+	}
+	const uint64_t blobOffset = AlignUp(offset, BLOB_ALIGNMENT);
+	std::vector<MeshRecord> records(meshes);
+	for (MeshRecord& record : records) {
+		for (Blob& blob : record.blobs) {
+			blob.offset += blobOffset;
+		}
+	}
+
+	const std::wstring cachePath = GetCachePath(sourcePath);
+	const std::wstring temporaryPath = cachePath + L".tmp";
+	{
+#ifdef _WIN32
+		std::ofstream stream(temporaryPath.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+#else
+		std::ofstream stream(Unicode::UnicodeToMultibytes(temporaryPath.c_str()), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+#endif
+		if (!stream.is_open()) {
+			Debug::ShowMessage("Graphic::ModelCache::Write(): open model cache failed.");
+			return false;
+		}
+		const std::vector<char> padding(static_cast<size_t>(blobOffset - offset), 0);
+		stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		stream.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(MeshRecord));
+		stream.write(reinterpret_cast<const char*>(textures.data()), textures.size() * sizeof(TextureRecord));
+		stream.write(reinterpret_cast<const char*>(dependencies.data()), dependencies.size() * sizeof(DependencyRecord));
+		for (const std::string& path : texturePaths) {
+			stream.write(path.data(), path.size());
+		}
+		for (const std::string& path : dependencyPaths) {
+			stream.write(path.data(), path.size());
+		}
+		stream.write(padding.data(), padding.size());
+		stream.write(reinterpret_cast<const char*>(blobs.data()), blobs.size());
+		if (!stream) {
+			stream.close();
+			RemoveFile(temporaryPath);
+			Debug::ShowMessage("Graphic::ModelCache::Write(): write model cache failed.");
+			return false;
+		}
+	}
+
+	// replaced at once, a load never maps a partially written cache
+	if (!ReplaceFile(temporaryPath, cachePath)) {
+		RemoveFile(temporaryPath);
+		Debug::ShowMessage("Graphic::ModelCache::Write(): replace model cache failed.");
+		return false;
+	}
+
+	return true;
+}
+
+std::wstring Graphic::ModelCache::GetCachePath(const wchar_t* sourcePath)
+{
+	return std::wstring(sourcePath) + L".meshcache";
+}
+
+const Graphic::ModelCache::Header& Graphic::ModelCache::GetHeader() const
+{
+	return *reinterpret_cast<const Header*>(view);
+}
+
+bool Graphic::ModelCache::Validate(const Blob& blob) const
+{
+	return blob.offset <= viewSize && blob.size <= viewSize - blob.offset;
+}
+
+bool Graphic::ModelCache::GetSourceStamp(const wchar_t* sourcePath, uint64_t& size, uint64_t& time)
+{
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA attributes = {};
+	if (!GetFileAttributesExW(sourcePath, GetFileExInfoStandard, &attributes)) {
+		return false;
+	}
+	size = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+	time = (static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+#else
+	struct stat status = {};
+	if (stat(Unicode::UnicodeToMultibytes(sourcePath).c_str(), &status) != 0) {
+		return false;
+	}
+	size = static_cast<uint64_t>(status.st_size);
+	time = LastWriteTime(status);
+#endif
+	return true;
+}
+
+void Graphic::ModelCache::GetDependencyStamp(const char* path, uint64_t& size, uint64_t& time)
+{
+	size = MISSING_SIZE;
+	time = 0;
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA attributes = {};
+	if (GetFileAttributesExA(path, GetFileExInfoStandard, &attributes)) {
+		size = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+		time = (static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+	}
+#else
+	struct stat status = {};
+	if (stat(path, &status) == 0) {
+		size = static_cast<uint64_t>(status.st_size);
+		time = LastWriteTime(status);
+	}
+#endif
+}
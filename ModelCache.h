@@ -0,0 +1,141 @@
+#pragma once
+#include "Utility.h"
+
+namespace Graphic
+{
+	class ModelCache;
+}
+
+/**
+*	\description: class ModelCache: binary cache of an imported model, written next to the model file on the first
+*	import as "<model file>.meshcache". Later loads map the file into memory and upload the vertex and index blobs
+*	straight from the mapped pages, the importer is not run.
+*
+*	\detail: the file is a header, the mesh records, the texture records, the dependency records, their paths, then the
+*	blobs. Blobs are aligned to BLOB_ALIGNMENT from the beginning of the file, the mapped view is page aligned so they
+*	can be read in place. Dependencies are the other files the import read, e.g. the .mtl of an .obj and the textures,
+*	with their size and last write time. A cache is stale when the version differs, or the size or the last write time
+*	of the model file or of a dependency differs, a dependency missing at the import must still be missing.
+*/
+class Graphic::ModelCache
+{
+public:
+	static constexpr uint32_t MAGIC = 0x4c444d4e;		///< "NMDL"
+	static constexpr uint32_t VERSION = 2;				///< increase it when the layout or the import processing changes
+	static constexpr uint64_t BLOB_ALIGNMENT = 64;
+	static constexpr uint32_t MAX_LEVELS = 4;
+
+	enum BlobType
+	{
+		BLOB_VERTICES,			///< packed vertices of the mesh
+		BLOB_DEPTH_VERTICES,	///< packed positions of the depth pre-pass
+		BLOB_INDICES,			///< all levels of detail, of indexType
+		BLOB_OCCLUDER_POSITIONS,
+		BLOB_OCCLUDER_INDICES,
+		BLOB_COUNT
+	};
+
+	/**
+	*	bytes from the beginning of the file
+	*/
+	struct Blob
+	{
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	/**
+	*	model space data of one mesh, written as it is in memory
+	*/
+	struct MeshRecord
+	{
+		glm::vec3 boundsMinimum;
+		glm::vec3 boundsMaximum;
+		glm::vec3 boundsCenter;
+		float boundsRadius;
+		glm::vec4 positionOffset;
+		glm::vec4 positionScale;
+		GLint material[3];		///< diffuse, specular and ambient texture of the texture records, -1 means no texture
+		GLenum indexType;
+		uint32_t vertexCount;
+		uint32_t levelCount;
+		GLuint levels[MAX_LEVELS][2];	///< first index and index count
+		Blob blobs[BLOB_COUNT];
+	};
+
+	ModelCache();
+	ModelCache(const ModelCache& modelCache) = delete;
+	~ModelCache();
+
+	// loading
+	bool Open(const wchar_t* sourcePath); ///< false when there is no cache or it is stale
+	void Close();
+	uint32_t GetMeshCount() const;
+	const MeshRecord& GetMesh(uint32_t index) const;
+	uint32_t GetTextureCount() const;
+	std::string GetTexturePath(uint32_t index) const;
+	const void* GetBlob(const MeshRecord& mesh, BlobType type) const;
+
+	// writing, meshes and textures are kept in memory until written
+	uint32_t AddTexture(const char* path);
+	void AddDependency(const char* path); ///< as the import opened it, stamped by Write()
+	void AddMesh(const MeshRecord& record, const void* const data[BLOB_COUNT]); ///< sizes of the blobs are set by the record
+	bool Write(const wchar_t* sourcePath);
+
+	static std::wstring GetCachePath(const wchar_t* sourcePath);
+
+private:
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t sourceSize;
+		uint64_t sourceTime;
+		uint32_t meshRecordSize;	///< guards against a different layout of the same version
+		uint32_t meshCount;
+		uint32_t textureCount;
+		uint32_t dependencyCount;
+		uint64_t meshOffset;
+		uint64_t textureOffset;
+		uint64_t dependencyOffset;
+	};
+	/**
+	*	path relative to the directory of the model
+	*/
+	struct TextureRecord
+	{
+		uint64_t offset;
+		uint64_t length;
+	};
+	/**
+	*	path as the import opened it, size is MISSING_SIZE if the file did not exist
+	*/
+	struct DependencyRecord
+	{
+		uint64_t offset;
+		uint64_t length;
+		uint64_t size;
+		uint64_t time;
+	};
+	static constexpr uint64_t MISSING_SIZE = UINT64_MAX;
+
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int file;	///< descriptor, the view is mapped from it directly
+#endif
+	const unsigned char* view;
+	uint64_t viewSize;
+
+	std::vector<MeshRecord> meshes;		///< written meshes, blob offsets are relative to blobs until written
+	std::vector<std::string> texturePaths;
+	std::vector<std::string> dependencyPaths;
+	std::vector<unsigned char> blobs;
+
+	const Header& GetHeader() const;
+	bool Validate(const Blob& blob) const;
+
+	static bool GetSourceStamp(const wchar_t* sourcePath, uint64_t& size, uint64_t& time);
+	static void GetDependencyStamp(const char* path, uint64_t& size, uint64_t& time); ///< MISSING_SIZE if it does not exist
+};
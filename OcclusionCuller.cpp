@@ -0,0 +1,346 @@
+#include "OcclusionCuller.h"
+
+#include <cfloat>
+#include <chrono>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define OCCLUSION_SSE
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	constexpr float MIN_CLIP_W = 1e-5f;
+
+	float MillisecondsSince(const std::chrono::high_resolution_clock::time_point& start)
+	{
+		return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+Graphic::OcclusionCuller::OcclusionCuller()
+	:viewProjection(1.f), triangles(), clipPositions(), bins(HEIGHT / BIN_HEIGHT), levels(), statistics(), rasterized(false)
+{
+	int width = WIDTH;
+	int height = HEIGHT;
+	while (true) {
+		levels.push_back({ width, height, std::vector<float>(static_cast<size_t>(width) * height, 1.f) });
+		if (width == 1 && height == 1) {
+			break;
+		}
+		width = (std::max)((width + 1) / 2, 1);
+		height = (std::max)((height + 1) / 2, 1);
+	}
+}
+
+Graphic::OcclusionCuller::~OcclusionCuller()
+{
+}
+
+void Graphic::OcclusionCuller::BeginFrame(const glm::mat4& viewProjection)
+{
+	this->viewProjection = viewProjection;
+	triangles.clear();
+	for (std::vector<uint32_t>& bin : bins) {
+		bin.clear();
+	}
+	statistics = {};
+	rasterized = false;
+}
+
+void Graphic::OcclusionCuller::AddOccluder(const glm::vec3* positions, size_t vertexCount, const GLuint* indices, size_t indexCount,
+	const glm::mat4& model)
+{
+	if (positions == nullptr || indices == nullptr || triangles.size() >= MAX_TRIANGLES) {
+		return;
+	}
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	const glm::mat4 matrix = viewProjection * model;
+	clipPositions.resize(vertexCount);
+	for (size_t vertex = 0; vertex < vertexCount; ++vertex) {
+		clipPositions[vertex] = matrix * glm::vec4(positions[vertex], 1.f);
+	}
+
+	for (size_t i = 0; i + 3 <= indexCount && triangles.size() < MAX_TRIANGLES; i += 3) {
+		const glm::vec4 corners[3] = { clipPositions[indices[i]], clipPositions[indices[i + 1]], clipPositions[indices[i + 2]] };
+		float distances[3];
+		int insideCount = 0;
+		for (int corner = 0; corner < 3; ++corner) {
+			// distance to the near plane, z = -w
+			distances[corner] = corners[corner].z + corners[corner].w;
+			insideCount += distances[corner] >= 0.f ? 1 : 0;
+		}
+		if (insideCount == 3) {
+			SetupTriangle(corners[0], corners[1], corners[2]);
+			continue;
+		}
+		if (insideCount == 0) {
+			continue;
+		}
+
+		// clip against the near plane, the polygon has 3 or 4 corners
+		glm::vec4 polygon[4];
+		int polygonCount = 0;
+		for (int corner = 0; corner < 3; ++corner) {
+			const int next = (corner + 1) % 3;
+			if (distances[corner] >= 0.f) {
+				polygon[polygonCount++] = corners[corner];
+			}
+			if ((distances[corner] >= 0.f) != (distances[next] >= 0.f)) {
+				const float t = distances[corner] / (distances[corner] - distances[next]);
+				polygon[polygonCount++] = corners[corner] + (corners[next] - corners[corner]) * t;
+			}
+		}
+		for (int corner = 2; corner < polygonCount; ++corner) {
+			SetupTriangle(polygon[0], polygon[corner - 1], polygon[corner]);
+		}
+	}
+
+	statistics.occluders++;
+	statistics.rasterizeMilliseconds += MillisecondsSince(start);
+}
+
+void Graphic::OcclusionCuller::Rasterize()
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	std::vector<float>& depths = levels[0].depths;
+	std::fill(depths.begin(), depths.end(), 1.f);
+	if (!triangles.empty()) {
+		// bins own disjoint rows
+		ThreadPool::GetInstance().ParallelFor(bins.size(), [this](size_t bin) {
+			RasterizeBin(bin);
+		});
+	}
+	BuildPyramid();
+
+	statistics.triangles = static_cast<uint32_t>(triangles.size());
+	statistics.rasterizeMilliseconds += MillisecondsSince(start);
+	rasterized = true;
+}
+
+size_t Graphic::OcclusionCuller::TestBoxes(const SceneBVH::Box* boxes, size_t count, uint8_t* visible)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	size_t visibleCount = 0;
+	for (size_t i = 0; i < count; ++i) {
+		visible[i] = IsOccluded(boxes[i]) ? 0 : 1;
+		visibleCount += visible[i];
+	}
+
+	statistics.tested += static_cast<uint32_t>(count);
+	statistics.occluded += static_cast<uint32_t>(count - visibleCount);
+	statistics.testMilliseconds += MillisecondsSince(start);
+
+	return visibleCount;
+}
+
+bool Graphic::OcclusionCuller::IsOccluded(const SceneBVH::Box& box) const
+{
+	if (!rasterized || triangles.empty()) {
+		return false;
+	}
+
+	/**
+	*	screen rectangle and nearest depth of the corners, boxes crossing the near plane are visible
+	*/
+	float minX = FLT_MAX;
+	float minY = FLT_MAX;
+	float maxX = -FLT_MAX;
+	float maxY = -FLT_MAX;
+	float minZ = FLT_MAX;
+	for (int corner = 0; corner < 8; ++corner) {
+		const glm::vec3 position((corner & 1) ? box.maximum.x : box.minimum.x, (corner & 2) ? box.maximum.y : box.minimum.y,
+			(corner & 4) ? box.maximum.z : box.minimum.z);
+		const glm::vec4 clip = viewProjection * glm::vec4(position, 1.f);
+		if (clip.w < MIN_CLIP_W || clip.z < -clip.w) {
+			return false;
+		}
+		const float invW = 1.f / clip.w;
+		const float x = (clip.x * invW * 0.5f + 0.5f) * WIDTH;
+		const float y = (clip.y * invW * 0.5f + 0.5f) * HEIGHT;
+		minX = (std::min)(minX, x);
+		maxX = (std::max)(maxX, x);
+		minY = (std::min)(minY, y);
+		maxY = (std::max)(maxY, y);
+		minZ = (std::min)(minZ, clip.z * invW * 0.5f + 0.5f);
+	}
+
+	const int x0 = (std::max)(static_cast<int>(std::floor(minX)), 0);
+	const int y0 = (std::max)(static_cast<int>(std::floor(minY)), 0);
+	const int x1 = (std::min)(static_cast<int>(std::floor(maxX)), WIDTH - 1);
+	const int y1 = (std::min)(static_cast<int>(std::floor(maxY)), HEIGHT - 1);
+	if (x0 > x1 || y0 > y1) {
+		return false;
+	}
+
+	// the level where the rectangle covers at most 2 x 2 texels
+	size_t level = 0;
+	while (level + 1 < levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1)) {
+		level++;
+	}
+
+	/**
+	*	finer levels keep nearer farthest depths, they are tried when the coarse texels are inconclusive
+	*/
+	const size_t finestLevel = level > REFINE_LEVELS ? level - REFINE_LEVELS : 0;
+	while (true) {
+		const Level& texels = levels[level];
+		bool occluded = true;
+		for (int y = y0 >> level; occluded && y <= (y1 >> level); ++y) {
+			for (int x = x0 >> level; x <= (x1 >> level); ++x) {
+				if (texels.depths[static_cast<size_t>(y) * texels.width + x] >= minZ) {
+					occluded = false;
+					break;
+				}
+			}
+		}
+		if (occluded) {
+			return true;
+		}
+		if (level == finestLevel) {
+			return false;
+		}
+		level--;
+	}
+}
+
+bool Graphic::OcclusionCuller::HasOccluders() const
+{
+	return !triangles.empty();
+}
+
+const Graphic::OcclusionCuller::Statistics& Graphic::OcclusionCuller::GetStatistics() const
+{
+	return statistics;
+}
+
+void Graphic::OcclusionCuller::SetupTriangle(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2)
+{
+	auto toScreen = [](const glm::vec4& clip) {
+		const float invW = 1.f / (std::max)(clip.w, MIN_CLIP_W);
+		return glm::vec3((clip.x * invW * 0.5f + 0.5f) * WIDTH, (clip.y * invW * 0.5f + 0.5f) * HEIGHT, clip.z * invW * 0.5f + 0.5f);
+	};
+	const glm::vec3 p[3] = { toScreen(v0), toScreen(v1), toScreen(v2) };
+
+	// counter clockwise front faces have positive area
+	const float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+	if (!(area > 0.f)) {
+		return;
+	}
+
+	Triangle triangle = {};
+	triangle.minX = (std::max)(static_cast<int>(std::floor((std::min)({ p[0].x, p[1].x, p[2].x }))), 0);
+	triangle.maxX = (std::min)(static_cast<int>(std::ceil((std::max)({ p[0].x, p[1].x, p[2].x }))), WIDTH - 1);
+	triangle.minY = (std::max)(static_cast<int>(std::floor((std::min)({ p[0].y, p[1].y, p[2].y }))), 0);
+	triangle.maxY = (std::min)(static_cast<int>(std::ceil((std::max)({ p[0].y, p[1].y, p[2].y }))), HEIGHT - 1);
+	if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+		return;
+	}
+
+	/**
+	*	edge i runs from corner i to corner i + 1 and weights the opposite corner i + 2
+	*/
+	const float invArea = 1.f / area;
+	triangle.depthA = 0.f;
+	triangle.depthB = 0.f;
+	triangle.depthC = 0.f;
+	for (int edge = 0; edge < 3; ++edge) {
+		const glm::vec3& a = p[edge];
+		const glm::vec3& b = p[(edge + 1) % 3];
+		triangle.edgeA[edge] = a.y - b.y;
+		triangle.edgeB[edge] = b.x - a.x;
+		triangle.edgeC[edge] = -(triangle.edgeA[edge] * a.x + triangle.edgeB[edge] * a.y);
+
+		const float weight = p[(edge + 2) % 3].z * invArea;
+		triangle.depthA += triangle.edgeA[edge] * weight;
+		triangle.depthB += triangle.edgeB[edge] * weight;
+		triangle.depthC += triangle.edgeC[edge] * weight;
+	}
+
+	const uint32_t index = static_cast<uint32_t>(triangles.size());
+	triangles.push_back(triangle);
+	for (int bin = triangle.minY / BIN_HEIGHT; bin <= triangle.maxY / BIN_HEIGHT; ++bin) {
+		bins[bin].push_back(index);
+	}
+}
+
+void Graphic::OcclusionCuller::RasterizeBin(size_t bin)
+{
+	const int binMinY = static_cast<int>(bin) * BIN_HEIGHT;
+	const int binMaxY = (std::min)(binMinY + BIN_HEIGHT, HEIGHT) - 1;
+	float* depths = levels[0].depths.data();
+
+	for (uint32_t index : bins[bin]) {
+		const Triangle& triangle = triangles[index];
+		const int minY = (std::max)(triangle.minY, binMinY);
+		const int maxY = (std::min)(triangle.maxY, binMaxY);
+		// WIDTH is a multiple of 4, so aligned blocks never cross the row
+		const int minX = triangle.minX & ~3;
+
+		for (int y = minY; y <= maxY; ++y) {
+			const float pixelY = y + 0.5f;
+			float* row = depths + static_cast<size_t>(y) * WIDTH;
+
+#if defined(OCCLUSION_SSE)
+			const __m128 pixelOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+			const __m128 zero = _mm_setzero_ps();
+			__m128 edgeA[3];
+			__m128 edgeRow[3];
+			for (int edge = 0; edge < 3; ++edge) {
+				edgeA[edge] = _mm_set1_ps(triangle.edgeA[edge]);
+				edgeRow[edge] = _mm_set1_ps(triangle.edgeB[edge] * pixelY + triangle.edgeC[edge]);
+			}
+			const __m128 depthA = _mm_set1_ps(triangle.depthA);
+			const __m128 depthRow = _mm_set1_ps(triangle.depthB * pixelY + triangle.depthC);
+
+			for (int x = minX; x <= triangle.maxX; x += 4) {
+				const __m128 pixelX = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), pixelOffsets);
+				__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[0], pixelX), edgeRow[0]), zero);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[1], pixelX), edgeRow[1]), zero));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[2], pixelX), edgeRow[2]), zero));
+				if (_mm_movemask_ps(inside) == 0) {
+					continue;
+				}
+
+				const __m128 depth = _mm_add_ps(_mm_mul_ps(depthA, pixelX), depthRow);
+				const __m128 stored = _mm_loadu_ps(row + x);
+				const __m128 nearest = _mm_min_ps(stored, depth);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, stored)));
+			}
+#else
+			for (int x = minX; x <= triangle.maxX; ++x) {
+				const float pixelX = x + 0.5f;
+				bool inside = true;
+				for (int edge = 0; edge < 3; ++edge) {
+					inside = inside && triangle.edgeA[edge] * pixelX + triangle.edgeB[edge] * pixelY + triangle.edgeC[edge] >= 0.f;
+				}
+				if (inside) {
+					row[x] = (std::min)(row[x], triangle.depthA * pixelX + triangle.depthB * pixelY + triangle.depthC);
+				}
+			}
+#endif
+		}
+	}
+}
+
+void Graphic::OcclusionCuller::BuildPyramid()
+{
+	for (size_t level = 1; level < levels.size(); ++level) {
+		const Level& source = levels[level - 1];
+		Level& target = levels[level];
+		for (int y = 0; y < target.height; ++y) {
+			const int y0 = (std::min)(y * 2, source.height - 1);
+			const int y1 = (std::min)(y * 2 + 1, source.height - 1);
+			for (int x = 0; x < target.width; ++x) {
+				const int x0 = (std::min)(x * 2, source.width - 1);
+				const int x1 = (std::min)(x * 2 + 1, source.width - 1);
+				target.depths[static_cast<size_t>(y) * target.width + x] = (std::max)({
+					source.depths[static_cast<size_t>(y0) * source.width + x0], source.depths[static_cast<size_t>(y0) * source.width + x1],
+					source.depths[static_cast<size_t>(y1) * source.width + x0], source.depths[static_cast<size_t>(y1) * source.width + x1] });
+			}
+		}
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include "Utility.h"
+#include "SceneBVH.h"
+
+namespace Graphic
+{
+	class OcclusionCuller;
+}
+
+/**
+*	\description: class OcclusionCuller: software occlusion culling on the CPU. Occluder triangles are rasterized into a
+*	low resolution depth buffer, a pyramid of the farthest depths is built from it, and the screen space boxes of
+*	candidates are tested against the pyramid level where they cover at most 2 x 2 texels, then against finer levels.
+*
+*	\detail: rows of the depth buffer are split into bins which are rasterized by the worker threads, four pixels at a
+*	time with SSE. Only front faces of occluders are drawn, triangles crossing the near plane are clipped.
+*/
+class Graphic::OcclusionCuller
+{
+public:
+	static constexpr int WIDTH = 320;	///< multiple of 4
+	static constexpr int HEIGHT = 192;
+	static constexpr int BIN_HEIGHT = 16;
+	static constexpr size_t MAX_TRIANGLES = 64 * 1024; ///< occluder triangles per frame, the rest are skipped
+	static constexpr size_t REFINE_LEVELS = 2; ///< finer pyramid levels tried before a box is reported visible
+
+	/**
+	*	counts and CPU time of a frame
+	*/
+	struct Statistics
+	{
+		uint32_t occluders;
+		uint32_t triangles;		///< occluder triangles rasterized
+		uint32_t tested;
+		uint32_t occluded;
+		float rasterizeMilliseconds;
+		float testMilliseconds;
+	};
+
+	OcclusionCuller();
+	OcclusionCuller(const OcclusionCuller& occlusionCuller) = delete;
+	~OcclusionCuller();
+
+	void BeginFrame(const glm::mat4& viewProjection); ///< clears occluders and depth
+	void AddOccluder(const glm::vec3* positions, size_t vertexCount, const GLuint* indices, size_t indexCount, const glm::mat4& model);
+	void Rasterize(); ///< draws occluders and builds the pyramid
+
+	size_t TestBoxes(const SceneBVH::Box* boxes, size_t count, uint8_t* visible); ///< world boxes, returns visible count
+	bool IsOccluded(const SceneBVH::Box& box) const;
+
+	bool HasOccluders() const;
+	const Statistics& GetStatistics() const;
+
+private:
+	/**
+	*	edge functions and depth plane in pixel space, E(x, y) = a * x + b * y + c
+	*/
+	struct Triangle
+	{
+		float edgeA[3];
+		float edgeB[3];
+		float edgeC[3];
+		float depthA;
+		float depthB;
+		float depthC;
+		int minX;
+		int maxX;
+		int minY;
+		int maxY;
+	};
+	struct Level
+	{
+		int width;
+		int height;
+		std::vector<float> depths;
+	};
+
+	glm::mat4 viewProjection;
+	std::vector<Triangle> triangles;
+	std::vector<glm::vec4> clipPositions;		///< vertices of the occluder being added
+	std::vector<std::vector<uint32_t>> bins;	///< triangles overlapping each bin
+	std::vector<Level> levels;					///< levels[0] is the depth buffer, each level keeps the farthest depth of 2 x 2 texels
+	Statistics statistics;
+	bool rasterized;
+
+	void SetupTriangle(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2);
+	void RasterizeBin(size_t bin);
+	void BuildPyramid();
+};
@@ -16,6 +16,16 @@ public:
 
 		glm::vec4 textColor = glm::vec4(1.f, 0.5f, 0.2f, 1.f);
 		fps->SetColor(textColor);
+
+		statistics = gui->CreateStaticText(L"statistics", 0.f, 0.f);
+		statistics->SetPosition(Widgets::StaticText::TEXT_POS_LEFT_TOP);
+		statistics->SetTextScale(0.5f);
+		statistics->SetColor(textColor);
+
+		gpuTimes = gui->CreateStaticText(L"gpu", 0.f, 0.f);
+		gpuTimes->SetPosition(Widgets::StaticText::TEXT_POS_LEFT_BOTTOM);
+		gpuTimes->SetTextScale(0.5f);
+		gpuTimes->SetColor(textColor);
 	}
 
 	~Pannel()
@@ -27,12 +37,77 @@ public:
 	{
 		gui->Update(dt);
 
-		std::wstring fpsText = L"FPS:" + std::to_wstring(Window::GetFPS());
-		fps->SetTitle(fpsText);
+		std::wostringstream fpsText;
+		fpsText.setf(std::ios::fixed);
+		fpsText.precision(2);
+		fpsText << L"FPS:" << Window::GetFPS();
+		if (const Graphic::FramePacer* framePacer = Window::GetFramePacer()) {
+			const Graphic::FramePacer::Statistics& pacing = framePacer->GetStatistics();
+			fpsText << L" Frame:" << pacing.frameMilliseconds << L"ms CPU wait fence:" << pacing.fenceWaitMilliseconds <<
+				L"ms limiter:" << pacing.limiterWaitMilliseconds << L"ms swap:" << pacing.swapMilliseconds << L"ms in flight:" <<
+				pacing.framesInFlight;
+		}
+		fps->SetTitle(fpsText.str());
+
+		const Graphic::Renderer::FrameStatistics& frameStatistics = Graphic::Renderer::GetFrameStatistics();
+		std::wstring statisticsText = L"Draws:" + std::to_wstring(frameStatistics.drawItems) +
+			L" Programs:" + std::to_wstring(frameStatistics.programSwitches) +
+			L" Texture binds:" + std::to_wstring(frameStatistics.textureBinds) +
+			L" State calls issued:" + std::to_wstring(frameStatistics.stateCalls.issued) +
+			L" elided:" + std::to_wstring(frameStatistics.stateCalls.elided) +
+			L" Passes:" + std::to_wstring(frameStatistics.passes.passes - frameStatistics.passes.culledPasses) +
+			L" Targets:" + std::to_wstring(frameStatistics.passes.physicalTextures) +
+			L" Visible:" + std::to_wstring(frameStatistics.visibleMeshes) +
+			L" Culled:" + std::to_wstring(frameStatistics.culledMeshes) +
+			L" Occluded meshes:" + std::to_wstring(frameStatistics.occludedMeshes) +
+			L" Instances:" + std::to_wstring(frameStatistics.visibleInstances) +
+			L"/" + std::to_wstring(frameStatistics.visibleInstances + frameStatistics.culledInstances) +
+			L" Occluded:" + std::to_wstring(frameStatistics.occlusion.occluded) + L"/" + std::to_wstring(frameStatistics.occlusion.tested) +
+			L" (" + std::to_wstring(frameStatistics.occlusion.rasterizeMilliseconds + frameStatistics.occlusion.testMilliseconds) + L"ms)" +
+			L" Depth pre-pass(F10):" + (Graphic::Renderer::GetDepthPrePass() ? L"on" : L"off") +
+			L" Front to back(F11):" + (Graphic::Renderer::GetFrontToBack() ? L"on" : L"off");
+		statistics->SetTitle(statisticsText);
+
+		UpdateGPUTimes();
+	}
+
+	void UpdateGPUTimes()
+	{
+		/**
+		*	passes are listed in order, render targets inside them are summed up by name
+		*/
+		const Graphic::GPUProfiler* profiler = Graphic::Renderer::GetGPUProfiler();
+		if (profiler == nullptr) {
+			return;
+		}
+
+		std::wostringstream text;
+		text.setf(std::ios::fixed);
+		text.precision(2);
+		text << L"GPU " << profiler->GetFrameMilliseconds() << L"ms";
+
+		std::map<std::string, std::pair<unsigned int, double>> targets;
+		for (const Graphic::GPUProfiler::ScopeResult& result : profiler->GetResults()) {
+			if (result.depth == 0) {
+				text << L" " << Unicode::MultibytesToUnicode(result.name.c_str()) << L":" << result.milliseconds;
+			}
+			else {
+				auto& target = targets[result.name];
+				target.first++;
+				target.second += result.milliseconds;
+			}
+		}
+		for (const auto& target : targets) {
+			text << L" " << Unicode::MultibytesToUnicode(target.first.c_str()) << L"x" << target.second.first << L":" << target.second.second;
+		}
+
+		gpuTimes->SetTitle(text.str());
 	}
 
 	ControlsManager* gui;
 	Window* window;
 	Widgets::StaticText* fps;
+	Widgets::StaticText* statistics;
+	Widgets::StaticText* gpuTimes;
 
 };
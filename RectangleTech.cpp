@@ -13,27 +13,33 @@ RectangleTech::~RectangleTech()
 {
 }
 
-bool RectangleTech::Init()
+void RectangleTech::Compile()
+{
+	shader = CompileVariant(style == RECT_SOFT ? ROUNDED : 0);
+}
+
+Graphic::Shader* RectangleTech::CompileVariant(Features features)
 {
 	// rectangle shader code
 
 	const char* rectVSCode = R"(
 	#version 440
 	#define RECT_VERTEX_SHADER
+	)" FRAME_CONSTANTS_GLSL R"(
 	
 	layout (location = 0) in vec4 vertex;
 	
 	out vec2 textureCoords;
 	out vec2 position;
 	
-	uniform mat4 projection;
-	uniform mat4 model;
+	layout (location = 0) uniform mat4 model;
 
 	void main()
 	{
 		position = vertex.xy;
 		textureCoords = vertex.zw;
-		gl_Position = projection * model * vec4(position, 0.0, 1.0);
+		vec4 pixel = model * vec4(position, 0.0, 1.0);
+		gl_Position = vec4(pixel.xy * frame.content.xy * frame.viewport.zw * 2.0 - 1.0, 0.0, 1.0);
 	}
 	)";
 
@@ -46,14 +52,16 @@ bool RectangleTech::Init()
 	
 	out vec4 fragColor;
 	
+	layout (location = 1) uniform vec4 textColor;
+
+	#ifdef TEXTURED
 	uniform sampler2D text;
-	uniform bool toggleTexture;
-	uniform vec4 textColor;
-	
-	uniform vec2 center;
-	uniform vec2 size;
-	uniform float radius;
+	#endif
 
+	#ifdef ROUNDED
+	layout (location = 2) uniform vec2 center;
+	layout (location = 3) uniform vec2 size;
+	layout (location = 4) uniform float radius;
 	
 	bool InCircle(vec2 pos, vec2 center)
 	{
@@ -87,92 +95,119 @@ bool RectangleTech::Init()
 	
 		return false;
 	}
+	#endif
 	
 	void main()
 	{
+	#ifdef ROUNDED
 		// If this pixel isn't in the region, discard it
-		if(radius != 0.0 && !CheckPixel(position)){
+		if(!CheckPixel(position)){
 			discard;
 		}
+	#endif
 
-		if(toggleTexture){
-			vec4 sampled = vec4(1.0, 1.0, 1.0, texture(text, textureCoords).r);
-			fragColor = textColor * sampled;
-		}else{
-			fragColor = textColor;
-		}	
+	#ifdef TEXTURED
+		vec4 sampled = vec4(1.0, 1.0, 1.0, texture(text, textureCoords).r);
+		fragColor = textColor * sampled;
+	#else
+		fragColor = textColor;
+	#endif
 
 	}
 	)";
 
+	static const Feature FEATURES[] = { { ROUNDED, "ROUNDED" }, { TEXTURED, "TEXTURED" } };
+	std::string fsCode = Specialize(rectFSCode, features, FEATURES, 2);
+
+	return Resources::CreateShader(rectVSCode, fsCode.c_str());
+}
 
-	shader = Resources::CreateShader(rectVSCode, rectFSCode);
+bool RectangleTech::Init()
+{
+	// the style is a feature, an untextured variant is selected until a texture is set
+	SelectVariant(style == RECT_SOFT ? ROUNDED : 0);
 	shader->Use();
 
-	/** get location */
-	projectionLocation = shader->GetLocation("projection");
-	modelLocation = shader->GetLocation("model");
-	toggleTextureLocation = shader->GetLocation("toggleTexture");
-	textColorLocation = shader->GetLocation("textColor");
-	centerLocation = shader->GetLocation("center");
-	radiusLocation = shader->GetLocation("radius");
-	sizeLocation = shader->GetLocation("size");
+	return true;
+}
 
+void RectangleTech::InitVariant(Graphic::Shader* variant)
+{
 	// initialize matrix
-	glm::mat4 projection = glm::ortho(0.f, static_cast<float>(Window::GetWindowWidth()), 0.f, static_cast<float>(Window::GetWindowHeight()));
 	glm::mat4 model(1.f);
-	shader->SetMat4(projectionLocation, projection);
-	shader->SetMat4(modelLocation, model);
+	variant->SetMat4(MODEL_LOCATION, model);
 
-	// initialize clolor, texture
-	shader->SetBool(toggleTextureLocation, GL_FALSE);
-	shader->SetVec4(textColorLocation, Graphic::DEFAULT_COLOR);
-
-	// initialize radius, center position and size
-	shader->SetFloat(radiusLocation, 0.f);
-	shader->SetVec2(centerLocation, Widgets::DEFAULT_CENTER);
-	shader->SetVec2(sizeLocation, Widgets::DEFAULT_SIZE);
-
-	return true;
-}
+	// initialize clolor
+	variant->SetVec4(TEXT_COLOR_LOCATION, Graphic::DEFAULT_COLOR);
 
-void RectangleTech::SetProjection(glm::mat4& projection)
-{
-	shader->SetMat4(projectionLocation, projection);
+	// initialize radius, center position and size, inactive in the variants without ROUNDED
+	variant->SetFloat(RADIUS_LOCATION, 0.f);
+	variant->SetVec2(CENTER_LOCATION, Widgets::DEFAULT_CENTER);
+	variant->SetVec2(SIZE_LOCATION, Widgets::DEFAULT_SIZE);
 }
 
 void RectangleTech::SetColor(glm::vec4& color)
 {
-	shader->SetVec4(textColorLocation, color);
+	shader->SetVec4(TEXT_COLOR_LOCATION, color);
 }
 
 void RectangleTech::ToggleTexture(bool status)
 {
-	shader->SetBool(toggleTextureLocation, status);
+	SelectVariant(status ? (features | TEXTURED) : (features & ~TEXTURED));
 }
 
 void RectangleTech::SetTexture(GLuint textureID)
 {
-	shader->SetBool(toggleTextureLocation, GL_TRUE);
-	glBindTexture(GL_TEXTURE_2D, textureID);
+	ToggleTexture(true);
+	Graphic::GLBindTexture(GL_TEXTURE_2D, textureID);
 }
 
+/**
+*	center, size and radius shape the corners, the variants of RECT_REGULAR have none of them
+*/
 void RectangleTech::SetCenter(glm::vec2& center)
 {
-	shader->SetVec2(centerLocation, center);
+	if (features & ROUNDED) {
+		shader->SetVec2(CENTER_LOCATION, center);
+	}
 }
 
 void RectangleTech::SetSize(glm::vec2& size)
 {
-	shader->SetVec2(sizeLocation, size);
+	if (features & ROUNDED) {
+		shader->SetVec2(SIZE_LOCATION, size);
+	}
 }
 
 void RectangleTech::SetRadius(float R)
 {
-	if (style == RECT_REGULAR) {
-		shader->SetFloat(radiusLocation, 0.f);
+	if (features & ROUNDED) {
+		shader->SetFloat(RADIUS_LOCATION, R);
 	}
-	else {
-		shader->SetFloat(radiusLocation, R);
+}
+
+void RectangleTech::SetColor(const glm::vec4& color, Graphic::CommandBuffer* commandBuffer)
+{
+	commandBuffer->Uniform4f(TEXT_COLOR_LOCATION, color);
+}
+
+void RectangleTech::SetCenter(const glm::vec2& center, Graphic::CommandBuffer* commandBuffer)
+{
+	if (features & ROUNDED) {
+		commandBuffer->Uniform2f(CENTER_LOCATION, center);
+	}
+}
+
+void RectangleTech::SetSize(const glm::vec2& size, Graphic::CommandBuffer* commandBuffer)
+{
+	if (features & ROUNDED) {
+		commandBuffer->Uniform2f(SIZE_LOCATION, size);
+	}
+}
+
+void RectangleTech::SetRadius(float R, Graphic::CommandBuffer* commandBuffer)
+{
+	if (features & ROUNDED) {
+		commandBuffer->Uniform1f(RADIUS_LOCATION, R);
 	}
 }
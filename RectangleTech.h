@@ -11,12 +11,15 @@ public:
 		RECT_REGULAR
 	};
 
+	static constexpr Features ROUNDED = 1 << 0;		///< corners are cut to the radius, RECT_SOFT
+	static constexpr Features TEXTURED = 1 << 1;	///< alpha is read from the texture
+
 	RectangleTech(RectStyle style = RECT_REGULAR);
 	virtual ~RectangleTech();
 
+	void Compile();
 	bool Init();
 
-	void SetProjection(glm::mat4& projection);
 	void SetColor(glm::vec4& color);
 	void ToggleTexture(bool status);
 	void SetTexture(GLuint textureID);
@@ -24,15 +27,30 @@ public:
 	void SetSize(glm::vec2& size);
 	void SetRadius(float R);
 
+	// record into a command buffer instead of calling GL
+	void SetColor(const glm::vec4& color, Graphic::CommandBuffer* commandBuffer);
+	void SetCenter(const glm::vec2& center, Graphic::CommandBuffer* commandBuffer);
+	void SetSize(const glm::vec2& size, Graphic::CommandBuffer* commandBuffer);
+	void SetRadius(float R, Graphic::CommandBuffer* commandBuffer);
+
+protected:
+	Graphic::Shader* CompileVariant(Features features);
+	void InitVariant(Graphic::Shader* variant);
+
 private:
+	/**
+	*	explicit uniform locations of the shaders
+	*/
+	enum UniformLocation : GLuint
+	{
+		MODEL_LOCATION = 0,
+		TEXT_COLOR_LOCATION = 1,
+		CENTER_LOCATION = 2,
+		SIZE_LOCATION = 3,
+		RADIUS_LOCATION = 4
+	};
+
 	RectStyle style;
-	GLuint projectionLocation;
-	GLuint modelLocation;
-	GLuint toggleTextureLocation;
-	GLuint textColorLocation;
-	GLuint centerLocation;
-	GLuint radiusLocation;
-	GLuint sizeLocation;
 
 
 	friend class Rect;
@@ -0,0 +1,160 @@
+#include "RenderQueue.h"
+
+namespace
+{
+	constexpr int LAYER_SHIFT = 60;
+	constexpr uint64_t LAYER_MASK = 0xf;
+
+	/** truncate a GL object name into a key field, collisions only cost a redundant switch */
+	inline uint64_t KeyField(GLuint value, int bits)
+	{
+		return static_cast<uint64_t>(value) & ((1ull << bits) - 1ull);
+	}
+
+	inline uint64_t QuantizeDepth(float depth)
+	{
+		float clampedDepth = depth < 0.f ? 0.f : (depth > 1.f ? 1.f : depth);
+		return static_cast<uint64_t>(clampedDepth * 65535.f);
+	}
+}
+
+Graphic::RenderQueue::RenderQueue()
+	:items(), sortBuffer(), frontToBack(false)
+{
+}
+
+Graphic::RenderQueue::RenderQueue(const RenderQueue& renderQueue)
+	:items(renderQueue.items), sortBuffer(), frontToBack(renderQueue.frontToBack)
+{
+}
+
+Graphic::RenderQueue::~RenderQueue()
+{
+}
+
+void Graphic::RenderQueue::Clear()
+{
+	// keep capacity, the queue is refilled every frame
+	items.clear();
+}
+
+void Graphic::RenderQueue::Push(RenderTarget* target, RenderLayer layer, GLuint program, GLuint texture, GLuint vertexArray, float depth)
+{
+	uint64_t key = frontToBack && layer == LAYER_OPAQUE ? MakeFrontToBackKey(layer, depth, program, texture, vertexArray) :
+		MakeKey(layer, program, texture, vertexArray, depth);
+	DrawItem item = { key, target, program, texture, vertexArray };
+	items.push_back(item);
+}
+
+void Graphic::RenderQueue::PushOrdered(RenderTarget* target, RenderLayer layer, uint32_t sequence, GLuint program, GLuint texture, GLuint vertexArray)
+{
+	DrawItem item = { MakeOrderedKey(layer, sequence, program, texture, vertexArray), target, program, texture, vertexArray };
+	items.push_back(item);
+}
+
+void Graphic::RenderQueue::Sort()
+{
+	/**
+	*	LSD radix sort, 8 passes of 8 bits, all histograms are built in one sweep.
+	*	A pass is skipped when every key has the same byte, which is the common case for the high bytes.
+	*/
+	const size_t count = items.size();
+	if (count < 2) {
+		return;
+	}
+	sortBuffer.resize(count);
+
+	size_t histogram[8][256] = {};
+	for (const DrawItem& item : items) {
+		for (int pass = 0; pass < 8; ++pass) {
+			histogram[pass][(item.key >> (pass * 8)) & 0xff]++;
+		}
+	}
+
+	DrawItem* source = items.data();
+	DrawItem* destination = sortBuffer.data();
+	for (int pass = 0; pass < 8; ++pass) {
+		const int shift = pass * 8;
+		if (histogram[pass][(source[0].key >> shift) & 0xff] == count) {
+			continue;
+		}
+
+		// exclusive prefix sum
+		size_t offset = 0;
+		for (size_t& bucket : histogram[pass]) {
+			size_t bucketCount = bucket;
+			bucket = offset;
+			offset += bucketCount;
+		}
+
+		for (size_t i = 0; i < count; ++i) {
+			destination[histogram[pass][(source[i].key >> shift) & 0xff]++] = source[i];
+		}
+		std::swap(source, destination);
+	}
+
+	if (source != items.data()) {
+		items.swap(sortBuffer);
+	}
+}
+
+void Graphic::RenderQueue::SetFrontToBack(bool frontToBack)
+{
+	this->frontToBack = frontToBack;
+}
+
+bool Graphic::RenderQueue::GetFrontToBack() const
+{
+	return frontToBack;
+}
+
+size_t Graphic::RenderQueue::Count() const
+{
+	return items.size();
+}
+
+const Graphic::DrawItem* Graphic::RenderQueue::GetItems() const
+{
+	return items.data();
+}
+
+size_t Graphic::RenderQueue::LowerBound(RenderLayer layer) const
+{
+	uint64_t layerKey = (static_cast<uint64_t>(layer) & LAYER_MASK) << LAYER_SHIFT;
+	auto iter = std::lower_bound(items.begin(), items.end(), layerKey,
+		[](const DrawItem& item, uint64_t key) { return item.key < key; });
+
+	return static_cast<size_t>(iter - items.begin());
+}
+
+uint64_t Graphic::RenderQueue::MakeKey(RenderLayer layer, GLuint program, GLuint texture, GLuint vertexArray, float depth)
+{
+	return (static_cast<uint64_t>(layer) & LAYER_MASK) << LAYER_SHIFT |
+		KeyField(program, 12) << 48 |
+		KeyField(texture, 16) << 32 |
+		KeyField(vertexArray, 16) << 16 |
+		QuantizeDepth(depth);
+}
+
+uint64_t Graphic::RenderQueue::MakeFrontToBackKey(RenderLayer layer, float depth, GLuint program, GLuint texture, GLuint vertexArray)
+{
+	return (static_cast<uint64_t>(layer) & LAYER_MASK) << LAYER_SHIFT |
+		QuantizeDepth(depth) << 44 |
+		KeyField(program, 12) << 32 |
+		KeyField(texture, 16) << 16 |
+		KeyField(vertexArray, 16);
+}
+
+uint64_t Graphic::RenderQueue::MakeOrderedKey(RenderLayer layer, uint32_t sequence, GLuint program, GLuint texture, GLuint vertexArray)
+{
+	return (static_cast<uint64_t>(layer) & LAYER_MASK) << LAYER_SHIFT |
+		KeyField(sequence, 16) << 44 |
+		KeyField(program, 12) << 32 |
+		KeyField(texture, 16) << 16 |
+		KeyField(vertexArray, 16);
+}
+
+Graphic::RenderLayer Graphic::RenderQueue::GetLayer(uint64_t key)
+{
+	return static_cast<RenderLayer>((key >> LAYER_SHIFT) & LAYER_MASK);
+}
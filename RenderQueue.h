@@ -0,0 +1,73 @@
+#pragma once
+#include "Utility.h"
+
+namespace Graphic
+{
+	class RenderTarget;
+	class RenderQueue;
+
+	/**
+	*	render layers, occupy the most significant bits of a sort key, so all opaque 3D items are drawn before UI
+	*/
+	enum RenderLayer
+	{
+		LAYER_OPAQUE = 0,
+		LAYER_TRANSPARENT,
+		LAYER_UI,
+
+		LAYER_COUNT
+	};
+
+	/**
+	*	one draw submitted by a render target, the states are kept beside the key to detect switches
+	*/
+	struct DrawItem
+	{
+		uint64_t key;			///< sort key
+		RenderTarget* target;	///< render target which submitted this item
+		GLuint program;			///< shader program, 0 means the target binds it by itself
+		GLuint texture;			///< primary texture
+		GLuint vertexArray;		///< vertex array object
+	};
+}
+
+/**
+*	\description: class RenderQueue: collect the draw items of a frame and radix sort them by a 64-bit key into
+*	a contiguous array, the items which share program, texture and vertex array are drawn one after another.
+*
+*	\detail: key layout, from the most significant bit
+*		3D layers:	| layer 4 | program 12 | texture 16 | vertex array 16 | depth 16 |
+*		front to back opaque layer:	| layer 4 | depth 16 | program 12 | texture 16 | vertex array 16 |
+*		UI layer:	| layer 4 | sequence 16 | program 12 | texture 16 | vertex array 16 |
+*	UI items keep their creation order, because later widgets must cover former ones. Opaque items drawn front to back
+*	fail the depth test early instead of being shaded and covered.
+*/
+class Graphic::RenderQueue
+{
+public:
+	RenderQueue();
+	RenderQueue(const RenderQueue& renderQueue);
+	~RenderQueue();
+
+	void Clear();
+	void Push(RenderTarget* target, RenderLayer layer, GLuint program, GLuint texture, GLuint vertexArray, float depth);
+	void PushOrdered(RenderTarget* target, RenderLayer layer, uint32_t sequence, GLuint program, GLuint texture, GLuint vertexArray);
+	void Sort();
+	void SetFrontToBack(bool frontToBack); ///< order of opaque items pushed later
+	bool GetFrontToBack() const;
+
+	size_t Count() const;
+	const DrawItem* GetItems() const;
+	size_t LowerBound(RenderLayer layer) const; ///< index of the first sorted item in the layer or above
+
+	static uint64_t MakeKey(RenderLayer layer, GLuint program, GLuint texture, GLuint vertexArray, float depth);
+	static uint64_t MakeFrontToBackKey(RenderLayer layer, float depth, GLuint program, GLuint texture, GLuint vertexArray);
+	static uint64_t MakeOrderedKey(RenderLayer layer, uint32_t sequence, GLuint program, GLuint texture, GLuint vertexArray);
+	static RenderLayer GetLayer(uint64_t key);
+
+private:
+	std::vector<DrawItem> items;		///< items of current frame
+	std::vector<DrawItem> sortBuffer;	///< ping-pong buffer of radix sort
+	bool frontToBack;					///< opaque items are sorted by depth first
+
+};
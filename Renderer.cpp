@@ -1,22 +1,224 @@
 #include "Renderer.h"
 #include "Widgets.h"
 #include "Shader.h"
+#include "Windows.h"
 #include <iostream>
 #include <stdexcept>
 #include <stdexcept>
-#include <Windows.h>
 
 // thread not safety
 Graphic::Renderer* g_pRenderer = nullptr;
 
+namespace
+{
+	constexpr GLuint UNKNOWN_BINDING = 0xffffffff;
+	constexpr GLint UNKNOWN_CAPABILITY = -1;
+	constexpr GLenum UNKNOWN_ENUM = 0xffffffff;
+
+	constexpr size_t MAX_TRACKED_CAPABILITIES = 16;
+	constexpr GLuint MAX_TRACKED_TEXTURE_UNITS = 32;
+	constexpr GLuint MAX_TRACKED_BINDING_POINTS = 16;
+
+	enum TextureTargetIndex
+	{
+		TEXTURE_TARGET_2D,
+		TEXTURE_TARGET_2D_ARRAY,
+		TEXTURE_TARGET_CUBE_MAP,
+
+		TEXTURE_TARGET_COUNT
+	};
+
+	enum BufferTargetIndex
+	{
+		BUFFER_TARGET_ARRAY,
+		BUFFER_TARGET_ELEMENT_ARRAY,
+		BUFFER_TARGET_DRAW_INDIRECT,
+		BUFFER_TARGET_SHADER_STORAGE,
+		BUFFER_TARGET_UNIFORM,
+
+		BUFFER_TARGET_COUNT
+	};
+
+	int GetTextureTargetIndex(GLenum target)
+	{
+		switch (target)
+		{
+		case GL_TEXTURE_2D:
+			return TEXTURE_TARGET_2D;
+		case GL_TEXTURE_2D_ARRAY:
+			return TEXTURE_TARGET_2D_ARRAY;
+		case GL_TEXTURE_CUBE_MAP:
+			return TEXTURE_TARGET_CUBE_MAP;
+		default:
+			return -1;
+		}
+	}
+
+	int GetBufferTargetIndex(GLenum target)
+	{
+		switch (target)
+		{
+		case GL_ARRAY_BUFFER:
+			return BUFFER_TARGET_ARRAY;
+		case GL_ELEMENT_ARRAY_BUFFER:
+			return BUFFER_TARGET_ELEMENT_ARRAY;
+		case GL_DRAW_INDIRECT_BUFFER:
+			return BUFFER_TARGET_DRAW_INDIRECT;
+		case GL_SHADER_STORAGE_BUFFER:
+			return BUFFER_TARGET_SHADER_STORAGE;
+		case GL_UNIFORM_BUFFER:
+			return BUFFER_TARGET_UNIFORM;
+		default:
+			return -1;
+		}
+	}
+
+	/**
+	*	shadow copy of the states changed through Graphic::GL* wrappers, untracked or unknown states are always issued
+	*/
+	struct StateCache
+	{
+		struct Capability
+		{
+			GLenum capability;
+			GLint enabled;
+		};
+
+		Capability capabilities[MAX_TRACKED_CAPABILITIES];
+		size_t capabilityCount;
+
+		GLuint program;
+		GLuint activeTextureUnit;
+		GLuint textures[MAX_TRACKED_TEXTURE_UNITS][TEXTURE_TARGET_COUNT];
+		GLenum blendSource;
+		GLenum blendDestination;
+		GLenum depthFunc;
+		GLint depthMask;
+		GLint colorMask;	///< one bit per channel
+		GLuint vertexArray;
+		GLuint buffers[BUFFER_TARGET_COUNT];
+		GLuint storageBuffers[MAX_TRACKED_BINDING_POINTS];
+		GLuint uniformBuffers[MAX_TRACKED_BINDING_POINTS];
+		GLuint drawFramebuffer;
+		GLuint readFramebuffer;
+		GLint viewport[4];
+
+		Graphic::GLStateStatistics statistics;
+
+		StateCache()
+			:statistics()
+		{
+			Invalidate();
+		}
+
+		void Invalidate()
+		{
+			capabilityCount = 0;
+			program = UNKNOWN_BINDING;
+			activeTextureUnit = UNKNOWN_BINDING;
+			for (auto& unit : textures) {
+				std::fill(std::begin(unit), std::end(unit), UNKNOWN_BINDING);
+			}
+			blendSource = UNKNOWN_ENUM;
+			blendDestination = UNKNOWN_ENUM;
+			depthFunc = UNKNOWN_ENUM;
+			depthMask = -1;
+			colorMask = -1;
+			vertexArray = UNKNOWN_BINDING;
+			std::fill(std::begin(buffers), std::end(buffers), UNKNOWN_BINDING);
+			std::fill(std::begin(storageBuffers), std::end(storageBuffers), UNKNOWN_BINDING);
+			std::fill(std::begin(uniformBuffers), std::end(uniformBuffers), UNKNOWN_BINDING);
+			drawFramebuffer = UNKNOWN_BINDING;
+			readFramebuffer = UNKNOWN_BINDING;
+			std::fill(std::begin(viewport), std::end(viewport), -1);
+		}
+
+		/** returns true if the call has to be issued, and records the new value */
+		template<typename _Ty>
+		bool Change(_Ty& shadow, _Ty value)
+		{
+			if (shadow == value) {
+				statistics.elided++;
+				return false;
+			}
+			shadow = value;
+			statistics.issued++;
+			return true;
+		}
+
+		bool Untracked()
+		{
+			statistics.issued++;
+			return true;
+		}
+
+		GLint* FindCapability(GLenum capability)
+		{
+			for (size_t i = 0; i < capabilityCount; ++i) {
+				if (capabilities[i].capability == capability) {
+					return &capabilities[i].enabled;
+				}
+			}
+			if (capabilityCount < MAX_TRACKED_CAPABILITIES) {
+				capabilities[capabilityCount] = { capability, UNKNOWN_CAPABILITY };
+				return &capabilities[capabilityCount++].enabled;
+			}
+			return nullptr;
+		}
+
+		/** bound objects revert to 0 when they are deleted */
+		static void Forget(GLuint* bindings, size_t count, const GLuint* names, GLsizei n)
+		{
+			for (size_t i = 0; i < count; ++i) {
+				for (GLsizei k = 0; k < n; ++k) {
+					if (bindings[i] == names[k]) {
+						bindings[i] = 0;
+					}
+				}
+			}
+		}
+	};
+
+	StateCache g_stateCache;
+
+	/**
+	*	data written through the mapped stream buffer reaches the trace right before the draws which may read it
+	*/
+	void CaptureStreamBuffer()
+	{
+		if (g_pRenderer && Graphic::GLTrace::IsCapturing()) {
+			Graphic::Renderer::GetStreamBuffer()->Capture();
+		}
+	}
+}
+
 Graphic::Renderer::Renderer()
-	:targetList(), updateCallBack(nullptr)
+	:targetList(), renderQueue(), statistics(), streamBuffer(new StreamBuffer(GL_ARRAY_BUFFER, STREAM_REGION_SIZE)),
+	commandBuffers(), frameGraph(), profiler(new GPUProfiler()), frameConstants(), frameConstantsBuffer(0), frustum(),
+	frameIndex(0), sceneBVH(), lodBias(0.f), occlusionCuller(),
+	occlusionCulling(true), depthPrePass(false), updateCallBack(nullptr), frameGraphCallBack(nullptr)
 {
+	streamBuffer->Init();
+	renderQueue.SetFrontToBack(true);
+
+	frameConstants.view = glm::mat4(1.f);
+	frameConstants.projection = glm::mat4(1.f);
+	frameConstants.viewProjection = glm::mat4(1.f);
+	GLGenBuffers(1, &frameConstantsBuffer);
+	GLBindBuffer(GL_UNIFORM_BUFFER, frameConstantsBuffer);
+	GLBufferData(GL_UNIFORM_BUFFER, sizeof(FrameConstants), &frameConstants, GL_DYNAMIC_DRAW);
+	GLBindBufferBase(GL_UNIFORM_BUFFER, FRAME_CONSTANTS_BINDING, frameConstantsBuffer);
+
 	g_pRenderer = this;
 }
 
 Graphic::Renderer::Renderer(const Renderer& renderer)
-	:targetList(renderer.targetList), updateCallBack(renderer.updateCallBack)
+	:targetList(renderer.targetList), renderQueue(renderer.renderQueue), statistics(renderer.statistics), 
+	streamBuffer(nullptr), commandBuffers(), frameGraph(), profiler(nullptr), frameConstants(renderer.frameConstants),
+	frameConstantsBuffer(0), frustum(renderer.frustum), frameIndex(renderer.frameIndex), sceneBVH(), lodBias(renderer.lodBias),
+	occlusionCuller(), occlusionCulling(renderer.occlusionCulling), depthPrePass(renderer.depthPrePass),
+	updateCallBack(renderer.updateCallBack),
+	frameGraphCallBack(renderer.frameGraphCallBack)
 {
 }
 
@@ -26,6 +228,14 @@ Graphic::Renderer::~Renderer()
 	for (Graphic::RenderTarget* target : targetList) {
 		SafeDelete(target);
 	}
+	SafeDelete(streamBuffer);
+	SafeDelete(profiler);
+	if (frameConstantsBuffer != 0) {
+		GLDeleteBuffers(1, &frameConstantsBuffer);
+	}
+	if (g_pRenderer == this) {
+		g_pRenderer = nullptr;
+	}
 }
 
 void Graphic::Renderer::AddObeject(RenderTarget* target)
@@ -49,17 +259,64 @@ void Graphic::Renderer::SetUpdateCallBack(UpdateCallBack updateFunc)
 
 void Graphic::Renderer::Render(float dt)
 {
+	GLResetStateStatistics();
+
 	// calling update function
 	try
 	{
+		if (streamBuffer) {
+			streamBuffer->BeginFrame();
+		}
+		if (profiler) {
+			profiler->BeginFrame();
+		}
+
+		// the update callback still sees the statistics of last frame
 		if (updateCallBack) {
 			updateCallBack(dt);
 		}
+		statistics = {};
+		UpdateFrameConstants(dt);
+
+		// whole subtrees of instances are rejected before the models test their meshes
+		sceneBVH.Cull(frustum);
+		statistics.visibleInstances = sceneBVH.GetVisibleCount();
+		statistics.culledInstances = sceneBVH.GetItemCount() - statistics.visibleInstances;
+
+		// occluders are rasterized before any target tests its meshes against them
+		occlusionCuller.BeginFrame(frameConstants.viewProjection);
+		if (occlusionCulling) {
+			for (Graphic::RenderTarget* target : targetList) {
+				target->SubmitOccluders(&occlusionCuller);
+			}
+			occlusionCuller.Rasterize();
+		}
 
-		// render all targets
+		// collect draw items of all targets and sort them by key
+		renderQueue.Clear();
 		for (Graphic::RenderTarget* target : targetList) {
-			target->Render(dt);
+			target->Submit(&renderQueue);
+		}
+		renderQueue.Sort();
+		CountSwitches();
+		statistics.occlusion = occlusionCuller.GetStatistics();
+
+		// the passes draw ranges of the sorted queue
+		BuildFrameGraph();
+		frameGraph.Compile();
+		frameGraph.Execute(dt, profiler);
+
+		statistics.passes = frameGraph.GetStatistics();
+		statistics.stateCalls = GLGetStateStatistics();
+		statistics.textureBinds = statistics.stateCalls.textureBinds;
+
+		if (profiler) {
+			profiler->EndFrame();
+		}
+		if (streamBuffer) {
+			streamBuffer->EndFrame();
 		}
+		frameIndex++;
 	}
 	catch (const std::exception& excep)
 	{
@@ -67,8 +324,346 @@ void Graphic::Renderer::Render(float dt)
 	}
 }
 
+void Graphic::Renderer::SetFrameGraphCallBack(FrameGraphCallBack frameGraphFunc)
+{
+	if (g_pRenderer == nullptr) {
+		return;
+	}
+	g_pRenderer->frameGraphCallBack = frameGraphFunc;
+}
+
+const Graphic::Renderer::FrameStatistics& Graphic::Renderer::GetFrameStatistics()
+{
+	static const FrameStatistics emptyStatistics = {};
+	if (g_pRenderer == nullptr) {
+		return emptyStatistics;
+	}
+	return g_pRenderer->statistics;
+}
+
+Graphic::GPUProfiler* Graphic::Renderer::GetGPUProfiler()
+{
+	if (g_pRenderer == nullptr) {
+		return nullptr;
+	}
+	return g_pRenderer->profiler;
+}
+
+void Graphic::Renderer::SetCamera(const glm::mat4& view, const glm::mat4& projection)
+{
+	if (g_pRenderer == nullptr) {
+		return;
+	}
+	g_pRenderer->frameConstants.view = view;
+	g_pRenderer->frameConstants.projection = projection;
+}
+
+const Graphic::FrameConstants& Graphic::Renderer::GetFrameConstants()
+{
+	if (g_pRenderer == nullptr) {
+		throw std::runtime_error("Exception: Graphic::Renderer::GetFrameConstants(): No renderer has been created!");
+	}
+	return g_pRenderer->frameConstants;
+}
+
+const Graphic::Frustum& Graphic::Renderer::GetFrustum()
+{
+	if (g_pRenderer == nullptr) {
+		throw std::runtime_error("Exception: Graphic::Renderer::GetFrustum(): No renderer has been created!");
+	}
+	return g_pRenderer->frustum;
+}
+
+uint64_t Graphic::Renderer::GetFrameIndex()
+{
+	if (g_pRenderer == nullptr) {
+		return 0;
+	}
+	return g_pRenderer->frameIndex;
+}
+
+void Graphic::Renderer::AddCullingStatistics(uint32_t visible, uint32_t culled)
+{
+	if (g_pRenderer == nullptr) {
+		return;
+	}
+	g_pRenderer->statistics.visibleMeshes += visible;
+	g_pRenderer->statistics.culledMeshes += culled;
+}
+
+void Graphic::Renderer::AddOcclusionStatistics(uint32_t occluded)
+{
+	if (g_pRenderer == nullptr) {
+		return;
+	}
+	g_pRenderer->statistics.visibleMeshes -= (std::min)(occluded, g_pRenderer->statistics.visibleMeshes);
+	g_pRenderer->statistics.occludedMeshes += occluded;
+}
+
+Graphic::SceneBVH* Graphic::Renderer::GetSceneBVH()
+{
+	if (g_pRenderer == nullptr) {
+		return nullptr;
+	}
+	return &g_pRenderer->sceneBVH;
+}
+
+void Graphic::Renderer::SetLODBias(float bias)
+{
+	if (g_pRenderer == nullptr) {
+		return;
+	}
+	g_pRenderer->lodBias = bias;
+}
+
+float Graphic::Renderer::GetLODBias()
+{
+	if (g_pRenderer == nullptr) {
+		return 0.f;
+	}
+	return g_pRenderer->lodBias;
+}
+
+Graphic::OcclusionCuller* Graphic::Renderer::GetOcclusionCuller()
+{
+	if (g_pRenderer == nullptr || !g_pRenderer->occlusionCulling) {
+		return nullptr;
+	}
+	return &g_pRenderer->occlusionCuller;
+}
+
+void Graphic::Renderer::SetOcclusionCulling(bool enable)
+{
+	if (g_pRenderer == nullptr) {
+		return;
+	}
+	g_pRenderer->occlusionCulling = enable;
+}
+
+void Graphic::Renderer::SetDepthPrePass(bool enable)
+{
+	if (g_pRenderer == nullptr) {
+		return;
+	}
+	g_pRenderer->depthPrePass = enable;
+}
+
+bool Graphic::Renderer::GetDepthPrePass()
+{
+	return g_pRenderer != nullptr && g_pRenderer->depthPrePass;
+}
+
+void Graphic::Renderer::SetFrontToBack(bool enable)
+{
+	if (g_pRenderer == nullptr) {
+		return;
+	}
+	g_pRenderer->renderQueue.SetFrontToBack(enable);
+}
+
+bool Graphic::Renderer::GetFrontToBack()
+{
+	return g_pRenderer != nullptr && g_pRenderer->renderQueue.GetFrontToBack();
+}
+
+Graphic::StreamBuffer* Graphic::Renderer::GetStreamBuffer()
+{
+	if (g_pRenderer == nullptr) {
+		throw std::runtime_error("Exception: Graphic::Renderer::GetStreamBuffer(): No renderer has been created!");
+	}
+	return g_pRenderer->streamBuffer;
+}
+
+void Graphic::Renderer::UpdateFrameConstants(float dt)
+{
+	int framebufferWidth = 0;
+	int framebufferHeight = 0;
+	Window::GetFramebufferSize(framebufferWidth, framebufferHeight);
+	const float width = static_cast<float>((std::max)(framebufferWidth, 1));
+	const float height = static_cast<float>((std::max)(framebufferHeight, 1));
+
+	frameConstants.viewProjection = frameConstants.projection * frameConstants.view;
+	frustum.Extract(frameConstants.viewProjection);
+	frameConstants.viewport = glm::vec4(width, height, 1.f / width, 1.f / height);
+	frameConstants.time = glm::vec4(frameConstants.time.x + dt, dt, 0.f, 0.f);
+	float contentScaleX = 1.f;
+	float contentScaleY = 1.f;
+	Window::GetContentScale(contentScaleX, contentScaleY);
+	frameConstants.content = glm::vec4(contentScaleX, contentScaleY, 0.f, 0.f);
+
+	// one upload for all programs, orphaned so the draws of the previous frame are not waited for
+	GLBindBuffer(GL_UNIFORM_BUFFER, frameConstantsBuffer);
+	GLBufferData(GL_UNIFORM_BUFFER, sizeof(FrameConstants), &frameConstants, GL_DYNAMIC_DRAW);
+	GLBindBufferBase(GL_UNIFORM_BUFFER, FRAME_CONSTANTS_BINDING, frameConstantsBuffer);
+}
+
+void Graphic::Renderer::BuildFrameGraph()
+{
+	/**
+	*	scene: opaque and transparent layers on the cleared backbuffer
+	*	user passes: shadow, post-processing ..., they must end with a write of the backbuffer
+	*	UI: widget layer on top
+	*/
+	frameGraph.Reset();
+
+	int framebufferWidth = 0;
+	int framebufferHeight = 0;
+	Window::GetFramebufferSize(framebufferWidth, framebufferHeight);
+	TextureDescription backbufferDescription = { framebufferWidth, framebufferHeight, GL_RGBA8 };
+	FrameGraphResource backbuffer = frameGraph.Import("Backbuffer", backbufferDescription, Window::GetBackbuffer());
+
+	const size_t count = renderQueue.Count();
+	const size_t transparentBegin = renderQueue.LowerBound(LAYER_TRANSPARENT);
+	const size_t uiBegin = renderQueue.LowerBound(LAYER_UI);
+
+	/**
+	*	optional depth pre-pass, opaque items write depth only, so the scene pass shades each pixel once
+	*/
+	FrameGraphResource sceneDepth = backbuffer;
+	if (depthPrePass) {
+		frameGraph.AddPass("DepthPrePass",
+			[&](FrameGraph::PassBuilder& builder) {
+				sceneDepth = builder.Write(backbuffer);
+			},
+			[this, transparentBegin](const FrameGraph& graph, float dt) {
+				GLDepthMask(GL_TRUE);
+				GLClearColor(1.f, 1.f, 1.f, 1.f);
+				GLClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				GLEnable(GL_DEPTH_TEST);
+				GLDepthFunc(GL_LESS);
+				GLColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+				ExecuteQueue(0, transparentBegin, dt, true);
+				GLColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+			});
+	}
+
+	FrameGraphResource sceneColor = INVALID_RESOURCE;
+	const bool prePassed = depthPrePass;
+	frameGraph.AddPass("Scene",
+		[&](FrameGraph::PassBuilder& builder) {
+			sceneColor = builder.Write(sceneDepth);
+		},
+		[this, transparentBegin, uiBegin, prePassed](const FrameGraph& graph, float dt) {
+			if (prePassed) {
+				// only the fragment which won the pre-pass is shaded
+				GLDepthFunc(GL_EQUAL);
+				GLDepthMask(GL_FALSE);
+				ExecuteQueue(0, transparentBegin, dt);
+				GLDepthFunc(GL_LESS);
+				GLDepthMask(GL_TRUE);
+				ExecuteQueue(transparentBegin, uiBegin, dt);
+				return;
+			}
+
+			GLDepthMask(GL_TRUE);
+			GLClearColor(1.f, 1.f, 1.f, 1.f);
+			GLClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			GLEnable(GL_DEPTH_TEST);
+			GLDepthFunc(GL_LESS);
+			ExecuteQueue(0, uiBegin, dt);
+		});
+
+	if (frameGraphCallBack) {
+		sceneColor = frameGraphCallBack(frameGraph, sceneColor);
+	}
+
+	frameGraph.AddPass("UI",
+		[&](FrameGraph::PassBuilder& builder) {
+			builder.Write(sceneColor);
+		},
+		[this, uiBegin, count](const FrameGraph& graph, float dt) {
+			ExecuteQueue(uiBegin, count, dt);
+		});
+}
+
+void Graphic::Renderer::CountSwitches()
+{
+	const size_t count = renderQueue.Count();
+	const DrawItem* items = renderQueue.GetItems();
+	statistics.drawItems = static_cast<uint32_t>(count);
+
+	/**
+	*	items are sorted, so a program is bound once for a run of items sharing it. Texture binds are counted by
+	*	GLBindTexture(), the texture of a sort key does not cover the textures a draw binds itself
+	*/
+	GLuint currentProgram = 0;
+	for (size_t i = 0; i < count; ++i) {
+		if (items[i].program != 0 && items[i].program != currentProgram) {
+			currentProgram = items[i].program;
+			statistics.programSwitches++;
+		}
+		if (items[i].program == 0) {
+			currentProgram = 0;
+		}
+	}
+}
+
+void Graphic::Renderer::ExecuteQueue(size_t begin, size_t end, float dt, bool depthOnly)
+{
+	const size_t count = end - begin;
+	const DrawItem* items = renderQueue.GetItems() + begin;
+	if (count == 0) {
+		return;
+	}
+
+	/**
+	*	split the queue into contiguous ranges, record them on the workers and replay them in order on this thread
+	*/
+	ThreadPool& threadPool = ThreadPool::GetInstance();
+	size_t bufferCount = (count + MIN_ITEMS_PER_COMMAND_BUFFER - 1) / MIN_ITEMS_PER_COMMAND_BUFFER;
+	bufferCount = (std::min)(bufferCount, threadPool.GetThreadCount() + 1);
+	commandBuffers.resize(bufferCount);
+
+	const size_t itemsPerBuffer = (count + bufferCount - 1) / bufferCount;
+	// a GL trace marks the render targets as sections as well
+	const bool targetScopes = (profiler && profiler->IsTargetScopesEnabled()) || GLTrace::IsCapturing();
+	threadPool.ParallelFor(bufferCount, [&](size_t bufferIndex) {
+		CommandBuffer& commandBuffer = commandBuffers[bufferIndex];
+		commandBuffer.Reset();
+
+		const size_t rangeBegin = bufferIndex * itemsPerBuffer;
+		const size_t rangeEnd = (std::min)(rangeBegin + itemsPerBuffer, count);
+		GLuint boundProgram = 0;
+		for (size_t i = rangeBegin; i < rangeEnd; ++i) {
+			const DrawItem& item = items[i];
+
+			if (targetScopes) {
+				commandBuffer.BeginScope(item.target->GetName());
+			}
+
+			// depth-only draws bind their own program, others draw as usual with color writes masked
+			if (depthOnly && item.target->RecordDepth(&commandBuffer, dt)) {
+				boundProgram = 0;
+			}
+			else {
+				if (item.program != 0 && item.program != boundProgram) {
+					commandBuffer.UseProgram(item.program);
+					boundProgram = item.program;
+				}
+				if (!item.target->Record(&commandBuffer, dt)) {
+					commandBuffer.CallTarget(item.target);
+				}
+
+				// targets without a program in their items bind their own one
+				if (item.program == 0) {
+					boundProgram = 0;
+				}
+			}
+
+			if (targetScopes) {
+				commandBuffer.EndScope();
+			}
+		}
+	});
+
+	for (const CommandBuffer& commandBuffer : commandBuffers) {
+		commandBuffer.Execute(dt, profiler);
+	}
+}
+
 Graphic::Primitive::Primitive()
-	:vertexArrayObject(0), vertexBufferObject(0), indexArrayObject(0), vertexCount(0), indexCount(0), storageType(UNKNOWN_TYPE)
+	:vertexArrayObject(0), vertexBufferObject(0), indexArrayObject(0), vertexCount(0), indexCount(0), indexOffset(0),
+	indexType(GL_UNSIGNED_INT), instanceCount(0), baseInstance(0), indirectBufferObject(0), indirectDrawCount(0), storageType(UNKNOWN_TYPE)
 {
 }
 
@@ -79,6 +674,13 @@ Graphic::Primitive::Primitive(const Primitive& primitive)
 	this->vertexBufferObject = primitive.vertexBufferObject;
 	this->vertexCount = primitive.vertexCount;
 	this->indexCount = primitive.indexCount;
+	this->indexOffset = primitive.indexOffset;
+	this->indexType = primitive.indexType;
+	this->instanceCount = primitive.instanceCount;
+	this->baseInstance = primitive.baseInstance;
+	this->indirectBufferObject = primitive.indirectBufferObject;
+	this->indirectDrawCount = primitive.indirectDrawCount;
+	this->storageType = primitive.storageType;
 }
 
 Graphic::Primitive::~Primitive()
@@ -88,17 +690,17 @@ Graphic::Primitive::~Primitive()
 void Graphic::Primitive::CreateBuffer(GLenum target)
 {
 	if (vertexArrayObject == 0) {
-		GLCall(glGenVertexArrays(1, &vertexArrayObject));
+		GLGenVertexArrays(1, &vertexArrayObject);
 	}
 
 	switch (target)
 	{
 	case GL_ARRAY_BUFFER:
-		GLCall(glGenBuffers(1, &vertexBufferObject));
+		GLGenBuffers(1, &vertexBufferObject);
 		break;
 
 	case GL_ELEMENT_ARRAY_BUFFER:
-		GLCall(glGenBuffers(1, &indexArrayObject));
+		GLGenBuffers(1, &indexArrayObject);
 		break;
 
 	default:
@@ -109,25 +711,26 @@ void Graphic::Primitive::CreateBuffer(GLenum target)
 	return;
 }
 
-void Graphic::Primitive::AttachBuffer(GLenum target, size_t size, void* data, GLenum usage)
+void Graphic::Primitive::AttachBuffer(GLenum target, size_t size, const void* data, GLenum usage)
 {
 	if (vertexArrayObject == 0) {
 		throw std::runtime_error("Exception: Render::Primitive::AttachBuffer(): No vertex array object has been created!");
 	}
 	// bind vertex array
-	GLCall(glBindVertexArray(vertexArrayObject));
+	GLBindVertexArray(vertexArrayObject);
 
 	// choose data target
 	switch (target)
 	{
 	case GL_ARRAY_BUFFER:
-		GLCall(glBindBuffer(target, vertexBufferObject));
+		GLBindBuffer(target, vertexBufferObject);
 		vertexCount = size / sizeof(GLfloat);
 		break;
 	
 	case GL_ELEMENT_ARRAY_BUFFER:
-		GLCall(glBindBuffer(target, indexArrayObject));
-		indexCount = size / sizeof(GLuint);
+		GLBindBuffer(target, indexArrayObject);
+		indexCount = static_cast<GLuint>(size / GetIndexSize());
+		indexOffset = 0;
 		break;
 
 	default:
@@ -152,50 +755,243 @@ void Graphic::Primitive::AttachBuffer(GLenum target, size_t size, void* data, GL
 	}
 
 
-	GLCall(glBufferData(target, size, data, usage));
+	GLBufferData(target, size, data, usage);
 
 	return;
 }
 
+void Graphic::Primitive::ShareBuffer(GLenum target, GLuint buffer)
+{
+	/**
+	*	use a buffer owned by someone else, e.g. the stream buffer, the primitive never releases it
+	*/
+	if (vertexArrayObject == 0) {
+		GLGenVertexArrays(1, &vertexArrayObject);
+	}
+	GLBindVertexArray(vertexArrayObject);
+
+	switch (target)
+	{
+	case GL_ARRAY_BUFFER:
+		vertexBufferObject = buffer;
+		break;
+
+	case GL_ELEMENT_ARRAY_BUFFER:
+		indexArrayObject = buffer;
+		break;
+
+	default:
+		throw std::invalid_argument("Exception: Render::Primitive::ShareBuffer(): Invalid buffer target!");
+		break;
+	}
+	GLBindBuffer(target, buffer);
+	storageType = DYNAMIC;
+}
+
 void Graphic::Primitive::DetachBuffer()
 {
-	GLCall(glBindVertexArray(0));
-	GLCall(glBindBuffer(GL_ARRAY_BUFFER, 0));
-	GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+	GLBindVertexArray(0);
+	GLBindBuffer(GL_ARRAY_BUFFER, 0);
+	GLBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
 void Graphic::Primitive::BufferSubData(GLenum target, size_t offset, size_t size, void* data)
 {
 
 	if (GL_ARRAY_BUFFER == target) {
-		GLCall(glBindBuffer(target, vertexBufferObject));
+		GLBindBuffer(target, vertexBufferObject);
 	}
 	else if (GL_ELEMENT_ARRAY_BUFFER == target) {
-		GLCall(glBindBuffer(target, vertexBufferObject));
+		GLBindBuffer(target, vertexBufferObject);
 	}
 	else {
 		throw std::invalid_argument("Exception: Render::Primitive::CreateBuffer(): Invalid buffer target!");
 	}
-	GLCall(glBufferSubData(target, offset, size, data));
+	GLBufferSubData(target, offset, size, data);
 }
 
 void Graphic::Primitive::AttribPointer(GLuint layout, size_t numberOfCompoments, size_t stride, const void* offsetPointer)
 {
-	GLCall(glEnableVertexAttribArray(layout));
-	GLCall(glVertexAttribPointer(layout, numberOfCompoments, GL_FLOAT, GL_FALSE, stride * sizeof(GLfloat), offsetPointer));
+	GLEnableVertexAttribArray(layout);
+	GLVertexAttribPointer(layout, numberOfCompoments, GL_FLOAT, GL_FALSE, stride * sizeof(GLfloat), offsetPointer);
 }
 
+void Graphic::Primitive::AttribFormat(GLuint layout, GLint components, GLenum type, GLboolean normalized, size_t stride, size_t offset)
+{
+	/**
+	*	packed attributes, integers are read as normalized or plain floats, see Graphic::VertexFormat
+	*/
+	GLEnableVertexAttribArray(layout);
+	GLVertexAttribPointer(layout, components, type, normalized, static_cast<GLsizei>(stride), reinterpret_cast<const void*>(offset));
+}
+
+void Graphic::Primitive::AttachInstanceBuffer(GLuint buffer, GLuint layout)
+{
+	if (vertexArrayObject == 0) {
+		throw std::runtime_error("Exception: Render::Primitive::AttachInstanceBuffer(): No vertex array object has been created!");
+	}
+	GLBindVertexArray(vertexArrayObject);
+	GLBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+	// per-instance mat4 takes four consecutive locations, one column each
+	for (GLuint column = 0; column < 4; ++column) {
+		GLEnableVertexAttribArray(layout + column);
+		GLVertexAttribPointer(layout + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::vec4) * column));
+		GLVertexAttribDivisor(layout + column, 1);
+	}
+
+	DetachBuffer();
+}
+
+void Graphic::Primitive::SetInstanceCount(GLuint count)
+{
+	instanceCount = count;
+	baseInstance = 0;
+}
+
+void Graphic::Primitive::SetInstanceRange(GLuint first, GLuint count)
+{
+	instanceCount = count;
+	baseInstance = first;
+}
+
+void Graphic::Primitive::SetIndexRange(GLuint first, GLuint count)
+{
+	indexOffset = first;
+	indexCount = count;
+}
+
+void Graphic::Primitive::SetIndexType(GLenum type)
+{
+	if (type != GL_UNSIGNED_INT && type != GL_UNSIGNED_SHORT && type != GL_UNSIGNED_BYTE) {
+		throw std::invalid_argument("Exception: Render::Primitive::SetIndexType(): Invalid index type!");
+	}
+	indexType = type;
+}
+
+void Graphic::Primitive::AttachIndirectBuffer(size_t size, const void* commands, GLsizei drawCount)
+{
+	if (indexArrayObject == 0) {
+		throw std::runtime_error("Exception: Render::Primitive::AttachIndirectBuffer(): Indirect drawing needs an index buffer!");
+	}
+	if (indirectBufferObject == 0) {
+		GLGenBuffers(1, &indirectBufferObject);
+	}
+
+	// commands are rewritten when instance count changes, glBufferData orphans the old storage
+	GLBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBufferObject);
+	GLBufferData(GL_DRAW_INDIRECT_BUFFER, size, commands, GL_DYNAMIC_DRAW);
+
+	indirectDrawCount = drawCount;
+}
 
 void Graphic::Primitive::Render(float dt)
 {
-	GLCall(glBindVertexArray(vertexArrayObject));
+	GLBindVertexArray(vertexArrayObject);
+
+	// draw all commands of indirect buffer at once
+	if (indirectBufferObject != 0) {
+		RenderIndirect(0, indirectDrawCount);
+		return;
+	}
 
 	// use index buffer
 	if (indexArrayObject != 0) {
-		GLCall(glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, nullptr));
+		if (instanceCount > 0 && baseInstance > 0) {
+			GLDrawElementsInstancedBaseInstance(GL_TRIANGLES, indexCount, indexType, (void*)(indexOffset * GetIndexSize()), instanceCount,
+				baseInstance);
+		}
+		else if (instanceCount > 0) {
+			GLDrawElementsInstanced(GL_TRIANGLES, indexCount, indexType, (void*)(indexOffset * GetIndexSize()), instanceCount);
+		}
+		else {
+			GLDrawElements(GL_TRIANGLES, indexCount, indexType, (void*)(indexOffset * GetIndexSize()));
+		}
 	}
 	else {
-		GLCall(glDrawArrays(GL_TRIANGLES, 0, vertexCount));
+		if (instanceCount > 0) {
+			GLDrawArraysInstanced(GL_TRIANGLES, 0, vertexCount, instanceCount);
+		}
+		else {
+			GLDrawArrays(GL_TRIANGLES, 0, vertexCount);
+		}
+	}
+}
+
+void Graphic::Primitive::RenderRange(GLint first, GLsizei count)
+{
+	GLBindVertexArray(vertexArrayObject);
+	GLDrawArrays(GL_TRIANGLES, first, count);
+}
+
+void Graphic::Primitive::RenderIndirect(GLsizei first, GLsizei count)
+{
+	if (indirectBufferObject == 0 || first < 0 || first + count > indirectDrawCount) {
+		throw std::out_of_range("Exception: Render::Primitive::RenderIndirect(): Commands out of the indirect buffer!");
+	}
+	GLBindVertexArray(vertexArrayObject);
+	GLBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBufferObject);
+	GLMultiDrawElementsIndirect(GL_TRIANGLES, indexType, (void*)(first * INDIRECT_COMMAND_SIZE), count, 0);
+}
+
+void Graphic::Primitive::Record(CommandBuffer* commandBuffer) const
+{
+	/**
+	*	same draw as Render(), recorded for replay
+	*/
+	commandBuffer->BindVertexArray(vertexArrayObject);
+
+	if (indirectBufferObject != 0) {
+		commandBuffer->MultiDrawIndirect(indirectBufferObject, indirectDrawCount, indexType);
+	}
+	else if (indexArrayObject != 0) {
+		commandBuffer->DrawElements(indexCount, indexType, indexOffset * GetIndexSize(), instanceCount, baseInstance);
+	}
+	else {
+		commandBuffer->DrawArrays(0, vertexCount, instanceCount);
+	}
+}
+
+void Graphic::Primitive::RecordRange(CommandBuffer* commandBuffer, GLint first, GLsizei count) const
+{
+	commandBuffer->BindVertexArray(vertexArrayObject);
+	commandBuffer->DrawArrays(first, count);
+}
+
+void Graphic::Primitive::RecordIndirect(CommandBuffer* commandBuffer, GLsizei first, GLsizei count) const
+{
+	if (indirectBufferObject == 0 || first < 0 || first + count > indirectDrawCount) {
+		throw std::out_of_range("Exception: Render::Primitive::RecordIndirect(): Commands out of the indirect buffer!");
+	}
+	commandBuffer->BindVertexArray(vertexArrayObject);
+	commandBuffer->MultiDrawIndirect(indirectBufferObject, count, indexType, first * INDIRECT_COMMAND_SIZE);
+}
+
+GLuint Graphic::Primitive::GetVertexArray() const
+{
+	return vertexArrayObject;
+}
+
+GLuint Graphic::Primitive::GetIndexBuffer() const
+{
+	return indexArrayObject;
+}
+
+GLenum Graphic::Primitive::GetIndexType() const
+{
+	return indexType;
+}
+
+size_t Graphic::Primitive::GetIndexSize() const
+{
+	switch (indexType)
+	{
+	case GL_UNSIGNED_BYTE:
+		return sizeof(GLubyte);
+	case GL_UNSIGNED_SHORT:
+		return sizeof(GLushort);
+	default:
+		return sizeof(GLuint);
 	}
 }
 
@@ -204,85 +1000,565 @@ Graphic::Primitive::StorageType Graphic::Primitive::GetStorageType()
 	return storageType;
 }
 
+const Graphic::GLStateStatistics& Graphic::GLGetStateStatistics()
+{
+	return g_stateCache.statistics;
+}
+
+void Graphic::GLResetStateStatistics()
+{
+	g_stateCache.statistics = {};
+}
+
+void Graphic::GLInvalidateStateCache()
+{
+	g_stateCache.Invalidate();
+}
+
 void Graphic::GLEnable(GLenum capbility)
 {
-	GLCall(glEnable(capbility));
+	GLint* enabled = g_stateCache.FindCapability(capbility);
+	if (enabled ? g_stateCache.Change(*enabled, static_cast<GLint>(GL_TRUE)) : g_stateCache.Untracked()) {
+		GLCall(glEnable(capbility));
+		GLTrace::Record(GLTrace::Call::ENABLE, capbility);
+	}
 }
 
 void Graphic::GLDisable(GLenum capbility)
 {
-	GLCall(glDisable(capbility));
+	GLint* enabled = g_stateCache.FindCapability(capbility);
+	if (enabled ? g_stateCache.Change(*enabled, static_cast<GLint>(GL_FALSE)) : g_stateCache.Untracked()) {
+		GLCall(glDisable(capbility));
+		GLTrace::Record(GLTrace::Call::DISABLE, capbility);
+	}
+}
+
+void Graphic::GLDepthFunc(GLenum func)
+{
+	if (g_stateCache.Change(g_stateCache.depthFunc, func)) {
+		GLCall(glDepthFunc(func));
+		GLTrace::Record(GLTrace::Call::DEPTH_FUNC, func);
+	}
+}
+
+void Graphic::GLDepthMask(GLboolean flag)
+{
+	if (g_stateCache.Change(g_stateCache.depthMask, static_cast<GLint>(flag))) {
+		GLCall(glDepthMask(flag));
+		GLTrace::Record(GLTrace::Call::DEPTH_MASK, flag);
+	}
+}
+
+void Graphic::GLColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)
+{
+	GLint mask = (red ? 1 : 0) | (green ? 2 : 0) | (blue ? 4 : 0) | (alpha ? 8 : 0);
+	if (g_stateCache.Change(g_stateCache.colorMask, mask)) {
+		GLCall(glColorMask(red, green, blue, alpha));
+		GLTrace::Record(GLTrace::Call::COLOR_MASK, red, green, blue, alpha);
+	}
+}
+
+void Graphic::GLClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+{
+	GLCall(glClearColor(red, green, blue, alpha));
+	GLTrace::Record(GLTrace::Call::CLEAR_COLOR, red, green, blue, alpha);
+}
+
+void Graphic::GLClear(GLbitfield mask)
+{
+	GLCall(glClear(mask));
+	GLTrace::Record(GLTrace::Call::CLEAR, mask);
+}
+
+void Graphic::GLPixelStorei(GLenum pname, GLint param)
+{
+	GLCall(glPixelStorei(pname, param));
+	if (pname == GL_UNPACK_ALIGNMENT) {
+		// sizes of the recorded uploads depend on it
+		GLTrace::SetUnpackAlignment(param);
+	}
+	GLTrace::Record(GLTrace::Call::PIXEL_STORE, pname, param);
 }
 
 void Graphic::GLGenTextures(GLsizei n, GLuint* texture)
 {
 	GLCall(glGenTextures(n, texture));
+	GLTrace::RecordData(GLTrace::Call::GEN_TEXTURES, texture, n * sizeof(GLuint), n);
+}
+
+void Graphic::GLDeleteTextures(GLsizei n, const GLuint* textures)
+{
+	for (auto& unit : g_stateCache.textures) {
+		StateCache::Forget(unit, TEXTURE_TARGET_COUNT, textures, n);
+	}
+	GLCall(glDeleteTextures(n, textures));
+	GLTrace::RecordData(GLTrace::Call::DELETE_TEXTURES, textures, n * sizeof(GLuint), n);
+}
+
+void Graphic::GLActiveTexture(GLenum texture)
+{
+	if (g_stateCache.Change(g_stateCache.activeTextureUnit, static_cast<GLuint>(texture - GL_TEXTURE0))) {
+		GLCall(glActiveTexture(texture));
+		GLTrace::Record(GLTrace::Call::ACTIVE_TEXTURE, texture);
+	}
 }
 
 void Graphic::GLBindTexture(GLenum target, GLuint texture)
 {
-	GLCall(glBindTexture(target, texture));
+	int targetIndex = GetTextureTargetIndex(target);
+	GLuint unit = g_stateCache.activeTextureUnit;
+	if (targetIndex < 0 || unit >= MAX_TRACKED_TEXTURE_UNITS) {
+		g_stateCache.Untracked();
+		g_stateCache.statistics.textureBinds++;
+		GLCall(glBindTexture(target, texture));
+		GLTrace::Record(GLTrace::Call::BIND_TEXTURE, target, texture);
+		return;
+	}
+
+	if (g_stateCache.Change(g_stateCache.textures[unit][targetIndex], texture)) {
+		g_stateCache.statistics.textureBinds++;
+		GLCall(glBindTexture(target, texture));
+		GLTrace::Record(GLTrace::Call::BIND_TEXTURE, target, texture);
+	}
 }
 
 void Graphic::GLTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels)
 {
 	GLCall(glTexImage2D(target, level, internalformat, width, height, border, format, type, pixels));
+	GLTrace::RecordData(GLTrace::Call::TEX_IMAGE_2D, pixels, GLTrace::ImageSize(width, height, 1, format, type),
+		target, level, internalformat, width, height, border, format, type);
 }
 
 void Graphic::GLTexParameteri(GLenum target, GLenum pname, GLint param)
 {
 	GLCall(glTexParameteri(target, pname, param));
+	GLTrace::Record(GLTrace::Call::TEX_PARAMETER_I, target, pname, param);
+}
+
+void Graphic::GLTexStorage2D(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height)
+{
+	GLCall(glTexStorage2D(target, levels, internalformat, width, height));
+	GLTrace::Record(GLTrace::Call::TEX_STORAGE_2D, target, levels, internalformat, width, height);
+}
+
+void Graphic::GLTexStorage3D(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth)
+{
+	GLCall(glTexStorage3D(target, levels, internalformat, width, height, depth));
+	GLTrace::Record(GLTrace::Call::TEX_STORAGE_3D, target, levels, internalformat, width, height, depth);
+}
+
+void Graphic::GLTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels)
+{
+	GLCall(glTexSubImage2D(target, level, xoffset, yoffset, width, height, format, type, pixels));
+	GLTrace::RecordData(GLTrace::Call::TEX_SUB_IMAGE_2D, pixels, GLTrace::ImageSize(width, height, 1, format, type),
+		target, level, xoffset, yoffset, width, height, format, type);
+}
+
+void Graphic::GLTexSubImage3D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const void* pixels)
+{
+	GLCall(glTexSubImage3D(target, level, xoffset, yoffset, zoffset, width, height, depth, format, type, pixels));
+	GLTrace::RecordData(GLTrace::Call::TEX_SUB_IMAGE_3D, pixels, GLTrace::ImageSize(width, height, depth, format, type),
+		target, level, xoffset, yoffset, zoffset, width, height, depth, format, type);
+}
+
+void Graphic::GLGenerateMipmap(GLenum target)
+{
+	GLCall(glGenerateMipmap(target));
+	GLTrace::Record(GLTrace::Call::GENERATE_MIPMAP, target);
+}
+
+GLuint64 Graphic::GLGetTextureHandle(GLuint texture)
+{
+	GLuint64 handle = glGetTextureHandleARB(texture);
+	GLTrace::Record(GLTrace::Call::GET_TEXTURE_HANDLE, texture, handle);
+	return handle;
+}
+
+void Graphic::GLMakeTextureHandleResident(GLuint64 handle)
+{
+	GLCall(glMakeTextureHandleResidentARB(handle));
+	GLTrace::Record(GLTrace::Call::MAKE_TEXTURE_HANDLE_RESIDENT, handle);
+}
+
+void Graphic::GLMakeTextureHandleNonResident(GLuint64 handle)
+{
+	GLCall(glMakeTextureHandleNonResidentARB(handle));
+	GLTrace::Record(GLTrace::Call::MAKE_TEXTURE_HANDLE_NON_RESIDENT, handle);
 }
 
 
 void Graphic::GLBlendFunc(GLenum sourceFactor, GLenum destinationFactor)
 {
+	if (g_stateCache.blendSource == sourceFactor && g_stateCache.blendDestination == destinationFactor) {
+		g_stateCache.statistics.elided++;
+		return;
+	}
+	g_stateCache.blendSource = sourceFactor;
+	g_stateCache.blendDestination = destinationFactor;
+	g_stateCache.statistics.issued++;
+
 	GLCall(glBlendFunc(sourceFactor, destinationFactor));
+	GLTrace::Record(GLTrace::Call::BLEND_FUNC, sourceFactor, destinationFactor);
+}
+
+void Graphic::GLGenBuffers(GLsizei n, GLuint* buffers)
+{
+	GLCall(glGenBuffers(n, buffers));
+	GLTrace::RecordData(GLTrace::Call::GEN_BUFFERS, buffers, n * sizeof(GLuint), n);
+}
+
+void Graphic::GLBindBuffer(GLenum target, GLuint buffer)
+{
+	int targetIndex = GetBufferTargetIndex(target);
+	if (targetIndex < 0) {
+		g_stateCache.Untracked();
+		GLCall(glBindBuffer(target, buffer));
+		GLTrace::Record(GLTrace::Call::BIND_BUFFER, target, buffer);
+		return;
+	}
+
+	if (g_stateCache.Change(g_stateCache.buffers[targetIndex], buffer)) {
+		GLCall(glBindBuffer(target, buffer));
+		GLTrace::Record(GLTrace::Call::BIND_BUFFER, target, buffer);
+	}
+}
+
+void Graphic::GLBindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+	GLuint* bindingPoints = nullptr;
+	if (target == GL_SHADER_STORAGE_BUFFER) {
+		bindingPoints = g_stateCache.storageBuffers;
+	}
+	else if (target == GL_UNIFORM_BUFFER) {
+		bindingPoints = g_stateCache.uniformBuffers;
+	}
+
+	if (bindingPoints == nullptr || index >= MAX_TRACKED_BINDING_POINTS) {
+		g_stateCache.Untracked();
+		GLCall(glBindBufferBase(target, index, buffer));
+		GLTrace::Record(GLTrace::Call::BIND_BUFFER_BASE, target, index, buffer);
+	}
+	else if (g_stateCache.Change(bindingPoints[index], buffer)) {
+		GLCall(glBindBufferBase(target, index, buffer));
+		GLTrace::Record(GLTrace::Call::BIND_BUFFER_BASE, target, index, buffer);
+	}
+	else {
+		return;
+	}
+
+	// glBindBufferBase binds the generic binding point as well
+	int targetIndex = GetBufferTargetIndex(target);
+	if (targetIndex >= 0) {
+		g_stateCache.buffers[targetIndex] = buffer;
+	}
+}
+
+void Graphic::GLDeleteBuffers(GLsizei n, const GLuint* buffers)
+{
+	StateCache::Forget(g_stateCache.buffers, BUFFER_TARGET_COUNT, buffers, n);
+	StateCache::Forget(g_stateCache.storageBuffers, MAX_TRACKED_BINDING_POINTS, buffers, n);
+	StateCache::Forget(g_stateCache.uniformBuffers, MAX_TRACKED_BINDING_POINTS, buffers, n);
+	GLCall(glDeleteBuffers(n, buffers));
+	GLTrace::RecordData(GLTrace::Call::DELETE_BUFFERS, buffers, n * sizeof(GLuint), n);
+}
+
+void Graphic::GLBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+{
+	GLCall(glBufferData(target, size, data, usage));
+	GLTrace::RecordData(GLTrace::Call::BUFFER_DATA, data, static_cast<size_t>(size), target, size, usage);
+}
+
+void Graphic::GLBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data)
+{
+	GLCall(glBufferSubData(target, offset, size, data));
+	GLTrace::RecordData(GLTrace::Call::BUFFER_SUB_DATA, data, static_cast<size_t>(size), target, offset, size);
+}
+
+void Graphic::GLBufferStorage(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags)
+{
+	GLCall(glBufferStorage(target, size, data, flags));
+	GLTrace::RecordData(GLTrace::Call::BUFFER_STORAGE, data, static_cast<size_t>(size), target, size, flags);
+}
+
+void Graphic::GLGenVertexArrays(GLsizei n, GLuint* vertexArrays)
+{
+	GLCall(glGenVertexArrays(n, vertexArrays));
+	GLTrace::RecordData(GLTrace::Call::GEN_VERTEX_ARRAYS, vertexArrays, n * sizeof(GLuint), n);
+}
+
+void Graphic::GLBindVertexArray(GLuint vertexArray)
+{
+	if (g_stateCache.Change(g_stateCache.vertexArray, vertexArray)) {
+		// element array binding belongs to vertex array object
+		g_stateCache.buffers[BUFFER_TARGET_ELEMENT_ARRAY] = UNKNOWN_BINDING;
+		GLCall(glBindVertexArray(vertexArray));
+		GLTrace::Record(GLTrace::Call::BIND_VERTEX_ARRAY, vertexArray);
+	}
+}
+
+void Graphic::GLDeleteVertexArrays(GLsizei n, const GLuint* vertexArrays)
+{
+	StateCache::Forget(&g_stateCache.vertexArray, 1, vertexArrays, n);
+	g_stateCache.buffers[BUFFER_TARGET_ELEMENT_ARRAY] = UNKNOWN_BINDING;
+	GLCall(glDeleteVertexArrays(n, vertexArrays));
+	GLTrace::RecordData(GLTrace::Call::DELETE_VERTEX_ARRAYS, vertexArrays, n * sizeof(GLuint), n);
+}
+
+void Graphic::GLEnableVertexAttribArray(GLuint index)
+{
+	GLCall(glEnableVertexAttribArray(index));
+	GLTrace::Record(GLTrace::Call::ENABLE_VERTEX_ATTRIB_ARRAY, index);
+}
+
+void Graphic::GLVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer)
+{
+	GLCall(glVertexAttribPointer(index, size, type, normalized, stride, pointer));
+	GLTrace::Record(GLTrace::Call::VERTEX_ATTRIB_POINTER, index, size, type, normalized, stride, reinterpret_cast<size_t>(pointer));
+}
+
+void Graphic::GLVertexAttribDivisor(GLuint index, GLuint divisor)
+{
+	GLCall(glVertexAttribDivisor(index, divisor));
+	GLTrace::Record(GLTrace::Call::VERTEX_ATTRIB_DIVISOR, index, divisor);
+}
+
+void Graphic::GLGenFramebuffers(GLsizei n, GLuint* framebuffers)
+{
+	GLCall(glGenFramebuffers(n, framebuffers));
+	GLTrace::RecordData(GLTrace::Call::GEN_FRAMEBUFFERS, framebuffers, n * sizeof(GLuint), n);
+}
+
+void Graphic::GLBindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	bool changed = false;
+	switch (target)
+	{
+	case GL_FRAMEBUFFER:
+		// both bindings must be compared, do not short-circuit
+		changed = g_stateCache.Change(g_stateCache.drawFramebuffer, framebuffer);
+		changed = g_stateCache.Change(g_stateCache.readFramebuffer, framebuffer) || changed;
+		break;
+
+	case GL_DRAW_FRAMEBUFFER:
+		changed = g_stateCache.Change(g_stateCache.drawFramebuffer, framebuffer);
+		break;
+
+	case GL_READ_FRAMEBUFFER:
+		changed = g_stateCache.Change(g_stateCache.readFramebuffer, framebuffer);
+		break;
+
+	default:
+		changed = g_stateCache.Untracked();
+		break;
+	}
+	if (changed) {
+		GLCall(glBindFramebuffer(target, framebuffer));
+		GLTrace::Record(GLTrace::Call::BIND_FRAMEBUFFER, target, framebuffer);
+	}
+}
+
+void Graphic::GLDeleteFramebuffers(GLsizei n, const GLuint* framebuffers)
+{
+	StateCache::Forget(&g_stateCache.drawFramebuffer, 1, framebuffers, n);
+	StateCache::Forget(&g_stateCache.readFramebuffer, 1, framebuffers, n);
+	GLCall(glDeleteFramebuffers(n, framebuffers));
+	GLTrace::RecordData(GLTrace::Call::DELETE_FRAMEBUFFERS, framebuffers, n * sizeof(GLuint), n);
+}
+
+void Graphic::GLFramebufferTexture2D(GLenum target, GLenum attachment, GLenum textureTarget, GLuint texture, GLint level)
+{
+	GLCall(glFramebufferTexture2D(target, attachment, textureTarget, texture, level));
+	GLTrace::Record(GLTrace::Call::FRAMEBUFFER_TEXTURE_2D, target, attachment, textureTarget, texture, level);
+}
+
+void Graphic::GLFramebufferRenderbuffer(GLenum target, GLenum attachment, GLenum renderbufferTarget, GLuint renderbuffer)
+{
+	GLCall(glFramebufferRenderbuffer(target, attachment, renderbufferTarget, renderbuffer));
+	GLTrace::Record(GLTrace::Call::FRAMEBUFFER_RENDERBUFFER, target, attachment, renderbufferTarget, renderbuffer);
+}
+
+void Graphic::GLDrawBuffer(GLenum buffer)
+{
+	GLCall(glDrawBuffer(buffer));
+	GLTrace::Record(GLTrace::Call::DRAW_BUFFER, buffer);
+}
+
+void Graphic::GLDrawBuffers(GLsizei n, const GLenum* buffers)
+{
+	GLCall(glDrawBuffers(n, buffers));
+	GLTrace::RecordData(GLTrace::Call::DRAW_BUFFERS, buffers, n * sizeof(GLenum), n);
+}
+
+void Graphic::GLGenRenderbuffers(GLsizei n, GLuint* renderbuffers)
+{
+	GLCall(glGenRenderbuffers(n, renderbuffers));
+	GLTrace::RecordData(GLTrace::Call::GEN_RENDERBUFFERS, renderbuffers, n * sizeof(GLuint), n);
+}
+
+void Graphic::GLBindRenderbuffer(GLenum target, GLuint renderbuffer)
+{
+	GLCall(glBindRenderbuffer(target, renderbuffer));
+	GLTrace::Record(GLTrace::Call::BIND_RENDERBUFFER, target, renderbuffer);
+}
+
+void Graphic::GLDeleteRenderbuffers(GLsizei n, const GLuint* renderbuffers)
+{
+	GLCall(glDeleteRenderbuffers(n, renderbuffers));
+	GLTrace::RecordData(GLTrace::Call::DELETE_RENDERBUFFERS, renderbuffers, n * sizeof(GLuint), n);
+}
+
+void Graphic::GLRenderbufferStorage(GLenum target, GLenum internalformat, GLsizei width, GLsizei height)
+{
+	GLCall(glRenderbufferStorage(target, internalformat, width, height));
+	GLTrace::Record(GLTrace::Call::RENDERBUFFER_STORAGE, target, internalformat, width, height);
+}
+
+void Graphic::GLViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	GLint& shadowX = g_stateCache.viewport[0];
+	GLint& shadowY = g_stateCache.viewport[1];
+	GLint& shadowWidth = g_stateCache.viewport[2];
+	GLint& shadowHeight = g_stateCache.viewport[3];
+	if (shadowX == x && shadowY == y && shadowWidth == width && shadowHeight == height) {
+		g_stateCache.statistics.elided++;
+		return;
+	}
+	g_stateCache.Untracked();
+	shadowX = x;
+	shadowY = y;
+	shadowWidth = width;
+	shadowHeight = height;
+	GLCall(glViewport(x, y, width, height));
+	GLTrace::Record(GLTrace::Call::VIEWPORT, x, y, width, height);
+}
+
+void Graphic::GLDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+	CaptureStreamBuffer();
+	GLCall(glDrawArrays(mode, first, count));
+	GLTrace::Record(GLTrace::Call::DRAW_ARRAYS, mode, first, count);
+}
+
+void Graphic::GLDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instanceCount)
+{
+	CaptureStreamBuffer();
+	GLCall(glDrawArraysInstanced(mode, first, count, instanceCount));
+	GLTrace::Record(GLTrace::Call::DRAW_ARRAYS_INSTANCED, mode, first, count, instanceCount);
+}
+
+void Graphic::GLDrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
+{
+	CaptureStreamBuffer();
+	GLCall(glDrawElements(mode, count, type, indices));
+	GLTrace::Record(GLTrace::Call::DRAW_ELEMENTS, mode, count, type, reinterpret_cast<size_t>(indices));
+}
+
+void Graphic::GLDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instanceCount)
+{
+	CaptureStreamBuffer();
+	GLCall(glDrawElementsInstanced(mode, count, type, indices, instanceCount));
+	GLTrace::Record(GLTrace::Call::DRAW_ELEMENTS_INSTANCED, mode, count, type, reinterpret_cast<size_t>(indices), instanceCount);
+}
+
+void Graphic::GLDrawElementsInstancedBaseInstance(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instanceCount,
+	GLuint baseInstance)
+{
+	CaptureStreamBuffer();
+	GLCall(glDrawElementsInstancedBaseInstance(mode, count, type, indices, instanceCount, baseInstance));
+	GLTrace::Record(GLTrace::Call::DRAW_ELEMENTS_INSTANCED_BASE_INSTANCE, mode, count, type, reinterpret_cast<size_t>(indices),
+		instanceCount, baseInstance);
+}
+
+void Graphic::GLMultiDrawElementsIndirect(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount, GLsizei stride)
+{
+	CaptureStreamBuffer();
+	GLCall(glMultiDrawElementsIndirect(mode, type, indirect, drawCount, stride));
+	GLTrace::Record(GLTrace::Call::MULTI_DRAW_ELEMENTS_INDIRECT, mode, type, reinterpret_cast<size_t>(indirect), drawCount, stride);
+}
+
+GLsync Graphic::GLFenceSync(GLenum condition, GLbitfield flags)
+{
+	GLsync sync = nullptr;
+	GLCall(sync = glFenceSync(condition, flags));
+	return sync;
+}
+
+GLenum Graphic::GLClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+	GLenum result = GL_WAIT_FAILED;
+	GLCall(result = glClientWaitSync(sync, flags, timeout));
+	return result;
+}
+
+void Graphic::GLDeleteSync(GLsync sync)
+{
+	GLCall(glDeleteSync(sync));
 }
 
 GLuint Graphic::GLCreateShader(GLenum shaderType)
 {
-	return glCreateShader(shaderType);
+	GLuint shader = glCreateShader(shaderType);
+	GLTrace::Record(GLTrace::Call::CREATE_SHADER, shaderType, shader);
+	return shader;
 }
 
 void Graphic::GLShaderSource(GLuint shader, GLsizei count, const GLchar** string, const GLint* length)
 {
 	GLCall(glShaderSource(shader, count, string, length));
+	if (GLTrace::IsCapturing()) {
+		// the strings are joined, the replayer passes one source
+		std::string source;
+		for (GLsizei i = 0; i < count; ++i) {
+			source.append(string[i], length && length[i] >= 0 ? static_cast<size_t>(length[i]) : strlen(string[i]));
+		}
+		GLTrace::RecordData(GLTrace::Call::SHADER_SOURCE, source.data(), source.size(), shader);
+	}
 }
 
 void Graphic::GLCompileShader(GLuint shader)
 {
 	GLCall(glCompileShader(shader));
+	GLTrace::Record(GLTrace::Call::COMPILE_SHADER, shader);
 }
 
 GLuint Graphic::GLCreateProgram()
 {
-	return glCreateProgram();
+	GLuint program = glCreateProgram();
+	GLTrace::Record(GLTrace::Call::CREATE_PROGRAM, program);
+	return program;
 }
 
 void Graphic::GLAttachShader(GLuint program, GLuint shader)
 {
 	GLCall(glAttachShader(program, shader));
+	GLTrace::Record(GLTrace::Call::ATTACH_SHADER, program, shader);
 }
 
 void Graphic::GLLinkProgram(GLuint program)
 {
 	GLCall(glLinkProgram(program));
+	GLTrace::Record(GLTrace::Call::LINK_PROGRAM, program);
+	GLTrace::RecordProgramUniforms(program);
 }
 
 void Graphic::GLDeleteShader(GLuint shader)
 {
 	GLCall(glDeleteShader(shader));
+	GLTrace::Record(GLTrace::Call::DELETE_SHADER, shader);
 }
 
 void Graphic::GLDeleteProgram(GLuint program)
 {
 	GLCall(glDeleteProgram(program));
+	GLTrace::Record(GLTrace::Call::DELETE_PROGRAM, program);
 }
 
 void Graphic::GLUseProgram(GLuint program)
 {
-	GLCall(glUseProgram(program));
+	if (g_stateCache.Change(g_stateCache.program, program)) {
+		GLCall(glUseProgram(program));
+		GLTrace::Record(GLTrace::Call::USE_PROGRAM, program);
+	}
 }
 
 void Graphic::GLGetShaderInfoLog(GLuint shader, GLsizei maxLength, GLsizei* length, GLchar* infoLog)
@@ -316,51 +1592,103 @@ GLuint Graphic::GLGetUniformLocation(GLuint program, const GLchar* name)
 void Graphic::GLUniform1i(GLint location, GLint v0)
 {
 	GLCall(glUniform1i(location, v0));
+	GLTrace::Record(GLTrace::Call::UNIFORM_1I, location, v0);
 }
 
 void Graphic::GLUniform1f(GLint location, GLfloat v0)
 {
 	GLCall(glUniform1f(location, v0));
+	GLTrace::Record(GLTrace::Call::UNIFORM_1F, location, v0);
 }
 
 void Graphic::GLUniform2f(GLuint location, GLfloat v0, GLfloat v1)
 {
 	GLCall(glUniform2f(location, v0, v1));
+	GLTrace::Record(GLTrace::Call::UNIFORM_2F, location, v0, v1);
 }
 
 void Graphic::GLUniform2fv(GLuint location, GLsizei count, const GLfloat* value)
 {
 	GLCall(glUniform2fv(location, count, value));
+	GLTrace::RecordData(GLTrace::Call::UNIFORM_2FV, value, count * 2 * sizeof(GLfloat), location, count);
 }
 
 void Graphic::GLUniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2)
 {
 	GLCall(glUniform3f(location, v0, v1, v2));
+	GLTrace::Record(GLTrace::Call::UNIFORM_3F, location, v0, v1, v2);
 }
 
 void Graphic::GLUniform3fv(GLint location, GLsizei count, const GLfloat* value)
 {
 	GLCall(glUniform3fv(location, count, value));
+	GLTrace::RecordData(GLTrace::Call::UNIFORM_3FV, value, count * 3 * sizeof(GLfloat), location, count);
 }
 
 void Graphic::GLUniform4f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3)
 {
 	GLCall(glUniform4f(location, v0, v1, v2, v3));
+	GLTrace::Record(GLTrace::Call::UNIFORM_4F, location, v0, v1, v2, v3);
 }
 
 void Graphic::GLUniform4fv(GLint location, GLsizei count, const GLfloat* value)
 {
 	GLCall(glUniform4fv(location, count, value));
+	GLTrace::RecordData(GLTrace::Call::UNIFORM_4FV, value, count * 4 * sizeof(GLfloat), location, count);
 }
 
 void Graphic::GLUniformMatrix3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
 {
 	GLCall(glUniformMatrix3fv(location, count, transpose, value));
+	GLTrace::RecordData(GLTrace::Call::UNIFORM_MATRIX_3FV, value, count * 9 * sizeof(GLfloat), location, count, transpose);
 }
 
 void Graphic::GLUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
 {
 	GLCall(glUniformMatrix4fv(location, count, transpose, value));
+	GLTrace::RecordData(GLTrace::Call::UNIFORM_MATRIX_4FV, value, count * 16 * sizeof(GLfloat), location, count, transpose);
+}
+
+void Graphic::GLProgramUniform1i(GLuint program, GLint location, GLint v0)
+{
+	GLCall(glProgramUniform1i(program, location, v0));
+	GLTrace::Record(GLTrace::Call::PROGRAM_UNIFORM_1I, program, location, v0);
+}
+
+void Graphic::GLProgramUniform1f(GLuint program, GLint location, GLfloat v0)
+{
+	GLCall(glProgramUniform1f(program, location, v0));
+	GLTrace::Record(GLTrace::Call::PROGRAM_UNIFORM_1F, program, location, v0);
+}
+
+void Graphic::GLProgramUniform2fv(GLuint program, GLint location, GLsizei count, const GLfloat* value)
+{
+	GLCall(glProgramUniform2fv(program, location, count, value));
+	GLTrace::RecordData(GLTrace::Call::PROGRAM_UNIFORM_2FV, value, count * 2 * sizeof(GLfloat), program, location, count);
+}
+
+void Graphic::GLProgramUniform3fv(GLuint program, GLint location, GLsizei count, const GLfloat* value)
+{
+	GLCall(glProgramUniform3fv(program, location, count, value));
+	GLTrace::RecordData(GLTrace::Call::PROGRAM_UNIFORM_3FV, value, count * 3 * sizeof(GLfloat), program, location, count);
+}
+
+void Graphic::GLProgramUniform4fv(GLuint program, GLint location, GLsizei count, const GLfloat* value)
+{
+	GLCall(glProgramUniform4fv(program, location, count, value));
+	GLTrace::RecordData(GLTrace::Call::PROGRAM_UNIFORM_4FV, value, count * 4 * sizeof(GLfloat), program, location, count);
+}
+
+void Graphic::GLProgramUniformMatrix3fv(GLuint program, GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+{
+	GLCall(glProgramUniformMatrix3fv(program, location, count, transpose, value));
+	GLTrace::RecordData(GLTrace::Call::PROGRAM_UNIFORM_MATRIX_3FV, value, count * 9 * sizeof(GLfloat), program, location, count, transpose);
+}
+
+void Graphic::GLProgramUniformMatrix4fv(GLuint program, GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+{
+	GLCall(glProgramUniformMatrix4fv(program, location, count, transpose, value));
+	GLTrace::RecordData(GLTrace::Call::PROGRAM_UNIFORM_MATRIX_4FV, value, count * 16 * sizeof(GLfloat), program, location, count, transpose);
 }
 
 Graphic::RenderTarget::RenderTarget()
@@ -377,3 +1705,30 @@ Graphic::RenderTarget::~RenderTarget()
 {
 	delete primitive;
 }
+
+void Graphic::RenderTarget::Submit(RenderQueue* queue)
+{
+	queue->Push(this, LAYER_OPAQUE, 0, 0, primitive->GetVertexArray(), 0.f);
+}
+
+void Graphic::RenderTarget::SubmitOccluders(OcclusionCuller* occlusionCuller)
+{
+	// most targets occlude nothing
+}
+
+bool Graphic::RenderTarget::Record(CommandBuffer* commandBuffer, float dt) const
+{
+	// not recordable, the renderer calls Render() on the GL thread instead
+	return false;
+}
+
+bool Graphic::RenderTarget::RecordDepth(CommandBuffer* commandBuffer, float dt) const
+{
+	// the pre-pass draws the target with its shading program
+	return false;
+}
+
+const char* Graphic::RenderTarget::GetName() const
+{
+	return "RenderTarget";
+}
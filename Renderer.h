@@ -1,27 +1,113 @@
 #pragma once
 #include "Debug.h"
+#include "RenderQueue.h"
+#include "StreamBuffer.h"
+#include "CommandBuffer.h"
+#include "FrameGraph.h"
+#include "GPUProfiler.h"
+#include "Frustum.h"
+#include "SceneBVH.h"
+#include "OcclusionCuller.h"
+#include "GLTrace.h"
 
 class Window;
 
 // render callback function
 typedef void (*UpdateCallBack)(float dt);
+// adds passes between scene and UI, returns the version of the backbuffer the UI is drawn on
+typedef Graphic::FrameGraphResource (*FrameGraphCallBack)(Graphic::FrameGraph& graph, Graphic::FrameGraphResource sceneColor);
 
 namespace Graphic
 {
+	/**
+	*	state wrappers keep a shadow copy of the GL state, calls which would not change anything are elided.
+	*	All wrappers record the calls they issue while a Graphic::GLTrace capture is running
+	*/
+	struct GLStateStatistics
+	{
+		uint32_t issued;
+		uint32_t elided;
+		uint32_t textureBinds;	///< glBindTexture calls among the issued ones
+	};
+	const GLStateStatistics& GLGetStateStatistics();
+	void GLResetStateStatistics();
+	void GLInvalidateStateCache(); ///< call it after GL states are changed without the wrappers
+
 	// state
 	void GLEnable(GLenum capbility);
 	void GLDisable(GLenum capbility);
+	void GLDepthFunc(GLenum func);
+	void GLDepthMask(GLboolean flag);
+	void GLColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha);
+	void GLClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+	void GLClear(GLbitfield mask);
+	void GLPixelStorei(GLenum pname, GLint param);
 
 	// texture
 	void GLGenTextures(GLsizei n, GLuint* texture);
+	void GLDeleteTextures(GLsizei n, const GLuint* textures);
+	void GLActiveTexture(GLenum texture);
 	void GLBindTexture(GLenum target, GLuint texture);
 	void GLTexImage2D(GLenum target, GLint level, GLint internalformat,
 		GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels);
 	void GLTexParameteri(GLenum target, GLenum pname, GLint param);
+	void GLTexStorage2D(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height);
+	void GLTexStorage3D(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth);
+	void GLTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset,
+		GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels);
+	void GLTexSubImage3D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset,
+		GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const void* pixels);
+	void GLGenerateMipmap(GLenum target);
+	GLuint64 GLGetTextureHandle(GLuint texture);
+	void GLMakeTextureHandleResident(GLuint64 handle);
+	void GLMakeTextureHandleNonResident(GLuint64 handle);
 
 	// blend
 	void GLBlendFunc(GLenum sourceFactor, GLenum destinationFactor);
 
+	// buffer
+	void GLGenBuffers(GLsizei n, GLuint* buffers);
+	void GLBindBuffer(GLenum target, GLuint buffer);
+	void GLBindBufferBase(GLenum target, GLuint index, GLuint buffer);
+	void GLDeleteBuffers(GLsizei n, const GLuint* buffers);
+	void GLBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage);
+	void GLBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data);
+	void GLBufferStorage(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+	void GLGenVertexArrays(GLsizei n, GLuint* vertexArrays);
+	void GLBindVertexArray(GLuint vertexArray);
+	void GLDeleteVertexArrays(GLsizei n, const GLuint* vertexArrays);
+	void GLEnableVertexAttribArray(GLuint index);
+	void GLVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer);
+	void GLVertexAttribDivisor(GLuint index, GLuint divisor);
+
+	// framebuffer
+	void GLGenFramebuffers(GLsizei n, GLuint* framebuffers);
+	void GLBindFramebuffer(GLenum target, GLuint framebuffer);
+	void GLDeleteFramebuffers(GLsizei n, const GLuint* framebuffers);
+	void GLFramebufferTexture2D(GLenum target, GLenum attachment, GLenum textureTarget, GLuint texture, GLint level);
+	void GLFramebufferRenderbuffer(GLenum target, GLenum attachment, GLenum renderbufferTarget, GLuint renderbuffer);
+	void GLDrawBuffer(GLenum buffer);
+	void GLDrawBuffers(GLsizei n, const GLenum* buffers);
+	void GLGenRenderbuffers(GLsizei n, GLuint* renderbuffers);
+	void GLBindRenderbuffer(GLenum target, GLuint renderbuffer);
+	void GLDeleteRenderbuffers(GLsizei n, const GLuint* renderbuffers);
+	void GLRenderbufferStorage(GLenum target, GLenum internalformat, GLsizei width, GLsizei height);
+	void GLViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+	// draw
+	void GLDrawArrays(GLenum mode, GLint first, GLsizei count);
+	void GLDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instanceCount);
+	void GLDrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices);
+	void GLDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instanceCount);
+	void GLDrawElementsInstancedBaseInstance(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instanceCount,
+		GLuint baseInstance);
+	void GLMultiDrawElementsIndirect(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount, GLsizei stride);
+
+	// sync, not traced, a replay has no frames in flight to wait for
+	GLsync GLFenceSync(GLenum condition, GLbitfield flags);
+	GLenum GLClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout);
+	void GLDeleteSync(GLsync sync);
+
 	// shader
 	GLuint GLCreateShader(GLenum shaderType);
 	GLuint GLCreateProgram();
@@ -50,14 +136,54 @@ namespace Graphic
 	void GLUniformMatrix3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value);
 	void GLUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value);
 
+	// uniform of any program, needs not to be in use
+	void GLProgramUniform1i(GLuint program, GLint location, GLint v0);
+	void GLProgramUniform1f(GLuint program, GLint location, GLfloat v0);
+	void GLProgramUniform2fv(GLuint program, GLint location, GLsizei count, const GLfloat* value);
+	void GLProgramUniform3fv(GLuint program, GLint location, GLsizei count, const GLfloat* value);
+	void GLProgramUniform4fv(GLuint program, GLint location, GLsizei count, const GLfloat* value);
+	void GLProgramUniformMatrix3fv(GLuint program, GLint location, GLsizei count, GLboolean transpose, const GLfloat* value);
+	void GLProgramUniformMatrix4fv(GLuint program, GLint location, GLsizei count, GLboolean transpose, const GLfloat* value);
+
 	class RenderTarget;
 	class Renderer;
 	class Primitive;
 	class Shader;
 
 	constexpr glm::vec4 DEFAULT_COLOR(1.0f);
+
+	/**
+	*	constants shared by all shaders, std140 layout, uploaded once per frame
+	*/
+	struct FrameConstants
+	{
+		glm::mat4 view;
+		glm::mat4 projection;
+		glm::mat4 viewProjection;
+		glm::vec4 viewport;	///< width, height, 1 / width, 1 / height of the framebuffer
+		glm::vec4 time;		///< elapsed time, frame time, 0, 0
+		glm::vec4 content;	///< framebuffer pixels per window unit in x and y, 0, 0
+	};
+	constexpr GLuint FRAME_CONSTANTS_BINDING = 0;
 }
 
+/**
+*	GLSL declaration of FrameConstants, insert it after the #version line of a shader:
+*		R"( #version 440 )" FRAME_CONSTANTS_GLSL R"( ... )"
+*	2D shaders map pixel positions with frame.viewport instead of an ortho matrix. Widgets are laid out in window
+*	units like the cursor, their shaders scale positions by frame.content.xy into framebuffer pixels first.
+*/
+#define FRAME_CONSTANTS_GLSL \
+	"\nlayout (std140, binding = 0) uniform FrameConstants\n" \
+	"{\n" \
+	"	mat4 view;\n" \
+	"	mat4 projection;\n" \
+	"	mat4 viewProjection;\n" \
+	"	vec4 viewport;\n" \
+	"	vec4 time;\n" \
+	"	vec4 content;\n" \
+	"} frame;\n"
+
 
 /**
 *	\description: class RenderTarget is the fundenmetal class of all rendering object
@@ -75,8 +201,14 @@ protected:
 	Graphic::Primitive* primitive;
 
 	virtual bool Render(float dt) = 0;
+	virtual void Submit(RenderQueue* queue);
+	virtual void SubmitOccluders(OcclusionCuller* occlusionCuller); ///< before Submit(), occluders of the frame
+	virtual bool Record(CommandBuffer* commandBuffer, float dt) const; ///< may run on a worker thread, must not touch GL or the target
+	virtual bool RecordDepth(CommandBuffer* commandBuffer, float dt) const; ///< depth-only draw of the pre-pass, false if unsupported
+	virtual const char* GetName() const; ///< scope name in the GPU profiler
 
 	friend class Renderer;
+	friend class CommandBuffer;
 
 };
 
@@ -91,14 +223,75 @@ public:
 	Renderer(const Renderer& renderer);
 	~Renderer();
 
+	/**
+	*	state switches caused by the sorted draw order of a frame
+	*/
+	struct FrameStatistics
+	{
+		uint32_t drawItems;
+		uint32_t programSwitches;
+		uint32_t textureBinds;	///< issued by GLBindTexture(), materials bind their textures outside of the sort key
+		GLStateStatistics stateCalls; ///< state calls issued and elided by the wrappers
+		FrameGraph::Statistics passes; ///< passes and transient textures of the frame graph
+		uint32_t visibleMeshes; ///< meshes which passed frustum and occlusion culling
+		uint32_t culledMeshes;	///< by the frustum
+		uint32_t occludedMeshes; ///< inside the frustum, every instance is occluded
+		uint32_t visibleInstances; ///< instances which passed the scene hierarchy
+		uint32_t culledInstances;
+		OcclusionCuller::Statistics occlusion; ///< software occlusion culling of meshes
+	};
+
 	static void AddObeject(RenderTarget* target);
 	static void SetUpdateCallBack(UpdateCallBack updateFunc);
+	static void SetFrameGraphCallBack(FrameGraphCallBack frameGraphFunc);
+	static const FrameStatistics& GetFrameStatistics();
+	static StreamBuffer* GetStreamBuffer();
+	static GPUProfiler* GetGPUProfiler();
+	static void SetCamera(const glm::mat4& view, const glm::mat4& projection);
+	static const FrameConstants& GetFrameConstants();
+	static const Frustum& GetFrustum(); ///< frustum of the camera of current frame
+	static uint64_t GetFrameIndex();
+	static void AddCullingStatistics(uint32_t visible, uint32_t culled);
+	static void AddOcclusionStatistics(uint32_t occluded); ///< meshes counted visible by AddCullingStatistics()
+	static SceneBVH* GetSceneBVH(); ///< instances of all models, culled once per frame
+	static void SetLODBias(float bias); ///< positive values select coarser levels of detail
+	static float GetLODBias();
+	static OcclusionCuller* GetOcclusionCuller(); ///< null if occlusion culling is disabled
+	static void SetOcclusionCulling(bool enable);
+	static void SetDepthPrePass(bool enable); ///< opaque depth first, then shading with GL_EQUAL
+	static bool GetDepthPrePass();
+	static void SetFrontToBack(bool enable); ///< opaque items sorted by depth instead of states
+	static bool GetFrontToBack();
 	void Render(float dt);
 
+	static constexpr size_t STREAM_REGION_SIZE = 256 * 1024; ///< bytes of dynamic data per frame
+	static constexpr size_t MIN_ITEMS_PER_COMMAND_BUFFER = 32; ///< smaller batches are not worth a worker
+
 private: 
 	std::list<RenderTarget*> targetList; ///< render taget list
+	RenderQueue renderQueue; ///< sorted draw items of current frame
+	FrameStatistics statistics; ///< statistics of last frame
+	StreamBuffer* streamBuffer; ///< ring buffer of dynamic vertex data
+	std::vector<CommandBuffer> commandBuffers; ///< one per contiguous range of the sorted queue
+	FrameGraph frameGraph; ///< passes of current frame
+	GPUProfiler* profiler; ///< GPU time of passes and targets
+	FrameConstants frameConstants; ///< camera and viewport of current frame
+	GLuint frameConstantsBuffer; ///< uniform buffer at FRAME_CONSTANTS_BINDING
+	Frustum frustum; ///< extracted from frame constants
+	uint64_t frameIndex; ///< frames rendered
+	SceneBVH sceneBVH; ///< world bounds of model instances
+	float lodBias; ///< levels added to the level of detail chosen by projected size
+	OcclusionCuller occlusionCuller; ///< depth of occluders rasterized on the CPU
+	bool occlusionCulling;
+	bool depthPrePass;
 
 	UpdateCallBack updateCallBack; ///< update callback function
+	FrameGraphCallBack frameGraphCallBack; ///< user passes between scene and UI
+
+	void BuildFrameGraph();
+	void UpdateFrameConstants(float dt);
+	void CountSwitches();
+	void ExecuteQueue(size_t begin, size_t end, float dt, bool depthOnly = false);
 
 };
 
@@ -109,6 +302,8 @@ private:
 class Graphic::Primitive
 {
 public:
+	static constexpr size_t INDIRECT_COMMAND_SIZE = 5 * sizeof(GLuint); ///< bytes of a DrawElementsIndirectCommand
+
 	Primitive();
 	Primitive(const Primitive& primitive);
 
@@ -116,11 +311,28 @@ public:
 
 	void CreateBuffer(GLenum target);
 
-	void AttachBuffer(GLenum target, size_t size, void* data, GLenum usage);
+	void AttachBuffer(GLenum target, size_t size, const void* data, GLenum usage);
 	void DetachBuffer();
 	void BufferSubData(GLenum target, size_t offset, size_t size, void* data);
 	void AttribPointer(GLuint layout, size_t numberOfCompoments, size_t stride, const void* offsetPointer);
+	void AttribFormat(GLuint layout, GLint components, GLenum type, GLboolean normalized, size_t stride, size_t offset); ///< stride and offset in bytes
+	void AttachInstanceBuffer(GLuint buffer, GLuint layout);
+	void SetInstanceCount(GLuint count);
+	void SetInstanceRange(GLuint first, GLuint count); ///< instances first ~ first + count - 1 of the instance buffer
+	void SetIndexRange(GLuint first, GLuint count); ///< part of the index buffer drawn, e.g. one level of detail
+	void SetIndexType(GLenum type); ///< GL_UNSIGNED_INT by default, set it before attaching or sharing indices
+	void AttachIndirectBuffer(size_t size, const void* commands, GLsizei drawCount);
+	void ShareBuffer(GLenum target, GLuint buffer);
 	void Render(float dt);
+	void RenderRange(GLint first, GLsizei count);
+	void RenderIndirect(GLsizei first, GLsizei count); ///< commands first ~ first + count - 1 of the indirect buffer
+	void Record(CommandBuffer* commandBuffer) const;
+	void RecordRange(CommandBuffer* commandBuffer, GLint first, GLsizei count) const;
+	void RecordIndirect(CommandBuffer* commandBuffer, GLsizei first, GLsizei count) const;
+
+	GLuint GetVertexArray() const;
+	GLuint GetIndexBuffer() const;
+	GLenum GetIndexType() const;
 
 public:
 	enum StorageType
@@ -139,6 +351,15 @@ private:
 
 	GLuint vertexCount;
 	GLuint indexCount;
+	GLuint indexOffset; ///< first index drawn
+	GLenum indexType;
+	GLuint instanceCount; ///< 0 means non-instanced drawing
+	GLuint baseInstance;
+
+	GLuint indirectBufferObject; ///< DrawElementsIndirectCommand array, drawn by glMultiDrawElementsIndirect
+	GLsizei indirectDrawCount;
 
 	StorageType storageType;
+
+	size_t GetIndexSize() const; ///< bytes of an index
 };
\ No newline at end of file
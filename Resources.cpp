@@ -1,6 +1,9 @@
 #include "Resources.h"
 #include "Shader.h"
 #include "Widgets.h"
+#include "MeshTech.h"
+#include "RectangleTech.h"
+#include "FontTech.h"
 
 Resources* g_pResourceManager;
 
@@ -25,6 +28,9 @@ Graphic::Shader* Resources::CreateShader(const char* vsCode, const char* fsCode,
 {
 	std::string code(vsCode);
 	code.append(fsCode);
+	if (gsCode) {
+		code.append(gsCode);
+	}
 	
 	// get hash code
 	unsigned int hash = HashString::FNV_1A_Multibyte(code.c_str(), code.size());
@@ -44,6 +50,26 @@ Graphic::Shader* Resources::CreateShader(const char* vsCode, const char* fsCode,
 	return shader;
 }
 
+void Resources::CompileTechniques()
+{
+	/**
+	*	the programs stay in the shader set, the techniques created later find them there, compiled or still compiling.
+	*	MeshTech has a variant per kind of material, the models submit the ones they use, see Model::Load()
+	*/
+	RectangleTech rectTech(RectangleTech::RECT_REGULAR);
+	RectangleTech softRectTech(RectangleTech::RECT_SOFT);
+	FontTech fontTech;
+	MeshDepthTech depthTech;
+	rectTech.Compile();
+	softRectTech.Compile();
+	fontTech.Compile();
+	depthTech.Compile();
+	if (GLEW_ARB_multi_draw_indirect && GLEW_ARB_shader_draw_parameters && GLEW_ARB_shader_storage_buffer_object) {
+		MeshBatchTech batchTech;
+		batchTech.Compile();
+	}
+}
+
 Widgets::Font* Resources::CreateFontx(const wchar_t* path)
 {
 	// get hash code
@@ -17,6 +17,7 @@ public:
 	~Resources();
 
 	static Graphic::Shader* CreateShader(const char* vsCode, const char* fsCode, const char* gsCode = nullptr);
+	static void CompileTechniques(); ///< submits the programs of all techniques at once, so they compile in parallel
 	static Widgets::Font* CreateFontx(const wchar_t* path);
 
 private:
@@ -0,0 +1,394 @@
+#include "SceneBVH.h"
+
+#include <cfloat>
+
+namespace
+{
+	constexpr uint32_t ALL_PLANES = (1u << Graphic::Frustum::PLANE_COUNT) - 1;
+	constexpr uint32_t TASKS_PER_THREAD = 4;
+
+	const glm::vec3 EMPTY_MINIMUM(FLT_MAX);
+	const glm::vec3 EMPTY_MAXIMUM(-FLT_MAX);
+}
+
+Graphic::SceneBVH::SceneBVH()
+	:items(), freeItems(), nodes(), itemOrder(), dirtyItems(), visibility(), aliveCount(0), refitCount(0), visibleCount(0),
+	needsRebuild(false)
+{
+}
+
+Graphic::SceneBVH::~SceneBVH()
+{
+}
+
+uint32_t Graphic::SceneBVH::Insert(const Box& box)
+{
+	uint32_t item = 0;
+	if (!freeItems.empty()) {
+		item = freeItems.back();
+		freeItems.pop_back();
+	}
+	else {
+		item = static_cast<uint32_t>(items.size());
+		items.push_back({});
+	}
+
+	items[item] = { box, INVALID_ITEM, true, false };
+	aliveCount++;
+	needsRebuild = true;
+
+	return item;
+}
+
+void Graphic::SceneBVH::Update(uint32_t item, const Box& box)
+{
+	if (item >= items.size() || !items[item].alive) {
+		throw std::invalid_argument("Exception: Graphic::SceneBVH::Update(): Invalid item!");
+	}
+
+	items[item].box = box;
+	if (!items[item].dirty) {
+		items[item].dirty = true;
+		dirtyItems.push_back(item);
+	}
+}
+
+void Graphic::SceneBVH::Remove(uint32_t item)
+{
+	if (item >= items.size() || !items[item].alive) {
+		throw std::invalid_argument("Exception: Graphic::SceneBVH::Remove(): Invalid item!");
+	}
+
+	items[item].alive = false;
+	freeItems.push_back(item);
+	aliveCount--;
+	needsRebuild = true;
+}
+
+void Graphic::SceneBVH::Build()
+{
+	nodes.clear();
+	itemOrder.clear();
+	for (uint32_t item = 0; item < items.size(); ++item) {
+		items[item].leaf = INVALID_ITEM;
+		items[item].dirty = false;
+		if (items[item].alive) {
+			itemOrder.push_back(item);
+		}
+	}
+	dirtyItems.clear();
+
+	if (!itemOrder.empty()) {
+		// a full tree has 2n - 1 nodes at most
+		nodes.reserve(itemOrder.size() * 2);
+		BuildNode(INVALID_ITEM, 0, static_cast<uint32_t>(itemOrder.size()));
+	}
+
+	refitCount = 0;
+	needsRebuild = false;
+}
+
+void Graphic::SceneBVH::Cull(const Frustum& frustum)
+{
+	if (needsRebuild || refitCount > aliveCount) {
+		Build();
+	}
+	else if (!dirtyItems.empty()) {
+		Refit();
+	}
+
+	visibility.assign(items.size(), 0);
+	visibleCount = 0;
+	if (nodes.empty()) {
+		return;
+	}
+
+	if (itemOrder.size() < MIN_PARALLEL_ITEMS) {
+		visibleCount = Traverse(frustum, 0, ALL_PLANES, 0, 0, nullptr);
+		return;
+	}
+
+	/**
+	*	the top of the tree is traversed here, subtrees below the split depth become jobs of the workers.
+	*	Items of different subtrees never overlap, so the jobs write disjoint bytes of visibility.
+	*/
+	ThreadPool& threadPool = ThreadPool::GetInstance();
+	const size_t taskTarget = (threadPool.GetThreadCount() + 1) * TASKS_PER_THREAD;
+	uint32_t splitDepth = 0;
+	while ((static_cast<size_t>(1) << splitDepth) < taskTarget) {
+		splitDepth++;
+	}
+
+	std::vector<Task> tasks;
+	visibleCount = Traverse(frustum, 0, ALL_PLANES, 0, splitDepth, &tasks);
+
+	std::vector<uint32_t> taskVisibleCounts(tasks.size(), 0);
+	threadPool.ParallelFor(tasks.size(), [&](size_t task) {
+		taskVisibleCounts[task] = Traverse(frustum, tasks[task].node, tasks[task].planeMask, 0, 0, nullptr);
+	});
+	for (uint32_t count : taskVisibleCounts) {
+		visibleCount += count;
+	}
+}
+
+bool Graphic::SceneBVH::IsVisible(uint32_t item) const
+{
+	return item < visibility.size() && visibility[item] != 0;
+}
+
+uint32_t Graphic::SceneBVH::GetItemCount() const
+{
+	return aliveCount;
+}
+
+uint32_t Graphic::SceneBVH::GetVisibleCount() const
+{
+	return visibleCount;
+}
+
+Graphic::SceneBVH::Box Graphic::SceneBVH::Transform(const Box& box, const glm::mat4& matrix)
+{
+	// the extent of a transformed box is the extent projected on the absolute axes of the matrix
+	const glm::vec3 center = glm::vec3(matrix * glm::vec4((box.minimum + box.maximum) * 0.5f, 1.f));
+	const glm::vec3 extent = (box.maximum - box.minimum) * 0.5f;
+	const glm::vec3 transformedExtent = glm::abs(glm::vec3(matrix[0])) * extent.x + glm::abs(glm::vec3(matrix[1])) * extent.y +
+		glm::abs(glm::vec3(matrix[2])) * extent.z;
+
+	return { center - transformedExtent, center + transformedExtent };
+}
+
+uint32_t Graphic::SceneBVH::BuildNode(uint32_t parent, uint32_t first, uint32_t count)
+{
+	const uint32_t index = static_cast<uint32_t>(nodes.size());
+	nodes.push_back({});
+
+	glm::vec3 minimum = EMPTY_MINIMUM;
+	glm::vec3 maximum = EMPTY_MAXIMUM;
+	glm::vec3 centroidMinimum = EMPTY_MINIMUM;
+	glm::vec3 centroidMaximum = EMPTY_MAXIMUM;
+	for (uint32_t i = first; i < first + count; ++i) {
+		const Box& box = items[itemOrder[i]].box;
+		const glm::vec3 centroid = (box.minimum + box.maximum) * 0.5f;
+		minimum = glm::min(minimum, box.minimum);
+		maximum = glm::max(maximum, box.maximum);
+		centroidMinimum = glm::min(centroidMinimum, centroid);
+		centroidMaximum = glm::max(centroidMaximum, centroid);
+	}
+
+	Node& node = nodes[index];
+	node.minimum = minimum;
+	node.maximum = maximum;
+	node.parent = parent;
+	node.itemFirst = first;
+	node.itemCount = count;
+	node.rightChild = 0;
+
+	if (count <= MAX_LEAF_ITEMS) {
+		for (uint32_t i = first; i < first + count; ++i) {
+			items[itemOrder[i]].leaf = index;
+		}
+		return index;
+	}
+
+	/**
+	*	binned SAH on the axis of the largest centroid extent, the split with the lowest
+	*	leftCount * leftArea + rightCount * rightArea wins
+	*/
+	const glm::vec3 centroidExtent = centroidMaximum - centroidMinimum;
+	int axis = 0;
+	if (centroidExtent.y > centroidExtent[axis]) {
+		axis = 1;
+	}
+	if (centroidExtent.z > centroidExtent[axis]) {
+		axis = 2;
+	}
+
+	uint32_t middle = first;
+	if (centroidExtent[axis] > 0.f) {
+		struct Bin
+		{
+			glm::vec3 minimum;
+			glm::vec3 maximum;
+			uint32_t count;
+		};
+		Bin bins[BIN_COUNT];
+		for (Bin& bin : bins) {
+			bin = { EMPTY_MINIMUM, EMPTY_MAXIMUM, 0 };
+		}
+
+		const float binScale = static_cast<float>(BIN_COUNT) / centroidExtent[axis];
+		auto binOf = [&](uint32_t item) {
+			const Box& box = items[item].box;
+			const float centroid = (box.minimum[axis] + box.maximum[axis]) * 0.5f;
+			return (std::min)(static_cast<uint32_t>((centroid - centroidMinimum[axis]) * binScale), BIN_COUNT - 1);
+		};
+
+		for (uint32_t i = first; i < first + count; ++i) {
+			Bin& bin = bins[binOf(itemOrder[i])];
+			bin.minimum = glm::min(bin.minimum, items[itemOrder[i]].box.minimum);
+			bin.maximum = glm::max(bin.maximum, items[itemOrder[i]].box.maximum);
+			bin.count++;
+		}
+
+		// right sweep stores the cost part of the bins after each split
+		float rightCosts[BIN_COUNT] = {};
+		glm::vec3 sweepMinimum = EMPTY_MINIMUM;
+		glm::vec3 sweepMaximum = EMPTY_MAXIMUM;
+		uint32_t sweepCount = 0;
+		for (uint32_t split = BIN_COUNT - 1; split > 0; --split) {
+			sweepMinimum = glm::min(sweepMinimum, bins[split].minimum);
+			sweepMaximum = glm::max(sweepMaximum, bins[split].maximum);
+			sweepCount += bins[split].count;
+			rightCosts[split] = sweepCount > 0 ? sweepCount * Area(sweepMinimum, sweepMaximum) : 0.f;
+		}
+
+		float bestCost = FLT_MAX;
+		uint32_t bestSplit = 0;
+		sweepMinimum = EMPTY_MINIMUM;
+		sweepMaximum = EMPTY_MAXIMUM;
+		sweepCount = 0;
+		for (uint32_t split = 1; split < BIN_COUNT; ++split) {
+			sweepMinimum = glm::min(sweepMinimum, bins[split - 1].minimum);
+			sweepMaximum = glm::max(sweepMaximum, bins[split - 1].maximum);
+			sweepCount += bins[split - 1].count;
+			if (sweepCount == 0 || sweepCount == count) {
+				continue;
+			}
+			const float cost = sweepCount * Area(sweepMinimum, sweepMaximum) + rightCosts[split];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestSplit = split;
+			}
+		}
+
+		if (bestSplit > 0) {
+			middle = static_cast<uint32_t>(std::partition(itemOrder.begin() + first, itemOrder.begin() + first + count,
+				[&](uint32_t item) { return binOf(item) < bestSplit; }) - itemOrder.begin());
+		}
+	}
+
+	// coincident centroids, split at the median
+	if (middle == first || middle == first + count) {
+		middle = first + count / 2;
+		std::nth_element(itemOrder.begin() + first, itemOrder.begin() + middle, itemOrder.begin() + first + count,
+			[&](uint32_t left, uint32_t right) {
+				return items[left].box.minimum[axis] + items[left].box.maximum[axis] <
+					items[right].box.minimum[axis] + items[right].box.maximum[axis];
+			});
+	}
+
+	BuildNode(index, first, middle - first);
+	const uint32_t rightChild = BuildNode(index, middle, first + count - middle);
+	nodes[index].rightChild = rightChild;
+
+	return index;
+}
+
+void Graphic::SceneBVH::Refit()
+{
+	/**
+	*	walk from the leaf of each moved item up to the root
+	*/
+	for (uint32_t item : dirtyItems) {
+		items[item].dirty = false;
+		if (!items[item].alive) {
+			continue;
+		}
+		for (uint32_t node = items[item].leaf; node != INVALID_ITEM; node = nodes[node].parent) {
+			FitNode(node);
+		}
+		refitCount++;
+	}
+	dirtyItems.clear();
+}
+
+void Graphic::SceneBVH::FitNode(uint32_t index)
+{
+	Node& node = nodes[index];
+	if (node.rightChild == 0) {
+		node.minimum = EMPTY_MINIMUM;
+		node.maximum = EMPTY_MAXIMUM;
+		for (uint32_t i = node.itemFirst; i < node.itemFirst + node.itemCount; ++i) {
+			const Item& item = items[itemOrder[i]];
+			if (item.alive) {
+				node.minimum = glm::min(node.minimum, item.box.minimum);
+				node.maximum = glm::max(node.maximum, item.box.maximum);
+			}
+		}
+		return;
+	}
+
+	const Node& left = nodes[index + 1];
+	const Node& right = nodes[node.rightChild];
+	node.minimum = glm::min(left.minimum, right.minimum);
+	node.maximum = glm::max(left.maximum, right.maximum);
+}
+
+uint32_t Graphic::SceneBVH::Traverse(const Frustum& frustum, uint32_t index, uint32_t planeMask, uint32_t depth,
+	uint32_t splitDepth, std::vector<Task>* tasks)
+{
+	const Node& node = nodes[index];
+	if (!Classify(frustum, node.minimum, node.maximum, planeMask)) {
+		return 0;
+	}
+
+	// inside all planes, accept the whole subtree
+	if (planeMask == 0) {
+		for (uint32_t i = node.itemFirst; i < node.itemFirst + node.itemCount; ++i) {
+			visibility[itemOrder[i]] = 1;
+		}
+		return node.itemCount;
+	}
+
+	if (node.rightChild == 0) {
+		uint32_t visible = 0;
+		for (uint32_t i = node.itemFirst; i < node.itemFirst + node.itemCount; ++i) {
+			const Item& item = items[itemOrder[i]];
+			uint32_t itemMask = planeMask;
+			if (item.alive && Classify(frustum, item.box.minimum, item.box.maximum, itemMask)) {
+				visibility[itemOrder[i]] = 1;
+				visible++;
+			}
+		}
+		return visible;
+	}
+
+	if (tasks && depth == splitDepth) {
+		tasks->push_back({ index, planeMask });
+		return 0;
+	}
+
+	const uint32_t rightChild = node.rightChild;
+	return Traverse(frustum, index + 1, planeMask, depth + 1, splitDepth, tasks) +
+		Traverse(frustum, rightChild, planeMask, depth + 1, splitDepth, tasks);
+}
+
+bool Graphic::SceneBVH::Classify(const Frustum& frustum, const glm::vec3& minimum, const glm::vec3& maximum, uint32_t& planeMask)
+{
+	/**
+	*	returns false if the box is outside, clears the planes which the box is completely inside of
+	*/
+	const glm::vec3 center = (minimum + maximum) * 0.5f;
+	const glm::vec3 extent = (maximum - minimum) * 0.5f;
+	for (uint32_t p = 0; p < Frustum::PLANE_COUNT; ++p) {
+		if ((planeMask & (1u << p)) == 0) {
+			continue;
+		}
+		const glm::vec4& plane = frustum.GetPlane(static_cast<Frustum::PlaneIndex>(p));
+		const float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+		const float radius = glm::dot(glm::abs(glm::vec3(plane)), extent);
+		if (distance + radius < 0.f) {
+			return false;
+		}
+		if (distance - radius >= 0.f) {
+			planeMask &= ~(1u << p);
+		}
+	}
+	return true;
+}
+
+float Graphic::SceneBVH::Area(const glm::vec3& minimum, const glm::vec3& maximum)
+{
+	const glm::vec3 extent = maximum - minimum;
+	return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include "Utility.h"
+#include "Frustum.h"
+
+namespace Graphic
+{
+	class SceneBVH;
+}
+
+/**
+*	\description: class SceneBVH: bounding volume hierarchy of scene items, e.g. model instances, for hierarchical
+*	frustum culling. The tree is built with the binned surface area heuristic, moving items only refit the boxes of
+*	their ancestors, inserted and removed items rebuild it before the next cull.
+*
+*	\detail: nodes are flattened in depth first order, the left child follows its parent and the items of a subtree are
+*	contiguous, so a subtree inside the frustum is accepted without visiting its nodes. Subtrees below a split depth are
+*	traversed by the worker threads.
+*/
+class Graphic::SceneBVH
+{
+public:
+	struct Box
+	{
+		glm::vec3 minimum;
+		glm::vec3 maximum;
+	};
+
+	static constexpr uint32_t INVALID_ITEM = 0xffffffff;
+	static constexpr uint32_t MAX_LEAF_ITEMS = 4;
+	static constexpr uint32_t BIN_COUNT = 12;
+	static constexpr uint32_t MIN_PARALLEL_ITEMS = 1024; ///< smaller trees are traversed on the calling thread
+
+	SceneBVH();
+	SceneBVH(const SceneBVH& sceneBVH) = delete;
+	~SceneBVH();
+
+	uint32_t Insert(const Box& box);
+	void Update(uint32_t item, const Box& box);
+	void Remove(uint32_t item);
+
+	void Build();
+	void Cull(const Frustum& frustum); ///< visibility of all items, rebuilds or refits the tree first
+
+	bool IsVisible(uint32_t item) const;
+	uint32_t GetItemCount() const;
+	uint32_t GetVisibleCount() const;
+
+	static Box Transform(const Box& box, const glm::mat4& matrix);
+
+private:
+	struct Node
+	{
+		glm::vec3 minimum;
+		uint32_t rightChild;	///< 0 for leaves, the left child is the next node
+		glm::vec3 maximum;
+		uint32_t parent;
+		uint32_t itemFirst;		///< range of itemOrder covered by the subtree
+		uint32_t itemCount;
+		uint32_t padding[2];
+	};
+	struct Item
+	{
+		Box box;
+		uint32_t leaf;	///< INVALID_ITEM if the item is not in the tree
+		bool alive;
+		bool dirty;
+	};
+	struct Task
+	{
+		uint32_t node;
+		uint32_t planeMask;
+	};
+
+	std::vector<Item> items;
+	std::vector<uint32_t> freeItems;
+	std::vector<Node> nodes;
+	std::vector<uint32_t> itemOrder;	///< items in leaf order
+	std::vector<uint32_t> dirtyItems;
+	std::vector<uint8_t> visibility;	///< indexed by item
+
+	uint32_t aliveCount;
+	uint32_t refitCount;	///< refits since last build, too many of them degrade the tree
+	uint32_t visibleCount;
+	bool needsRebuild;
+
+	uint32_t BuildNode(uint32_t parent, uint32_t first, uint32_t count);
+	void Refit();
+	void FitNode(uint32_t node);
+	uint32_t Traverse(const Frustum& frustum, uint32_t node, uint32_t planeMask, uint32_t depth, uint32_t splitDepth,
+		std::vector<Task>* tasks);
+
+	static bool Classify(const Frustum& frustum, const glm::vec3& minimum, const glm::vec3& maximum, uint32_t& planeMask);
+	static float Area(const glm::vec3& minimum, const glm::vec3& maximum);
+};
@@ -1,20 +1,136 @@
 #include "Shader.h"
 #include "Renderer.h"
+#include "Debug.h"
 #include <fstream>
 #include <sstream>
+#include <iomanip>
+#include <cstring>
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+	// linked programs, replayed command buffers find the shadow table of a program here
+	std::map<GLuint, Graphic::Shader*> g_shaders;
+
+	uint32_t ComponentCount(GLenum type)
+	{
+		switch (type)
+		{
+		case GL_FLOAT_VEC2:
+		case GL_INT_VEC2:
+			return 2;
+		case GL_FLOAT_VEC3:
+		case GL_INT_VEC3:
+			return 3;
+		case GL_FLOAT_VEC4:
+		case GL_INT_VEC4:
+		case GL_FLOAT_MAT2:
+			return 4;
+		case GL_FLOAT_MAT3:
+			return 9;
+		case GL_FLOAT_MAT4:
+			return 16;
+		default:
+			// scalars, bools and samplers
+			return 1;
+		}
+	}
+
+	uint64_t FNV_1A_64(uint64_t hash, const char* text)
+	{
+		for (; text && *text; ++text) {
+			hash = (hash ^ static_cast<unsigned char>(*text)) * 0x100000001b3ull;
+		}
+		// separates the strings, "ab" + "c" differs from "a" + "bc"
+		return (hash ^ 0xff) * 0x100000001b3ull;
+	}
+
+	/**
+	*	binaries are only valid for the driver which created them, vendor, renderer and version name it
+	*/
+	uint64_t DriverHash()
+	{
+		static const uint64_t hash = []() {
+			uint64_t driver = 0xcbf29ce484222325ull;
+			const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+			for (GLenum name : names) {
+				driver = FNV_1A_64(driver, reinterpret_cast<const char*>(glGetString(name)));
+			}
+			return driver;
+		}();
+		return hash;
+	}
+
+	const std::vector<GLint>& BinaryFormats()
+	{
+		static const std::vector<GLint> formats = []() {
+			std::vector<GLint> supported;
+			if (GLEW_ARB_get_program_binary == GL_FALSE && GLEW_VERSION_4_1 == GL_FALSE) {
+				return supported;
+			}
+			GLint count = 0;
+			GLCall(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count));
+			supported.resize(static_cast<size_t>((std::max)(count, 0)));
+			if (count > 0) {
+				GLCall(glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, supported.data()));
+			}
+			return supported;
+		}();
+		return formats;
+	}
+
+	std::string BinaryPath(uint64_t key)
+	{
+		std::stringstream path;
+		path << Graphic::Shader::CACHE_DIRECTORY << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+		return path.str();
+	}
+
+	/**
+	*	the driver compiles and links on as many threads as it likes, compile and link calls return at once
+	*/
+	bool IsParallelCompileSupported()
+	{
+		static const bool supported = []() {
+#ifdef GL_KHR_parallel_shader_compile
+			if (GLEW_KHR_parallel_shader_compile) {
+				GLCall(glMaxShaderCompilerThreadsKHR(0xffffffff));
+				return true;
+			}
+#endif
+#ifdef GL_ARB_parallel_shader_compile
+			if (GLEW_ARB_parallel_shader_compile) {
+				GLCall(glMaxShaderCompilerThreadsARB(0xffffffff));
+				return true;
+			}
+#endif
+			return false;
+		}();
+		return supported;
+	}
+}
 
 Graphic::Shader::Shader()
-	:shaderID(0)
+	:shaderID(0), pendingShaders{ 0, 0, 0 }, isPending(false), cacheKey(0), uniforms(), values(), names()
 {
 }
 
 Graphic::Shader::~Shader()
 {
+	g_shaders.erase(shaderID);
+	for (GLuint shader : pendingShaders) {
+		if (shader != 0) {
+			Graphic::GLDeleteShader(shader);
+		}
+	}
 	Graphic::GLDeleteProgram(shaderID);
 }
 
 void Graphic::Shader::Use()
 {
+	Resolve();
 	Graphic::GLUseProgram(shaderID);
 }
 
@@ -26,17 +142,26 @@ int Graphic::Shader::CreateProgram(const char* vexShaderSrc, const char* fragSha
 		throw std::invalid_argument("Exception: Graphic::Shader::CreateProgram(): Null shader source code!");
 	}
 
+	if (!BinaryFormats().empty()) {
+		cacheKey = FNV_1A_64(FNV_1A_64(FNV_1A_64(DriverHash(), vexShaderSrc), fragShaderSrc), geoShaderSrc);
+	}
+
+	// a binary of an earlier run skips compile and link, a trace records the sources though, so it replays anywhere
+	if (cacheKey != 0 && !GLTrace::IsCapturing() && LoadBinary()) {
+		Reflect();
+		g_shaders[shaderID] = this;
+		return shaderID;
+	}
+
 	// compile vertex shader
 	GLuint vertex = GLCreateShader(GL_VERTEX_SHADER);
 	GLShaderSource(vertex, 1, &vexShaderSrc, nullptr);
 	GLCompileShader(vertex);
-	CheckErorrStatus(vertex, GL_VERTEX_SHADER);
 
 	// compile fragment shader
 	GLuint fragment = GLCreateShader(GL_FRAGMENT_SHADER);
 	GLShaderSource(fragment, 1, &fragShaderSrc, nullptr);
 	GLCompileShader(fragment);
-	CheckErorrStatus(fragment, GL_FRAGMENT_SHADER);
 
 	// compile geometry shader, if it has.
 	GLuint geometryShader = 0;
@@ -44,24 +169,28 @@ int Graphic::Shader::CreateProgram(const char* vexShaderSrc, const char* fragSha
 		geometryShader = GLCreateShader(GL_GEOMETRY_SHADER);
 		GLShaderSource(geometryShader, 1, &geoShaderSrc, nullptr);
 		GLCompileShader(geometryShader);
-		CheckErorrStatus(geometryShader, GL_GEOMETRY_SHADER);
 	}
 
-	// attach program
+	// attach program, the compile status is checked after the link, so a parallel compile is not waited for here
 	shaderID = GLCreateProgram();
+	if (cacheKey != 0) {
+		GLCall(glProgramParameteri(shaderID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+	}
 	GLAttachShader(shaderID, vertex);
 	GLAttachShader(shaderID, fragment);
 	if (geoShaderSrc) {
 		GLAttachShader(shaderID, geometryShader);
 	}
 	GLLinkProgram(shaderID);
-	// check for linking errors
-	CheckErorrStatus(shaderID, GL_LINK_STATUS);
 
-	GLDeleteShader(vertex);
-	GLDeleteShader(fragment);
-	if (geoShaderSrc) {
-		GLDeleteShader(geometryShader);
+	pendingShaders[0] = vertex;
+	pendingShaders[1] = fragment;
+	pendingShaders[2] = geometryShader;
+	isPending = true;
+	g_shaders[shaderID] = this;
+
+	if (!IsParallelCompileSupported()) {
+		Resolve();
 	}
 
 	return shaderID;
@@ -128,64 +257,264 @@ int Graphic::Shader::CreateProgramFromFile(const char* vertexShaderpath, const c
 
 void Graphic::Shader::SetBool(GLuint location, GLboolean value) const
 {
-	Graphic::GLUniform1i(location, value);
+	SetInt(location, static_cast<GLint>(value));
 }
 
 void Graphic::Shader::SetInt(GLuint location, GLint value) const
 {
-	Graphic::GLUniform1i(location, value);
+	if (Update(location, &value, 1)) {
+		Graphic::GLProgramUniform1i(shaderID, location, value);
+	}
 }
 
 void Graphic::Shader::SetFloat(GLuint location, GLfloat value) const
 {
-	Graphic::GLUniform1f(location, value);
+	if (Update(location, &value, 1)) {
+		Graphic::GLProgramUniform1f(shaderID, location, value);
+	}
 }
 
-void Graphic::Shader::SetVec2(GLuint location, const glm::vec2& value)
+void Graphic::Shader::SetVec2(GLuint location, const glm::vec2& value) const
 {
-	Graphic::GLUniform2fv(location, 1, glm::value_ptr(value));
+	if (Update(location, glm::value_ptr(value), 2)) {
+		Graphic::GLProgramUniform2fv(shaderID, location, 1, glm::value_ptr(value));
+	}
 }
 
-void Graphic::Shader::SetVec2(GLuint location, GLfloat x, GLfloat y)
+void Graphic::Shader::SetVec2(GLuint location, GLfloat x, GLfloat y) const
 {
-	Graphic::GLUniform2f(location, x, y);
+	SetVec2(location, glm::vec2(x, y));
 }
 
-void Graphic::Shader::SetVec3(GLuint location, glm::vec3& value) const
+void Graphic::Shader::SetVec3(GLuint location, const glm::vec3& value) const
 {
-	Graphic::GLUniform3fv(location, 1, glm::value_ptr(value));
+	if (Update(location, glm::value_ptr(value), 3)) {
+		Graphic::GLProgramUniform3fv(shaderID, location, 1, glm::value_ptr(value));
+	}
 }
 
 void Graphic::Shader::SetVec3(GLuint location, GLfloat x, GLfloat y, GLfloat z) const
 {
-	Graphic::GLUniform3f(location, x, y, z);
+	SetVec3(location, glm::vec3(x, y, z));
 }
 
 void Graphic::Shader::SetVec4(GLuint location, const glm::vec4& value) const
 {
-	Graphic::GLUniform4fv(location, 1, glm::value_ptr(value));
+	if (Update(location, glm::value_ptr(value), 4)) {
+		Graphic::GLProgramUniform4fv(shaderID, location, 1, glm::value_ptr(value));
+	}
 }
 
 void Graphic::Shader::SetVec4(GLuint location, GLfloat x, GLfloat y, GLfloat z, GLfloat w) const
 {
-	Graphic::GLUniform4f(location, x, y, z, w);
+	SetVec4(location, glm::vec4(x, y, z, w));
 }
 
-void Graphic::Shader::SetMat3(GLuint location, glm::mat3& value) const
+void Graphic::Shader::SetMat3(GLuint location, const glm::mat3& value) const
 {
-	GLint transformLoc = location;
-	Graphic::GLUniformMatrix3fv(transformLoc, 1, GL_FALSE, glm::value_ptr(value));
+	if (Update(location, glm::value_ptr(value), 9)) {
+		Graphic::GLProgramUniformMatrix3fv(shaderID, location, 1, GL_FALSE, glm::value_ptr(value));
+	}
 }
 
-void Graphic::Shader::SetMat4(GLuint location, glm::mat4& value) const
+void Graphic::Shader::SetMat4(GLuint location, const glm::mat4& value) const
 {
-	GLint transformLoc = location;
-	Graphic::GLUniformMatrix4fv(transformLoc, 1, GL_FALSE, glm::value_ptr(value));
+	if (Update(location, glm::value_ptr(value), 16)) {
+		Graphic::GLProgramUniformMatrix4fv(shaderID, location, 1, GL_FALSE, glm::value_ptr(value));
+	}
 }
 
 GLuint Graphic::Shader::GetLocation(const char* name)
 {
-	return Graphic::GLGetUniformLocation(shaderID, name);
+	Resolve();
+
+	auto iter = names.find(name);
+	if (iter != names.end()) {
+		return iter->second;
+	}
+	if (names.empty()) {
+		// no reflection, see Reflect()
+		return Graphic::GLGetUniformLocation(shaderID, name);
+	}
+	return INVALID_LOCATION;
+}
+
+Graphic::Shader* Graphic::Shader::FindShader(GLuint program)
+{
+	auto iter = g_shaders.find(program);
+	return iter == g_shaders.end() ? nullptr : iter->second;
+}
+
+void Graphic::Shader::Resolve()
+{
+	if (!isPending) {
+		return;
+	}
+	isPending = false;
+
+	// querying a status waits for the compile or the link of the driver
+	const GLenum types[] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER };
+	for (size_t stage = 0; stage < 3; ++stage) {
+		if (pendingShaders[stage] != 0) {
+			CheckErorrStatus(pendingShaders[stage], types[stage]);
+		}
+	}
+	CheckErorrStatus(shaderID, GL_LINK_STATUS);
+
+	for (GLuint& shader : pendingShaders) {
+		if (shader != 0) {
+			GLDeleteShader(shader);
+			shader = 0;
+		}
+	}
+
+	if (cacheKey != 0) {
+		SaveBinary();
+	}
+	Reflect();
+}
+
+bool Graphic::Shader::LoadBinary()
+{
+	std::ifstream file(BinaryPath(cacheKey), std::ios_base::in | std::ios_base::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	BinaryHeader header = {};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	const std::vector<GLint>& formats = BinaryFormats();
+	if (!file || header.magic != BINARY_MAGIC || header.key != cacheKey || header.length == 0 ||
+		std::find(formats.begin(), formats.end(), static_cast<GLint>(header.format)) == formats.end()) {
+		return false;
+	}
+	std::vector<char> binary(header.length);
+	file.read(binary.data(), binary.size());
+	if (!file) {
+		return false;
+	}
+
+	shaderID = GLCreateProgram();
+	GLCall(glProgramBinary(shaderID, header.format, binary.data(), static_cast<GLsizei>(header.length)));
+	GLint success = 0;
+	Graphic::GLGetProgramiv(shaderID, GL_LINK_STATUS, &success);
+	if (!success) {
+		// rejected, e.g. by a driver update which kept the version string, it is compiled and saved again
+		Graphic::GLDeleteProgram(shaderID);
+		shaderID = 0;
+		Debug::ShowMessage("Graphic::Shader::LoadBinary(): cached program binary rejected by the driver.");
+		return false;
+	}
+
+	return true;
+}
+
+void Graphic::Shader::SaveBinary() const
+{
+	GLint length = 0;
+	Graphic::GLGetProgramiv(shaderID, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return;
+	}
+
+	std::vector<char> binary(static_cast<size_t>(length));
+	GLsizei written = 0;
+	GLenum format = 0;
+	GLCall(glGetProgramBinary(shaderID, length, &written, &format, binary.data()));
+	BinaryHeader header = { BINARY_MAGIC, format, cacheKey, static_cast<uint32_t>(written), 0 };
+
+#ifdef _WIN32
+	CreateDirectoryA(CACHE_DIRECTORY, nullptr);
+#else
+	mkdir(CACHE_DIRECTORY, 0755);
+#endif
+	std::ofstream file(BinaryPath(cacheKey), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+	if (!file.is_open()) {
+		Debug::ShowMessage("Graphic::Shader::SaveBinary(): open program binary cache failed.");
+		return;
+	}
+	// a partially written file fails the length check of LoadBinary()
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(binary.data(), written);
+}
+
+void Graphic::Shader::Reflect()
+{
+	uniforms.clear();
+	values.clear();
+	names.clear();
+
+	// program interface query is core since GL 4.3, without it values are not shadowed
+	if (GLEW_ARB_program_interface_query == GL_FALSE && GLEW_VERSION_4_3 == GL_FALSE) {
+		return;
+	}
+
+	GLint count = 0;
+	GLCall(glGetProgramInterfaceiv(shaderID, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count));
+
+	const GLenum properties[] = { GL_NAME_LENGTH, GL_TYPE, GL_LOCATION, GL_ARRAY_SIZE, GL_BLOCK_INDEX };
+	std::vector<GLchar> nameBuffer;
+	for (GLint index = 0; index < count; ++index) {
+		GLint params[5] = {};
+		GLCall(glGetProgramResourceiv(shaderID, GL_UNIFORM, index, 5, properties, 5, nullptr, params));
+		const GLint location = params[2];
+		const GLint arraySize = params[3];
+		// members of uniform blocks, e.g. FrameConstants, have no location
+		if (params[4] != -1 || location < 0) {
+			continue;
+		}
+
+		nameBuffer.resize(static_cast<size_t>(params[0]) + 1);
+		GLCall(glGetProgramResourceName(shaderID, GL_UNIFORM, index, static_cast<GLsizei>(nameBuffer.size()), nullptr, nameBuffer.data()));
+		std::string name(nameBuffer.data());
+
+		// arrays are reported once as "name[0]", their elements have consecutive locations
+		std::string arrayName = name;
+		if (arraySize > 1 && arrayName.size() > 3 && arrayName.compare(arrayName.size() - 3, 3, "[0]") == 0) {
+			arrayName.erase(arrayName.size() - 3);
+			names[arrayName] = static_cast<GLuint>(location);
+		}
+
+		const uint32_t components = ComponentCount(static_cast<GLenum>(params[1]));
+		for (GLint element = 0; element < arraySize; ++element) {
+			const GLuint elementLocation = static_cast<GLuint>(location + element);
+			if (elementLocation >= uniforms.size()) {
+				uniforms.resize(elementLocation + 1, Uniform{ 0, 0, 0 });
+			}
+			// values of a linked program are zero
+			uniforms[elementLocation] = { static_cast<GLenum>(params[1]), static_cast<uint32_t>(values.size()), components };
+			values.resize(values.size() + components, 0);
+
+			if (arraySize > 1) {
+				names[arrayName + "[" + std::to_string(element) + "]"] = elementLocation;
+			}
+			else {
+				names[name] = elementLocation;
+			}
+		}
+	}
+}
+
+bool Graphic::Shader::Update(GLuint location, const void* value, uint32_t components) const
+{
+	if (location == INVALID_LOCATION) {
+		return false;
+	}
+	if (location >= uniforms.size() || uniforms[location].components == 0) {
+		// inactive, e.g. a uniform of a feature a variant is compiled without, setting it would be an error
+		return names.empty();
+	}
+	if (uniforms[location].components != components) {
+		return true;
+	}
+
+	uint32_t* shadow = values.data() + uniforms[location].offset;
+	const size_t bytes = components * sizeof(uint32_t);
+	if (std::memcmp(shadow, value, bytes) == 0) {
+		return false;
+	}
+	std::memcpy(shadow, value, bytes);
+	return true;
 }
 
 void Graphic::Shader::CheckErorrStatus(GLuint program, GLenum type)
@@ -3,6 +3,17 @@
 
 namespace Graphic
 {
+	/**
+	*	\description: class Shader: program and a reflected table of its active uniforms. Uniform IDs are the locations
+	*	found at link time, the table shadows their current values, so a setter whose value did not change makes no GL
+	*	call. Values are set with glProgramUniform*, the program needs not to be in use.
+	*
+	*	\detail: uniforms must only be changed through the setters, or the shadow values are stale.
+	*
+	*	Linked programs are kept in a disk cache of program binaries, keyed by the sources and the driver, so later runs
+	*	skip compile and link. Where KHR_parallel_shader_compile is supported a compile only submits the program, the
+	*	driver compiles on its own threads and the status is checked on the first use of the program, see Resolve().
+	*/
 	class Shader
 	{
 	public:
@@ -17,23 +28,63 @@ namespace Graphic
 		void SetInt(GLuint location, GLint value) const;
 		void SetFloat(GLuint location, GLfloat value) const;
 
-		void SetVec2(GLuint location, const glm::vec2& value);
-		void SetVec2(GLuint location, GLfloat x, GLfloat y);
+		void SetVec2(GLuint location, const glm::vec2& value) const;
+		void SetVec2(GLuint location, GLfloat x, GLfloat y) const;
 
-		void SetVec3(GLuint location, glm::vec3& value) const;
+		void SetVec3(GLuint location, const glm::vec3& value) const;
 		void SetVec3(GLuint location, GLfloat x, GLfloat y, GLfloat z) const;
 
 		void SetVec4(GLuint location, const glm::vec4& value) const;
 		void SetVec4(GLuint location, GLfloat x, GLfloat y, GLfloat z, GLfloat w) const;
 
-		void SetMat3(GLuint location, glm::mat3& value) const;
-		void SetMat4(GLuint location, glm::mat4& value) const;
+		void SetMat3(GLuint location, const glm::mat3& value) const;
+		void SetMat4(GLuint location, const glm::mat4& value) const;
+
+		GLuint GetLocation(const char* name);	///< ID of an active uniform from the reflected table, INVALID_LOCATION if none
+		GLuint GetID() const { return shaderID; }
+		void Resolve();	///< waits for compile and link, checks them and reflects the program
+
+		static Shader* FindShader(GLuint program);	///< shader of a linked program, nullptr if unknown
+		static constexpr GLuint INVALID_LOCATION = 0xffffffff;
+		static constexpr const char* CACHE_DIRECTORY = "ShaderCache";
+		static constexpr uint32_t BINARY_MAGIC = 0x4e425250;	///< "PRBN"
 
-		GLuint GetLocation(const char* name);
-		GLuint GetID() { return shaderID; }
 	private:
+		/**
+		*	active uniform, value is a range of the shadow table, one 32 bits word per component
+		*/
+		struct Uniform
+		{
+			GLenum type;
+			uint32_t offset;
+			uint32_t components;
+		};
+
+		/**
+		*	header of a cached program binary, the binary follows it
+		*/
+		struct BinaryHeader
+		{
+			uint32_t magic;
+			GLenum format;
+			uint64_t key;
+			uint32_t length;
+			uint32_t padding;
+		};
+
 		GLuint shaderID;
+		GLuint pendingShaders[3];	///< vertex, fragment and geometry shader of a link in progress, 0 if unused
+		bool isPending;				///< compile and link are submitted, their status is not checked yet
+		uint64_t cacheKey;			///< of the program binary, 0 if binaries are not supported
+		std::vector<Uniform> uniforms;				///< indexed by location, type 0 for unused locations
+		mutable std::vector<uint32_t> values;		///< shadow values
+		std::map<std::string, GLuint> names;	///< uniform name to location, used at initialization only
+
 		void CheckErorrStatus(GLuint program, GLenum type);
+		void Reflect();
+		bool LoadBinary();
+		void SaveBinary() const;
+		bool Update(GLuint location, const void* value, uint32_t components) const; ///< false if the value is unchanged
 
 	};
 
@@ -1,6 +1,7 @@
 #pragma once
 #include "Technique.h"
 #include "Shader.h"
+#include "Resources.h"
 
 class TriangleTech : public Technique
 {
@@ -15,19 +16,19 @@ public:
 
 	}
 
-	bool Init()
+	void Compile()
 	{
 		const char* vertexShader = R"(
 			#version 440 core
 			#define TRIANGLE_VERTEX_SHADER
+		)" FRAME_CONSTANTS_GLSL R"(
 
 			layout (location = 0) in vec3 pos;
 
-			uniform mat4 m4ProjectionView;
 			uniform mat4 m4Model;
 
 			void main(){
-				gl_Position = m4ProjectionView * m4Model * vec4(pos, 1.0);
+				gl_Position = frame.viewProjection * m4Model * vec4(pos, 1.0);
 			}
 		)";
 		const char* fragmentShader = R"(
@@ -43,24 +44,19 @@ public:
 		)";
 
 		shader = Resources::CreateShader(vertexShader, fragmentShader);
-		glm::mat4 projectionView(1.f);
+	}
+
+	bool Init()
+	{
+		Compile();
 
 		shader->Use();
 		/**	get location */
-		projectionLocation = shader->GetLocation("m4ProjectionView");
 		modelLocation = shader->GetLocation("m4Model");
 
-		shader->SetMat4(projectionLocation, projectionView);
-
 		return true;
 	}
 
-	void SetProjection(glm::mat4& projectionView)
-	{
-		shader->Use();
-		shader->SetMat4(projectionLocation, projectionView);
-	}
-
 	void SetModel(glm::mat4& model)
 	{
 		shader->Use();
@@ -68,7 +64,6 @@ public:
 	}
 
 private:
-	GLuint projectionLocation;
 	GLuint modelLocation;
 };
 class Triangle : public Graphic::RenderTarget
@@ -101,11 +96,6 @@ public:
 
 	}
 
-	void SetProjectionView(glm::mat4& projectionView)
-	{
-		technique->SetProjection(projectionView);
-	}
-
 	~Triangle()
 	{
 		SafeDelete(technique);
@@ -134,6 +124,8 @@ private:
 class CubeTech : public Technique
 {
 public:
+	static constexpr Features TEXTURED = 1 << 0;	///< the color is modulated by sampler1
+
 	CubeTech()
 		:Technique()
 	{
@@ -142,76 +134,89 @@ public:
 	{
 	}
 
+	void Compile()
+	{
+		shader = CompileVariant(0);
+	}
+
 	bool Init()
+	{
+		// untextured until a texture is set
+		SelectVariant(0);
+		shader->Use();
+
+		return true;
+	}
+	void SetModel(glm::mat4& model)
+	{
+		shader->Use();
+		shader->SetMat4(MODEL_LOCATION, model);
+	}
+	void ToggleTexture(bool status)
+	{
+		SelectVariant(status ? (features | TEXTURED) : (features & ~TEXTURED));
+	}
+
+protected:
+	Graphic::Shader* CompileVariant(Features features)
 	{
 		const char* vertexShader = R"(
 			#version 440 core
 			#define CUBE_VERTEX_SHADER
+		)" FRAME_CONSTANTS_GLSL R"(
 
 			layout (location = 0) in vec3 av3Position;
 			layout (location = 1) in vec2 av2TextureCoord;
 
-			uniform mat4 m4ProjectionView;
-			uniform mat4 m4Model;
+			layout (location = 0) uniform mat4 m4Model;
 
 			out vec2 v2TextureCoord;
 
 			void main(){
 				v2TextureCoord = av2TextureCoord;
-				gl_Position = m4ProjectionView * m4Model * vec4(av3Position, 1.0);
+				gl_Position = frame.viewProjection * m4Model * vec4(av3Position, 1.0);
 			}
 		)";
 		const char* fragmentShader = R"(
 			#version 440 core
 			#define CUBE_FRAGMENT_SHADER
 
+			#ifdef TEXTURED
 			uniform sampler2D sampler1;
-			uniform vec4 v4Color;
-			uniform bool toggleTexture;
+			#endif
 			
 			in vec2 v2TextureCoord;
 			
 			out vec4 fragColor;
 
 			void main(){
-				if(toggleTexture){
-					fragColor = vec4(0.9f, 0.8f, 0.6f, 1.f) * texture(sampler1, v2TextureCoord);
-				}else{				
-					fragColor = vec4(0.9f, 0.8f, 0.6f, 1.f);
-				}
+			#ifdef TEXTURED
+				fragColor = vec4(0.9f, 0.8f, 0.6f, 1.f) * texture(sampler1, v2TextureCoord);
+			#else
+				fragColor = vec4(0.9f, 0.8f, 0.6f, 1.f);
+			#endif
 			}
 		)";
 
-		shader = Resources::CreateShader(vertexShader, fragmentShader);
-		glm::mat4 projectionView(1.f);
-
-		shader->Use();
-		/** get location */
-		projectionLocation = shader->GetLocation("m4ProjectionView");
-		toggleTextureLocation = shader->GetLocation("m4Model");
-		toggleTextureLocation = shader->GetLocation("toggleTexture");
-
-		shader->SetMat4(projectionLocation, projectionView);
-		shader->SetBool(toggleTextureLocation, GL_FALSE);
+		static const Feature FEATURES[] = { { TEXTURED, "TEXTURED" } };
+		std::string fsCode = Specialize(fragmentShader, features, FEATURES, 1);
 
-		return true;
+		return Resources::CreateShader(vertexShader, fsCode.c_str());
 	}
-	void SetProjection(glm::mat4& projectionView)
+	void InitVariant(Graphic::Shader* variant)
 	{
-		shader->Use();
-		shader->SetMat4(projectionLocation, projectionView);
-	}
-
-	void SetModel(glm::mat4& model)
-	{
-		shader->Use();
-		shader->SetMat4(modelLocation, model);
+		glm::mat4 model(1.f);
+		variant->SetMat4(MODEL_LOCATION, model);
 	}
 
 private:
-	GLuint projectionLocation;
-	GLuint modelLocation;
-	GLuint toggleTextureLocation;
+	/**
+	*	explicit uniform locations of the shaders
+	*/
+	enum UniformLocation : GLuint
+	{
+		MODEL_LOCATION = 0
+	};
 
 };
 class Cube : public Graphic::RenderTarget
@@ -271,11 +276,6 @@ public:
 	}
 
 
-	void SetProjectionView(glm::mat4& projectionView)
-	{	
-		cubeTech->SetProjection(projectionView);
-	}
-
 	bool Render(float dt)
 	{
 		static glm::mat4 model(1.f);
@@ -0,0 +1,165 @@
+#include "StreamBuffer.h"
+#include "Renderer.h"
+
+Graphic::StreamBuffer::StreamBuffer(GLenum target, size_t regionSize, GLuint regionCount)
+	:target(target), buffer(0), regionSize(regionSize), regionCount(regionCount), currentRegion(0), writeOffset(0),
+	capturedOffset(0), persistent(false), mapped(false), mappedPointer(nullptr), mappedOffset(0), mappedSize(0),
+	fences(regionCount, nullptr)
+{
+}
+
+Graphic::StreamBuffer::~StreamBuffer()
+{
+	for (GLsync& fence : fences) {
+		if (fence) {
+			GLDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
+
+	if (buffer != 0) {
+		GLBindBuffer(target, buffer);
+		if (persistent) {
+			GLCall(glUnmapBuffer(target));
+		}
+		GLDeleteBuffers(1, &buffer);
+	}
+}
+
+bool Graphic::StreamBuffer::Init()
+{
+	if (buffer != 0) {
+		return true;
+	}
+	if (regionSize == 0 || regionCount == 0) {
+		throw std::invalid_argument("Exception: Graphic::StreamBuffer::Init(): Empty stream buffer!");
+	}
+
+	GLGenBuffers(1, &buffer);
+	GLBindBuffer(target, buffer);
+
+	persistent = GLEW_ARB_buffer_storage != GL_FALSE;
+	if (persistent) {
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		GLBufferStorage(target, regionSize * regionCount, nullptr, flags);
+		mappedPointer = static_cast<unsigned char*>(glMapBufferRange(target, 0, regionSize * regionCount, flags));
+		if (mappedPointer == nullptr) {
+			throw std::runtime_error("Exception: Graphic::StreamBuffer::Init(): Map persistent buffer failed!");
+		}
+	}
+	else {
+		// orphaning needs only one region
+		regionCount = 1;
+		fences.resize(1, nullptr);
+		GLBufferData(target, regionSize, nullptr, GL_STREAM_DRAW);
+	}
+
+	return true;
+}
+
+void Graphic::StreamBuffer::BeginFrame()
+{
+	writeOffset = 0;
+	capturedOffset = 0;
+
+	if (!persistent) {
+		GLBindBuffer(target, buffer);
+		GLBufferData(target, regionSize, nullptr, GL_STREAM_DRAW);
+		return;
+	}
+
+	/**
+	*	move to the next region and wait until the GPU has finished the frame which used it
+	*/
+	currentRegion = (currentRegion + 1) % regionCount;
+	GLsync& fence = fences[currentRegion];
+	if (fence) {
+		GLbitfield waitFlags = 0;
+		GLuint64 timeout = 0;
+		while (true) {
+			GLenum result = GLClientWaitSync(fence, waitFlags, timeout);
+			if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED) {
+				break;
+			}
+			// flush once, then block
+			waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+			timeout = 1000000000ull;
+		}
+		GLDeleteSync(fence);
+		fence = nullptr;
+	}
+}
+
+void Graphic::StreamBuffer::EndFrame()
+{
+	if (!persistent) {
+		return;
+	}
+	fences[currentRegion] = GLFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void* Graphic::StreamBuffer::Map(size_t size, size_t alignment, GLintptr& offset)
+{
+	// reserve the range lock-free, recorders may allocate concurrently
+	size_t currentOffset = writeOffset.load();
+	size_t alignedOffset = 0;
+	do {
+		alignedOffset = alignment > 1 ? (currentOffset + alignment - 1) / alignment * alignment : currentOffset;
+		if (alignedOffset + size > regionSize) {
+			Debug::ShowMessage("Graphic::StreamBuffer::Map(): region of current frame is exhausted.");
+			return nullptr;
+		}
+	} while (!writeOffset.compare_exchange_weak(currentOffset, alignedOffset + size));
+	offset = static_cast<GLintptr>(currentRegion * regionSize + alignedOffset);
+
+	if (persistent) {
+		return mappedPointer + offset;
+	}
+
+	// the storage was orphaned at the beginning of the frame, no one reads this range
+	GLBindBuffer(target, buffer);
+	void* pointer = glMapBufferRange(target, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	mapped = pointer != nullptr;
+	mappedPointer = static_cast<unsigned char*>(pointer);
+	mappedOffset = offset;
+	mappedSize = size;
+
+	return pointer;
+}
+
+void Graphic::StreamBuffer::Unmap()
+{
+	if (persistent || !mapped) {
+		return;
+	}
+	GLBindBuffer(target, buffer);
+	// the trace sees the range as an upload
+	GLTrace::RecordData(GLTrace::Call::BUFFER_CONTENTS, mappedPointer, mappedSize, buffer, mappedOffset, mappedSize);
+	GLCall(glUnmapBuffer(target));
+	mapped = false;
+	mappedPointer = nullptr;
+}
+
+void Graphic::StreamBuffer::Capture()
+{
+	if (!persistent || !GLTrace::IsCapturing()) {
+		return;
+	}
+	const size_t written = writeOffset.load();
+	if (written <= capturedOffset) {
+		return;
+	}
+	const size_t offset = currentRegion * regionSize + capturedOffset;
+	GLTrace::RecordData(GLTrace::Call::BUFFER_CONTENTS, mappedPointer + offset, written - capturedOffset, buffer, offset, written - capturedOffset);
+	capturedOffset = written;
+}
+
+GLuint Graphic::StreamBuffer::GetBuffer() const
+{
+	return buffer;
+}
+
+bool Graphic::StreamBuffer::IsPersistent() const
+{
+	return persistent;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "Utility.h"
+
+namespace Graphic
+{
+	class StreamBuffer;
+}
+
+/**
+*	\description: class StreamBuffer: ring buffer for dynamic data written every frame.
+*	The buffer is split into one region per frame in flight, it is mapped once with GL_MAP_PERSISTENT_BIT and
+*	GL_MAP_COHERENT_BIT, and a fence guards each region so the CPU never writes what the GPU is still reading.
+*
+*	\detail: without ARB_buffer_storage the buffer is orphaned by glBufferData at the beginning of each frame,
+*	and every Map() maps an unsynchronized range of the fresh storage.
+*	Map() of a persistent buffer touches no GL and may be called from worker threads, the fallback is GL thread only.
+*/
+class Graphic::StreamBuffer
+{
+public:
+	StreamBuffer(GLenum target, size_t regionSize, GLuint regionCount = 3);
+	StreamBuffer(const StreamBuffer& streamBuffer) = delete;
+	~StreamBuffer();
+
+	bool Init();
+
+	void BeginFrame();
+	void EndFrame();
+
+	void* Map(size_t size, size_t alignment, GLintptr& offset);
+	void Unmap();
+	void Capture(); ///< records the data written since the last capture into the running GL trace, GL thread only
+
+	GLuint GetBuffer() const;
+	bool IsPersistent() const;
+
+private:
+	GLenum target;
+	GLuint buffer;
+
+	size_t regionSize;
+	GLuint regionCount;
+	GLuint currentRegion;
+	std::atomic<size_t> writeOffset; ///< write head inside current region
+	size_t capturedOffset; ///< data before it is in the GL trace
+
+	bool persistent;
+	bool mapped;	///< a range is mapped in fallback mode
+	unsigned char* mappedPointer; ///< whole buffer in persistent mode, the mapped range in fallback mode
+	GLintptr mappedOffset;	///< of the range mapped in fallback mode
+	size_t mappedSize;
+	std::vector<GLsync> fences;
+
+};
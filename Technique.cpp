@@ -3,7 +3,7 @@
 #include "Renderer.h"
 
 Technique::Technique()
-	:shader(nullptr)
+	:shader(nullptr), features(0), variants()
 {
 }
 
@@ -16,3 +16,79 @@ void Technique::Use()
 	shader->Use();
 	//Graphic::GLEnable(GL_DEPTH_TEST);
 }
+
+void Technique::Use(Graphic::CommandBuffer* commandBuffer) const
+{
+	commandBuffer->UseProgram(GetProgram());
+}
+
+GLuint Technique::GetProgram() const
+{
+	if (shader == nullptr) {
+		return 0;
+	}
+	return shader->GetID();
+}
+
+void Technique::Precompile(Features features)
+{
+	if (variants.find(features) == variants.end()) {
+		CompileVariant(features);
+	}
+}
+
+GLuint Technique::GetProgram(Features features)
+{
+	return GetVariant(features)->GetID();
+}
+
+void Technique::SelectVariant(Features features)
+{
+	shader = GetVariant(features);
+	this->features = features;
+}
+
+Graphic::Shader* Technique::CompileVariant(Features features)
+{
+	Compile();
+	return shader;
+}
+
+void Technique::InitVariant(Graphic::Shader* variant)
+{
+}
+
+std::string Technique::Specialize(const char* code, Features features, const Feature* table, size_t count)
+{
+	std::string specialized(code);
+	std::string defines;
+	for (size_t index = 0; index < count; ++index) {
+		if (features & table[index].bit) {
+			defines.append("#define ").append(table[index].define).append("\n");
+		}
+	}
+
+	// #version must stay the first statement
+	size_t position = specialized.find("#version");
+	position = position == std::string::npos ? 0 : specialized.find('\n', position);
+	position = position == std::string::npos ? specialized.size() : position + 1;
+	specialized.insert(position, defines);
+
+	return specialized;
+}
+
+Graphic::Shader* Technique::GetVariant(Features features)
+{
+	auto variant = variants.find(features);
+	if (variant != variants.end()) {
+		return variant->second;
+	}
+
+	// compiled by an earlier request or by Resources::CompileTechniques(), Resources returns the same shader
+	Graphic::Shader* created = CompileVariant(features);
+	created->Resolve();
+	InitVariant(created);
+	variants[features] = created;
+
+	return created;
+}
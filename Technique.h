@@ -1,23 +1,65 @@
 #pragma once
+#include "Utility.h"
 
 namespace Graphic
 {
 	class Shader;
 	class Renderer;
+	class CommandBuffer;
 }
 
 
+/**
+*	\description: class Technique: program of a kind of draw and the uniforms it sets. Compile() only submits the program,
+*	its compilation may still run on the threads of the driver, Init() calls it and waits for the program on its first
+*	use, see Graphic::Shader.
+*
+*	\detail: a technique may declare features, each one a bit of Features and a #define of its shaders, in place of
+*	branches on uniforms. Every combination is a variant, a program of its own which is created on its first request
+*	and shared through Resources. Uniforms of the variants have explicit locations, so a location is the same in all
+*	of them, and the setters set the uniforms of the selected variant.
+*/
 class Technique
 {
 public:
+	typedef uint32_t Features;	///< feature bits of a variant
+
 	Technique();
 	virtual ~Technique();
 
+	virtual void Compile() = 0;
 	virtual bool Init() = 0;
 	void Use();
+	void Use(Graphic::CommandBuffer* commandBuffer) const;
+	GLuint GetProgram() const;
+	void Precompile(Features features);		///< submits a variant without waiting for its compile
+	GLuint GetProgram(Features features);	///< program of a variant, created on its first request, GL thread only
+	void SelectVariant(Features features);	///< created on its first request, GL thread only
+	Features GetFeatures() const { return features; }
 
 protected:
+	/**
+	*	bit of a feature and the name it is defined with
+	*/
+	struct Feature
+	{
+		Features bit;
+		const char* define;
+	};
+
+	Graphic::Shader* shader;	///< selected variant
+	Features features;			///< of the selected variant
+	std::map<Features, Graphic::Shader*> variants;	///< initialized variants, the shaders are owned by Resources
+
+	virtual Graphic::Shader* CompileVariant(Features features);	///< the one program of a technique without features
+	virtual void InitVariant(Graphic::Shader* variant);			///< uniforms of a new variant, before it is selected
+
+	/**
+	*	defines of the features set in features, inserted right after the #version line of code
+	*/
+	static std::string Specialize(const char* code, Features features, const Feature* table, size_t count);
+
+private:
+	Graphic::Shader* GetVariant(Features features);
 
-	Graphic::Shader* shader;	
-	
 };
@@ -1,9 +1,13 @@
 #include "Utility.h"
-#include <Windows.h>
+#ifndef _WIN32
+#include <codecvt>
+#include <locale>
+#endif
 #include <cstdlib>
 #include <stdexcept>
 
 
+#ifdef _WIN32
 std::string Unicode::UnicodeToMultibytes(const wchar_t* text)
 {
 	int num = WideCharToMultiByte(CP_ACP, 0, text, -1, nullptr, 0, nullptr, FALSE);
@@ -19,14 +23,30 @@ std::string Unicode::UnicodeToMultibytes(const wchar_t* text)
 std::wstring Unicode::MultibytesToUnicode(const char* text)
 {
 	int num = MultiByteToWideChar(CP_UTF8, 0, text, -1, nullptr, 0);
-	LPWSTR buffer = new wchar_t(sizeof(wchar_t) * num);
-	MultiByteToWideChar(CP_UTF8, 0, text, num, buffer, sizeof(wchar_t) * num);
+	LPWSTR buffer = new wchar_t[num];
+	MultiByteToWideChar(CP_UTF8, 0, text, -1, buffer, num);
 
 	std::wstring result(buffer);
 	delete[] buffer;
 
 	return result;
 }
+#else
+/**
+*	the multibyte encoding is UTF-8 on the other platforms, wchar_t holds UTF-32
+*/
+std::string Unicode::UnicodeToMultibytes(const wchar_t* text)
+{
+	std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+	return converter.to_bytes(text);
+}
+
+std::wstring Unicode::MultibytesToUnicode(const char* text)
+{
+	std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+	return converter.from_bytes(text);
+}
+#endif // _WIN32
 
 unsigned int HashString::FNV_1A_Unicode(const wchar_t* str, size_t length)
 {
@@ -65,3 +85,146 @@ unsigned int HashString::FNV_1A_Multibyte(const char* str, size_t length)
 
 	return hashValue;
 }
+
+
+namespace
+{
+	thread_local bool t_insideParallelFor = false;
+}
+
+ThreadPool::ThreadPool(size_t threadCount)
+	:workers(), mutex(), wakeCondition(), doneCondition(), job(nullptr), jobCount(0), nextJob(0), finishedJobs(0),
+	activeWorkers(0), generation(0), stopping(false), error()
+{
+	for (size_t i = 0; i < threadCount; ++i) {
+		workers.emplace_back(&ThreadPool::WorkerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeCondition.notify_all();
+
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
+
+size_t ThreadPool::GetThreadCount() const
+{
+	return workers.size();
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& job)
+{
+	if (count == 0) {
+		return;
+	}
+	if (workers.empty() || count == 1 || t_insideParallelFor) {
+		for (size_t i = 0; i < count; ++i) {
+			job(i);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->job = &job;
+		jobCount = count;
+		nextJob = 0;
+		finishedJobs = 0;
+		error = nullptr;
+		generation++;
+	}
+	wakeCondition.notify_all();
+
+	RunJobs(&job, count);
+
+	/**
+	*	wait for the jobs and for every woken worker, so no one touches the job after returning
+	*/
+	std::exception_ptr jobError;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		doneCondition.wait(lock, [this]() { return finishedJobs == jobCount && activeWorkers == 0; });
+		this->job = nullptr;
+		jobCount = 0;
+		jobError = error;
+		error = nullptr;
+	}
+
+	if (jobError) {
+		std::rethrow_exception(jobError);
+	}
+}
+
+ThreadPool& ThreadPool::GetInstance()
+{
+	static ThreadPool threadPool(std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 0);
+	return threadPool;
+}
+
+void ThreadPool::WorkerLoop()
+{
+	uint64_t seenGeneration = 0;
+	while (true) {
+		const std::function<void(size_t)>* currentJob = nullptr;
+		size_t currentCount = 0;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeCondition.wait(lock, [&]() { return stopping || generation != seenGeneration; });
+			if (stopping) {
+				return;
+			}
+			seenGeneration = generation;
+			currentJob = job;
+			currentCount = jobCount;
+			activeWorkers++;
+		}
+
+		if (currentJob) {
+			RunJobs(currentJob, currentCount);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			activeWorkers--;
+		}
+		doneCondition.notify_all();
+	}
+}
+
+void ThreadPool::RunJobs(const std::function<void(size_t)>* job, size_t jobCount)
+{
+	t_insideParallelFor = true;
+
+	size_t index = 0;
+	while ((index = nextJob.fetch_add(1)) < jobCount) {
+		try
+		{
+			(*job)(index);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!error) {
+				error = std::current_exception();
+			}
+		}
+
+		bool lastJob = false;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			lastJob = ++finishedJobs == jobCount;
+		}
+		if (lastJob) {
+			doneCondition.notify_all();
+		}
+	}
+
+	t_insideParallelFor = false;
+}
@@ -7,29 +7,64 @@
 #include <algorithm>
 #include <string>
 #include <list>	
+#include <vector>
 #include <set>
 #include <stack>
 #include <queue>
 #include <memory>
 #include <map>
 #include <stdexcept>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
 
-// windows API
+// windows API, the shims below cover the few calls used outside of it
+#ifdef _WIN32
 #include <Windows.h>
+#else
+#include <cstring>
+#include <cwchar>
+
+#ifndef MAX_PATH
+#define MAX_PATH 260
+#endif
+
+inline int memcpy_s(void* destination, size_t destinationSize, const void* source, size_t count)
+{
+	if (count > destinationSize) {
+		return -1;
+	}
+	memcpy(destination, source, count);
+	return 0;
+}
+
+inline size_t wcsnlen_s(const wchar_t* text, size_t maxCount)
+{
+	return text ? wcsnlen(text, maxCount) : 0;
+}
+#endif // _WIN32
 
 // GLEW
 #define GLEW_STATIC
 #include <GL/glew.h>
-#include <GL/GL.h>
-#include <GL/GLU.h>
+#include <GL/gl.h>
+#include <GL/glu.h>
 
+#ifdef _MSC_VER
 #pragma comment(lib, "glew32S.lib")
 #pragma comment(lib, "opengl32.lib")
+#endif
 
 //GLFW
 #include <GLFW/glfw3.h>
 
+#ifdef _MSC_VER
 #pragma comment(lib, "glfw3.lib")
+#endif
 
 // glm math library
 #include <glm/glm.hpp>
@@ -53,6 +88,41 @@ public:
 	static unsigned int FNV_1A_Multibyte(const char* str, size_t length);
 };
 
+/**
+*	fixed pool of worker threads, ParallelFor() runs job(0) ... job(count - 1) on the workers and the calling thread,
+*	and returns when all of them are done. A nested ParallelFor() runs sequentially.
+*/
+class ThreadPool
+{
+public:
+	explicit ThreadPool(size_t threadCount);
+	ThreadPool(const ThreadPool& threadPool) = delete;
+	~ThreadPool();
+
+	size_t GetThreadCount() const;
+	void ParallelFor(size_t count, const std::function<void(size_t)>& job);
+
+	static ThreadPool& GetInstance();
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wakeCondition;
+	std::condition_variable doneCondition;
+
+	const std::function<void(size_t)>* job;
+	size_t jobCount;
+	std::atomic<size_t> nextJob;
+	size_t finishedJobs;
+	size_t activeWorkers;
+	uint64_t generation;
+	bool stopping;
+	std::exception_ptr error; ///< first exception thrown by a job, rethrown by ParallelFor()
+
+	void WorkerLoop();
+	void RunJobs(const std::function<void(size_t)>* job, size_t jobCount);
+};
+
 template <typename _Ty>
 void SafeDelete(_Ty*& ptr)
 {
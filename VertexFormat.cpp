@@ -0,0 +1,145 @@
+#include "VertexFormat.h"
+
+#include <cstring>
+
+namespace
+{
+	inline float Saturate(float value, float minimum, float maximum)
+	{
+		return value < minimum ? minimum : (value > maximum ? maximum : value);
+	}
+
+	inline float SignNotZero(float value)
+	{
+		return value >= 0.f ? 1.f : -1.f;
+	}
+
+	/**
+	*	smallest |w| which keeps its sign at 8 bits
+	*/
+	constexpr float MIN_TANGENT_FRAME_W = 1.f / 127.f;
+}
+
+uint16_t Graphic::VertexPacking::PackUnorm16(float value)
+{
+	return static_cast<uint16_t>(Saturate(value, 0.f, 1.f) * 65535.f + 0.5f);
+}
+
+int16_t Graphic::VertexPacking::PackSnorm16(float value)
+{
+	return static_cast<int16_t>(std::round(Saturate(value, -1.f, 1.f) * 32767.f));
+}
+
+int8_t Graphic::VertexPacking::PackSnorm8(float value)
+{
+	return static_cast<int8_t>(std::round(Saturate(value, -1.f, 1.f) * 127.f));
+}
+
+uint16_t Graphic::VertexPacking::PackHalf(float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	const uint32_t sign = (bits >> 16) & 0x8000;
+	const uint32_t exponent = (bits >> 23) & 0xff;
+	uint32_t mantissa = bits & 0x7fffff;
+
+	// infinity and NaN
+	if (exponent == 0xff) {
+		return static_cast<uint16_t>(sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+	}
+
+	const int halfExponent = static_cast<int>(exponent) - 127 + 15;
+	if (halfExponent >= 31) {
+		return static_cast<uint16_t>(sign | 0x7c00);
+	}
+
+	// subnormal halves keep the implicit bit in their mantissa
+	if (halfExponent <= 0) {
+		if (halfExponent < -10) {
+			return static_cast<uint16_t>(sign);
+		}
+		mantissa |= 0x800000;
+		const uint32_t shift = static_cast<uint32_t>(14 - halfExponent);
+		uint32_t half = mantissa >> shift;
+		const uint32_t rest = mantissa & ((1u << shift) - 1);
+		const uint32_t halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1))) {
+			half++;
+		}
+		return static_cast<uint16_t>(sign | half);
+	}
+
+	// rounding may carry into the exponent, up to infinity
+	uint32_t half = (static_cast<uint32_t>(halfExponent) << 10) | (mantissa >> 13);
+	const uint32_t rest = mantissa & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+		half++;
+	}
+	return static_cast<uint16_t>(sign | half);
+}
+
+glm::vec2 Graphic::VertexPacking::EncodeOctahedral(const glm::vec3& normal)
+{
+	const float sum = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+	if (sum <= 0.f) {
+		return glm::vec2(0.f);
+	}
+
+	const glm::vec3 n = normal / sum;
+	if (n.z >= 0.f) {
+		return glm::vec2(n.x, n.y);
+	}
+	// the lower hemisphere is folded over the diagonals
+	return glm::vec2((1.f - std::abs(n.y)) * SignNotZero(n.x), (1.f - std::abs(n.x)) * SignNotZero(n.y));
+}
+
+glm::vec4 Graphic::VertexPacking::EncodeTangentFrame(const glm::vec3& normal, const glm::vec3& tangent, const glm::vec3& bitangent)
+{
+	/**
+	*	orthonormal frame around the normal, meshes without tangents get an arbitrary one
+	*/
+	glm::vec3 n = glm::dot(normal, normal) > 0.f ? glm::normalize(normal) : glm::vec3(0.f, 0.f, 1.f);
+	glm::vec3 t = tangent - n * glm::dot(n, tangent);
+	if (glm::dot(t, t) <= 1e-12f) {
+		t = std::abs(n.x) < 0.9f ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f);
+		t = t - n * glm::dot(n, t);
+	}
+	t = glm::normalize(t);
+	const glm::vec3 b = glm::cross(n, t);
+	const float handedness = glm::dot(b, bitangent) < 0.f ? -1.f : 1.f;
+
+	/**
+	*	quaternion of the rotation whose columns are tangent, bitangent, normal
+	*/
+	glm::vec4 q;
+	const float trace = t.x + b.y + n.z;
+	if (trace > 0.f) {
+		const float s = std::sqrt(trace + 1.f) * 2.f;
+		q = glm::vec4((b.z - n.y) / s, (n.x - t.z) / s, (t.y - b.x) / s, 0.25f * s);
+	}
+	else if (t.x > b.y && t.x > n.z) {
+		const float s = std::sqrt(1.f + t.x - b.y - n.z) * 2.f;
+		q = glm::vec4(0.25f * s, (b.x + t.y) / s, (n.x + t.z) / s, (b.z - n.y) / s);
+	}
+	else if (b.y > n.z) {
+		const float s = std::sqrt(1.f + b.y - t.x - n.z) * 2.f;
+		q = glm::vec4((b.x + t.y) / s, 0.25f * s, (n.y + b.z) / s, (n.x - t.z) / s);
+	}
+	else {
+		const float s = std::sqrt(1.f + n.z - t.x - b.y) * 2.f;
+		q = glm::vec4((n.x + t.z) / s, (n.y + b.z) / s, 0.25f * s, (t.y - b.x) / s);
+	}
+	q = glm::normalize(q);
+
+	// q and -q are the same rotation, w >= 0 frees its sign for the handedness
+	if (q.w < 0.f) {
+		q = -q;
+	}
+	if (q.w < MIN_TANGENT_FRAME_W) {
+		const glm::vec3 axis(q.x, q.y, q.z);
+		const float length = glm::length(axis);
+		const float scale = length > 0.f ? std::sqrt(1.f - MIN_TANGENT_FRAME_W * MIN_TANGENT_FRAME_W) / length : 0.f;
+		q = glm::vec4(axis * scale, MIN_TANGENT_FRAME_W);
+	}
+	return q * handedness;
+}
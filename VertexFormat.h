@@ -0,0 +1,87 @@
+#pragma once
+#include "Utility.h"
+#include "Renderer.h"
+
+namespace Graphic
+{
+	template<GLuint Layout, GLint Components, GLenum Type, GLboolean Normalized, size_t Offset>
+	struct VertexAttribute;
+
+	template<typename Vertex, typename... Attributes>
+	struct VertexFormat;
+
+	class VertexPacking;
+}
+
+/**
+*	\description: struct VertexAttribute: one attribute of an interleaved vertex, offset in bytes
+*/
+template<GLuint Layout, GLint Components, GLenum Type, GLboolean Normalized, size_t Offset>
+struct Graphic::VertexAttribute
+{
+	static void Apply(Primitive* primitive, size_t stride)
+	{
+		primitive->AttribFormat(Layout, Components, Type, Normalized, stride, Offset);
+	}
+};
+
+/**
+*	\description: struct VertexFormat: compile-time layout of a vertex type, Apply() sets the attribute pointers of the
+*	vertex buffer attached to a primitive, so the stride and offsets always follow the struct. e.g.
+*		typedef VertexFormat<Vertex, VertexAttribute<0, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, position)>> Format;
+*/
+template<typename Vertex, typename... Attributes>
+struct Graphic::VertexFormat
+{
+	static constexpr size_t STRIDE = sizeof(Vertex);
+	static constexpr size_t ATTRIBUTE_COUNT = sizeof...(Attributes);
+
+	static void Apply(Primitive* primitive)
+	{
+		// one call per attribute, in declaration order
+		int expand[] = { 0, (Attributes::Apply(primitive, STRIDE), 0)... };
+		(void)expand;
+	}
+};
+
+/**
+*	\description: class VertexPacking: conversions of vertex attributes into compact GPU formats, PACKED_VERTEX_GLSL
+*	decodes them in shaders.
+*
+*	\detail: tangent frames are quaternions whose sign of w keeps the handedness of the bitangent, w never rounds
+*	to zero at 8 bits, so the sign survives quantization.
+*/
+class Graphic::VertexPacking
+{
+public:
+	static uint16_t PackUnorm16(float value);	///< [0, 1]
+	static int16_t PackSnorm16(float value);	///< [-1, 1]
+	static int8_t PackSnorm8(float value);		///< [-1, 1]
+	static uint16_t PackHalf(float value);		///< IEEE half float, rounded to nearest
+
+	static glm::vec2 EncodeOctahedral(const glm::vec3& normal); ///< unit vector into [-1, 1]^2
+	static glm::vec4 EncodeTangentFrame(const glm::vec3& normal, const glm::vec3& tangent, const glm::vec3& bitangent);
+};
+
+/**
+*	GLSL decoders of VertexPacking, insert it after the #version line of a shader
+*/
+#define PACKED_VERTEX_GLSL \
+	"\nvec3 DecodeOctahedral(vec2 e)\n" \
+	"{\n" \
+	"	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));\n" \
+	"	float t = max(-n.z, 0.0);\n" \
+	"	n.x += n.x >= 0.0 ? -t : t;\n" \
+	"	n.y += n.y >= 0.0 ? -t : t;\n" \
+	"	return normalize(n);\n" \
+	"}\n" \
+	"vec3 RotateByQuaternion(vec4 q, vec3 v)\n" \
+	"{\n" \
+	"	return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);\n" \
+	"}\n" \
+	"void DecodeTangentFrame(vec4 frame, out vec3 tangent, out vec3 bitangent)\n" \
+	"{\n" \
+	"	vec4 q = normalize(frame);\n" \
+	"	tangent = RotateByQuaternion(q, vec3(1.0, 0.0, 0.0));\n" \
+	"	bitangent = RotateByQuaternion(q, vec3(0.0, 1.0, 0.0)) * (q.w < 0.0 ? -1.0 : 1.0);\n" \
+	"}\n"
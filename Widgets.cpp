@@ -49,9 +49,7 @@ bool Widgets::Rect::Init()
 	
 	rectTech->Init();
 
-	glm::mat4 projection = glm::ortho(0.f, static_cast<float>(Window::GetWindowWidth()), 0.f, static_cast<float>(Window::GetWindowHeight()));
-	// set clolor, texture and projection
-	rectTech->SetProjection(projection);
+	// set clolor and texture, projection comes from the frame constants
 	rectTech->SetColor(color);
 	rectTech->ToggleTexture(false);
 
@@ -127,6 +125,23 @@ bool Widgets::Rect::Render(float dt)
 	return true;
 }
 
+void Widgets::Rect::Record(Graphic::CommandBuffer* commandBuffer) const
+{
+	glm::vec2 center(left + (right - left) / 2.f, bottom + (top - bottom) / 2.f);
+	glm::vec2 size(right - left, top - bottom);
+
+	commandBuffer->Disable(GL_DEPTH_TEST);
+
+	rectTech->Use(commandBuffer);
+	rectTech->SetCenter(center, commandBuffer);
+	rectTech->SetSize(size, commandBuffer);
+	rectTech->SetColor(color, commandBuffer);
+	rectTech->SetRadius((top - bottom) * 0.2f, commandBuffer);
+	primitive->Record(commandBuffer);
+
+	commandBuffer->Enable(GL_DEPTH_TEST);
+}
+
 bool Widgets::Rect::operator==(const Rect& rect) const
 {
 	if (this->left == rect.left && this->right == rect.right && this->top == rect.top && this->bottom == rect.bottom) {
@@ -162,9 +177,10 @@ void Widgets::Font::LoadFont(const wchar_t* fontPath)
 {
 	fontTech->Init();
 	
-	primitive->CreateBuffer(GL_ARRAY_BUFFER);
-	primitive->AttachBuffer(GL_ARRAY_BUFFER, sizeof(GLfloat) * 6 * 4, nullptr, GL_DYNAMIC_DRAW);
+	// glyph quads are written into the stream buffer of renderer every frame
+	primitive->ShareBuffer(GL_ARRAY_BUFFER, Graphic::Renderer::GetStreamBuffer()->GetBuffer());
 	primitive->AttribPointer(0, 4, 4, 0);
+	primitive->DetachBuffer();
 
 	std::string path(Unicode::UnicodeToMultibytes(fontPath));
 	if (FT_Init_FreeType(&ft)) {
@@ -181,7 +197,7 @@ void Widgets::Font::LoadFont(const wchar_t* fontPath)
 		FT_Set_Pixel_Sizes(face, 0, 48);
 
 		// disable byte-alignment restriction
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		Graphic::GLPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 	}
 	// set unicode char map
 	FT_Select_Charmap(face, ft_encoding_unicode);
@@ -259,24 +275,109 @@ void Widgets::Font::Render2DText(glm::vec2& pos, glm::vec4& color, float scale,
 	GLDisable(GL_DEPTH_TEST);
 	GLBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+	// load missing glyphs first, nothing else may touch GL while the stream range is mapped
+	for (wchar_t c : text) {
+		if (charSet.end() == charSet.find(c)) {
+			AddCharacter(c);
+		}
+	}
+
+	GLint first = WriteQuads(pos, scale, text);
+	if (first < 0) {
+		GLDisable(GL_CULL_FACE);
+		GLEnable(GL_DEPTH_TEST);
+		return;
+	}
+
+	// one draw per glyph texture, no upload between them
+	for (wchar_t c : text) {
+		fontTech->BindTexture(charSet.at(c).textureID);
+		primitive->RenderRange(first, 6);
+		first += 6;
+	}
+
+	// end of rendering
+	GLDisable(GL_CULL_FACE);
+	GLEnable(GL_DEPTH_TEST);
+	GLBindTexture(GL_TEXTURE_2D, 0);
+
+	primitive->DetachBuffer();
+}
+
+bool Widgets::Font::Record2DText(Graphic::CommandBuffer* commandBuffer, const glm::vec2& pos, const glm::vec4& color, float scale, const std::wstring& text)
+{
+	using namespace Graphic;
+
+	if (!isInitialzied) {
+		throw std::invalid_argument("Exception: Widgets::Font::Record2DText(): No font has been loaded!");
+	}
+
+	/**
+	*	loading a glyph or mapping a range of an orphaned buffer calls GL, such text is rendered on the GL thread
+	*/
+	if (!Renderer::GetStreamBuffer()->IsPersistent()) {
+		return false;
+	}
+	for (wchar_t c : text) {
+		if (charSet.end() == charSet.find(c)) {
+			return false;
+		}
+	}
+
+	GLint first = WriteQuads(pos, scale, text);
+	if (first < 0) {
+		return true;
+	}
+
+	commandBuffer->Enable(GL_CULL_FACE);
+	commandBuffer->Enable(GL_BLEND);
+	commandBuffer->Disable(GL_DEPTH_TEST);
+	commandBuffer->BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	fontTech->Use(commandBuffer);
+	fontTech->SetColor(color, commandBuffer);
+
+	for (wchar_t c : text) {
+		fontTech->BindTexture(charSet.at(c).textureID, commandBuffer);
+		primitive->RecordRange(commandBuffer, first, 6);
+		first += 6;
+	}
+
+	commandBuffer->Disable(GL_CULL_FACE);
+	commandBuffer->Enable(GL_DEPTH_TEST);
+	commandBuffer->BindTexture(GL_TEXTURE_2D, 0);
+
+	return true;
+}
+
+GLint Widgets::Font::WriteQuads(const glm::vec2& pos, float scale, const std::wstring& text)
+{
+	/**
+	*	write all quads of the text into one allocation of the stream buffer, all glyphs must have been loaded.
+	*	returns the first vertex of the quads, or -1 when the stream buffer is exhausted
+	*/
+	const size_t VERTEX_SIZE = sizeof(GLfloat) * 4;
+	const size_t QUAD_VERTICES = 6;
+	Graphic::StreamBuffer* streamBuffer = Graphic::Renderer::GetStreamBuffer();
+	GLintptr offset = 0;
+	GLfloat* vertices = static_cast<GLfloat*>(streamBuffer->Map(text.size() * QUAD_VERTICES * VERTEX_SIZE, VERTEX_SIZE, offset));
+	if (vertices == nullptr) {
+		return -1;
+	}
+
 	GLfloat x = pos.x;
 	GLfloat y = pos.y;
 
 	for (wchar_t c : text) {
-		// query whether the character is existed
-		auto charInfo = charSet.find(c);
-		if (charSet.end() == charInfo) {
-			AddCharacter(c);
-			charInfo = charSet.find(c);
-		}
+		const CharInfo& charInfo = charSet.at(c);
 
-		GLfloat xPos = x + static_cast<GLfloat>(charInfo->second.bearingX) * scale;
-		GLfloat yPos = y - static_cast<GLfloat>(charInfo->second.height - charInfo->second.bearingY) * scale;
+		GLfloat xPos = x + static_cast<GLfloat>(charInfo.bearingX) * scale;
+		GLfloat yPos = y - static_cast<GLfloat>(charInfo.height - charInfo.bearingY) * scale;
 
-		GLfloat w = static_cast<GLfloat>(charInfo->second.width) * scale;
-		GLfloat h = static_cast<GLfloat>(charInfo->second.height) * scale;
+		GLfloat w = static_cast<GLfloat>(charInfo.width) * scale;
+		GLfloat h = static_cast<GLfloat>(charInfo.height) * scale;
 
-		GLfloat vertices[6][4] = {
+		const GLfloat quad[6][4] = {
 		{ xPos,     yPos + h,   0.0f, 0.0f },
 		{ xPos,     yPos,       0.0f, 1.0f },
 		{ xPos + w, yPos,       1.0f, 1.0f },
@@ -285,23 +386,15 @@ void Widgets::Font::Render2DText(glm::vec2& pos, glm::vec4& color, float scale,
 		{ xPos + w, yPos,       1.0f, 1.0f },
 		{ xPos + w, yPos + h,   1.0f, 0.0f }
 		};
-
-		fontTech->BindTexture(charInfo->second.textureID);
-
-		primitive->BufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-		primitive->Render(0.f);
+		memcpy(vertices, quad, sizeof(quad));
+		vertices += QUAD_VERTICES * 4;
 
 		// bitshift by 6 to get value in pixels (2^6 = 64 (divide amount of 1/64th pixels by 64 to get amount of pixels))
-		x += (charInfo->second.advance >> 6) * scale;
-
+		x += (charInfo.advance >> 6) * scale;
 	}
+	streamBuffer->Unmap();
 
-	// end of rendering
-	GLDisable(GL_CULL_FACE);
-	GLEnable(GL_DEPTH_TEST);
-	GLBindTexture(GL_TEXTURE_2D, 0);
-
-	primitive->DetachBuffer();
+	return static_cast<GLint>(offset / VERTEX_SIZE);
 }
 
 void Widgets::Font::GetCharacterSize(const wchar_t ch, float scale, float & width, float & height, float & advance, float & bearingY)
@@ -448,6 +541,16 @@ bool Widgets::StaticText::Render(float dt)
 	return true;
 }
 
+bool Widgets::StaticText::Record(Graphic::CommandBuffer* commandBuffer, float dt) const
+{
+	return font->Record2DText(commandBuffer, pos, color, scale, title);
+}
+
+const char* Widgets::StaticText::GetName() const
+{
+	return "StaticText";
+}
+
 bool Widgets::StaticText::Confirm(const Event& evt)
 {
 	/**
@@ -559,6 +662,14 @@ Widgets::BasicWidget::~BasicWidget()
 
 }
 
+void Widgets::BasicWidget::Submit(Graphic::RenderQueue* queue)
+{
+	/**
+	*	widgets are drawn in creation order on top of the scene
+	*/
+	queue->PushOrdered(this, Graphic::LAYER_UI, depth, 0, 0, primitive->GetVertexArray());
+}
+
 void Widgets::BasicWidget::SetActionHandler(Event::EventAction action, Event::ActionHandler handler)
 {
 	Event::ActionHandler* handle = GetActionHandler(action);
@@ -678,20 +789,38 @@ bool Widgets::Button::Update(float dt)
 	else {
 		currentColor = defaultColor;
 	}
+	// applied here, the rectangle is only read while it is rendered or recorded
+	rect->SetColor(currentColor);
 
 	return true;
 }
 
 bool Widgets::Button::Render(float dt)
 {	
-	rect->SetColor(currentColor); ///< rendering rectangle
-	rect->Render(dt);
+	rect->Render(dt); ///< rendering rectangle
 
 	title->Render(dt);	///< rendering title
 
 	return true;
 }
 
+bool Widgets::Button::Record(Graphic::CommandBuffer* commandBuffer, float dt) const
+{
+	rect->Record(commandBuffer);
+
+	// title falls back to the GL thread alone, the rectangle keeps its place in the buffer
+	if (!title->Record(commandBuffer, dt)) {
+		commandBuffer->CallTarget(title);
+	}
+
+	return true;
+}
+
+const char* Widgets::Button::GetName() const
+{
+	return "Button";
+}
+
 bool Widgets::Button::Confirm(const Event& evt)
 {
 	/**
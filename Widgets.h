@@ -13,11 +13,13 @@
 #include <ft2build.h>
 #include <freetype/ftglyph.h>
 #include FT_FREETYPE_H
+#ifdef _MSC_VER
 #ifdef _DEBUG
 #pragma comment(lib, "freetyped.lib")
 #else
 #pragma comment(lib, "freetype.lib")
 #endif // _DEBUG
+#endif // _MSC_VER
 
 #include "Renderer.h"
 #include "Utility.h"
@@ -67,6 +69,7 @@ public:
 	virtual bool Render(float dt) = 0;
 	virtual bool Update(float dt) = 0;
 	virtual bool Confirm(const Event& evt) = 0;
+	virtual void Submit(Graphic::RenderQueue* queue);
 	
 	void SetActionHandler(Event::EventAction action, Event::ActionHandler handler);
 
@@ -111,6 +114,7 @@ public:
 
 	bool Init();
 	bool Render(float dt);
+	void Record(Graphic::CommandBuffer* commandBuffer) const;
 
 	bool IsPointInside(float x, float y);
 	void SetColor(glm::vec4& color);
@@ -148,6 +152,7 @@ public:
 	void LoadFont(const wchar_t* fontPath);
 	void AddCharacter(const wchar_t c);
 	void Render2DText(glm::vec2& pos, glm::vec4& color, float scale, const std::wstring& text);
+	bool Record2DText(Graphic::CommandBuffer* commandBuffer, const glm::vec2& pos, const glm::vec4& color, float scale, const std::wstring& text);
 	void GetCharacterSize(const wchar_t ch, float scale, float & width, float & height, float & advance, float & bearingY);
 	GLuint GetCharacterTexture(const wchar_t ch);
 
@@ -177,6 +182,8 @@ private:
 
 	Graphic::Primitive* primitive;
 	FontTech* fontTech;
+
+	GLint WriteQuads(const glm::vec2& pos, float scale, const std::wstring& text);
 };
 
 /**
@@ -237,6 +244,8 @@ private:
 
 	bool Update(float dt);
 	bool Render(float dt);
+	bool Record(Graphic::CommandBuffer* commandBuffer, float dt) const;
+	const char* GetName() const;
 	bool Confirm(const Event& evt);
 
 	friend class ControlsManager;
@@ -279,6 +288,8 @@ protected:
 
 	bool Update(float dt);
 	bool Render(float dt);
+	bool Record(Graphic::CommandBuffer* commandBuffer, float dt) const;
+	const char* GetName() const;
 	bool Confirm(const Event& evt);
 
 	void CalculateTextPosition();
@@ -10,25 +10,36 @@ Window* g_pWindow = nullptr;
 //
 
 Window::Window()
-	:glfwWindow(nullptr), hInstance(nullptr), title(L"Window"), width(800.0), height(800.0), mouse(), clock(new Clock()),
-	renderer(nullptr), isInitailized(false), isFullScreened(false)
+	:glfwWindow(nullptr), title(L"Window"), width(800.0), height(800.0), mouse(), clock(new Clock()),
+	renderer(nullptr), framePacer(new Graphic::FramePacer()), isInitailized(false), isFullScreened(false), isHeadless(false), offscreenFramebuffer(0),
+	offscreenColor(0), offscreenDepth(0), frameLimit(0), frameIndex(0), capturePath()
 {
 	g_pWindow = this;
-	hInstance = GetModuleHandle(nullptr);
 }
 
-Window::Window(double width, double height, const wchar_t* title, bool fullscreen)
-	:glfwWindow(nullptr), hInstance(nullptr), title(title), width(width), height(height), mouse(), clock(new Clock()), 
-	renderer(nullptr), isInitailized(false), isFullScreened(fullscreen)
+Window::Window(double width, double height, const wchar_t* title, bool fullscreen, bool headless)
+	:glfwWindow(nullptr), title(title), width(width), height(height), mouse(), clock(new Clock()), 
+	renderer(nullptr), framePacer(new Graphic::FramePacer()), isInitailized(false), isFullScreened(fullscreen), isHeadless(headless), offscreenFramebuffer(0),
+	offscreenColor(0), offscreenDepth(0), frameLimit(0), frameIndex(0), capturePath()
 {
 	g_pWindow = this;
-	hInstance = GetModuleHandle(nullptr);
 }
 
 Window::~Window()
 {
+	// a capture still running ends with the last frame, releases are not traced
+	Graphic::GLTrace::End();
+
 	delete renderer;
 	delete clock;
+	// fences belong to the context, which is destroyed with the window
+	delete framePacer;
+
+	if (offscreenFramebuffer != 0) {
+		Graphic::GLDeleteFramebuffers(1, &offscreenFramebuffer);
+		Graphic::GLDeleteRenderbuffers(1, &offscreenColor);
+		Graphic::GLDeleteRenderbuffers(1, &offscreenDepth);
+	}
 
 	glfwDestroyWindow(glfwWindow);
 	glfwTerminate();
@@ -43,7 +54,7 @@ void Window::SetSize(int width, int height)
 void Window::SetViewPort(int x, int y, int width, int height)
 {
 	if (isInitailized) {
-		glViewport(x, y, width, height);
+		Graphic::GLViewport(x, y, width, height);
 	}
 }
 
@@ -82,6 +93,52 @@ void Window::SetMouseFunc(MouseFunc mouseFunc)
 	inputFuncs.mouseFunc = mouseFunc;
 }
 
+void Window::SetFrameLimit(unsigned int frames)
+{
+	frameLimit = frames;
+}
+
+void Window::SetCapturePath(const char* path)
+{
+	capturePath = path ? path : "";
+}
+
+bool Window::CaptureFrame(const char* path)
+{
+	/**
+	*	read back the backbuffer and write it as a binary PPM, rows are flipped to top-down order
+	*/
+	if (!isInitailized) {
+		return false;
+	}
+
+	int frameWidth = 0;
+	int frameHeight = 0;
+	GetFramebufferSize(frameWidth, frameHeight);
+	if (frameWidth <= 0 || frameHeight <= 0) {
+		return false;
+	}
+
+	std::vector<unsigned char> pixels(static_cast<size_t>(frameWidth) * frameHeight * 3);
+	Graphic::GLBindFramebuffer(GL_READ_FRAMEBUFFER, GetBackbuffer());
+	GLCall(glPixelStorei(GL_PACK_ALIGNMENT, 1));
+	GLCall(glReadPixels(0, 0, frameWidth, frameHeight, GL_RGB, GL_UNSIGNED_BYTE, pixels.data()));
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file.is_open()) {
+		std::string message = "Window::CaptureFrame(): open " + std::string(path) + " failed.";
+		Debug::ShowMessage(message.c_str());
+		return false;
+	}
+	file << "P6\n" << frameWidth << " " << frameHeight << "\n255\n";
+	const size_t rowSize = static_cast<size_t>(frameWidth) * 3;
+	for (int row = frameHeight - 1; row >= 0; --row) {
+		file.write(reinterpret_cast<const char*>(pixels.data() + row * rowSize), rowSize);
+	}
+
+	return file.good();
+}
+
 bool Window::Init()
 {
 	if (isInitailized) {
@@ -91,7 +148,24 @@ bool Window::Init()
 	// set error callback
 	glfwSetErrorCallback(ErrorCallBack);
 
-	glfwInit();
+	/**
+	*	headless mode uses the null platform of GLFW 3.4, the context comes from EGL (surfaceless on Mesa) or OSMesa,
+	*	so no display server is needed
+	*/
+	if (isHeadless) {
+#if defined(GLFW_PLATFORM_NULL)
+		if (!glfwPlatformSupported(GLFW_PLATFORM_NULL)) {
+			throw std::runtime_error("Exception: Window::Init(): the null platform of GLFW is required by headless mode!");
+		}
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#else
+		throw std::runtime_error("Exception: Window::Init(): headless mode requires GLFW 3.4 or later!");
+#endif
+	}
+
+	if (glfwInit() == GLFW_FALSE) {
+		throw std::runtime_error("Exception: Window::Init(): initialize GLFW failed!");
+	}
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, GLFW_VERSION_MAJOR);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, GLFW_VERSION_MINOR);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
@@ -107,28 +181,49 @@ bool Window::Init()
 	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
 #endif // _DEBUG
 
-	glfwWindow = glfwCreateWindow(width, height, Unicode::UnicodeToMultibytes(title.c_str()).c_str(), nullptr, nullptr);
-	// make current context
-	glfwMakeContextCurrent(glfwWindow);
+	if (isHeadless) {
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+	}
+
+	std::string windowTitle = Unicode::UnicodeToMultibytes(title.c_str());
+	glfwWindow = glfwCreateWindow(width, height, windowTitle.c_str(), nullptr, nullptr);
+	if (glfwWindow == nullptr && isHeadless) {
+		// no EGL, try the software OSMesa context
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+		glfwWindow = glfwCreateWindow(width, height, windowTitle.c_str(), nullptr, nullptr);
+	}
 	if (glfwWindow == nullptr) {
 		glfwTerminate();
 		ASSERT(false);
 	}
-	glfwSetCursorPos(glfwWindow, width / 2, height / 2);
+	// make current context
+	glfwMakeContextCurrent(glfwWindow);
 
-	glfwSetFramebufferSizeCallback(glfwWindow, FrameBufferSizeCallBack);
-	glfwSetWindowSizeCallback(glfwWindow, WidowSizeCallBack);
+	if (!isHeadless) {
+		glfwSetCursorPos(glfwWindow, width / 2, height / 2);
 
-	glfwSetKeyCallback(glfwWindow, KeyCallBack);
-	glfwSetCursorPosCallback(glfwWindow, CursorPosCallBack);
-	glfwSetMouseButtonCallback(glfwWindow, MouseButtonCallBack);
+		glfwSetFramebufferSizeCallback(glfwWindow, FrameBufferSizeCallBack);
+		glfwSetWindowSizeCallback(glfwWindow, WidowSizeCallBack);
+
+		glfwSetKeyCallback(glfwWindow, KeyCallBack);
+		glfwSetCursorPosCallback(glfwWindow, CursorPosCallBack);
+		glfwSetMouseButtonCallback(glfwWindow, MouseButtonCallBack);
+	}
 
 	/**
 	*	Initialize glew
 	*/
 
 	glewExperimental = true;
-	if (glewInit() != GLEW_OK) {
+	GLenum glewResult = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+	// a GLX build of GLEW reports no display on an EGL context, the entry points are loaded anyway
+	if (isHeadless && glewResult == GLEW_ERROR_NO_GLX_DISPLAY) {
+		glewResult = GLEW_OK;
+	}
+#endif
+	if (glewResult != GLEW_OK) {
 		glfwTerminate();
 		ASSERT(false);
 	}
@@ -149,12 +244,48 @@ bool Window::Init()
 #endif // _DEBUG
 	
 
+	if (isHeadless && !InitOffscreenTarget()) {
+		return false;
+	}
+
 	// application initialized
 	isInitailized = true;
 
 	return true;
 }
 
+bool Window::InitOffscreenTarget()
+{
+	/**
+	*	color and depth-stencil renderbuffers of window size, imported by the renderer as its backbuffer
+	*/
+	GLsizei targetWidth = static_cast<GLsizei>(width);
+	GLsizei targetHeight = static_cast<GLsizei>(height);
+
+	Graphic::GLGenRenderbuffers(1, &offscreenColor);
+	Graphic::GLBindRenderbuffer(GL_RENDERBUFFER, offscreenColor);
+	Graphic::GLRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, targetWidth, targetHeight);
+
+	Graphic::GLGenRenderbuffers(1, &offscreenDepth);
+	Graphic::GLBindRenderbuffer(GL_RENDERBUFFER, offscreenDepth);
+	Graphic::GLRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, targetWidth, targetHeight);
+	Graphic::GLBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	Graphic::GLGenFramebuffers(1, &offscreenFramebuffer);
+	Graphic::GLBindFramebuffer(GL_FRAMEBUFFER, offscreenFramebuffer);
+	Graphic::GLFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreenColor);
+	Graphic::GLFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, offscreenDepth);
+
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	Graphic::GLBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (!complete) {
+		throw std::runtime_error("Exception: Window::InitOffscreenTarget(): Offscreen framebuffer is incomplete!");
+	}
+	Graphic::GLViewport(0, 0, targetWidth, targetHeight);
+
+	return true;
+}
+
 double Window::GetWindowWidth()
 {
 	if (!g_pWindow)
@@ -171,6 +302,54 @@ double Window::GetWindowHeight()
 	return g_pWindow->height;
 }
 
+void Window::GetFramebufferSize(int& width, int& height)
+{
+	width = 0;
+	height = 0;
+	if (!g_pWindow || !g_pWindow->glfwWindow)
+		return;
+
+	if (g_pWindow->isHeadless) {
+		width = static_cast<int>(g_pWindow->width);
+		height = static_cast<int>(g_pWindow->height);
+		return;
+	}
+	glfwGetFramebufferSize(g_pWindow->glfwWindow, &width, &height);
+}
+
+void Window::GetContentScale(float& x, float& y)
+{
+	/**
+	*	cursor positions and the layout of widgets are in window units, the viewport is in framebuffer pixels
+	*/
+	x = 1.f;
+	y = 1.f;
+	int frameWidth = 0;
+	int frameHeight = 0;
+	GetFramebufferSize(frameWidth, frameHeight);
+	if (g_pWindow == nullptr || g_pWindow->width <= 0.0 || g_pWindow->height <= 0.0 || frameWidth <= 0 || frameHeight <= 0) {
+		return;
+	}
+	x = static_cast<float>(frameWidth / g_pWindow->width);
+	y = static_cast<float>(frameHeight / g_pWindow->height);
+}
+
+GLuint Window::GetBackbuffer()
+{
+	if (!g_pWindow)
+		return 0;
+
+	return g_pWindow->offscreenFramebuffer;
+}
+
+bool Window::IsHeadless()
+{
+	if (!g_pWindow)
+		return false;
+
+	return g_pWindow->isHeadless;
+}
+
 const wchar_t* Window::GetTitle()
 {
 	if (!g_pWindow)
@@ -187,6 +366,14 @@ float Window::GetFPS()
 	return g_pWindow->clock->GetFPS();
 }
 
+Graphic::FramePacer* Window::GetFramePacer()
+{
+	if (!g_pWindow)
+		return nullptr;
+
+	return g_pWindow->framePacer;
+}
+
 int Window::Running()
 {
 	if (!isInitailized) {
@@ -195,28 +382,41 @@ int Window::Running()
 
 	while (!glfwWindowShouldClose(glfwWindow))
 	{
+		if (frameLimit != 0 && frameIndex >= frameLimit) {
+			break;
+		}
+		// waits for the frame leaving the flight window and for the frame rate limit
+		framePacer->BeginFrame();
+		if (Graphic::GLTrace::IsCapturing()) {
+			int frameWidth = 0;
+			int frameHeight = 0;
+			GetFramebufferSize(frameWidth, frameHeight);
+			Graphic::GLTrace::BeginFrame(frameWidth, frameHeight);
+		}
 		clock->Update();
 		clock->AccumulateFrames();
 
-		glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glClearColor(1.f, 1.f, 1.f, 1.f);
-
-		glEnable(GL_DEPTH_TEST);
-
+		// clearing belongs to the scene pass of the renderer
 		if (renderer) {
 			renderer->Render(clock->GetFrameElapsedTime());
 		}
+		frameIndex++;
 
 		glfwPollEvents();
-		glfwSwapBuffers(glfwWindow);
+		framePacer->Present(isHeadless ? nullptr : glfwWindow);
+		Graphic::GLTrace::EndFrame();
 
 
 		///< input mouse events
-		if (inputFuncs.mouseFunc) {
+		if (!isHeadless && inputFuncs.mouseFunc) {
 			inputFuncs.mouseFunc(mouse.button, mouse.action, mouse.cursorXPos, mouse.cursorYPos, mouse.scollXOffset, mouse.scollYOffset);
 		}
 	}
 
+	if (!capturePath.empty() && !CaptureFrame(capturePath.c_str())) {
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -240,7 +440,7 @@ void Window::ErrorCallBack(int errorCode, const char* errorMessage)
 
 void Window::FrameBufferSizeCallBack(GLFWwindow* window, int width, int height)
 {
-	glViewport(0, 0, width, height);
+	Graphic::GLViewport(0, 0, width, height);
 }
 
 void Window::WidowSizeCallBack(GLFWwindow* window, int w, int h)
@@ -286,7 +486,7 @@ void Window::ScrollCallBack(GLFWwindow* window, double xoffset, double yoffset)
 //
 
 Clock::Clock()
-	:cpuNow(), cpuPre(), cpuFrequency(), frames(0), elapsedTime(0.f), frameElapesdTime(0.f), frameTimeAccumulation(0.f),
+	:cpuNow(0), cpuPre(0), cpuFrequency(1), frames(0), elapsedTime(0.f), frameElapesdTime(0.f), frameTimeAccumulation(0.f),
 	fps(0.f)
 {
 	Update();
@@ -303,7 +503,7 @@ float Clock::GetElapsedTimeInSecond()
 
 float Clock::GetCPUCurrentTime()
 {
-	return static_cast<float>(cpuNow.QuadPart);
+	return static_cast<float>(cpuNow);
 }
 
 float Clock::GetFrameElapsedTime()
@@ -328,10 +528,19 @@ float Clock::GetFPS()
 
 void Clock::Update()
 {
-	QueryPerformanceFrequency(&cpuFrequency);
-	QueryPerformanceCounter(&cpuNow);
-
-	frameElapesdTime = static_cast<float>(cpuNow.QuadPart - cpuPre.QuadPart) / static_cast<float>(cpuFrequency.QuadPart);
+#ifdef _WIN32
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	cpuNow = counter.QuadPart;
+	cpuFrequency = frequency.QuadPart;
+#else
+	typedef std::chrono::steady_clock::duration Ticks;
+	cpuNow = std::chrono::steady_clock::now().time_since_epoch().count();
+	cpuFrequency = Ticks::period::den / Ticks::period::num;
+#endif
+
+	frameElapesdTime = static_cast<float>(cpuNow - cpuPre) / static_cast<float>(cpuFrequency);
 	elapsedTime += frameElapesdTime;
 
 	frameTimeAccumulation += frameElapesdTime;
@@ -1,6 +1,7 @@
 #pragma once
 #include "Utility.h"
 #include "Renderer.h"
+#include "FramePacer.h"
 
 class Window;
 class Clock;
@@ -14,7 +15,7 @@ public:
 
 
 	Window();
-	Window(double width, double height, const wchar_t* title, bool fullscreen);
+	Window(double width, double height, const wchar_t* title, bool fullscreen, bool headless = false);
 	~Window();
 
 	// set window attributes
@@ -27,10 +28,20 @@ public:
 	void SetKeyBoradFunc(KeyBoardFunc keyBoardFunc);
 	void SetMouseFunc(MouseFunc mouseFunc);
 
+	// headless mode
+	void SetFrameLimit(unsigned int frames);
+	void SetCapturePath(const char* path);
+	bool CaptureFrame(const char* path);
+
 	static double GetWindowWidth();
 	static double GetWindowHeight();
+	static void GetFramebufferSize(int& width, int& height);
+	static void GetContentScale(float& x, float& y); ///< framebuffer pixels per window unit, above 1 on high DPI displays
+	static GLuint GetBackbuffer();
+	static bool IsHeadless();
 	static const wchar_t* GetTitle();
 	static float GetFPS();
+	static Graphic::FramePacer* GetFramePacer(); ///< frames in flight, frame rate limit and vsync of the loop
 
 	// Create renderer
 	Graphic::Renderer* GetRenderer();
@@ -38,7 +49,6 @@ public:
 private:
 
 	GLFWwindow* glfwWindow;
-	HINSTANCE hInstance;
 	std::wstring title;
 
 	double width;
@@ -48,10 +58,23 @@ private:
 	Clock* clock;
 	// renderer
 	Graphic::Renderer* renderer;
+	// frame pacing
+	Graphic::FramePacer* framePacer;
 
 	bool isInitailized;
 	bool isFullScreened;
 
+	/**
+	*	headless mode: no visible window, the frames are rendered into an offscreen framebuffer
+	*/
+	bool isHeadless;
+	GLuint offscreenFramebuffer;
+	GLuint offscreenColor;
+	GLuint offscreenDepth;
+	unsigned int frameLimit;	///< 0 means run until closed
+	unsigned int frameIndex;
+	std::string capturePath;	///< last frame is written here when not empty
+
 	// Mouse attributes
 	struct Mouse {
 		// cursor pos
@@ -75,6 +98,7 @@ private:
 	InputFuncs inputFuncs;
 
 	bool Init();
+	bool InitOffscreenTarget();
 	int Running();
 
 	static void ErrorCallBack(int errorCode, const char* errorMessage);
@@ -118,9 +142,9 @@ public:
 	void AccumulateFrames();
 
 private:
-	LARGE_INTEGER cpuNow;
-	LARGE_INTEGER cpuPre;
-	LARGE_INTEGER cpuFrequency;
+	int64_t cpuNow;			///< ticks of the performance counter, or of the steady clock off Windows
+	int64_t cpuPre;
+	int64_t cpuFrequency;	///< ticks per second
 
 	int frames;
 	float elapsedTime;
@@ -6,6 +6,8 @@
 #include "Model.h"
 
 #include "Pannel.hpp"
+#include <limits>
+#include <cmath>
 
 
 Engine engine;
@@ -15,6 +17,65 @@ Camera camera;
 Pannel* pannel;
 Model* model;
 
+void PrintUsage(const char* program)
+{
+	std::cerr << "usage: " << program << " [--headless] [--frames N] [--capture file.ppm]" << std::endl;
+	std::cerr << "\t[--vsync off|on|adaptive] [--frames-in-flight 1-3] [--fps-limit N]" << std::endl;
+	std::cerr << "\t[--trace file.gltrace [--trace-frames N]]" << std::endl;
+	std::cerr << "\t[--depth-prepass off|on] [--front-to-back off|on]" << std::endl;
+}
+
+/**
+*	false when the text is not a whole unsigned number, std::stoul() alone accepts "-1" and "12abc"
+*/
+bool ParseUnsigned(const char* text, unsigned int& value)
+{
+	try {
+		size_t length = 0;
+		const unsigned long number = std::stoul(text, &length);
+		if (text[0] == '-' || text[length] != '\0' || number > (std::numeric_limits<unsigned int>::max)()) {
+			return false;
+		}
+		value = static_cast<unsigned int>(number);
+		return true;
+	}
+	catch (const std::exception&) {
+		return false;
+	}
+}
+
+/**
+*	false when the text is neither "on" nor "off"
+*/
+bool ParseSwitch(const char* text, bool& value)
+{
+	const std::string mode(text);
+	if (mode != "on" && mode != "off") {
+		return false;
+	}
+	value = mode == "on";
+	return true;
+}
+
+/**
+*	false when the text is not a whole finite number of at least zero
+*/
+bool ParseNonNegative(const char* text, float& value)
+{
+	try {
+		size_t length = 0;
+		const float number = std::stof(text, &length);
+		if (text[length] != '\0' || !std::isfinite(number) || number < 0.f) {
+			return false;
+		}
+		value = number;
+		return true;
+	}
+	catch (const std::exception&) {
+		return false;
+	}
+}
+
 bool InitObject(Window& window)
 {
 	pannel = new Pannel(&window);
@@ -39,11 +100,15 @@ void Update(float dt)
 {
 	pannel->Update(dt);
 
-	static glm::mat4 perspective = glm::perspective(glm::radians(45.f), 1280.f / 720.f, 0.1f, 100.f);
-	glm::mat4 projectionView = perspective * camera.GetViewMatrix(dt);
+	// aspect follows the framebuffer, all shaders read the camera from the frame constants
+	int width = 0;
+	int height = 0;
+	Window::GetFramebufferSize(width, height);
+	float aspect = height > 0 ? static_cast<float>(width) / static_cast<float>(height) : 1.f;
+	glm::mat4 perspective = glm::perspective(glm::radians(45.f), aspect, 0.1f, 100.f);
+	renderer->SetCamera(camera.GetViewMatrix(dt), perspective);
 
 	glm::mat4 modelMat(1.f);
-	model->SetProjectionView(projectionView);
 	model->SetModel(modelMat);
 
 }
@@ -68,6 +133,24 @@ void KeyCallback(int key, int action)
 		camera.GoRight();
 		break;
 
+	case GLFW_KEY_F10:
+		if (action == GLFW_PRESS) {
+			renderer->SetDepthPrePass(!renderer->GetDepthPrePass());
+		}
+		break;
+
+	case GLFW_KEY_F11:
+		if (action == GLFW_PRESS) {
+			renderer->SetFrontToBack(!renderer->GetFrontToBack());
+		}
+		break;
+
+	case GLFW_KEY_F12:
+		if (action == GLFW_PRESS && renderer->GetGPUProfiler()) {
+			renderer->GetGPUProfiler()->Dump("gpu_profile.csv");
+		}
+		break;
+
 	default:
 		break;
 	}
@@ -90,9 +173,104 @@ void mouseCallBack(int button, int action, double xpos, double ypos, double scro
 		static_cast<long>(xOffset), static_cast<long>(yOffset));
 }
 
-int main() {
-	Window* window = engine.CreateWindowX(1280, 720);
+int main(int argc, char* argv[]) {
+	/**
+	*	--headless [--frames N] [--capture file.ppm]: render offscreen without a display, e.g. on CI nodes
+	*	--vsync off|on|adaptive, --frames-in-flight 1-3, --fps-limit N: frame pacing, see Graphic::FramePacer
+	*	--trace file.gltrace [--trace-frames N]: capture the GL calls up to the end of frame N, replay them with GLReplay
+	*	--depth-prepass off|on, --front-to-back off|on: order of the opaque pass, toggled by F10 and F11 while running
+	*/
+	bool headless = false;
+	unsigned int frames = 0;
+	const char* capturePath = nullptr;
+	Graphic::FramePacer::VSync vsync = Graphic::FramePacer::VSync::ON;
+	unsigned int framesInFlight = 2;
+	float frameRateLimit = 0.f;
+	const char* tracePath = nullptr;
+	unsigned int traceFrames = 1;
+	bool depthPrePass = false;
+	bool frontToBack = true;
+	for (int i = 1; i < argc; ++i) {
+		std::string argument(argv[i]);
+		if (argument == "--headless") {
+			headless = true;
+		}
+		else if (argument == "--frames" && i + 1 < argc) {
+			if (!ParseUnsigned(argv[++i], frames)) {
+				std::cerr << "invalid frame count: " << argv[i] << std::endl;
+				PrintUsage(argv[0]);
+				return 1;
+			}
+		}
+		else if (argument == "--capture" && i + 1 < argc) {
+			capturePath = argv[++i];
+		}
+		else if (argument == "--vsync" && i + 1 < argc) {
+			std::string mode(argv[++i]);
+			if (mode != "off" && mode != "on" && mode != "adaptive") {
+				std::cerr << "invalid vsync mode: " << mode << std::endl;
+				PrintUsage(argv[0]);
+				return 1;
+			}
+			vsync = mode == "off" ? Graphic::FramePacer::VSync::OFF :
+				(mode == "adaptive" ? Graphic::FramePacer::VSync::ADAPTIVE : Graphic::FramePacer::VSync::ON);
+		}
+		else if (argument == "--frames-in-flight" && i + 1 < argc) {
+			if (!ParseUnsigned(argv[++i], framesInFlight) || framesInFlight < Graphic::FramePacer::MIN_FRAMES_IN_FLIGHT ||
+				framesInFlight > Graphic::FramePacer::MAX_FRAMES_IN_FLIGHT) {
+				std::cerr << "invalid frames in flight: " << argv[i] << std::endl;
+				PrintUsage(argv[0]);
+				return 1;
+			}
+		}
+		else if (argument == "--fps-limit" && i + 1 < argc) {
+			if (!ParseNonNegative(argv[++i], frameRateLimit)) {
+				std::cerr << "invalid frame rate limit: " << argv[i] << std::endl;
+				PrintUsage(argv[0]);
+				return 1;
+			}
+		}
+		else if (argument == "--trace" && i + 1 < argc) {
+			tracePath = argv[++i];
+		}
+		else if (argument == "--trace-frames" && i + 1 < argc) {
+			if (!ParseUnsigned(argv[++i], traceFrames)) {
+				std::cerr << "invalid trace frame count: " << argv[i] << std::endl;
+				PrintUsage(argv[0]);
+				return 1;
+			}
+		}
+		else if (argument == "--depth-prepass" && i + 1 < argc) {
+			if (!ParseSwitch(argv[++i], depthPrePass)) {
+				std::cerr << "invalid depth pre-pass mode: " << argv[i] << std::endl;
+				PrintUsage(argv[0]);
+				return 1;
+			}
+		}
+		else if (argument == "--front-to-back" && i + 1 < argc) {
+			if (!ParseSwitch(argv[++i], frontToBack)) {
+				std::cerr << "invalid front to back mode: " << argv[i] << std::endl;
+				PrintUsage(argv[0]);
+				return 1;
+			}
+		}
+	}
+
+	// the trace starts before the context is created, so it holds every resource the frames use
+	if (tracePath && !Graphic::GLTrace::Begin(tracePath, traceFrames)) {
+		return -1;
+	}
+
+	Window* window = engine.CreateWindowX(1280, 720, L"Window", false, headless);
+	if (window == nullptr) {
+		return -1;
+	}
 	window->SetFullScreen(false);
+	window->SetFrameLimit(frames);
+	window->SetCapturePath(capturePath);
+	Window::GetFramePacer()->SetVSync(vsync);
+	Window::GetFramePacer()->SetFramesInFlight(framesInFlight);
+	Window::GetFramePacer()->SetFrameRateLimit(frameRateLimit);
 
 	window->SetKeyBoradFunc(KeyCallback);
 	window->SetMouseFunc(mouseCallBack);
@@ -100,6 +278,8 @@ int main() {
 	///< initialize renderer
 	renderer = window->GetRenderer();
 	renderer->SetUpdateCallBack(Update);
+	renderer->SetDepthPrePass(depthPrePass);
+	renderer->SetFrontToBack(frontToBack);
 
 
 	///< initialize render list
@@ -107,9 +287,9 @@ int main() {
 		return -1;
 	}
 
-	engine.Running();
+	int result = engine.Running();
 
 	ReleaseObject();
 
-	return 0;
+	return result;
 }
\ No newline at end of file